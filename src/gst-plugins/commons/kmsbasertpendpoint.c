@@ -20,6 +20,8 @@
 
 #include <uuid/uuid.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "kms-core-enumtypes.h"
 #include "kms-core-marshal.h"
@@ -513,15 +515,88 @@ end:
 /* Connection management end */
 
 /* Configure media SDP begin */
+typedef struct _KmsUuidGenerator
+{
+  GRand *rand;
+  pid_t pid;
+} KmsUuidGenerator;
+
+static void
+kms_uuid_generator_free (KmsUuidGenerator * gen)
+{
+  g_rand_free (gen->rand);
+  g_slice_free (KmsUuidGenerator, gen);
+}
+
+static GPrivate uuid_generator =
+G_PRIVATE_INIT ((GDestroyNotify) kms_uuid_generator_free);
+
+/* Per thread generator, seeded once from the system entropy source */
+static GRand *
+get_uuid_rand (void)
+{
+  KmsUuidGenerator *gen = g_private_get (&uuid_generator);
+  guint32 seed[sizeof (uuid_t) / sizeof (guint32)];
+  uuid_t entropy;
+
+  if (gen != NULL && gen->pid == getpid ()) {
+    return gen->rand;
+  }
+
+  uuid_generate_random (entropy);
+  memcpy (seed, entropy, sizeof (seed));
+
+  if (gen == NULL) {
+    gen = g_slice_new (KmsUuidGenerator);
+    gen->rand = g_rand_new_with_seed_array (seed, G_N_ELEMENTS (seed));
+    g_private_set (&uuid_generator, gen);
+  } else {
+    /* Forked child, do not repeat the identifiers of the parent */
+    g_rand_set_seed_array (gen->rand, seed, G_N_ELEMENTS (seed));
+  }
+
+  gen->pid = getpid ();
+
+  return gen->rand;
+}
+
+static void
+generate_uuid (gchar * uuid_str)
+{
+  static const gchar hex[] = "0123456789abcdef";
+  GRand *rand = get_uuid_rand ();
+  guint8 bytes[sizeof (uuid_t)];
+  guint i;
+
+  for (i = 0; i < sizeof (bytes); i += 4) {
+    guint32 value = g_rand_int (rand);
+
+    memcpy (&bytes[i], &value, sizeof (value));
+  }
+
+  /* Version 4 (random) and RFC 4122 variant */
+  bytes[6] = (bytes[6] & 0x0f) | 0x40;
+  bytes[8] = (bytes[8] & 0x3f) | 0x80;
+
+  for (i = 0; i < sizeof (bytes); i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      *uuid_str++ = '-';
+    }
+
+    *uuid_str++ = hex[bytes[i] >> 4];
+    *uuid_str++ = hex[bytes[i] & 0x0f];
+  }
+
+  *uuid_str = '\0';
+}
+
 static void
 assign_uuid (GObject * ssrc)
 {
   gchar *uuid_str;
-  uuid_t uuid;
 
-  uuid_str = (gchar *) g_malloc0 (UUID_STR_SIZE);
-  uuid_generate (uuid);
-  uuid_unparse (uuid, uuid_str);
+  uuid_str = (gchar *) g_malloc (UUID_STR_SIZE);
+  generate_uuid (uuid_str);
 
   /* Assign a unique ID to each SSRC which will */
   /* be provided in statistics */
@@ -1244,15 +1319,12 @@ gst_base_rtp_get_payloader_for_caps (GstCaps * caps)
 {
   GstElementFactory *factory;
   GstElement *payloader = NULL;
-  GList *payloader_list, *filtered_list;
+  GList *filtered_list;
   GParamSpec *pspec;
 
-  payloader_list =
-      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_PAYLOADER,
-      GST_RANK_NONE);
   filtered_list =
-      gst_element_factory_list_filter (payloader_list, caps, GST_PAD_SRC,
-      FALSE);
+      kms_utils_get_element_factories_for_caps
+      (GST_ELEMENT_FACTORY_TYPE_PAYLOADER, NULL, caps);
 
   if (filtered_list == NULL) {
     goto end;
@@ -1284,7 +1356,6 @@ gst_base_rtp_get_payloader_for_caps (GstCaps * caps)
 
 end:
   gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (payloader_list);
 
   return payloader;
 }
@@ -1294,14 +1365,11 @@ gst_base_rtp_get_depayloader_for_caps (GstCaps * caps)
 {
   GstElementFactory *factory;
   GstElement *depayloader = NULL;
-  GList *payloader_list, *filtered_list, *l;
+  GList *filtered_list, *l;
 
-  payloader_list =
-      gst_element_factory_list_get_elements
-      (GST_ELEMENT_FACTORY_TYPE_DEPAYLOADER, GST_RANK_NONE);
   filtered_list =
-      gst_element_factory_list_filter (payloader_list, caps, GST_PAD_SINK,
-      FALSE);
+      kms_utils_get_element_factories_for_caps
+      (GST_ELEMENT_FACTORY_TYPE_DEPAYLOADER, caps, NULL);
 
   if (filtered_list == NULL) {
     goto end;
@@ -1328,7 +1396,6 @@ gst_base_rtp_get_depayloader_for_caps (GstCaps * caps)
 
 end:
   gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (payloader_list);
 
   return depayloader;
 }
@@ -37,6 +37,22 @@ G_DEFINE_TYPE_WITH_CODE (KmsLoop, kms_loop,
   )                                 \
 )
 
+/*
+ * Thread of the pool shared by every pooled loop. Each pooled loop is bound to
+ * a single worker for its whole life, so its sources are always dispatched in
+ * order by the same thread, as they would be with a dedicated thread.
+ */
+typedef struct _KmsLoopWorker
+{
+  GThread *thread;
+  GMainLoop *loop;
+  GMainContext *context;
+  gint users;
+} KmsLoopWorker;
+
+static KmsLoopWorker *workers = NULL;
+static guint n_workers = 0;
+
 struct _KmsLoopPrivate
 {
   GThread *thread;
@@ -46,6 +62,10 @@ struct _KmsLoopPrivate
   GCond cond;
   GMutex mutex;
   gboolean initialized;
+
+  gboolean pooled;
+  KmsLoopWorker *worker;
+  GSList *sources;
 };
 
 #define KMS_LOOP_LOCK(elem) \
@@ -58,6 +78,7 @@ enum
 {
   PROP_0,
   PROP_CONTEXT,
+  PROP_POOLED,
   N_PROPERTIES
 };
 
@@ -110,6 +131,174 @@ end:
   return NULL;
 }
 
+static gpointer
+worker_thread_init (gpointer data)
+{
+  KmsLoopWorker *worker = data;
+
+  if (!g_main_context_acquire (worker->context)) {
+    GST_ERROR ("Can not acquire context");
+    return NULL;
+  }
+
+  GST_DEBUG ("Running pool main loop");
+  g_main_loop_run (worker->loop);
+  g_main_context_release (worker->context);
+
+  return NULL;
+}
+
+static void
+kms_loop_init_workers (void)
+{
+  static gsize init = 0;
+  guint i;
+
+  if (!g_once_init_enter (&init)) {
+    return;
+  }
+
+  n_workers = MAX (g_get_num_processors (), 1);
+  workers = g_new0 (KmsLoopWorker, n_workers);
+
+  GST_INFO ("Creating %u pool threads", n_workers);
+
+  for (i = 0; i < n_workers; i++) {
+    workers[i].context = g_main_context_new ();
+    workers[i].loop = g_main_loop_new (workers[i].context, FALSE);
+    workers[i].thread = g_thread_new ("KmsLoopPool", worker_thread_init,
+        &workers[i]);
+  }
+
+  g_once_init_leave (&init, 1);
+}
+
+static KmsLoopWorker *
+kms_loop_worker_acquire (void)
+{
+  KmsLoopWorker *worker;
+  guint i;
+
+  kms_loop_init_workers ();
+
+  /* Pick the least used thread, races here only unbalance the pool */
+  worker = &workers[0];
+  for (i = 1; i < n_workers; i++) {
+    if (g_atomic_int_get (&workers[i].users) <
+        g_atomic_int_get (&worker->users)) {
+      worker = &workers[i];
+    }
+  }
+
+  g_atomic_int_inc (&worker->users);
+
+  return worker;
+}
+
+typedef struct _KmsLoopBarrier
+{
+  GMutex mutex;
+  GCond cond;
+  gboolean done;
+} KmsLoopBarrier;
+
+static gboolean
+barrier_reached (KmsLoopBarrier * barrier)
+{
+  g_mutex_lock (&barrier->mutex);
+  barrier->done = TRUE;
+  g_cond_signal (&barrier->cond);
+  g_mutex_unlock (&barrier->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Waits until the worker runs out of ready sources with higher priority than
+ * G_PRIORITY_DEFAULT_IDLE, the same point at which a dedicated loop quits.
+ */
+static void
+kms_loop_worker_sync (KmsLoopWorker * worker)
+{
+  KmsLoopBarrier barrier;
+  GSource *source;
+
+  g_mutex_init (&barrier.mutex);
+  g_cond_init (&barrier.cond);
+  barrier.done = FALSE;
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_DEFAULT_IDLE);
+  g_source_set_callback (source, (GSourceFunc) barrier_reached, &barrier,
+      NULL);
+  g_source_attach (source, worker->context);
+  g_source_unref (source);
+
+  g_mutex_lock (&barrier.mutex);
+  while (!barrier.done) {
+    g_cond_wait (&barrier.cond, &barrier.mutex);
+  }
+  g_mutex_unlock (&barrier.mutex);
+
+  g_cond_clear (&barrier.cond);
+  g_mutex_clear (&barrier.mutex);
+}
+
+static void
+kms_loop_release_worker (KmsLoop * self)
+{
+  KmsLoopWorker *worker;
+  GSList *sources, *l;
+
+  KMS_LOOP_LOCK (self);
+
+  worker = self->priv->worker;
+  self->priv->worker = NULL;
+  KMS_LOOP_UNLOCK (self);
+
+  if (worker == NULL) {
+    return;
+  }
+
+  /* A pool thread does not need to wait for itself */
+  if (!g_main_context_is_owner (worker->context)) {
+    kms_loop_worker_sync (worker);
+  }
+
+  KMS_LOOP_LOCK (self);
+  sources = self->priv->sources;
+  self->priv->sources = NULL;
+  KMS_LOOP_UNLOCK (self);
+
+  /* Drop what a dedicated loop would have dropped along with its context */
+  for (l = sources; l != NULL; l = g_slist_next (l)) {
+    g_source_destroy (l->data);
+  }
+
+  g_slist_free_full (sources, (GDestroyNotify) g_source_unref);
+  g_atomic_int_add (&worker->users, -1);
+}
+
+static void
+kms_loop_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsLoop *self = KMS_LOOP (object);
+
+  KMS_LOOP_LOCK (self);
+
+  switch (property_id) {
+    case PROP_POOLED:
+      self->priv->pooled = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  KMS_LOOP_UNLOCK (self);
+}
+
 static void
 kms_loop_get_property (GObject * object, guint property_id, GValue * value,
     GParamSpec * pspec)
@@ -122,6 +311,9 @@ kms_loop_get_property (GObject * object, guint property_id, GValue * value,
     case PROP_CONTEXT:
       g_value_set_boxed (value, self->priv->context);
       break;
+    case PROP_POOLED:
+      g_value_set_boolean (value, self->priv->pooled);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -137,6 +329,8 @@ kms_loop_dispose (GObject * obj)
 
   GST_DEBUG_OBJECT (obj, "Dispose");
 
+  kms_loop_release_worker (self);
+
   KMS_LOOP_LOCK (self);
 
   if (self->priv->thread != NULL) {
@@ -183,6 +377,31 @@ kms_loop_finalize (GObject * obj)
   G_OBJECT_CLASS (kms_loop_parent_class)->finalize (obj);
 }
 
+static void
+kms_loop_constructed (GObject * obj)
+{
+  KmsLoop *self = KMS_LOOP (obj);
+
+  G_OBJECT_CLASS (kms_loop_parent_class)->constructed (obj);
+
+  if (self->priv->pooled) {
+    self->priv->worker = kms_loop_worker_acquire ();
+    self->priv->context = g_main_context_ref (self->priv->worker->context);
+    self->priv->loop = g_main_loop_ref (self->priv->worker->loop);
+    return;
+  }
+
+  self->priv->thread = g_thread_new ("KmsLoop", loop_thread_init, self);
+
+  g_mutex_lock (&self->priv->mutex);
+
+  while (!self->priv->initialized) {
+    g_cond_wait (&self->priv->cond, &self->priv->mutex);
+  }
+
+  g_mutex_unlock (&self->priv->mutex);
+}
+
 static void
 kms_loop_class_init (KmsLoopClass * klass)
 {
@@ -190,6 +409,8 @@ kms_loop_class_init (KmsLoopClass * klass)
 
   objclass->dispose = kms_loop_dispose;
   objclass->finalize = kms_loop_finalize;
+  objclass->constructed = kms_loop_constructed;
+  objclass->set_property = kms_loop_set_property;
   objclass->get_property = kms_loop_get_property;
 
   /* Install properties */
@@ -198,6 +419,11 @@ kms_loop_class_init (KmsLoopClass * klass)
       "Main loop context",
       G_TYPE_MAIN_CONTEXT, (GParamFlags) (G_PARAM_READABLE));
 
+  obj_properties[PROP_POOLED] = g_param_spec_boolean ("pooled",
+      "Pooled",
+      "Run on a thread shared with other loops instead of a dedicated one",
+      FALSE, (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
   g_object_class_install_properties (objclass, N_PROPERTIES, obj_properties);
 
   /* Registers a private structure for the instantiatable type */
@@ -213,28 +439,45 @@ kms_loop_init (KmsLoop * self)
   g_rec_mutex_init (&self->priv->rmutex);
   g_cond_init (&self->priv->cond);
   g_mutex_init (&self->priv->mutex);
+}
 
-  self->priv->thread = g_thread_new ("KmsLoop", loop_thread_init, self);
-
-  g_mutex_lock (&self->priv->mutex);
+KmsLoop *
+kms_loop_new (void)
+{
+  GObject *loop;
 
-  while (!self->priv->initialized) {
-    g_cond_wait (&self->priv->cond, &self->priv->mutex);
-  }
+  loop = g_object_new (KMS_TYPE_LOOP, NULL);
 
-  g_mutex_unlock (&self->priv->mutex);
+  return KMS_LOOP (loop);
 }
 
 KmsLoop *
-kms_loop_new (void)
+kms_loop_new_pooled (void)
 {
   GObject *loop;
 
-  loop = g_object_new (KMS_TYPE_LOOP, NULL);
+  loop = g_object_new (KMS_TYPE_LOOP, "pooled", TRUE, NULL);
 
   return KMS_LOOP (loop);
 }
 
+static void
+kms_loop_prune_sources (KmsLoop * self)
+{
+  GSList *l = self->priv->sources;
+
+  while (l != NULL) {
+    GSList *next = g_slist_next (l);
+
+    if (g_source_is_destroyed (l->data)) {
+      g_source_unref (l->data);
+      self->priv->sources = g_slist_delete_link (self->priv->sources, l);
+    }
+
+    l = next;
+  }
+}
+
 static guint
 kms_loop_attach (KmsLoop * self, GSource * source, gint priority,
     GSourceFunc function, gpointer data, GDestroyNotify notify)
@@ -243,7 +486,7 @@ kms_loop_attach (KmsLoop * self, GSource * source, gint priority,
 
   KMS_LOOP_LOCK (self);
 
-  if (self->priv->thread == NULL) {
+  if (self->priv->thread == NULL && self->priv->worker == NULL) {
     KMS_LOOP_UNLOCK (self);
     return 0;
   }
@@ -252,6 +495,14 @@ kms_loop_attach (KmsLoop * self, GSource * source, gint priority,
   g_source_set_callback (source, function, data, notify);
   id = g_source_attach (source, self->priv->context);
 
+  if (self->priv->worker != NULL) {
+    /* The context outlives this loop, so its sources are tracked to be
+     * destroyed on dispose */
+    kms_loop_prune_sources (self);
+    self->priv->sources = g_slist_prepend (self->priv->sources,
+        g_source_ref (source));
+  }
+
   KMS_LOOP_UNLOCK (self);
 
   return id;
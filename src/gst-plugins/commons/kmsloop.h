@@ -67,6 +67,14 @@ GType kms_loop_get_type (void);
 
 KmsLoop * kms_loop_new (void);
 
+/*
+ * Loop multiplexed with other pooled loops over a set of threads sized to the
+ * number of processors. Sources of one loop keep running in order on the same
+ * thread, but they must not block because they delay the other loops. Blocking
+ * work, such as state changes, has to be moved to a thread pool.
+ */
+KmsLoop * kms_loop_new_pooled (void);
+
 guint kms_loop_idle_add (KmsLoop *self, GSourceFunc function,
   gpointer data);
 
@@ -0,0 +1,723 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define KMS_SPEAKER_SELECTOR_NEON
+#endif
+
+#include "kmsspeakerselector.h"
+#include "kmsrefstruct.h"
+
+#define GST_DEFAULT_NAME "kmsspeakerselector"
+#define GST_CAT_DEFAULT kms_speaker_selector_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+/* Weight of the last buffer in the smoothed power of an input */
+#define POWER_SMOOTHING 0.3
+/* Level of silence */
+#define MIN_LEVEL -100.0
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define FORMAT_S16 "S16LE"
+#define FORMAT_F32 "F32LE"
+#else
+#define FORMAT_S16 "S16BE"
+#define FORMAT_F32 "F32BE"
+#endif
+
+typedef enum
+{
+  INPUT_FORMAT_UNKNOWN,
+  INPUT_FORMAT_S16,
+  INPUT_FORMAT_F32
+} InputFormat;
+
+typedef struct _KmsSpeakerInput
+{
+  guint id;
+  gboolean active;
+  gboolean measured;
+  InputFormat format;
+  gdouble power;
+  gdouble level;
+} KmsSpeakerInput;
+
+struct _KmsSpeakerSelector
+{
+  KmsRefStruct ref;
+
+  GMutex mutex;
+  GHashTable *inputs;
+  guint max_active;
+  guint n_active;
+  gdouble hysteresis;
+
+  KmsSpeakerSelectorNotify notify;
+  gpointer notify_data;
+  /* Notifications running out of the lock, set_notify waits for them */
+  guint notifying;
+  GCond notify_cond;
+};
+
+/* Selector being notified from the current thread, if any */
+static GPrivate current_notify = G_PRIVATE_INIT (NULL);
+
+typedef struct _ProbeData
+{
+  KmsSpeakerSelector *selector;
+  guint id;
+} ProbeData;
+
+gdouble
+kms_speaker_selector_get_power_s16 (const gint16 * samples, guint n)
+{
+  guint64 sum = 0;
+  guint i = 0;
+
+  if (n == 0) {
+    return 0.0;
+  }
+#if defined (__SSE2__)
+  {
+    __m128i acc = _mm_setzero_si128 ();
+    __m128i zero = _mm_setzero_si128 ();
+    guint64 lanes[2];
+
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (samples + i));
+      /* Sums of two squares fit in an unsigned 32 bits integer */
+      __m128i sq = _mm_madd_epi16 (v, v);
+
+      acc = _mm_add_epi64 (acc, _mm_unpacklo_epi32 (sq, zero));
+      acc = _mm_add_epi64 (acc, _mm_unpackhi_epi32 (sq, zero));
+    }
+
+    _mm_storeu_si128 ((__m128i *) lanes, acc);
+    sum = lanes[0] + lanes[1];
+  }
+#elif defined (KMS_SPEAKER_SELECTOR_NEON)
+  {
+    int64x2_t acc = vdupq_n_s64 (0);
+
+    for (; i + 8 <= n; i += 8) {
+      int16x8_t v = vld1q_s16 (samples + i);
+
+      acc = vpadalq_s32 (acc, vmull_s16 (vget_low_s16 (v), vget_low_s16 (v)));
+      acc = vpadalq_s32 (acc, vmull_s16 (vget_high_s16 (v),
+              vget_high_s16 (v)));
+    }
+
+    sum = vgetq_lane_s64 (acc, 0) + vgetq_lane_s64 (acc, 1);
+  }
+#endif
+
+  for (; i < n; i++) {
+    sum += (gint32) samples[i] * samples[i];
+  }
+
+  return (gdouble) sum / ((gdouble) n * 32768.0 * 32768.0);
+}
+
+gdouble
+kms_speaker_selector_get_power_f32 (const gfloat * samples, guint n)
+{
+  gdouble sum = 0.0;
+  guint i = 0;
+
+  if (n == 0) {
+    return 0.0;
+  }
+#if defined (__SSE2__)
+  {
+    __m128 acc = _mm_setzero_ps ();
+    gfloat lanes[4];
+
+    for (; i + 4 <= n; i += 4) {
+      __m128 v = _mm_loadu_ps (samples + i);
+
+      acc = _mm_add_ps (acc, _mm_mul_ps (v, v));
+    }
+
+    _mm_storeu_ps (lanes, acc);
+    sum = (gdouble) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+#elif defined (KMS_SPEAKER_SELECTOR_NEON)
+  {
+    float32x4_t acc = vdupq_n_f32 (0.0f);
+
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t v = vld1q_f32 (samples + i);
+
+      acc = vmlaq_f32 (acc, v, v);
+    }
+
+    sum = (gdouble) vgetq_lane_f32 (acc, 0) + vgetq_lane_f32 (acc, 1) +
+        vgetq_lane_f32 (acc, 2) + vgetq_lane_f32 (acc, 3);
+  }
+#endif
+
+  for (; i < n; i++) {
+    sum += samples[i] * samples[i];
+  }
+
+  return sum / n;
+}
+
+static gdouble
+get_buffer_power (GstBuffer * buffer, InputFormat format)
+{
+  gdouble power = 0.0;
+  GstMapInfo info;
+
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    return 0.0;
+  }
+
+  if (format == INPUT_FORMAT_S16) {
+    power = kms_speaker_selector_get_power_s16 ((const gint16 *) info.data,
+        info.size / sizeof (gint16));
+  } else if (format == INPUT_FORMAT_F32) {
+    power = kms_speaker_selector_get_power_f32 ((const gfloat *) info.data,
+        info.size / sizeof (gfloat));
+  }
+
+  gst_buffer_unmap (buffer, &info);
+
+  return power;
+}
+
+static KmsSpeakerInput *
+get_quietest_active (KmsSpeakerSelector * self)
+{
+  KmsSpeakerInput *quietest = NULL;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->inputs);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsSpeakerInput *input = value;
+
+    if (input->active && (quietest == NULL || input->level < quietest->level)) {
+      quietest = input;
+    }
+  }
+
+  return quietest;
+}
+
+static void
+set_active (KmsSpeakerSelector * self, KmsSpeakerInput * input,
+    gboolean active)
+{
+  if (input->active == active) {
+    return;
+  }
+
+  GST_DEBUG ("Input %u %s (%.1f dB)", input->id,
+      active ? "activated" : "deactivated", input->level);
+
+  input->active = active;
+
+  if (active) {
+    self->n_active++;
+  } else {
+    self->n_active--;
+  }
+}
+
+/* Deactivates the quietest inputs over the limit, returns TRUE if any */
+static gboolean
+enforce_max_active (KmsSpeakerSelector * self)
+{
+  gboolean changed = FALSE;
+
+  if (self->max_active == 0) {
+    return FALSE;
+  }
+
+  while (self->n_active > self->max_active) {
+    set_active (self, get_quietest_active (self), FALSE);
+    changed = TRUE;
+  }
+
+  return changed;
+}
+
+/* Returns TRUE if the set of active inputs changed */
+static gboolean
+update_selection (KmsSpeakerSelector * self, KmsSpeakerInput * input)
+{
+  KmsSpeakerInput *quietest;
+
+  if (self->max_active == 0 ||
+      g_hash_table_size (self->inputs) <= self->max_active) {
+    if (input->active) {
+      return FALSE;
+    }
+
+    set_active (self, input, TRUE);
+    return TRUE;
+  }
+
+  if (input->active) {
+    return enforce_max_active (self);
+  }
+
+  if (self->n_active < self->max_active) {
+    set_active (self, input, TRUE);
+    return TRUE;
+  }
+
+  quietest = get_quietest_active (self);
+
+  if (quietest == NULL || input->level <= quietest->level + self->hysteresis) {
+    return FALSE;
+  }
+
+  set_active (self, quietest, FALSE);
+  set_active (self, input, TRUE);
+
+  return TRUE;
+}
+
+static void
+kms_speaker_selector_notify (KmsSpeakerSelector * self)
+{
+  KmsSpeakerSelectorNotify notify;
+  gpointer data;
+
+  g_mutex_lock (&self->mutex);
+  notify = self->notify;
+  data = self->notify_data;
+
+  if (notify == NULL) {
+    g_mutex_unlock (&self->mutex);
+    return;
+  }
+
+  self->notifying++;
+  g_mutex_unlock (&self->mutex);
+
+  g_private_set (&current_notify, self);
+  notify (self, data);
+  g_private_set (&current_notify, NULL);
+
+  g_mutex_lock (&self->mutex);
+  if (--self->notifying == 0) {
+    g_cond_broadcast (&self->notify_cond);
+  }
+  g_mutex_unlock (&self->mutex);
+}
+
+static void
+kms_speaker_selector_set_format (KmsSpeakerSelector * self, guint id,
+    GstCaps * caps)
+{
+  InputFormat format = INPUT_FORMAT_UNKNOWN;
+  KmsSpeakerInput *input;
+  const gchar *str;
+
+  str = gst_structure_get_string (gst_caps_get_structure (caps, 0), "format");
+
+  if (g_strcmp0 (str, FORMAT_S16) == 0) {
+    format = INPUT_FORMAT_S16;
+  } else if (g_strcmp0 (str, FORMAT_F32) == 0) {
+    format = INPUT_FORMAT_F32;
+  } else {
+    GST_WARNING ("Level of input %u can not be measured (%" GST_PTR_FORMAT
+        ")", id, caps);
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  input = g_hash_table_lookup (self->inputs, GUINT_TO_POINTER (id));
+
+  if (input != NULL) {
+    input->format = format;
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/* Returns FALSE if the buffer is not going to be mixed */
+static gboolean
+kms_speaker_selector_process (KmsSpeakerSelector * self, guint id,
+    GstBuffer * buffer)
+{
+  KmsSpeakerInput *input;
+  gboolean active = TRUE, changed = FALSE;
+  InputFormat format;
+  gdouble power;
+
+  g_mutex_lock (&self->mutex);
+
+  input = g_hash_table_lookup (self->inputs, GUINT_TO_POINTER (id));
+
+  if (input == NULL || (self->max_active == 0 && input->active)) {
+    /* Nothing to select, measuring is not needed */
+    g_mutex_unlock (&self->mutex);
+    return TRUE;
+  }
+
+  format = input->format;
+  g_mutex_unlock (&self->mutex);
+
+  power = format == INPUT_FORMAT_UNKNOWN ? 1.0 :
+      get_buffer_power (buffer, format);
+
+  g_mutex_lock (&self->mutex);
+
+  /* Input could have been removed while measuring */
+  input = g_hash_table_lookup (self->inputs, GUINT_TO_POINTER (id));
+
+  if (input != NULL) {
+    if (input->measured) {
+      input->power += POWER_SMOOTHING * (power - input->power);
+    } else {
+      input->power = power;
+      input->measured = TRUE;
+    }
+
+    input->level = input->power > 0.0 ?
+        MAX (10.0 * log10 (input->power), MIN_LEVEL) : MIN_LEVEL;
+
+    changed = update_selection (self, input);
+    active = input->active;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (changed) {
+    kms_speaker_selector_notify (self);
+  }
+
+  return active;
+}
+
+static GstPadProbeReturn
+input_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  ProbeData *data = user_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+    if (!kms_speaker_selector_process (data->selector, data->id, buffer)) {
+      /* Only metadata is written, memory is not copied */
+      buffer = gst_buffer_make_writable (buffer);
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_GAP);
+      GST_PAD_PROBE_INFO_DATA (info) = buffer;
+    }
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      kms_speaker_selector_set_format (data->selector, data->id, caps);
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+probe_data_destroy (ProbeData * data)
+{
+  kms_speaker_selector_unref (data->selector);
+  g_slice_free (ProbeData, data);
+}
+
+void
+kms_speaker_selector_add_input (KmsSpeakerSelector * self, guint id,
+    GstPad * pad)
+{
+  KmsSpeakerInput *input;
+  ProbeData *data;
+
+  g_return_if_fail (self != NULL);
+
+  input = g_slice_new0 (KmsSpeakerInput);
+  input->id = id;
+  input->level = MIN_LEVEL;
+
+  g_mutex_lock (&self->mutex);
+  g_hash_table_insert (self->inputs, GUINT_TO_POINTER (id), input);
+  g_mutex_unlock (&self->mutex);
+
+  data = g_slice_new0 (ProbeData);
+  data->selector = kms_speaker_selector_ref (self);
+  data->id = id;
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, input_probe, data,
+      (GDestroyNotify) probe_data_destroy);
+}
+
+void
+kms_speaker_selector_remove_input (KmsSpeakerSelector * self, guint id)
+{
+  KmsSpeakerInput *input;
+  gboolean changed = FALSE;
+
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  input = g_hash_table_lookup (self->inputs, GUINT_TO_POINTER (id));
+
+  if (input != NULL) {
+    changed = input->active;
+    set_active (self, input, FALSE);
+    g_hash_table_remove (self->inputs, GUINT_TO_POINTER (id));
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (changed) {
+    kms_speaker_selector_notify (self);
+  }
+}
+
+static gint
+compare_ids (gconstpointer a, gconstpointer b)
+{
+  guint id_a = *(const guint *) a, id_b = *(const guint *) b;
+
+  return id_a < id_b ? -1 : (id_a > id_b ? 1 : 0);
+}
+
+GArray *
+kms_speaker_selector_get_active (KmsSpeakerSelector * self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  GArray *active;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  active = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  g_mutex_lock (&self->mutex);
+  g_hash_table_iter_init (&iter, self->inputs);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsSpeakerInput *input = value;
+
+    if (input->active) {
+      g_array_append_val (active, input->id);
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  g_array_sort (active, compare_ids);
+
+  return active;
+}
+
+GstMessage *
+kms_speaker_selector_new_message (KmsSpeakerSelector * self, GstObject * src,
+    const gchar * pad_template)
+{
+  GValue inputs = G_VALUE_INIT;
+  GstStructure *st;
+  GArray *active;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  active = kms_speaker_selector_get_active (self);
+  g_value_init (&inputs, GST_TYPE_ARRAY);
+
+  for (i = 0; i < active->len; i++) {
+    GValue name = G_VALUE_INIT;
+
+    g_value_init (&name, G_TYPE_STRING);
+    g_value_take_string (&name, g_strdup_printf (pad_template,
+            g_array_index (active, guint, i)));
+    gst_value_array_append_and_take_value (&inputs, &name);
+  }
+
+  g_array_free (active, TRUE);
+
+  st = gst_structure_new_empty ("active-inputs");
+  gst_structure_take_value (st, "inputs", &inputs);
+
+  return gst_message_new_element (src, st);
+}
+
+void
+kms_speaker_selector_set_notify (KmsSpeakerSelector * self,
+    KmsSpeakerSelectorNotify func, gpointer user_data)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->notify = func;
+  self->notify_data = user_data;
+
+  /*
+   * The previous function is not running anymore when this returns, unless
+   * it is the one changing it
+   */
+  while (self->notifying >
+      (g_private_get (&current_notify) == self ? 1 : 0)) {
+    g_cond_wait (&self->notify_cond, &self->mutex);
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_speaker_selector_set_max_active (KmsSpeakerSelector * self,
+    guint max_active)
+{
+  GHashTableIter iter;
+  gboolean changed;
+  gpointer value;
+
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  self->max_active = max_active;
+
+  if (max_active == 0) {
+    /* Every input is activated again on its next buffer */
+    changed = FALSE;
+    g_hash_table_iter_init (&iter, self->inputs);
+
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+      KmsSpeakerInput *input = value;
+
+      changed |= !input->active;
+      set_active (self, input, TRUE);
+    }
+  } else {
+    changed = enforce_max_active (self);
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (changed) {
+    kms_speaker_selector_notify (self);
+  }
+}
+
+guint
+kms_speaker_selector_get_max_active (KmsSpeakerSelector * self)
+{
+  guint max_active;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  g_mutex_lock (&self->mutex);
+  max_active = self->max_active;
+  g_mutex_unlock (&self->mutex);
+
+  return max_active;
+}
+
+void
+kms_speaker_selector_set_hysteresis (KmsSpeakerSelector * self,
+    gdouble hysteresis)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->hysteresis = hysteresis;
+  g_mutex_unlock (&self->mutex);
+}
+
+gdouble
+kms_speaker_selector_get_hysteresis (KmsSpeakerSelector * self)
+{
+  gdouble hysteresis;
+
+  g_return_val_if_fail (self != NULL, 0.0);
+
+  g_mutex_lock (&self->mutex);
+  hysteresis = self->hysteresis;
+  g_mutex_unlock (&self->mutex);
+
+  return hysteresis;
+}
+
+static void
+kms_speaker_input_free (KmsSpeakerInput * input)
+{
+  g_slice_free (KmsSpeakerInput, input);
+}
+
+static void
+kms_speaker_selector_destroy (KmsSpeakerSelector * self)
+{
+  g_hash_table_unref (self->inputs);
+  g_mutex_clear (&self->mutex);
+  g_cond_clear (&self->notify_cond);
+
+  g_slice_free (KmsSpeakerSelector, self);
+}
+
+KmsSpeakerSelector *
+kms_speaker_selector_new (void)
+{
+  KmsSpeakerSelector *self;
+
+  self = g_slice_new0 (KmsSpeakerSelector);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (self),
+      (GDestroyNotify) kms_speaker_selector_destroy);
+
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->notify_cond);
+  self->inputs = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) kms_speaker_input_free);
+  self->hysteresis = KMS_SPEAKER_SELECTOR_DEFAULT_HYSTERESIS;
+
+  return self;
+}
+
+KmsSpeakerSelector *
+kms_speaker_selector_ref (KmsSpeakerSelector * self)
+{
+  return (KmsSpeakerSelector *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (self));
+}
+
+void
+kms_speaker_selector_unref (KmsSpeakerSelector * self)
+{
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (self));
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
@@ -0,0 +1,78 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef __KMS_SPEAKER_SELECTOR_H__
+#define __KMS_SPEAKER_SELECTOR_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Selects the loudest audio inputs of a mixer. The level of each input is
+ * measured on every raw S16 or F32 buffer. Buffers of inputs out of the
+ * selection are flagged as GST_BUFFER_FLAG_GAP so that converters and mixers
+ * skip them.
+ */
+typedef struct _KmsSpeakerSelector KmsSpeakerSelector;
+
+/* Called from a streaming thread each time the set of active inputs changes */
+typedef void (*KmsSpeakerSelectorNotify) (KmsSpeakerSelector * selector,
+    gpointer user_data);
+
+#define KMS_SPEAKER_SELECTOR_DEFAULT_HYSTERESIS 6.0
+
+KmsSpeakerSelector * kms_speaker_selector_new (void);
+KmsSpeakerSelector * kms_speaker_selector_ref (KmsSpeakerSelector * self);
+void kms_speaker_selector_unref (KmsSpeakerSelector * self);
+
+/*
+ * Called out of the selector lock when the active inputs change. Once this
+ * returns the previous function is not running and will not be called again.
+ */
+void kms_speaker_selector_set_notify (KmsSpeakerSelector * self,
+    KmsSpeakerSelectorNotify func, gpointer user_data);
+
+/* 0 means that every input is active */
+void kms_speaker_selector_set_max_active (KmsSpeakerSelector * self,
+    guint max_active);
+guint kms_speaker_selector_get_max_active (KmsSpeakerSelector * self);
+
+/* dB an inactive input has to be over the quietest active one to replace it */
+void kms_speaker_selector_set_hysteresis (KmsSpeakerSelector * self,
+    gdouble hysteresis);
+gdouble kms_speaker_selector_get_hysteresis (KmsSpeakerSelector * self);
+
+/* Measures the buffers going through @pad as input @id */
+void kms_speaker_selector_add_input (KmsSpeakerSelector * self, guint id,
+    GstPad * pad);
+void kms_speaker_selector_remove_input (KmsSpeakerSelector * self, guint id);
+
+/* Returns a sorted array of guint with the ids of the active inputs */
+GArray * kms_speaker_selector_get_active (KmsSpeakerSelector * self);
+
+/*
+ * Element message named "active-inputs" with an "inputs" array holding the
+ * names of the active pads, built from @pad_template ("sink_%u")
+ */
+GstMessage * kms_speaker_selector_new_message (KmsSpeakerSelector * self,
+    GstObject * src, const gchar * pad_template);
+
+/* Mean square of the samples, normalized to [0, 1] */
+gdouble kms_speaker_selector_get_power_s16 (const gint16 * samples, guint n);
+gdouble kms_speaker_selector_get_power_f32 (const gfloat * samples, guint n);
+
+G_END_DECLS
+
+#endif /* __KMS_SPEAKER_SELECTOR_H__ */
@@ -765,6 +765,201 @@ kms_utils_remb_event_manager_get_min (RembEventManager * manager)
 
 /* REMB event end */
 
+/* element factories begin */
+
+#define FACTORIES_CACHE_MAX_SIZE 256
+
+typedef struct _FactoriesCacheEntry
+{
+  GList *factories;
+  /* Node in factories_lru, its data is the key of the entry */
+  GList link;
+} FactoriesCacheEntry;
+
+G_LOCK_DEFINE_STATIC (factories_cache);
+static GHashTable *factories_cache = NULL;
+/* Entries from the most to the least recently used */
+static GQueue factories_lru = G_QUEUE_INIT;
+static guint32 factories_cache_cookie;
+
+/* Fields that differ between sessions but never between factories */
+static const gchar *session_fields[] = {
+  "ssrc", "clock-base", "seqnum-base", "timestamp-offset", "seqnum-offset",
+  "payload", NULL
+};
+
+static void
+factories_cache_entry_free (gpointer data)
+{
+  FactoriesCacheEntry *entry = data;
+
+  gst_plugin_feature_list_free (entry->factories);
+  g_slice_free (FactoriesCacheEntry, entry);
+}
+
+/* Called with the factories_cache lock held */
+static void
+factories_cache_clear (void)
+{
+  g_hash_table_remove_all (factories_cache);
+  g_queue_init (&factories_lru);
+}
+
+static GstCaps *
+strip_session_fields (const GstCaps * caps)
+{
+  GstCaps *stripped;
+  guint i;
+
+  if (caps == NULL) {
+    return NULL;
+  }
+
+  stripped = gst_caps_copy (caps);
+
+  for (i = 0; i < gst_caps_get_size (stripped); i++) {
+    GstStructure *st = gst_caps_get_structure (stripped, i);
+    const gchar **field;
+
+    for (field = session_fields; *field != NULL; field++) {
+      gst_structure_remove_field (st, *field);
+    }
+  }
+
+  return stripped;
+}
+
+static gchar *
+factories_cache_key (GstElementFactoryListType type,
+    const GstCaps * sink_caps, const GstCaps * src_caps)
+{
+  gchar *sink, *src, *key;
+
+  sink = sink_caps != NULL ? gst_caps_to_string (sink_caps) : NULL;
+  src = src_caps != NULL ? gst_caps_to_string (src_caps) : NULL;
+
+  key = g_strdup_printf ("%" G_GUINT64_FORMAT "|%s|%s", type,
+      sink != NULL ? sink : "", src != NULL ? src : "");
+
+  g_free (sink);
+  g_free (src);
+
+  return key;
+}
+
+static GList *
+filter_element_factories (GstElementFactoryListType type,
+    const GstCaps * sink_caps, const GstCaps * src_caps)
+{
+  GList *list, *filtered;
+
+  list = gst_element_factory_list_get_elements (type, GST_RANK_NONE);
+
+  if (sink_caps != NULL) {
+    filtered =
+        gst_element_factory_list_filter (list, sink_caps, GST_PAD_SINK, FALSE);
+    gst_plugin_feature_list_free (list);
+    list = filtered;
+  }
+
+  if (src_caps != NULL) {
+    filtered =
+        gst_element_factory_list_filter (list, src_caps, GST_PAD_SRC, FALSE);
+    gst_plugin_feature_list_free (list);
+    list = filtered;
+  }
+
+  return list;
+}
+
+/*
+ * Returns the factories of @type able to handle @sink_caps on their sink pads
+ * and @src_caps on their source pads, in the same order as
+ * gst_element_factory_list_filter. Per session RTP fields (ssrc, payload,
+ * clock-base...) are ignored, so every session with the same media shares a
+ * result. Up to FACTORIES_CACHE_MAX_SIZE results are cached until the
+ * registry changes, the least recently used is evicted first. Free the list
+ * with gst_plugin_feature_list_free.
+ */
+GList *
+kms_utils_get_element_factories_for_caps (GstElementFactoryListType type,
+    const GstCaps * sink_caps, const GstCaps * src_caps)
+{
+  FactoriesCacheEntry *entry;
+  GstCaps *sink, *src;
+  guint32 cookie;
+  GList *list;
+  gchar *key;
+
+  cookie = gst_registry_get_feature_list_cookie (gst_registry_get ());
+  sink = strip_session_fields (sink_caps);
+  src = strip_session_fields (src_caps);
+  key = factories_cache_key (type, sink, src);
+
+  G_LOCK (factories_cache);
+
+  if (factories_cache == NULL) {
+    factories_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        factories_cache_entry_free);
+    factories_cache_cookie = cookie;
+  } else if (factories_cache_cookie != cookie) {
+    GST_DEBUG ("Registry changed, clearing element factories cache");
+    factories_cache_clear ();
+    factories_cache_cookie = cookie;
+  }
+
+  entry = g_hash_table_lookup (factories_cache, key);
+
+  if (entry != NULL) {
+    g_queue_unlink (&factories_lru, &entry->link);
+    g_queue_push_head_link (&factories_lru, &entry->link);
+    list = gst_plugin_feature_list_copy (entry->factories);
+    G_UNLOCK (factories_cache);
+    g_free (key);
+    goto end;
+  }
+
+  G_UNLOCK (factories_cache);
+
+  list = filter_element_factories (type, sink, src);
+
+  G_LOCK (factories_cache);
+
+  if (factories_cache_cookie == cookie
+      && !g_hash_table_contains (factories_cache, key)) {
+    if (g_hash_table_size (factories_cache) >= FACTORIES_CACHE_MAX_SIZE) {
+      GList *lru = g_queue_pop_tail_link (&factories_lru);
+
+      g_hash_table_remove (factories_cache, lru->data);
+    }
+
+    entry = g_slice_new0 (FactoriesCacheEntry);
+    entry->factories = gst_plugin_feature_list_copy (list);
+    entry->link.data = key;
+    g_queue_push_head_link (&factories_lru, &entry->link);
+
+    /* Takes the key */
+    g_hash_table_insert (factories_cache, key, entry);
+    key = NULL;
+  }
+
+  G_UNLOCK (factories_cache);
+  g_free (key);
+
+end:
+  if (sink != NULL) {
+    gst_caps_unref (sink);
+  }
+
+  if (src != NULL) {
+    gst_caps_unref (src);
+  }
+
+  return list;
+}
+
+/* element factories end */
+
 /* time begin */
 
 GstClockTime
@@ -56,6 +56,9 @@ void kms_utils_remb_event_manager_destroy (RembEventManager * manager);
 void kms_utils_remb_event_manager_pointer_destroy (gpointer manager);
 guint kms_utils_remb_event_manager_get_min (RembEventManager * manager);
 
+/* Element factories */
+GList * kms_utils_get_element_factories_for_caps (GstElementFactoryListType type, const GstCaps * sink_caps, const GstCaps * src_caps);
+
 /* time */
 GstClockTime kms_utils_get_time_nsecs ();
 
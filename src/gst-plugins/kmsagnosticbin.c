@@ -23,11 +23,14 @@
 #include "kmsparsetreebin.h"
 #include "kmsdectreebin.h"
 #include "kmsenctreebin.h"
+#include "kmstranscoderregistry.h"
 
 #define PLUGIN_NAME "agnosticbin"
 
 #define LINKING_DATA "linking-data"
 #define UNLINKING_DATA "unlinking-data"
+#define SHARED_LINK_DATA "shared-link-data"
+#define SHARED_GHOST_DATA "shared-ghost-data"
 
 static GstStaticCaps static_raw_audio_caps =
 GST_STATIC_CAPS (KMS_AGNOSTIC_RAW_AUDIO_CAPS);
@@ -61,6 +64,9 @@ G_DEFINE_TYPE (KmsAgnosticBin2, kms_agnostic_bin2, GST_TYPE_BIN);
 
 #define TARGET_BITRATE_DEFAULT 300000
 
+/* Maximum number of pads walked looking for the tee feeding an agnosticbin */
+#define MAX_UPSTREAM_HOPS 16
+
 struct _KmsAgnosticBin2Private
 {
   GHashTable *bins;
@@ -77,10 +83,42 @@ struct _KmsAgnosticBin2Private
   gboolean started;
 
   GThreadPool *remove_pool;
+  /* Relinks pads fed by branches of other agnosticbins when they disappear,
+   * protected by the object lock */
+  GThreadPool *relink_pool;
 
   gint default_bitrate;
+
+  /* Set once a branch is published, so it can be withdrawn when removed */
+  KmsTranscoderRegistry *registry;
 };
 
+typedef struct _SharedRelink
+{
+  KmsAgnosticBin2 *agnosticbin;
+  GstPad *pad;
+} SharedRelink;
+
+/*
+ * Set on the tee pad feeding another agnosticbin and on the first element of
+ * the consumer. Either side can remove the link, even if the pads were
+ * already unlinked by their bins.
+ */
+typedef struct _SharedLink
+{
+  /* Outermost ghost pads of the owner and the consumer */
+  GstPad *exposed;
+  GstPad *end;
+  /* Pad of the consumer fed from the link */
+  GstPad *pad;
+} SharedLink;
+
+/* Serializes creation and removal of the ghost pads of shared links */
+G_LOCK_DEFINE_STATIC (shared_links);
+
+static gboolean kms_agnostic_bin2_process_pad (KmsAgnosticBin2 * self,
+    GstPad * pad);
+
 enum
 {
   PROP_0,
@@ -332,12 +370,12 @@ no_fail_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
   return GST_FLOW_OK;
 }
 
-static void
-link_element_to_tee (GstElement * tee, GstElement * element)
+/* Requests a pad of @tee to feed @element, removed when they are unlinked */
+static GstPad *
+prepare_tee_link (GstElement * tee, GstElement * element)
 {
   GstPad *tee_src = gst_element_get_request_pad (tee, "src_%u");
   GstPad *element_sink = gst_element_get_static_pad (element, "sink");
-  GstPadLinkReturn ret;
   GstPadChainFunction old_func;
 
   /*
@@ -361,6 +399,18 @@ link_element_to_tee (GstElement * tee, GstElement * element)
   gst_pad_add_probe (tee_src, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, tee_src_probe,
       NULL, NULL);
 
+  g_object_unref (element_sink);
+
+  return tee_src;
+}
+
+static void
+link_element_to_tee (GstElement * tee, GstElement * element)
+{
+  GstPad *tee_src = prepare_tee_link (tee, element);
+  GstPad *element_sink = gst_element_get_static_pad (element, "sink");
+  GstPadLinkReturn ret;
+
   ret = gst_pad_link_full (tee_src, element_sink, GST_PAD_LINK_CHECK_NOTHING);
 
   if (G_UNLIKELY (GST_PAD_LINK_FAILED (ret))) {
@@ -400,15 +450,17 @@ remove_target_pad (GstPad * pad)
   g_object_unref (target);
 }
 
-static void
-kms_agnostic_bin2_link_to_tee (KmsAgnosticBin2 * self, GstPad * pad,
-    GstElement * tee, GstCaps * caps)
+/* Creates the elements feeding @pad, returns the first one */
+static GstElement *
+kms_agnostic_bin2_create_output (KmsAgnosticBin2 * self, GstPad * pad,
+    GstCaps * caps)
 {
-  GstElement *queue = gst_element_factory_make ("queue", NULL);
+  /* No queue needed, the fan-out already pushes from its own threads */
+  GstElement *identity = gst_element_factory_make ("identity", NULL);
   GstPad *target;
 
-  gst_bin_add (GST_BIN (self), queue);
-  gst_element_sync_state_with_parent (queue);
+  gst_bin_add (GST_BIN (self), identity);
+  gst_element_sync_state_with_parent (identity);
 
   if (!gst_caps_is_any (caps) && is_raw_caps (caps)) {
     GstElement *convert = kms_utils_create_convert_for_caps (caps);
@@ -425,15 +477,525 @@ kms_agnostic_bin2_link_to_tee (KmsAgnosticBin2 * self, GstPad * pad,
     gst_element_sync_state_with_parent (convert);
     gst_element_sync_state_with_parent (rate);
 
-    gst_element_link_many (queue, rate, convert, mediator, NULL);
+    gst_element_link_many (identity, rate, convert, mediator, NULL);
     target = gst_element_get_static_pad (mediator, "src");
   } else {
-    target = gst_element_get_static_pad (queue, "src");
+    target = gst_element_get_static_pad (identity, "src");
   }
 
   gst_ghost_pad_set_target (GST_GHOST_PAD (pad), target);
   g_object_unref (target);
-  link_element_to_tee (tee, queue);
+
+  return identity;
+}
+
+static void
+kms_agnostic_bin2_link_to_tee (KmsAgnosticBin2 * self, GstPad * pad,
+    GstElement * tee, GstCaps * caps)
+{
+  GstElement *element = kms_agnostic_bin2_create_output (self, pad, caps);
+
+  link_element_to_tee (tee, element);
+}
+
+/*
+ * Returns the tee or fan-out feeding this agnosticbin, if it is only separated
+ * from it by ghost pads, queues and identities, so the stream received is
+ * exactly the one leaving the tee.
+ */
+static GstElement *
+kms_agnostic_bin2_get_upstream_tee (KmsAgnosticBin2 * self)
+{
+  GstPad *pad = gst_pad_get_peer (self->priv->sink);
+  GstElement *tee = NULL;
+  guint hops;
+
+  for (hops = 0; pad != NULL && hops < MAX_UPSTREAM_HOPS; hops++) {
+    GstPad *next = NULL;
+
+    if (GST_IS_GHOST_PAD (pad)) {
+      next = gst_ghost_pad_get_target (GST_GHOST_PAD (pad));
+    } else if (GST_IS_PROXY_PAD (pad)) {
+      /* Internal pad of a sink ghost pad */
+      GstProxyPad *ghost = gst_proxy_pad_get_internal (GST_PROXY_PAD (pad));
+
+      if (ghost != NULL) {
+        next = gst_pad_get_peer (GST_PAD (ghost));
+        g_object_unref (ghost);
+      }
+    } else {
+      GstElement *element = gst_pad_get_parent_element (pad);
+      const gchar *factory = NULL;
+
+      if (element != NULL && gst_element_get_factory (element) != NULL) {
+        factory = GST_OBJECT_NAME (gst_element_get_factory (element));
+      }
+
+      if (g_strcmp0 (factory, "tee") == 0
+          || g_strcmp0 (factory, "kmsfanout") == 0) {
+        tee = element;
+        element = NULL;
+      } else if (g_strcmp0 (factory, "queue") == 0
+          || g_strcmp0 (factory, "identity") == 0) {
+        GstPad *element_sink = gst_element_get_static_pad (element, "sink");
+
+        next = gst_pad_get_peer (element_sink);
+        g_object_unref (element_sink);
+      }
+
+      if (element != NULL) {
+        g_object_unref (element);
+      }
+    }
+
+    g_object_unref (pad);
+    pad = tee != NULL ? NULL : next;
+
+    if (tee != NULL && next != NULL) {
+      g_object_unref (next);
+    }
+  }
+
+  if (pad != NULL) {
+    g_object_unref (pad);
+  }
+
+  return tee;
+}
+
+static gboolean
+kms_agnostic_bin2_get_stream_id (KmsAgnosticBin2 * self, guint * stream_id)
+{
+  GstElement *tee = kms_agnostic_bin2_get_upstream_tee (self);
+
+  if (tee == NULL) {
+    return FALSE;
+  }
+
+  *stream_id = kms_transcoder_registry_get_stream_id (tee);
+  g_object_unref (tee);
+
+  return TRUE;
+}
+
+static void
+relink_shared_pad_async (gpointer data, gpointer not_used)
+{
+  SharedRelink *relink = data;
+  KmsAgnosticBin2 *self = relink->agnosticbin;
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  if (GST_OBJECT_PARENT (relink->pad) == GST_OBJECT (self)) {
+    GST_DEBUG_OBJECT (self, "Shared branch removed, relinking %"
+        GST_PTR_FORMAT, relink->pad);
+    remove_target_pad (relink->pad);
+    kms_agnostic_bin2_process_pad (self, relink->pad);
+  }
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
+  g_object_unref (relink->pad);
+  g_object_unref (relink->agnosticbin);
+  g_slice_free (SharedRelink, relink);
+}
+
+static void
+kms_agnostic_bin2_push_relink (KmsAgnosticBin2 * self, GstPad * pad)
+{
+  SharedRelink *relink;
+
+  GST_OBJECT_LOCK (self);
+
+  /* Not relinked if it is being disposed */
+  if (self->priv->relink_pool != NULL) {
+    relink = g_slice_new0 (SharedRelink);
+    relink->agnosticbin = g_object_ref (self);
+    relink->pad = g_object_ref (pad);
+    g_thread_pool_push (self->priv->relink_pool, relink, NULL);
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static SharedLink *
+shared_link_new (GstPad * exposed, GstPad * end, GstPad * pad)
+{
+  SharedLink *link = g_slice_new0 (SharedLink);
+
+  link->exposed = g_object_ref (exposed);
+  link->end = g_object_ref (end);
+  link->pad = g_object_ref (pad);
+
+  return link;
+}
+
+static void
+shared_link_destroy (SharedLink * link)
+{
+  g_object_unref (link->exposed);
+  g_object_unref (link->end);
+  g_object_unref (link->pad);
+  g_slice_free (SharedLink, link);
+}
+
+/* Closest bin holding both @a and @b, NULL if they are not in the same one */
+static GstObject *
+find_common_ancestor (GstObject * a, GstObject * b)
+{
+  GstObject *ancestor = gst_object_get_parent (a);
+
+  while (ancestor != NULL && !gst_object_has_ancestor (b, ancestor)) {
+    GstObject *next = gst_object_get_parent (ancestor);
+
+    gst_object_unref (ancestor);
+    ancestor = next;
+  }
+
+  return ancestor;
+}
+
+/*
+ * Ghosts @pad on every bin holding it below @ancestor. Returns the outermost
+ * pad, that can be linked inside @ancestor.
+ */
+static GstPad *
+ghost_pad_up_to (GstPad * pad, GstObject * ancestor)
+{
+  GstPad *current = g_object_ref (pad);
+  GstObject *element = gst_pad_get_parent (pad);
+
+  while (element != NULL) {
+    GstObject *bin = gst_object_get_parent (element);
+    GstPad *ghost;
+
+    gst_object_unref (element);
+    element = NULL;
+
+    if (bin == NULL || bin == ancestor) {
+      if (bin != NULL) {
+        gst_object_unref (bin);
+      }
+      break;
+    }
+
+    ghost = gst_ghost_pad_new (NULL, current);
+    g_object_set_data (G_OBJECT (ghost), SHARED_GHOST_DATA,
+        GINT_TO_POINTER (TRUE));
+    gst_element_add_pad (GST_ELEMENT (bin), ghost);
+
+    g_object_unref (current);
+    current = g_object_ref (ghost);
+    element = bin;
+  }
+
+  return current;
+}
+
+/* Removes the ghost pads added by ghost_pad_up_to, from the outermost one */
+static void
+remove_ghost_chain (GstPad * pad)
+{
+  GstPad *current = g_object_ref (pad);
+
+  while (current != NULL
+      && g_object_get_data (G_OBJECT (current), SHARED_GHOST_DATA) != NULL) {
+    GstPad *target = gst_ghost_pad_get_target (GST_GHOST_PAD (current));
+    GstElement *parent = gst_pad_get_parent_element (current);
+
+    /* Unlinking the innermost one releases the tee pad */
+    gst_ghost_pad_set_target (GST_GHOST_PAD (current), NULL);
+
+    if (parent != NULL) {
+      gst_element_remove_pad (parent, current);
+      g_object_unref (parent);
+    }
+
+    g_object_unref (current);
+    current = target;
+  }
+
+  if (current != NULL) {
+    g_object_unref (current);
+  }
+}
+
+/* Called with the shared_links lock held, does nothing if already removed */
+static void
+unlink_shared_unlocked (SharedLink * link)
+{
+  GstPad *peer = gst_pad_get_peer (link->exposed);
+
+  if (peer == link->end) {
+    gst_pad_unlink (link->exposed, link->end);
+  }
+
+  if (peer != NULL) {
+    g_object_unref (peer);
+  }
+
+  remove_ghost_chain (link->end);
+  remove_ghost_chain (link->exposed);
+}
+
+/*
+ * Feeds @element, and so @pad, from @tee in another agnosticbin. The link is
+ * made inside @ancestor, through ghost pads on the bins holding each of them.
+ */
+static gboolean
+link_element_to_shared_tee (GstElement * tee, GstElement * element,
+    GstPad * pad, GstObject * ancestor)
+{
+  GstPad *tee_src, *element_sink, *src_end, *sink_end;
+  GstPadLinkReturn ret;
+
+  G_LOCK (shared_links);
+
+  tee_src = prepare_tee_link (tee, element);
+  element_sink = gst_element_get_static_pad (element, "sink");
+  src_end = ghost_pad_up_to (tee_src, ancestor);
+  sink_end = ghost_pad_up_to (element_sink, ancestor);
+
+  ret = gst_pad_link (src_end, sink_end);
+
+  if (G_UNLIKELY (GST_PAD_LINK_FAILED (ret))) {
+    GST_ERROR ("Linking %" GST_PTR_FORMAT " with %" GST_PTR_FORMAT " result %d",
+        src_end, sink_end, ret);
+
+    remove_ghost_chain (sink_end);
+    remove_ghost_chain (src_end);
+
+    if (src_end == tee_src) {
+      gst_element_release_request_pad (tee, tee_src);
+    }
+  } else {
+    g_object_set_data_full (G_OBJECT (tee_src), SHARED_LINK_DATA,
+        shared_link_new (src_end, sink_end, pad),
+        (GDestroyNotify) shared_link_destroy);
+    g_object_set_data_full (G_OBJECT (element), SHARED_LINK_DATA,
+        shared_link_new (src_end, sink_end, pad),
+        (GDestroyNotify) shared_link_destroy);
+  }
+
+  G_UNLOCK (shared_links);
+
+  g_object_unref (sink_end);
+  g_object_unref (src_end);
+  g_object_unref (element_sink);
+  g_object_unref (tee_src);
+
+  return !GST_PAD_LINK_FAILED (ret);
+}
+
+/*
+ * Unlinks the other agnosticbins fed by @tee, their pads are linked again
+ * from a different branch.
+ */
+static void
+detach_shared_consumers (GstElement * tee)
+{
+  GstIterator *it = gst_element_iterate_src_pads (tee);
+  GList *tee_pads = NULL, *l;
+  GValue item = G_VALUE_INIT;
+
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    tee_pads = g_list_prepend (tee_pads, g_value_dup_object (&item));
+    g_value_reset (&item);
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  for (l = tee_pads; l != NULL; l = l->next) {
+    GstElement *agnosticbin = NULL;
+    GstPad *pad = NULL;
+    SharedLink *link;
+
+    G_LOCK (shared_links);
+
+    link = g_object_get_data (G_OBJECT (l->data), SHARED_LINK_DATA);
+
+    if (link != NULL) {
+      pad = g_object_ref (link->pad);
+      /* Releases the tee pad, and the link with it */
+      unlink_shared_unlocked (link);
+    }
+
+    G_UNLOCK (shared_links);
+
+    if (pad != NULL) {
+      agnosticbin = gst_pad_get_parent_element (pad);
+    }
+
+    if (agnosticbin != NULL) {
+      kms_agnostic_bin2_push_relink (KMS_AGNOSTIC_BIN2 (agnosticbin), pad);
+      g_object_unref (agnosticbin);
+    }
+
+    if (pad != NULL) {
+      g_object_unref (pad);
+    }
+  }
+
+  g_list_free_full (tee_pads, g_object_unref);
+}
+
+static void
+shared_bin_bitrate_changed (GObject * bin, GParamSpec * pspec, gpointer data)
+{
+  KmsTranscoderRegistry *registry;
+  GstElement *tee;
+  gint bitrate;
+
+  registry = kms_transcoder_registry_get (GST_ELEMENT (bin));
+
+  if (registry == NULL) {
+    return;
+  }
+
+  g_object_get (bin, "target-bitrate", &bitrate, NULL);
+  tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (bin));
+
+  /* Consumers of other tiers stop being driven by this encoder */
+  if (kms_transcoder_registry_update_bitrate (registry, tee, bitrate)) {
+    detach_shared_consumers (tee);
+  }
+
+  kms_transcoder_registry_unref (registry);
+}
+
+static void
+kms_agnostic_bin2_publish_bin (KmsAgnosticBin2 * self, GstBin * bin)
+{
+  guint stream_id;
+
+  if (!kms_agnostic_bin2_get_stream_id (self, &stream_id)) {
+    return;
+  }
+
+  if (self->priv->registry == NULL) {
+    self->priv->registry = kms_transcoder_registry_get (GST_ELEMENT (self));
+
+    if (self->priv->registry == NULL) {
+      return;
+    }
+  }
+
+  kms_transcoder_registry_publish (self->priv->registry, stream_id,
+      self->priv->default_bitrate,
+      kms_tree_bin_get_output_tee (KMS_TREE_BIN (bin)), self);
+
+  if (KMS_IS_ENC_TREE_BIN (bin)) {
+    g_signal_connect (bin, "notify::target-bitrate",
+        G_CALLBACK (shared_bin_bitrate_changed), NULL);
+  }
+}
+
+static void
+withdraw_bin (gpointer key, gpointer value, gpointer agnosticbin)
+{
+  KmsAgnosticBin2 *self = agnosticbin;
+  GstElement *tee;
+
+  if (self->priv->registry == NULL) {
+    return;
+  }
+
+  tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (value));
+  kms_transcoder_registry_withdraw (self->priv->registry, tee);
+  detach_shared_consumers (tee);
+}
+
+/* Disconnects this agnosticbin from branches owned by other agnosticbins */
+static void
+kms_agnostic_bin2_detach_from_shared (KmsAgnosticBin2 * self)
+{
+  GstIterator *it = gst_bin_iterate_elements (GST_BIN (self));
+  GValue item = G_VALUE_INIT;
+
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstElement *element = g_value_get_object (&item);
+    SharedLink *link = g_object_get_data (G_OBJECT (element), SHARED_LINK_DATA);
+
+    if (link != NULL) {
+      G_LOCK (shared_links);
+      unlink_shared_unlocked (link);
+      G_UNLOCK (shared_links);
+    }
+
+    g_value_reset (&item);
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+typedef struct _SharedAttach
+{
+  KmsAgnosticBin2 *self;
+  GstPad *pad;
+  GstCaps *caps;
+} SharedAttach;
+
+static gboolean
+attach_to_shared_tee (GstElement * tee, gpointer data)
+{
+  SharedAttach *attach = data;
+  GstObject *ancestor;
+  GstElement *element;
+  gboolean ret;
+
+  ancestor =
+      find_common_ancestor (GST_OBJECT (tee), GST_OBJECT (attach->self));
+
+  if (ancestor == NULL) {
+    return FALSE;
+  }
+
+  element = kms_agnostic_bin2_create_output (attach->self, attach->pad,
+      attach->caps);
+  ret = link_element_to_shared_tee (tee, element, attach->pad, ancestor);
+  gst_object_unref (ancestor);
+
+  if (ret) {
+    kms_utils_drop_until_keyframe (attach->pad, TRUE);
+  } else {
+    remove_target_pad (attach->pad);
+  }
+
+  return ret;
+}
+
+/* Feeds @pad from a branch of another agnosticbin receiving the same stream */
+static gboolean
+kms_agnostic_bin2_link_to_shared (KmsAgnosticBin2 * self, GstPad * pad,
+    GstCaps * caps)
+{
+  KmsTranscoderRegistry *registry;
+  SharedAttach attach;
+  guint stream_id;
+  gboolean ret;
+
+  if (!kms_agnostic_bin2_get_stream_id (self, &stream_id)) {
+    return FALSE;
+  }
+
+  registry = kms_transcoder_registry_get (GST_ELEMENT (self));
+
+  if (registry == NULL) {
+    return FALSE;
+  }
+
+  attach.self = self;
+  attach.pad = pad;
+  attach.caps = caps;
+
+  ret = kms_transcoder_registry_attach (registry, stream_id,
+      self->priv->default_bitrate, caps, self, attach_to_shared_tee, &attach);
+
+  kms_transcoder_registry_unref (registry);
+
+  return ret;
 }
 
 static GstBin *
@@ -533,6 +1095,7 @@ kms_agnostic_bin2_get_or_create_dec_bin (KmsAgnosticBin2 * self, GstCaps * caps)
 
       if (dec_bin != NULL) {
         kms_agnostic_bin2_insert_bin (self, dec_bin);
+        kms_agnostic_bin2_publish_bin (self, dec_bin);
       }
     }
 
@@ -575,6 +1138,7 @@ kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
   link_element_to_tee (output_tee, input_element);
 
   kms_agnostic_bin2_insert_bin (self, GST_BIN (enc_bin));
+  kms_agnostic_bin2_publish_bin (self, GST_BIN (enc_bin));
 
   return GST_BIN (enc_bin);
 }
@@ -603,6 +1167,12 @@ kms_agnostic_bin2_link_pad (KmsAgnosticBin2 * self, GstPad * pad, GstPad * peer)
   GST_DEBUG ("Query caps are: %" GST_PTR_FORMAT, caps);
   bin = kms_agnostic_bin2_find_bin_for_caps (self, caps);
 
+  if (bin == NULL && kms_agnostic_bin2_link_to_shared (self, pad, caps)) {
+    GST_DEBUG_OBJECT (self, "Linked to a shared branch");
+    gst_caps_unref (caps);
+    goto end;
+  }
+
   if (bin == NULL) {
     bin = kms_agnostic_bin2_create_bin_for_caps (self, caps);
     GST_DEBUG_OBJECT (self, "Created bin: %" GST_PTR_FORMAT, bin);
@@ -769,6 +1339,7 @@ kms_agnostic_bin2_configure_input (KmsAgnosticBin2 * self, const GstCaps * caps)
   self->priv->started = FALSE;
 
   GST_DEBUG ("Removing old treebins");
+  g_hash_table_foreach (self->priv->bins, withdraw_bin, self);
   g_hash_table_foreach (self->priv->bins, remove_bin, self);
   g_hash_table_remove_all (self->priv->bins);
 
@@ -911,10 +1482,29 @@ static void
 kms_agnostic_bin2_dispose (GObject * object)
 {
   KmsAgnosticBin2 *self = KMS_AGNOSTIC_BIN2 (object);
+  GThreadPool *relink_pool;
 
   GST_DEBUG_OBJECT (object, "dispose");
 
   KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  GST_OBJECT_LOCK (self);
+  relink_pool = self->priv->relink_pool;
+  self->priv->relink_pool = NULL;
+  GST_OBJECT_UNLOCK (self);
+
+  if (relink_pool != NULL) {
+    g_thread_pool_free (relink_pool, FALSE, FALSE);
+  }
+
+  g_hash_table_foreach (self->priv->bins, withdraw_bin, self);
+  kms_agnostic_bin2_detach_from_shared (self);
+
+  if (self->priv->registry != NULL) {
+    kms_transcoder_registry_unref (self->priv->registry);
+    self->priv->registry = NULL;
+  }
+
   g_thread_pool_free (self->priv->remove_pool, FALSE, FALSE);
 
   if (self->priv->input_bin_src_caps) {
@@ -1049,19 +1639,15 @@ static void
 kms_agnostic_bin2_init (KmsAgnosticBin2 * self)
 {
   GstPadTemplate *templ;
-  GstElement *tee, *fakesink;
-  GstPad *target, *sink;
+  GstElement *tee;
+  GstPad *target;
 
   self->priv = KMS_AGNOSTIC_BIN2_GET_PRIVATE (self);
 
-  tee = gst_element_factory_make ("tee", NULL);
+  tee = gst_element_factory_make ("kmsfanout", NULL);
   self->priv->input_tee = tee;
-  fakesink = gst_element_factory_make ("fakesink", NULL);
-
-  g_object_set (fakesink, "async", FALSE, NULL);
 
-  gst_bin_add_many (GST_BIN (self), tee, fakesink, NULL);
-  gst_element_link_many (tee, fakesink, NULL);
+  gst_bin_add (GST_BIN (self), tee);
 
   target = gst_element_get_static_pad (tee, "sink");
   templ = gst_static_pad_template_get (&sink_factory);
@@ -1069,12 +1655,11 @@ kms_agnostic_bin2_init (KmsAgnosticBin2 * self)
   gst_pad_set_query_function (self->priv->sink, kms_agnostic_bin2_sink_query);
   kms_utils_manage_gaps (self->priv->sink);
   g_object_unref (templ);
-  g_object_unref (target);
 
-  sink = gst_element_get_static_pad (fakesink, "sink");
-  gst_pad_add_probe (sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+  /* Caps are seen before they are queued for the branches */
+  gst_pad_add_probe (target, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
       kms_agnostic_bin2_sink_caps_probe, self, NULL);
-  g_object_unref (sink);
+  g_object_unref (target);
 
   gst_element_add_pad (GST_ELEMENT (self), self->priv->sink);
 
@@ -1083,6 +1668,8 @@ kms_agnostic_bin2_init (KmsAgnosticBin2 * self)
   self->priv->started = FALSE;
   self->priv->remove_pool =
       g_thread_pool_new (remove_on_unlinked_async, NULL, -1, FALSE, NULL);
+  self->priv->relink_pool =
+      g_thread_pool_new (relink_shared_pad_async, NULL, -1, FALSE, NULL);
   self->priv->bins =
       g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
   g_rec_mutex_init (&self->priv->thread_mutex);
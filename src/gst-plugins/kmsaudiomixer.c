@@ -22,6 +22,7 @@
 #include "kmsaudiomixer.h"
 #include "kmsloop.h"
 #include "kmsrefstruct.h"
+#include "kmsspeakerselector.h"
 
 #define PLUGIN_NAME "kmsaudiomixer"
 #define KEY_SINK_PAD_NAME "kms-key-sink-pad-name"
@@ -30,6 +31,9 @@
 #define KMS_LABEL_AGNOSTICBIN "agnosticbin"
 #define KMS_LABEL_ADDER "adder"
 
+#define DEFAULT_MIX_MINUS TRUE
+#define DEFAULT_MAX_ACTIVE_INPUTS 0
+
 #define KMS_AUDIO_MIXER_LOCK(mixer) \
   (g_rec_mutex_lock (&(mixer)->priv->mutex))
 
@@ -54,7 +58,25 @@ struct _KmsAudioMixerPrivate
   GHashTable *agnostics;
   GHashTable *typefinds;
   KmsLoop *loop;
+  /* Runs the state changes of removed branches, out of the shared loop */
+  GThreadPool *remove_pool;
   guint count;
+
+  /* Single mixing engine used instead of one adder per participant */
+  gboolean mix_minus;
+  GstElement *mixminus;
+  GHashTable *outputs;
+
+  KmsSpeakerSelector *selector;
+};
+
+enum
+{
+  PROP_0,
+  PROP_MIX_MINUS,
+  PROP_MAX_ACTIVE_INPUTS,
+  PROP_HYSTERESIS,
+  N_PROPERTIES
 };
 
 #define RAW_AUDIO_CAPS "audio/x-raw;"
@@ -211,19 +233,18 @@ get_stream_id_from_padname (const gchar * name)
 
 static void
 kms_audio_mixer_remove_sometimes_src_pad (KmsAudioMixer * self,
-    GstElement * adder)
+    GstPad * srcpad)
 {
   GstProxyPad *internal;
-  GstPad *srcpad, *peer;
+  GstPad *peer;
 
-  srcpad = gst_element_get_static_pad (adder, "src");
   peer = gst_pad_get_peer (srcpad);
   if (peer == NULL)
-    goto end_phase_1;
+    return;
 
   internal = gst_proxy_pad_get_internal ((GstProxyPad *) peer);
   if (internal == NULL)
-    goto end_phase_2;
+    goto end;
 
   gst_ghost_pad_set_target (GST_GHOST_PAD (internal), NULL);
 
@@ -238,17 +259,15 @@ kms_audio_mixer_remove_sometimes_src_pad (KmsAudioMixer * self,
   gst_element_remove_pad (GST_ELEMENT (self), GST_PAD (internal));
   gst_object_unref (internal);
 
-end_phase_2:
+end:
   gst_object_unref (peer);
-
-end_phase_1:
-  gst_object_unref (srcpad);
 }
 
 static gboolean
 remove_adder (GstElement * adder)
 {
   KmsAudioMixer *self;
+  GstPad *srcpad;
 
   self = (KmsAudioMixer *) gst_element_get_parent (adder);
   if (self == NULL) {
@@ -258,7 +277,9 @@ remove_adder (GstElement * adder)
 
   GST_DEBUG ("Removing element %" GST_PTR_FORMAT, adder);
 
-  kms_audio_mixer_remove_sometimes_src_pad (self, adder);
+  srcpad = gst_element_get_static_pad (adder, "src");
+  kms_audio_mixer_remove_sometimes_src_pad (self, srcpad);
+  gst_object_unref (srcpad);
 
   gst_object_ref (adder);
   gst_element_set_locked_state (adder, TRUE);
@@ -271,6 +292,24 @@ remove_adder (GstElement * adder)
   return G_SOURCE_REMOVE;
 }
 
+static void
+kms_audio_mixer_remove_output (KmsAudioMixer * self, GstPad * output)
+{
+  GST_DEBUG_OBJECT (self, "Removing output %" GST_PTR_FORMAT, output);
+
+  kms_audio_mixer_remove_sometimes_src_pad (self, output);
+  gst_element_release_request_pad (self->priv->mixminus, output);
+  gst_object_unref (output);
+}
+
+static gboolean
+remove_output_cb (gpointer key, gpointer value, gpointer self)
+{
+  kms_audio_mixer_remove_output (KMS_AUDIO_MIXER (self), GST_PAD (value));
+
+  return TRUE;
+}
+
 static void
 remove_agnostic_bin (GstElement * agnosticbin)
 {
@@ -391,8 +430,17 @@ kms_audio_mixer_dispose (GObject * object)
     self->priv->adders = NULL;
   }
 
+  if (self->priv->outputs != NULL) {
+    g_hash_table_foreach_remove (self->priv->outputs, remove_output_cb, self);
+    g_hash_table_unref (self->priv->outputs);
+    self->priv->outputs = NULL;
+  }
+
   g_clear_object (&self->priv->loop);
 
+  /* Probes can still hold the selector, this element is not notified again */
+  kms_speaker_selector_set_notify (self->priv->selector, NULL, NULL);
+
   KMS_AUDIO_MIXER_UNLOCK (self);
 
   G_OBJECT_CLASS (kms_audio_mixer_parent_class)->dispose (object);
@@ -406,11 +454,53 @@ kms_audio_mixer_finalize (GObject * object)
   GST_DEBUG_OBJECT (self, "finalize");
 
   g_hash_table_unref (self->priv->typefinds);
+  kms_speaker_selector_unref (self->priv->selector);
+  g_thread_pool_free (self->priv->remove_pool, FALSE, FALSE);
   g_rec_mutex_clear (&self->priv->mutex);
 
   G_OBJECT_CLASS (kms_audio_mixer_parent_class)->finalize (object);
 }
 
+static void
+link_agnosticbin_to_mix_minus (KmsAudioMixer * self, GstElement * agnosticbin,
+    gint id)
+{
+  GstPad *srcpad = NULL, *sinkpad = NULL;
+  gchar *padname;
+
+  srcpad = gst_element_get_request_pad (agnosticbin, "src_%u");
+  if (srcpad == NULL) {
+    GST_ERROR ("Could not get src pad in %" GST_PTR_FORMAT, agnosticbin);
+    return;
+  }
+
+  padname = g_strdup_printf (AUDIO_SINK_PAD, id);
+  sinkpad = gst_element_get_request_pad (self->priv->mixminus, padname);
+  g_free (padname);
+
+  if (sinkpad == NULL) {
+    GST_ERROR ("Could not get sink pad in %" GST_PTR_FORMAT,
+        self->priv->mixminus);
+    gst_element_release_request_pad (agnosticbin, srcpad);
+    goto end;
+  }
+
+  GST_DEBUG ("Linking %" GST_PTR_FORMAT " to %" GST_PTR_FORMAT, srcpad,
+      sinkpad);
+
+  if (gst_pad_link (srcpad, sinkpad) != GST_PAD_LINK_OK) {
+    GST_ERROR ("Could not link %" GST_PTR_FORMAT " to %" GST_PTR_FORMAT, srcpad,
+        sinkpad);
+    gst_element_release_request_pad (agnosticbin, srcpad);
+    gst_element_release_request_pad (self->priv->mixminus, sinkpad);
+  }
+
+  gst_object_unref (sinkpad);
+
+end:
+  gst_object_unref (srcpad);
+}
+
 static void
 kms_audio_mixer_have_type (GstElement * typefind, guint arg0, GstCaps * caps,
     gpointer data)
@@ -443,8 +533,12 @@ kms_audio_mixer_have_type (GstElement * typefind, guint arg0, GstCaps * caps,
   gst_bin_add_many (GST_BIN (self), audiorate, agnosticbin, NULL);
   gst_element_link_many (typefind, audiorate, agnosticbin, NULL);
 
-  g_hash_table_foreach (self->priv->adders, (GHFunc) link_new_agnosticbin,
-      agnosticbin);
+  if (self->priv->mix_minus) {
+    link_agnosticbin_to_mix_minus (self, agnosticbin, id);
+  } else {
+    g_hash_table_foreach (self->priv->adders, (GHFunc) link_new_agnosticbin,
+        agnosticbin);
+  }
 
   g_hash_table_insert (self->priv->agnostics, g_strdup (padname), agnosticbin);
 
@@ -599,11 +693,58 @@ kms_audio_mixer_remove_elements (KmsAudioMixer * self,
   }
 }
 
+typedef struct _KmsAudioMixerRemoval
+{
+  GstElement *agnosticbin;
+  GstElement *adder;
+} KmsAudioMixerRemoval;
+
+static void
+remove_elements_async (KmsAudioMixerRemoval * removal, gpointer user_data)
+{
+  if (removal->agnosticbin != NULL) {
+    remove_agnostic_bin (removal->agnosticbin);
+    gst_object_unref (removal->agnosticbin);
+  }
+
+  if (removal->adder != NULL) {
+    remove_adder (removal->adder);
+    gst_object_unref (removal->adder);
+  }
+
+  g_slice_free (KmsAudioMixerRemoval, removal);
+}
+
 static gboolean
 remove_elements_cb (KmsAudioMixerData * sync)
 {
-  kms_audio_mixer_remove_elements (sync->audiomixer, sync->agnosticbin,
-      sync->adder);
+  KmsAudioMixer *self = sync->audiomixer;
+  KmsAudioMixerRemoval *removal;
+
+  KMS_AUDIO_MIXER_LOCK (self);
+
+  if (sync->agnosticbin != NULL) {
+    unlink_agnosticbin (sync->agnosticbin);
+  }
+
+  if (sync->adder != NULL) {
+    unlink_adder_sources (sync->adder);
+  }
+
+  KMS_AUDIO_MIXER_UNLOCK (self);
+
+  /* Changing states blocks, the loop is shared with other elements */
+  removal = g_slice_new0 (KmsAudioMixerRemoval);
+
+  if (sync->agnosticbin != NULL) {
+    removal->agnosticbin = gst_object_ref (sync->agnosticbin);
+  }
+
+  if (sync->adder != NULL) {
+    removal->adder = gst_object_ref (sync->adder);
+  }
+
+  g_thread_pool_push (self->priv->remove_pool, removal, NULL);
 
   return G_SOURCE_REMOVE;
 }
@@ -742,6 +883,7 @@ static void
 unlinked_pad (GstPad * pad, GstPad * peer, gpointer user_data)
 {
   GstElement *agnostic = NULL, *adder = NULL, *typefind = NULL, *parent;
+  GstPad *output = NULL;
   KmsAudioMixer *self;
   gchar *padname;
 
@@ -775,10 +917,22 @@ unlinked_pad (GstPad * pad, GstPad * peer, gpointer user_data)
     g_hash_table_remove (self->priv->adders, padname);
   }
 
+  if (self->priv->outputs != NULL) {
+    output = g_hash_table_lookup (self->priv->outputs, padname);
+    g_hash_table_steal (self->priv->outputs, padname);
+  }
+
   KMS_AUDIO_MIXER_UNLOCK (self);
 
+  kms_speaker_selector_remove_input (self->priv->selector,
+      get_stream_id_from_padname (padname));
+
   g_free (padname);
 
+  if (output != NULL) {
+    kms_audio_mixer_remove_output (self, output);
+  }
+
   if (GST_STATE (parent) >= GST_STATE_PAUSED
       || GST_STATE_PENDING (parent) >= GST_STATE_PAUSED
       || GST_STATE_TARGET (parent) >= GST_STATE_PAUSED) {
@@ -803,6 +957,56 @@ end:
   gst_object_unref (parent);
 }
 
+static gboolean
+kms_audio_mixer_add_mix_minus_src_pad (KmsAudioMixer * self,
+    const char *padname, gint id)
+{
+  GstPad *output, *pad;
+  gchar *srcname;
+
+  KMS_AUDIO_MIXER_LOCK (self);
+
+  if (self->priv->mixminus == NULL) {
+    self->priv->mixminus = gst_element_factory_make ("kmsmixminus", NULL);
+    gst_bin_add (GST_BIN (self), self->priv->mixminus);
+    gst_element_sync_state_with_parent (self->priv->mixminus);
+  }
+
+  srcname = g_strdup_printf (AUDIO_SRC_PAD, id);
+  output = gst_element_get_request_pad (self->priv->mixminus, srcname);
+
+  if (output == NULL) {
+    GST_ERROR_OBJECT (self, "Can not get output %s", srcname);
+    KMS_AUDIO_MIXER_UNLOCK (self);
+    g_free (srcname);
+    return FALSE;
+  }
+
+  pad = gst_ghost_pad_new (srcname, output);
+  g_free (srcname);
+
+  if (GST_STATE (self) >= GST_STATE_PAUSED
+      || GST_STATE_PENDING (self) >= GST_STATE_PAUSED
+      || GST_STATE_TARGET (self) >= GST_STATE_PAUSED)
+    gst_pad_set_active (pad, TRUE);
+
+  if (gst_element_add_pad (GST_ELEMENT (self), pad)) {
+    g_hash_table_insert (self->priv->outputs, g_strdup (padname), output);
+    KMS_AUDIO_MIXER_UNLOCK (self);
+    return TRUE;
+  }
+
+  /* ERROR */
+  GST_ERROR_OBJECT (self, "Can not add pad %" GST_PTR_FORMAT, pad);
+  KMS_AUDIO_MIXER_UNLOCK (self);
+
+  gst_object_unref (pad);
+  gst_element_release_request_pad (self->priv->mixminus, output);
+  gst_object_unref (output);
+
+  return FALSE;
+}
+
 static gboolean
 kms_audio_mixer_add_src_pad (KmsAudioMixer * self, const char *padname)
 {
@@ -816,6 +1020,10 @@ kms_audio_mixer_add_src_pad (KmsAudioMixer * self, const char *padname)
     return FALSE;
   }
 
+  if (self->priv->mix_minus) {
+    return kms_audio_mixer_add_mix_minus_src_pad (self, padname, id);
+  }
+
   adder = gst_element_factory_make ("audiomixer", NULL);
   g_object_set_data_full (G_OBJECT (adder), KEY_SINK_PAD_NAME,
       g_strdup (padname), g_free);
@@ -907,6 +1115,13 @@ kms_audio_mixer_request_new_pad (GstElement * element,
     }
     gst_element_remove_pad (element, pad);
   } else {
+    GstPad *srcpad = gst_element_get_static_pad (typefind, "src");
+
+    /* Inputs are selected before being converted */
+    kms_speaker_selector_add_input (self->priv->selector,
+        get_stream_id_from_padname (padname), srcpad);
+    g_object_unref (srcpad);
+
     g_hash_table_insert (self->priv->typefinds, g_strdup (padname), typefind);
     g_object_set_data_full (G_OBJECT (typefind), KEY_SINK_PAD_NAME, padname,
         g_free);
@@ -952,6 +1167,68 @@ kms_audio_mixer_release_pad (GstElement * element, GstPad * pad)
   gst_element_remove_pad (element, pad);
 }
 
+static void
+kms_audio_mixer_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsAudioMixer *self = KMS_AUDIO_MIXER (object);
+
+  KMS_AUDIO_MIXER_LOCK (self);
+
+  switch (property_id) {
+    case PROP_MIX_MINUS:
+      if (self->priv->count > 0) {
+        GST_WARNING_OBJECT (self, "Mixing engine can not be changed once "
+            "pads are requested");
+        break;
+      }
+
+      self->priv->mix_minus = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_ACTIVE_INPUTS:
+      kms_speaker_selector_set_max_active (self->priv->selector,
+          g_value_get_uint (value));
+      break;
+    case PROP_HYSTERESIS:
+      kms_speaker_selector_set_hysteresis (self->priv->selector,
+          g_value_get_double (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  KMS_AUDIO_MIXER_UNLOCK (self);
+}
+
+static void
+kms_audio_mixer_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsAudioMixer *self = KMS_AUDIO_MIXER (object);
+
+  KMS_AUDIO_MIXER_LOCK (self);
+
+  switch (property_id) {
+    case PROP_MIX_MINUS:
+      g_value_set_boolean (value, self->priv->mix_minus);
+      break;
+    case PROP_MAX_ACTIVE_INPUTS:
+      g_value_set_uint (value,
+          kms_speaker_selector_get_max_active (self->priv->selector));
+      break;
+    case PROP_HYSTERESIS:
+      g_value_set_double (value,
+          kms_speaker_selector_get_hysteresis (self->priv->selector));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  KMS_AUDIO_MIXER_UNLOCK (self);
+}
+
 static void
 kms_audio_mixer_class_init (KmsAudioMixerClass * klass)
 {
@@ -974,11 +1251,44 @@ kms_audio_mixer_class_init (KmsAudioMixerClass * klass)
 
   gobject_class->dispose = GST_DEBUG_FUNCPTR (kms_audio_mixer_dispose);
   gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_audio_mixer_finalize);
+  gobject_class->set_property = kms_audio_mixer_set_property;
+  gobject_class->get_property = kms_audio_mixer_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MIX_MINUS,
+      g_param_spec_boolean ("mix-minus", "Mix minus",
+          "Mix every input once and remove each participant's own "
+          "contribution from its output, instead of using one adder per "
+          "participant. Inputs without data when a frame is due are left "
+          "out of it", DEFAULT_MIX_MINUS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_ACTIVE_INPUTS,
+      g_param_spec_uint ("max-active-inputs", "Maximum active inputs",
+          "Only the loudest inputs up to this number are mixed, "
+          "0 to mix all of them", 0, G_MAXUINT, DEFAULT_MAX_ACTIVE_INPUTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_HYSTERESIS,
+      g_param_spec_double ("hysteresis", "Hysteresis",
+          "dB an input has to be louder than the quietest active one "
+          "to replace it", 0.0, G_MAXDOUBLE,
+          KMS_SPEAKER_SELECTOR_DEFAULT_HYSTERESIS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsAudioMixerPrivate));
 }
 
+static void
+kms_audio_mixer_active_inputs_changed (KmsSpeakerSelector * selector,
+    gpointer data)
+{
+  GstElement *self = GST_ELEMENT (data);
+
+  gst_element_post_message (self, kms_speaker_selector_new_message (selector,
+          GST_OBJECT (self), AUDIO_SINK_PAD));
+}
+
 static void
 kms_audio_mixer_init (KmsAudioMixer * self)
 {
@@ -990,9 +1300,19 @@ kms_audio_mixer_init (KmsAudioMixer * self)
       g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
   self->priv->typefinds =
       g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->priv->outputs =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->priv->mix_minus = DEFAULT_MIX_MINUS;
+
+  self->priv->selector = kms_speaker_selector_new ();
+  kms_speaker_selector_set_notify (self->priv->selector,
+      kms_audio_mixer_active_inputs_changed, self);
 
   g_rec_mutex_init (&self->priv->mutex);
-  self->priv->loop = kms_loop_new ();
+  self->priv->loop = kms_loop_new_pooled ();
+  /* Not exclusive, idle threads are shared with every other pool */
+  self->priv->remove_pool =
+      g_thread_pool_new ((GFunc) remove_elements_async, NULL, -1, FALSE, NULL);
 
   g_object_set (G_OBJECT (self), "async-handling", TRUE, NULL);
 }
@@ -21,10 +21,13 @@
 
 #include "kmsaudiomixerbin.h"
 #include "kmsloop.h"
+#include "kmsspeakerselector.h"
 
 #define PLUGIN_NAME "audiomixerbin"
 #define KMS_AUDIO_MIXER_BIN_PROBE_ID_KEY "kms-audio-mixer-bin-probe-id"
 
+#define DEFAULT_MAX_ACTIVE_INPUTS 0
+
 #define KMS_AUDIO_MIXER_BIN_LOCK(mixer) \
   (g_rec_mutex_lock (&(mixer)->priv->mutex))
 
@@ -47,8 +50,19 @@ struct _KmsAudioMixerBinPrivate
   GstElement *adder;
   GRecMutex mutex;
   KmsLoop *loop;
+  /* Runs the state changes of removed branches, out of the shared loop */
+  GThreadPool *remove_pool;
   GstPad *srcpad;
   guint count;
+  KmsSpeakerSelector *selector;
+};
+
+enum
+{
+  PROP_0,
+  PROP_MAX_ACTIVE_INPUTS,
+  PROP_HYSTERESIS,
+  N_PROPERTIES
 };
 
 #define RAW_AUDIO_CAPS "audio/x-raw;"
@@ -293,6 +307,19 @@ kms_audio_mixer_bin_remove_elements (KmsAudioMixerBin * self,
   gst_bin_remove_many (GST_BIN (self), typefind, agnosticbin, NULL);
 }
 
+static void
+remove_elements_async (RefCounter * refdata, gpointer user_data)
+{
+  ProbeData *data;
+
+  data = (ProbeData *) refdata->data;
+
+  kms_audio_mixer_bin_remove_elements (data->audiomixer, data->typefind,
+      data->agnosticbin);
+
+  ref_counter_dec (refdata);
+}
+
 static gboolean
 remove_elements (RefCounter * refdata)
 {
@@ -302,8 +329,10 @@ remove_elements (RefCounter * refdata)
 
   kms_audio_mixer_bin_unlink_elements (data->audiomixer, data->typefind,
       data->agnosticbin);
-  kms_audio_mixer_bin_remove_elements (data->audiomixer, data->typefind,
-      data->agnosticbin);
+
+  /* Changing states blocks, the loop is shared with other elements */
+  g_thread_pool_push (data->audiomixer->priv->remove_pool,
+      ref_counter_inc (refdata), NULL);
 
   return G_SOURCE_REMOVE;
 }
@@ -492,6 +521,7 @@ kms_audio_mixer_bin_request_new_pad (GstElement * element,
   GstPad *sinkpad, *pad = NULL;
   GstElement *typefind;
   gchar *padname;
+  guint id;
 
   if (templ !=
       gst_element_class_get_pad_template (GST_ELEMENT_CLASS (G_OBJECT_GET_CLASS
@@ -513,7 +543,8 @@ kms_audio_mixer_bin_request_new_pad (GstElement * element,
 
   KMS_AUDIO_MIXER_BIN_LOCK (self);
 
-  padname = g_strdup_printf (AUDIO_MIXER_BIN_SINK_PAD, self->priv->count++);
+  id = self->priv->count++;
+  padname = g_strdup_printf (AUDIO_MIXER_BIN_SINK_PAD, id);
   pad = gst_ghost_pad_new (padname, sinkpad);
   g_object_unref (sinkpad);
   GST_DEBUG ("Creating pad %s", padname);
@@ -533,6 +564,12 @@ kms_audio_mixer_bin_request_new_pad (GstElement * element,
     self->priv->count--;
     pad = NULL;
   } else {
+    GstPad *srcpad = gst_element_get_static_pad (typefind, "src");
+
+    /* Inputs are selected before being converted */
+    kms_speaker_selector_add_input (self->priv->selector, id, srcpad);
+    g_object_unref (srcpad);
+
     g_signal_connect (G_OBJECT (typefind), "have-type",
         G_CALLBACK (kms_audio_mixer_bin_have_type), self);
   }
@@ -545,11 +582,21 @@ kms_audio_mixer_bin_request_new_pad (GstElement * element,
 static void
 kms_audio_mixer_bin_release_pad (GstElement * element, GstPad * pad)
 {
+  KmsAudioMixerBin *self = KMS_AUDIO_MIXER_BIN (element);
+  guint id;
+
   GST_DEBUG ("Unlinked pad %" GST_PTR_FORMAT, pad);
 
   if (gst_pad_get_direction (pad) != GST_PAD_SINK)
     return;
 
+  if (g_str_has_prefix (GST_OBJECT_NAME (pad),
+          AUDIO_MIXER_BIN_SINK_PAD_PREFIX)) {
+    id = g_ascii_strtoull (GST_OBJECT_NAME (pad) +
+        LENGTH_AUDIO_MIXER_BIN_SINK_PAD_PREFIX, NULL, 10);
+    kms_speaker_selector_remove_input (self->priv->selector, id);
+  }
+
   if (GST_STATE (element) >= GST_STATE_PAUSED
       || GST_STATE_PENDING (element) >= GST_STATE_PAUSED
       || GST_STATE_TARGET (element) >= GST_STATE_PAUSED) {
@@ -627,6 +674,9 @@ kms_audio_mixer_bin_dispose (GObject * object)
   kms_audio_mixer_bin_tear_down (self);
   g_clear_object (&self->priv->loop);
 
+  /* Probes can still hold the selector, this element is not notified again */
+  kms_speaker_selector_set_notify (self->priv->selector, NULL, NULL);
+
   KMS_AUDIO_MIXER_BIN_UNLOCK (self);
 
   G_OBJECT_CLASS (kms_audio_mixer_bin_parent_class)->dispose (object);
@@ -639,11 +689,55 @@ kms_audio_mixer_bin_finalize (GObject * object)
 
   GST_DEBUG_OBJECT (self, "finalize");
 
+  kms_speaker_selector_unref (self->priv->selector);
+  g_thread_pool_free (self->priv->remove_pool, FALSE, FALSE);
   g_rec_mutex_clear (&self->priv->mutex);
 
   G_OBJECT_CLASS (kms_audio_mixer_bin_parent_class)->finalize (object);
 }
 
+static void
+kms_audio_mixer_bin_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsAudioMixerBin *self = KMS_AUDIO_MIXER_BIN (object);
+
+  switch (property_id) {
+    case PROP_MAX_ACTIVE_INPUTS:
+      kms_speaker_selector_set_max_active (self->priv->selector,
+          g_value_get_uint (value));
+      break;
+    case PROP_HYSTERESIS:
+      kms_speaker_selector_set_hysteresis (self->priv->selector,
+          g_value_get_double (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_audio_mixer_bin_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsAudioMixerBin *self = KMS_AUDIO_MIXER_BIN (object);
+
+  switch (property_id) {
+    case PROP_MAX_ACTIVE_INPUTS:
+      g_value_set_uint (value,
+          kms_speaker_selector_get_max_active (self->priv->selector));
+      break;
+    case PROP_HYSTERESIS:
+      g_value_set_double (value,
+          kms_speaker_selector_get_hysteresis (self->priv->selector));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
 static void
 kms_audio_mixer_bin_class_init (KmsAudioMixerBinClass * klass)
 {
@@ -666,11 +760,36 @@ kms_audio_mixer_bin_class_init (KmsAudioMixerBinClass * klass)
 
   gobject_class->dispose = GST_DEBUG_FUNCPTR (kms_audio_mixer_bin_dispose);
   gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_audio_mixer_bin_finalize);
+  gobject_class->set_property = kms_audio_mixer_bin_set_property;
+  gobject_class->get_property = kms_audio_mixer_bin_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MAX_ACTIVE_INPUTS,
+      g_param_spec_uint ("max-active-inputs", "Maximum active inputs",
+          "Only the loudest inputs up to this number are mixed, "
+          "0 to mix all of them", 0, G_MAXUINT, DEFAULT_MAX_ACTIVE_INPUTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_HYSTERESIS,
+      g_param_spec_double ("hysteresis", "Hysteresis",
+          "dB an input has to be louder than the quietest active one "
+          "to replace it", 0.0, G_MAXDOUBLE,
+          KMS_SPEAKER_SELECTOR_DEFAULT_HYSTERESIS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsAudioMixerBinPrivate));
 }
 
+static void
+kms_audio_mixer_bin_active_inputs_changed (KmsSpeakerSelector * selector,
+    gpointer data)
+{
+  GstElement *self = GST_ELEMENT (data);
+
+  gst_element_post_message (self, kms_speaker_selector_new_message (selector,
+          GST_OBJECT (self), AUDIO_MIXER_BIN_SINK_PAD));
+}
+
 static void
 kms_audio_mixer_bin_init (KmsAudioMixerBin * self)
 {
@@ -689,7 +808,14 @@ kms_audio_mixer_bin_init (KmsAudioMixerBin * self)
   gst_element_sync_state_with_parent (self->priv->adder);
 
   g_rec_mutex_init (&self->priv->mutex);
-  self->priv->loop = kms_loop_new ();
+  self->priv->loop = kms_loop_new_pooled ();
+  /* Not exclusive, idle threads are shared with every other pool */
+  self->priv->remove_pool =
+      g_thread_pool_new ((GFunc) remove_elements_async, NULL, -1, FALSE, NULL);
+
+  self->priv->selector = kms_speaker_selector_new ();
+  kms_speaker_selector_set_notify (self->priv->selector,
+      kms_audio_mixer_bin_active_inputs_changed, self);
 
   g_object_set (G_OBJECT (self), "async-handling", TRUE, NULL);
 }
@@ -21,6 +21,8 @@
 #include <kmsfilterelement.h>
 #include <kmsaudiomixer.h>
 #include <kmsaudiomixerbin.h>
+#include <kmsmixminus.h>
+#include <kmsfanout.h>
 #include <kmsbitratefilter.h>
 #include <kmsbufferinjector.h>
 #include <kmspassthrough.h>
@@ -50,6 +52,12 @@ kurento_init (GstPlugin * kurento)
   if (!kms_audio_mixer_bin_plugin_init (kurento))
     return FALSE;
 
+  if (!kms_mix_minus_plugin_init (kurento))
+    return FALSE;
+
+  if (!kms_fan_out_plugin_init (kurento))
+    return FALSE;
+
   if (!kms_bitrate_filter_plugin_init (kurento))
     return FALSE;
 
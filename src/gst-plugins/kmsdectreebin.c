@@ -30,17 +30,13 @@ G_DEFINE_TYPE (KmsDecTreeBin, kms_dec_tree_bin, KMS_TYPE_TREE_BIN);
 static GstElement *
 create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
 {
-  GList *decoder_list, *filtered_list, *aux_list, *l;
+  GList *filtered_list, *l;
   GstElementFactory *decoder_factory = NULL;
   GstElement *decoder = NULL;
 
-  decoder_list =
-      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_DECODER,
-      GST_RANK_NONE);
-  aux_list =
-      gst_element_factory_list_filter (decoder_list, caps, GST_PAD_SINK, FALSE);
   filtered_list =
-      gst_element_factory_list_filter (aux_list, raw_caps, GST_PAD_SRC, FALSE);
+      kms_utils_get_element_factories_for_caps (GST_ELEMENT_FACTORY_TYPE_DECODER,
+      caps, raw_caps);
 
   for (l = filtered_list; l != NULL && decoder_factory == NULL; l = l->next) {
     decoder_factory = GST_ELEMENT_FACTORY (l->data);
@@ -53,8 +49,6 @@ create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
   }
 
   gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (decoder_list);
-  gst_plugin_feature_list_free (aux_list);
 
   return decoder;
 }
@@ -64,7 +58,7 @@ kms_dec_tree_bin_configure (KmsDecTreeBin * self, const GstCaps * caps,
     const GstCaps * raw_caps)
 {
   KmsTreeBin *tree_bin = KMS_TREE_BIN (self);
-  GstElement *dec, *output_tee;
+  GstElement *queue, *dec, *output_tee;
   GstPad *pad;
 
   dec = create_decoder_for_caps (caps, raw_caps);
@@ -79,12 +73,16 @@ kms_dec_tree_bin_configure (KmsDecTreeBin * self, const GstCaps * caps,
   kms_utils_drop_until_keyframe (pad, TRUE);
   gst_object_unref (pad);
 
-  gst_bin_add (GST_BIN (self), dec);
+  /* Decodes in its own thread instead of the one of the upstream fan-out */
+  queue = gst_element_factory_make ("queue", NULL);
+
+  gst_bin_add_many (GST_BIN (self), queue, dec, NULL);
   gst_element_sync_state_with_parent (dec);
+  gst_element_sync_state_with_parent (queue);
 
-  kms_tree_bin_set_input_element (tree_bin, dec);
+  kms_tree_bin_set_input_element (tree_bin, queue);
   output_tee = kms_tree_bin_get_output_tee (tree_bin);
-  gst_element_link (dec, output_tee);
+  gst_element_link_many (queue, dec, output_tee, NULL);
 
   return TRUE;
 }
@@ -40,6 +40,14 @@ struct _KmsEncTreeBinPrivate
   GstPad *enc_sink;
   gulong remb_manager_probe_id;
   RembEventManager *remb_manager;
+  gint target_bitrate;
+};
+
+enum
+{
+  PROP_0,
+  PROP_TARGET_BITRATE,
+  N_PROPERTIES
 };
 
 static void
@@ -60,15 +68,13 @@ configure_encoder (GstElement * encoder, const gchar * factory_name,
 static GstElement *
 create_encoder_for_caps (const GstCaps * caps, gint target_bitrate)
 {
-  GList *encoder_list, *filtered_list, *l;
+  GList *filtered_list, *l;
   GstElementFactory *encoder_factory = NULL;
   GstElement *encoder = NULL;
 
-  encoder_list =
-      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_ENCODER,
-      GST_RANK_NONE);
   filtered_list =
-      gst_element_factory_list_filter (encoder_list, caps, GST_PAD_SRC, FALSE);
+      kms_utils_get_element_factories_for_caps (GST_ELEMENT_FACTORY_TYPE_ENCODER,
+      NULL, caps);
 
   for (l = filtered_list; l != NULL && encoder_factory == NULL; l = l->next) {
     encoder_factory = GST_ELEMENT_FACTORY (l->data);
@@ -83,14 +89,15 @@ create_encoder_for_caps (const GstCaps * caps, gint target_bitrate)
   }
 
   gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (encoder_list);
 
   return encoder;
 }
 
-static void
+/* Returns TRUE if the bitrate of the encoder changed */
+static gboolean
 enc_set_target_bitrate (GstElement * enc, gint target_bitrate)
 {
+  gboolean changed = FALSE;
   gchar *name;
 
   g_object_get (enc, "name", &name, NULL);
@@ -102,6 +109,7 @@ enc_set_target_bitrate (GstElement * enc, gint target_bitrate)
     if (last_br / 1000 != target_bitrate / 1000) {
       GST_DEBUG_OBJECT (enc, "Set bitrate: %" G_GUINT32_FORMAT, target_bitrate);
       g_object_set (enc, "target-bitrate", target_bitrate, NULL);
+      changed = TRUE;
     }
   } else if (g_str_has_prefix (name, "x264enc")) {
     gint last_br, new_br = target_bitrate / 1000;
@@ -110,28 +118,37 @@ enc_set_target_bitrate (GstElement * enc, gint target_bitrate)
     if (last_br != new_br) {
       GST_DEBUG_OBJECT (enc, "Set bitrate: %" G_GUINT32_FORMAT, target_bitrate);
       g_object_set (enc, "target-bitrate", new_br, NULL);
+      changed = TRUE;
     }
   }
 
   g_free (name);
+
+  return changed;
 }
 
 static GstPadProbeReturn
 config_enc_bitrate_probe (GstPad * pad, GstPadProbeInfo * info,
     gpointer user_data)
 {
-  RembEventManager *remb_manager = user_data;
+  KmsEncTreeBin *self = user_data;
   GstElement *enc;
-  guint br = kms_utils_remb_event_manager_get_min (remb_manager);
+  guint br = kms_utils_remb_event_manager_get_min (self->priv->remb_manager);
+  gboolean changed;
 
   if (br == 0) {
     return GST_PAD_PROBE_OK;
   }
 
   enc = gst_pad_get_parent_element (pad);
-  enc_set_target_bitrate (enc, br);
+  changed = enc_set_target_bitrate (enc, br);
   g_object_unref (enc);
 
+  if (changed) {
+    g_atomic_int_set (&self->priv->target_bitrate, br);
+    g_object_notify (G_OBJECT (self), "target-bitrate");
+  }
+
   return GST_PAD_PROBE_OK;
 }
 
@@ -196,7 +213,8 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
     gint target_bitrate)
 {
   KmsTreeBin *tree_bin = KMS_TREE_BIN (self);
-  GstElement *rate, *convert, *mediator, *enc, *output_tee, *capsfilter;
+  GstElement *queue, *rate, *convert, *mediator, *enc, *output_tee;
+  GstElement *capsfilter;
   gboolean is_h264;
 
   enc = create_encoder_for_caps (caps, target_bitrate);
@@ -211,23 +229,27 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
   is_h264 = g_str_has_prefix (GST_OBJECT_NAME (enc), "x264");
 
   GST_DEBUG_OBJECT (self, "Encoder found: %" GST_PTR_FORMAT, enc);
+  self->priv->target_bitrate = target_bitrate;
 
   self->priv->enc_sink = gst_element_get_static_pad (enc, "sink");
   self->priv->remb_manager =
       kms_utils_remb_event_manager_create (self->priv->enc_sink);
   self->priv->remb_manager_probe_id =
       gst_pad_add_probe (self->priv->enc_sink, GST_PAD_PROBE_TYPE_BUFFER,
-      config_enc_bitrate_probe, self->priv->remb_manager, NULL);
+      config_enc_bitrate_probe, self, NULL);
 
   rate = kms_utils_create_rate_for_caps (caps);
   convert = kms_utils_create_convert_for_caps (caps);
   mediator = kms_utils_create_mediator_element (caps);
+  /* Encodes in its own thread instead of the one of the upstream fan-out */
+  queue = gst_element_factory_make ("queue", NULL);
 
-  gst_bin_add_many (GST_BIN (self), rate, convert, mediator, enc, NULL);
+  gst_bin_add_many (GST_BIN (self), queue, rate, convert, mediator, enc, NULL);
   gst_element_sync_state_with_parent (enc);
   gst_element_sync_state_with_parent (mediator);
   gst_element_sync_state_with_parent (convert);
   gst_element_sync_state_with_parent (rate);
+  gst_element_sync_state_with_parent (queue);
   if (is_h264) {
     GstCaps *filter_caps = gst_caps_from_string ("video/x-raw,format=I420");
     GstPad *sink;
@@ -245,13 +267,14 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
     gst_element_sync_state_with_parent (capsfilter);
   }
 
-  kms_tree_bin_set_input_element (tree_bin, rate);
+  kms_tree_bin_set_input_element (tree_bin, queue);
   output_tee = kms_tree_bin_get_output_tee (tree_bin);
   if (is_h264) {
-    gst_element_link_many (rate, convert, mediator, capsfilter, enc, output_tee,
-        NULL);
+    gst_element_link_many (queue, rate, convert, mediator, capsfilter, enc,
+        output_tee, NULL);
   } else {
-    gst_element_link_many (rate, convert, mediator, enc, output_tee, NULL);
+    gst_element_link_many (queue, rate, convert, mediator, enc, output_tee,
+        NULL);
   }
 
   return TRUE;
@@ -282,6 +305,22 @@ kms_enc_tree_bin_init (KmsEncTreeBin * self)
   self->priv->remb_manager_probe_id = 0L;
 }
 
+static void
+kms_enc_tree_bin_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsEncTreeBin *self = KMS_ENC_TREE_BIN (object);
+
+  switch (property_id) {
+    case PROP_TARGET_BITRATE:
+      g_value_set_int (value, g_atomic_int_get (&self->priv->target_bitrate));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
 static void
 kms_enc_tree_bin_dispose (GObject * object)
 {
@@ -324,6 +363,12 @@ kms_enc_tree_bin_class_init (KmsEncTreeBinClass * klass)
       GST_DEFAULT_NAME);
 
   gobject_class->dispose = kms_enc_tree_bin_dispose;
+  gobject_class->get_property = kms_enc_tree_bin_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_TARGET_BITRATE,
+      g_param_spec_int ("target-bitrate", "Target bitrate",
+          "Bitrate the encoder is configured to, adapted to REMB feedback",
+          0, G_MAXINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
   g_type_class_add_private (klass, sizeof (KmsEncTreeBinPrivate));
 }
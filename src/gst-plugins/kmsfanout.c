@@ -0,0 +1,773 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <string.h>
+
+#include "kmsfanout.h"
+#include "kmsrefstruct.h"
+#include "kmsutils.h"
+
+#define PLUGIN_NAME "kmsfanout"
+
+#define SRC_PAD_PREFIX "src_"
+
+#define DEFAULT_MAX_SIZE_BUFFERS 200
+
+/* Items pushed on a pad before giving way to the other pads of the pool */
+#define MAX_BATCH 16
+
+GST_DEBUG_CATEGORY_STATIC (kms_fan_out_debug_category);
+#define GST_CAT_DEFAULT kms_fan_out_debug_category
+
+#define KMS_FAN_OUT_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (        \
+    (obj),                             \
+    KMS_TYPE_FAN_OUT,                  \
+    KmsFanOutPrivate                   \
+  )                                    \
+)
+
+typedef struct _KmsFanOutOutput
+{
+  KmsRefStruct ref;
+  KmsFanOut *self;
+  GstPad *pad;
+
+  /* Protected by the object lock of the fan-out */
+  guint64 cursor;
+  gboolean lapped;
+  gboolean scheduled;
+  gboolean removed;
+} KmsFanOutOutput;
+
+typedef struct _KmsFanOutSlot
+{
+  GstMiniObject *item;
+  /* Outputs that have not read the item yet */
+  guint pending;
+} KmsFanOutSlot;
+
+struct _KmsFanOutPrivate
+{
+  GstPad *sink;
+
+  /* Protected by the object lock */
+  KmsFanOutSlot *ring;
+  guint size;
+  guint64 head;
+  GList *outputs;
+  guint n_outputs;
+  GList *sticky;
+  guint pad_count;
+};
+
+enum
+{
+  PROP_0,
+  PROP_MAX_SIZE_BUFFERS,
+  N_PROPERTIES
+};
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_factory =
+GST_STATIC_PAD_TEMPLATE (SRC_PAD_PREFIX "%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS_ANY);
+
+/* Pushes on the pads of every fan-out, sized to the number of processors */
+static GThreadPool *push_pool = NULL;
+
+G_DEFINE_TYPE_WITH_CODE (KmsFanOut, kms_fan_out,
+    GST_TYPE_ELEMENT,
+    GST_DEBUG_CATEGORY_INIT (kms_fan_out_debug_category,
+        PLUGIN_NAME, 0, "debug category for " PLUGIN_NAME " element"));
+
+static void
+kms_fan_out_output_destroy (KmsFanOutOutput * output)
+{
+  g_object_unref (output->pad);
+  g_slice_free (KmsFanOutOutput, output);
+}
+
+static gboolean
+is_same_sticky (GstEvent * a, GstEvent * b)
+{
+  if (GST_EVENT_TYPE (a) != GST_EVENT_TYPE (b)) {
+    return FALSE;
+  }
+
+  if (GST_EVENT_TYPE (a) != GST_EVENT_CUSTOM_DOWNSTREAM_STICKY) {
+    return TRUE;
+  }
+
+  return gst_event_has_name (a, gst_structure_get_name
+      (gst_event_get_structure (b)));
+}
+
+/* Called with the object lock held */
+static void
+kms_fan_out_remove_sticky (KmsFanOut * self, GstEventType type)
+{
+  GList *l = self->priv->sticky;
+
+  while (l != NULL) {
+    GList *next = l->next;
+
+    if (GST_EVENT_TYPE (l->data) == type) {
+      gst_event_unref (l->data);
+      self->priv->sticky = g_list_delete_link (self->priv->sticky, l);
+    }
+
+    l = next;
+  }
+}
+
+/* Called with the object lock held */
+static void
+kms_fan_out_update_sticky (KmsFanOut * self, GstEvent * event)
+{
+  GList *l;
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_STREAM_START) {
+    kms_fan_out_remove_sticky (self, GST_EVENT_EOS);
+  }
+
+  for (l = self->priv->sticky; l != NULL; l = l->next) {
+    if (is_same_sticky (l->data, event)) {
+      gst_event_unref (l->data);
+      l->data = gst_event_ref (event);
+      return;
+    }
+  }
+
+  self->priv->sticky = g_list_append (self->priv->sticky,
+      gst_event_ref (event));
+}
+
+/* Called with the object lock held */
+static GList *
+kms_fan_out_copy_sticky (KmsFanOut * self)
+{
+  return g_list_copy_deep (self->priv->sticky, (GCopyFunc) gst_event_ref,
+      NULL);
+}
+
+/* Consumes @sticky */
+static void
+kms_fan_out_store_sticky (GstPad * pad, GList * sticky)
+{
+  GList *l;
+
+  for (l = sticky; l != NULL; l = l->next) {
+    gst_pad_store_sticky_event (pad, l->data);
+  }
+
+  g_list_free_full (sticky, (GDestroyNotify) gst_event_unref);
+}
+
+/* Called with the object lock held */
+static void
+kms_fan_out_schedule (KmsFanOut * self, KmsFanOutOutput * output)
+{
+  if (output->scheduled || output->removed) {
+    return;
+  }
+
+  /* The task keeps both alive until the output is up to date */
+  output->scheduled = TRUE;
+  gst_object_ref (self);
+  kms_ref_struct_ref (KMS_REF_STRUCT_CAST (output));
+  g_thread_pool_push (push_pool, output, NULL);
+}
+
+static void
+kms_fan_out_release_items (GList * items)
+{
+  g_list_free_full (items, (GDestroyNotify) gst_mini_object_unref);
+}
+
+/* Called with the object lock held */
+static guint64
+kms_fan_out_oldest (KmsFanOut * self)
+{
+  if (self->priv->head > self->priv->size) {
+    return self->priv->head - self->priv->size;
+  }
+
+  return 0;
+}
+
+/* Called with the object lock held, @items gets the slots nobody needs */
+static void
+kms_fan_out_slot_read (KmsFanOut * self, guint64 index, GList ** items)
+{
+  KmsFanOutSlot *slot = &self->priv->ring[index % self->priv->size];
+
+  if (slot->item == NULL || --slot->pending > 0) {
+    return;
+  }
+
+  *items = g_list_prepend (*items, slot->item);
+  slot->item = NULL;
+}
+
+/* Called with the object lock held, moves @output to @to without reading */
+static void
+kms_fan_out_skip (KmsFanOut * self, KmsFanOutOutput * output, guint64 to,
+    GList ** items)
+{
+  guint64 i;
+
+  for (i = MAX (output->cursor, kms_fan_out_oldest (self)); i < to; i++) {
+    kms_fan_out_slot_read (self, i, items);
+  }
+
+  output->cursor = to;
+}
+
+/* Called with the object lock held, returns the items to be released */
+static GList *
+kms_fan_out_discard_pending (KmsFanOut * self)
+{
+  GList *items = NULL;
+  GList *l;
+
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    kms_fan_out_skip (self, l->data, self->priv->head, &items);
+  }
+
+  return items;
+}
+
+/* Called with the object lock held, returns the items to be released */
+static GList *
+kms_fan_out_clear_ring (KmsFanOut * self)
+{
+  GList *items = kms_fan_out_discard_pending (self);
+  guint i;
+
+  for (i = 0; i < self->priv->size; i++) {
+    if (self->priv->ring[i].item != NULL) {
+      items = g_list_prepend (items, self->priv->ring[i].item);
+      self->priv->ring[i].item = NULL;
+    }
+  }
+
+  return items;
+}
+
+/* Called with the object lock held, keeps the newest items that fit */
+static GList *
+kms_fan_out_resize (KmsFanOut * self, guint size)
+{
+  KmsFanOutSlot *ring = g_new0 (KmsFanOutSlot, size);
+  GList *items = NULL;
+  guint64 kept = MIN (MIN (self->priv->head, self->priv->size), size);
+  guint64 i;
+  GList *l;
+
+  for (i = self->priv->head - kept; i < self->priv->head; i++) {
+    ring[i % size] = self->priv->ring[i % self->priv->size];
+    self->priv->ring[i % self->priv->size].item = NULL;
+  }
+
+  for (i = 0; i < self->priv->size; i++) {
+    if (self->priv->ring[i].item != NULL) {
+      items = g_list_prepend (items, self->priv->ring[i].item);
+    }
+  }
+
+  /* Items out of the new ring are lost, these outputs resync as lapped */
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    KmsFanOutOutput *output = l->data;
+
+    if (output->cursor < self->priv->head - kept) {
+      output->cursor = self->priv->head - kept;
+      output->lapped = TRUE;
+    }
+  }
+
+  g_free (self->priv->ring);
+  self->priv->ring = ring;
+  self->priv->size = size;
+
+  return items;
+}
+
+static void
+kms_fan_out_write (KmsFanOut * self, GstMiniObject * item)
+{
+  KmsFanOutSlot *slot;
+  GstMiniObject *old;
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+
+  if (GST_IS_EVENT (item) && GST_EVENT_IS_STICKY (GST_EVENT_CAST (item))) {
+    kms_fan_out_update_sticky (self, GST_EVENT_CAST (item));
+  }
+
+  if (self->priv->n_outputs == 0) {
+    /* Nobody to read it, sticky events are replayed to new outputs */
+    self->priv->head++;
+    GST_OBJECT_UNLOCK (self);
+    gst_mini_object_unref (item);
+    return;
+  }
+
+  /* Only set if a lapped output did not read it yet */
+  slot = &self->priv->ring[self->priv->head % self->priv->size];
+  old = slot->item;
+  slot->item = item;
+  slot->pending = self->priv->n_outputs;
+  self->priv->head++;
+
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    kms_fan_out_schedule (self, l->data);
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  if (old != NULL) {
+    gst_mini_object_unref (old);
+  }
+}
+
+static void
+kms_fan_out_push_item (KmsFanOutOutput * output, GstMiniObject * item)
+{
+  if (GST_IS_BUFFER (item)) {
+    GstFlowReturn ret;
+
+    ret = gst_pad_push (output->pad, GST_BUFFER_CAST (item));
+
+    if (G_UNLIKELY (ret != GST_FLOW_OK)) {
+      GST_LOG_OBJECT (output->pad, "Push returned: %s",
+          gst_flow_get_name (ret));
+    }
+  } else {
+    gst_pad_push_event (output->pad, GST_EVENT_CAST (item));
+  }
+}
+
+/* Runs in the pool, only one task per output is queued at a time */
+static void
+kms_fan_out_service (gpointer data, gpointer not_used)
+{
+  KmsFanOutOutput *output = data;
+  KmsFanOut *self = output->self;
+  guint pushed;
+
+  GST_PAD_STREAM_LOCK (output->pad);
+
+  for (pushed = 0; pushed < MAX_BATCH; pushed++) {
+    GstMiniObject *item;
+    GList *items = NULL;
+
+    GST_OBJECT_LOCK (self);
+
+    if (output->removed || output->cursor == self->priv->head) {
+      output->scheduled = FALSE;
+      GST_OBJECT_UNLOCK (self);
+      goto done;
+    }
+
+    if (output->lapped || self->priv->head - output->cursor >
+        self->priv->size) {
+      GList *sticky;
+
+      GST_DEBUG_OBJECT (output->pad, "Too slow, skipping %" G_GUINT64_FORMAT
+          " items", self->priv->head - output->cursor);
+
+      output->lapped = FALSE;
+      kms_fan_out_skip (self, output, self->priv->head, &items);
+      sticky = kms_fan_out_copy_sticky (self);
+      GST_OBJECT_UNLOCK (self);
+
+      kms_fan_out_release_items (items);
+
+      /* Resume from a key frame with the current stream configuration */
+      kms_fan_out_store_sticky (output->pad, sticky);
+      kms_utils_drop_until_keyframe (output->pad, FALSE);
+      continue;
+    }
+
+    item = self->priv->ring[output->cursor % self->priv->size].item;
+    if (item != NULL) {
+      gst_mini_object_ref (item);
+    }
+    kms_fan_out_slot_read (self, output->cursor, &items);
+    output->cursor++;
+
+    GST_OBJECT_UNLOCK (self);
+
+    kms_fan_out_release_items (items);
+
+    if (item != NULL) {
+      kms_fan_out_push_item (output, item);
+    }
+  }
+
+  /* Pending items are left for a new task, queued behind the other pads */
+  GST_PAD_STREAM_UNLOCK (output->pad);
+  g_thread_pool_push (push_pool, output, NULL);
+
+  return;
+
+done:
+  GST_PAD_STREAM_UNLOCK (output->pad);
+
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (output));
+  gst_object_unref (self);
+}
+
+static GstFlowReturn
+kms_fan_out_sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  kms_fan_out_write (KMS_FAN_OUT (parent), GST_MINI_OBJECT_CAST (buffer));
+
+  /* Each output drops on its own, upstream is never slowed down */
+  return GST_FLOW_OK;
+}
+
+static gboolean
+kms_fan_out_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  KmsFanOut *self = KMS_FAN_OUT (parent);
+  GList *items;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      GST_OBJECT_LOCK (self);
+      items = kms_fan_out_discard_pending (self);
+      GST_OBJECT_UNLOCK (self);
+      kms_fan_out_release_items (items);
+      return gst_pad_event_default (pad, parent, event);
+    case GST_EVENT_FLUSH_STOP:
+      GST_OBJECT_LOCK (self);
+      items = kms_fan_out_discard_pending (self);
+      kms_fan_out_remove_sticky (self, GST_EVENT_SEGMENT);
+      kms_fan_out_remove_sticky (self, GST_EVENT_EOS);
+      GST_OBJECT_UNLOCK (self);
+      kms_fan_out_release_items (items);
+      return gst_pad_event_default (pad, parent, event);
+    default:
+      break;
+  }
+
+  if (!GST_EVENT_IS_SERIALIZED (event)) {
+    return gst_pad_event_default (pad, parent, event);
+  }
+
+  kms_fan_out_write (self, GST_MINI_OBJECT_CAST (event));
+
+  return TRUE;
+}
+
+static gboolean
+kms_fan_out_sink_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_ALLOCATION:
+      /* Buffers are shared by all outputs, upstream chooses how to allocate */
+      return FALSE;
+    case GST_QUERY_DRAIN:
+      return TRUE;
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static GstPad *
+kms_fan_out_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  KmsFanOut *self = KMS_FAN_OUT (element);
+  KmsFanOutOutput *output;
+  GList *sticky;
+  gchar *pad_name;
+  GstPad *pad;
+
+  if (name != NULL) {
+    pad = gst_element_get_static_pad (element, name);
+
+    if (pad != NULL) {
+      GST_WARNING_OBJECT (self, "Pad %s already exists", name);
+      g_object_unref (pad);
+
+      return NULL;
+    }
+  }
+
+  GST_OBJECT_LOCK (self);
+  if (name != NULL) {
+    /* Like tee, automatic names never reuse an index picked by the caller */
+    if (g_str_has_prefix (name, SRC_PAD_PREFIX)) {
+      const gchar *index = name + strlen (SRC_PAD_PREFIX);
+      gchar *end;
+      guint64 n;
+
+      n = g_ascii_strtoull (index, &end, 10);
+
+      if (end != index && *end == '\0' && n >= self->priv->pad_count
+          && n < G_MAXUINT) {
+        self->priv->pad_count = n + 1;
+      }
+    }
+
+    pad_name = g_strdup (name);
+  } else {
+    pad_name = g_strdup_printf (SRC_PAD_PREFIX "%u", self->priv->pad_count++);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  pad = gst_pad_new_from_template (templ, pad_name);
+  g_free (pad_name);
+
+  GST_PAD_SET_PROXY_CAPS (pad);
+
+  output = g_slice_new0 (KmsFanOutOutput);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (output),
+      (GDestroyNotify) kms_fan_out_output_destroy);
+  output->self = self;
+  output->pad = g_object_ref (pad);
+  gst_pad_set_element_private (pad, output);
+
+  if (GST_STATE (element) >= GST_STATE_PAUSED
+      || GST_STATE_PENDING (element) >= GST_STATE_PAUSED
+      || GST_STATE_TARGET (element) >= GST_STATE_PAUSED) {
+    gst_pad_set_active (pad, TRUE);
+  }
+
+  /* Counted as reader from now on, but held unscheduled until the sticky
+   * events are stored so that they are not overwritten */
+  GST_OBJECT_LOCK (self);
+  output->cursor = self->priv->head;
+  output->scheduled = TRUE;
+  self->priv->outputs = g_list_prepend (self->priv->outputs, output);
+  self->priv->n_outputs++;
+  sticky = kms_fan_out_copy_sticky (self);
+  GST_OBJECT_UNLOCK (self);
+
+  kms_fan_out_store_sticky (pad, sticky);
+
+  GST_OBJECT_LOCK (self);
+  output->scheduled = FALSE;
+  if (output->cursor != self->priv->head) {
+    kms_fan_out_schedule (self, output);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  gst_element_add_pad (element, pad);
+
+  return pad;
+}
+
+static void
+kms_fan_out_release_pad (GstElement * element, GstPad * pad)
+{
+  KmsFanOut *self = KMS_FAN_OUT (element);
+  KmsFanOutOutput *output = gst_pad_get_element_private (pad);
+  GList *items = NULL;
+
+  GST_DEBUG_OBJECT (self, "Release pad %" GST_PTR_FORMAT, pad);
+
+  GST_OBJECT_LOCK (self);
+  self->priv->outputs = g_list_remove (self->priv->outputs, output);
+  self->priv->n_outputs--;
+  output->removed = TRUE;
+  /* Items only this output was waiting for are released now */
+  kms_fan_out_skip (self, output, self->priv->head, &items);
+  GST_OBJECT_UNLOCK (self);
+
+  kms_fan_out_release_items (items);
+
+  /* Waits for the item being pushed, if any */
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (output));
+}
+
+static GstStateChangeReturn
+kms_fan_out_change_state (GstElement * element, GstStateChange transition)
+{
+  KmsFanOut *self = KMS_FAN_OUT (element);
+  GstStateChangeReturn ret;
+  GList *items, *sticky;
+
+  ret = GST_ELEMENT_CLASS (kms_fan_out_parent_class)->change_state (element,
+      transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      GST_OBJECT_LOCK (self);
+      items = kms_fan_out_clear_ring (self);
+      sticky = self->priv->sticky;
+      self->priv->sticky = NULL;
+      GST_OBJECT_UNLOCK (self);
+
+      kms_fan_out_release_items (items);
+      g_list_free_full (sticky, (GDestroyNotify) gst_event_unref);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static void
+kms_fan_out_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsFanOut *self = KMS_FAN_OUT (object);
+  GList *items = NULL;
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_MAX_SIZE_BUFFERS:
+      items = kms_fan_out_resize (self, g_value_get_uint (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  kms_fan_out_release_items (items);
+}
+
+static void
+kms_fan_out_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsFanOut *self = KMS_FAN_OUT (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_MAX_SIZE_BUFFERS:
+      g_value_set_uint (value, self->priv->size);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_fan_out_finalize (GObject * object)
+{
+  KmsFanOut *self = KMS_FAN_OUT (object);
+  GList *l;
+
+  GST_DEBUG_OBJECT (self, "finalize");
+
+  /* Pads not released are removed by the parent class without notice */
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    ((KmsFanOutOutput *) l->data)->removed = TRUE;
+  }
+
+  kms_fan_out_release_items (kms_fan_out_clear_ring (self));
+  g_list_free_full (self->priv->outputs,
+      (GDestroyNotify) kms_ref_struct_unref);
+  g_list_free_full (self->priv->sticky, (GDestroyNotify) gst_event_unref);
+  g_free (self->priv->ring);
+
+  G_OBJECT_CLASS (kms_fan_out_parent_class)->finalize (object);
+}
+
+static void
+kms_fan_out_class_init (KmsFanOutClass * klass)
+{
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "FanOut", "Generic",
+      "Pushes its input to every output from a ring shared by all of them",
+      "Kurento <kurento@googlegroups.com>");
+
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (kms_fan_out_request_new_pad);
+  gstelement_class->release_pad = GST_DEBUG_FUNCPTR (kms_fan_out_release_pad);
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR (kms_fan_out_change_state);
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_factory));
+
+  gobject_class->set_property = kms_fan_out_set_property;
+  gobject_class->get_property = kms_fan_out_get_property;
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_fan_out_finalize);
+
+  g_object_class_install_property (gobject_class, PROP_MAX_SIZE_BUFFERS,
+      g_param_spec_uint ("max-size-buffers", "Max size buffers",
+          "Items kept for each output before it starts dropping",
+          1, G_MAXUINT, DEFAULT_MAX_SIZE_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  push_pool = g_thread_pool_new (kms_fan_out_service, NULL,
+      MAX (g_get_num_processors (), 1), FALSE, NULL);
+
+  /* Registers a private structure for the instantiatable type */
+  g_type_class_add_private (klass, sizeof (KmsFanOutPrivate));
+}
+
+static void
+kms_fan_out_init (KmsFanOut * self)
+{
+  GstPadTemplate *templ;
+
+  self->priv = KMS_FAN_OUT_GET_PRIVATE (self);
+
+  self->priv->size = DEFAULT_MAX_SIZE_BUFFERS;
+  self->priv->ring = g_new0 (KmsFanOutSlot, self->priv->size);
+
+  templ = gst_static_pad_template_get (&sink_factory);
+  self->priv->sink = gst_pad_new_from_template (templ, "sink");
+  g_object_unref (templ);
+
+  GST_PAD_SET_PROXY_CAPS (self->priv->sink);
+  gst_pad_set_chain_function (self->priv->sink,
+      GST_DEBUG_FUNCPTR (kms_fan_out_sink_chain));
+  gst_pad_set_event_function (self->priv->sink,
+      GST_DEBUG_FUNCPTR (kms_fan_out_sink_event));
+  gst_pad_set_query_function (self->priv->sink,
+      GST_DEBUG_FUNCPTR (kms_fan_out_sink_query));
+
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->sink);
+}
+
+gboolean
+kms_fan_out_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_FAN_OUT);
+}
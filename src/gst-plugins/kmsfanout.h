@@ -0,0 +1,80 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_FAN_OUT_H_
+#define _KMS_FAN_OUT_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+#define KMS_TYPE_FAN_OUT kms_fan_out_get_type()
+
+#define KMS_FAN_OUT(obj) ( \
+  G_TYPE_CHECK_INSTANCE_CAST(  \
+    (obj),                     \
+    KMS_TYPE_FAN_OUT,          \
+    KmsFanOut                  \
+  )                            \
+)
+
+#define KMS_FAN_OUT_CLASS(klass) ( \
+  G_TYPE_CHECK_CLASS_CAST (        \
+    (klass),                       \
+    KMS_TYPE_FAN_OUT,              \
+    KmsFanOutClass                 \
+  )                                \
+)
+#define KMS_IS_FAN_OUT(obj) ( \
+  G_TYPE_CHECK_INSTANCE_TYPE (  \
+    (obj),                      \
+    KMS_TYPE_FAN_OUT            \
+  )                             \
+)
+#define KMS_IS_FAN_OUT_CLASS(klass) ( \
+  G_TYPE_CHECK_CLASS_TYPE((klass),    \
+  KMS_TYPE_FAN_OUT)                   \
+)
+
+typedef struct _KmsFanOut KmsFanOut;
+typedef struct _KmsFanOutClass KmsFanOutClass;
+typedef struct _KmsFanOutPrivate KmsFanOutPrivate;
+
+/**
+ * KmsFanOut:
+ *
+ * Replacement for tee + queue when a stream has many consumers. Input is
+ * stored once in a ring shared by every src_%u pad, each pad reads it through
+ * its own cursor from a small pool of threads shared by all fan-outs. A pad
+ * that falls behind more than max-size-buffers skips to the newest data
+ * without slowing down the others.
+ */
+struct _KmsFanOut
+{
+  GstElement parent;
+
+  /*< private > */
+  KmsFanOutPrivate *priv;
+};
+
+struct _KmsFanOutClass
+{
+  GstElementClass parent_class;
+};
+
+GType kms_fan_out_get_type (void);
+
+gboolean kms_fan_out_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif /* _KMS_FAN_OUT_H_ */
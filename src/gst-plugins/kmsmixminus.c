@@ -0,0 +1,1307 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/base/gstaggregator.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define KMS_MIX_MINUS_NEON
+#endif
+
+#include "kmsmixminus.h"
+
+#define PLUGIN_NAME "kmsmixminus"
+
+#define SINK_PAD_PREFIX "sink_"
+#define SRC_PAD_PREFIX "src_"
+
+#define FRAME_DURATION (10 * GST_MSECOND)
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define FORMAT_S16 "S16LE"
+#define FORMAT_F32 "F32LE"
+#else
+#define FORMAT_S16 "S16BE"
+#define FORMAT_F32 "F32BE"
+#endif
+
+#define MIX_MINUS_CAPS                                        \
+  "audio/x-raw, "                                             \
+  "format = (string) { " FORMAT_S16 ", " FORMAT_F32 " }, "    \
+  "layout = (string) interleaved, "                           \
+  "rate = (int) [ 1, MAX ], "                                 \
+  "channels = (int) [ 1, MAX ]"
+
+GST_DEBUG_CATEGORY_STATIC (kms_mix_minus_debug_category);
+#define GST_CAT_DEFAULT kms_mix_minus_debug_category
+
+#define KMS_MIX_MINUS_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (          \
+    (obj),                               \
+    KMS_TYPE_MIX_MINUS,                  \
+    KmsMixMinusPrivate                   \
+  )                                      \
+)
+
+#define KMS_TYPE_MIX_MINUS_PAD kms_mix_minus_pad_get_type()
+
+#define KMS_MIX_MINUS_PAD(obj) ( \
+  G_TYPE_CHECK_INSTANCE_CAST (   \
+    (obj),                       \
+    KMS_TYPE_MIX_MINUS_PAD,      \
+    KmsMixMinusPad               \
+  )                              \
+)
+
+typedef struct _KmsMixMinusPad
+{
+  GstAggregatorPad parent;
+
+  guint id;
+
+  /* Only accessed from the aggregation thread */
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gsize position;
+
+  /* Samples of the frame being mixed, zero where the input had no data */
+  guint8 *frame;
+  gsize frame_size;
+  gsize filled;
+  gboolean contributed;
+} KmsMixMinusPad;
+
+typedef struct _KmsMixMinusPadClass
+{
+  GstAggregatorPadClass parent_class;
+} KmsMixMinusPadClass;
+
+GType kms_mix_minus_pad_get_type (void);
+
+G_DEFINE_TYPE (KmsMixMinusPad, kms_mix_minus_pad, GST_TYPE_AGGREGATOR_PAD);
+
+typedef struct _KmsMixMinusOutput
+{
+  GstPad *pad;
+  guint id;
+  gboolean stream_start;
+  gboolean caps;
+  gboolean segment;
+} KmsMixMinusOutput;
+
+struct _KmsMixMinusPrivate
+{
+  /* Protected by the object lock */
+  GList *outputs;
+  GstCaps *caps;
+  gboolean is_float;
+  gint rate;
+  gint bpf;
+
+  /* Running time of the first frame and samples mixed since then */
+  GstClockTime base_time;
+  guint64 offset;
+
+  /* Only accessed from the aggregation thread */
+  gpointer total;
+  gsize total_size;
+};
+
+static GstStaticPadTemplate sink_factory =
+GST_STATIC_PAD_TEMPLATE (SINK_PAD_PREFIX "%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (MIX_MINUS_CAPS)
+    );
+
+static GstStaticPadTemplate src_factory =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (MIX_MINUS_CAPS)
+    );
+
+static GstStaticPadTemplate output_factory =
+GST_STATIC_PAD_TEMPLATE (SRC_PAD_PREFIX "%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (MIX_MINUS_CAPS)
+    );
+
+G_DEFINE_TYPE_WITH_CODE (KmsMixMinus, kms_mix_minus,
+    GST_TYPE_AGGREGATOR,
+    GST_DEBUG_CATEGORY_INIT (kms_mix_minus_debug_category,
+        PLUGIN_NAME, 0, "debug category for " PLUGIN_NAME " element"));
+
+/*
+ * Mixing kernels. Samples of every input are added once to a wider
+ * accumulator and each output is produced subtracting the contribution of
+ * its own input, so mixing N inputs into N outputs is O(N) per sample.
+ */
+
+static void
+mix_s16_accumulate (gint32 * total, const gint16 * in, guint n)
+{
+  guint i = 0;
+
+#if defined (__SSE2__)
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) (in + i));
+    __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16);
+    __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16);
+    __m128i t0 = _mm_loadu_si128 ((const __m128i *) (total + i));
+    __m128i t1 = _mm_loadu_si128 ((const __m128i *) (total + i + 4));
+
+    _mm_storeu_si128 ((__m128i *) (total + i), _mm_add_epi32 (t0, lo));
+    _mm_storeu_si128 ((__m128i *) (total + i + 4), _mm_add_epi32 (t1, hi));
+  }
+#elif defined (KMS_MIX_MINUS_NEON)
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t v = vld1q_s16 (in + i);
+
+    vst1q_s32 (total + i, vaddw_s16 (vld1q_s32 (total + i),
+            vget_low_s16 (v)));
+    vst1q_s32 (total + i + 4, vaddw_s16 (vld1q_s32 (total + i + 4),
+            vget_high_s16 (v)));
+  }
+#endif
+
+  for (; i < n; i++) {
+    total[i] += in[i];
+  }
+}
+
+/* @own can be NULL for outputs without input */
+static void
+mix_s16_minus (gint16 * out, const gint32 * total, const gint16 * own,
+    guint n)
+{
+  guint i = 0;
+
+#if defined (__SSE2__)
+  for (; i + 8 <= n; i += 8) {
+    __m128i t0 = _mm_loadu_si128 ((const __m128i *) (total + i));
+    __m128i t1 = _mm_loadu_si128 ((const __m128i *) (total + i + 4));
+
+    if (own != NULL) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (own + i));
+
+      t0 = _mm_sub_epi32 (t0, _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16));
+      t1 = _mm_sub_epi32 (t1, _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16));
+    }
+
+    _mm_storeu_si128 ((__m128i *) (out + i), _mm_packs_epi32 (t0, t1));
+  }
+#elif defined (KMS_MIX_MINUS_NEON)
+  for (; i + 8 <= n; i += 8) {
+    int32x4_t t0 = vld1q_s32 (total + i);
+    int32x4_t t1 = vld1q_s32 (total + i + 4);
+
+    if (own != NULL) {
+      int16x8_t v = vld1q_s16 (own + i);
+
+      t0 = vsubw_s16 (t0, vget_low_s16 (v));
+      t1 = vsubw_s16 (t1, vget_high_s16 (v));
+    }
+
+    vst1q_s16 (out + i, vcombine_s16 (vqmovn_s32 (t0), vqmovn_s32 (t1)));
+  }
+#endif
+
+  for (; i < n; i++) {
+    gint32 v = total[i] - (own != NULL ? own[i] : 0);
+
+    out[i] = CLAMP (v, G_MININT16, G_MAXINT16);
+  }
+}
+
+static void
+mix_f32_accumulate (gfloat * total, const gfloat * in, guint n)
+{
+  guint i = 0;
+
+#if defined (__SSE2__)
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps (total + i, _mm_add_ps (_mm_loadu_ps (total + i),
+            _mm_loadu_ps (in + i)));
+  }
+#elif defined (KMS_MIX_MINUS_NEON)
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32 (total + i, vaddq_f32 (vld1q_f32 (total + i),
+            vld1q_f32 (in + i)));
+  }
+#endif
+
+  for (; i < n; i++) {
+    total[i] += in[i];
+  }
+}
+
+static void
+mix_f32_minus (gfloat * out, const gfloat * total, const gfloat * own,
+    guint n)
+{
+  guint i = 0;
+
+  if (own == NULL) {
+    memcpy (out, total, n * sizeof (gfloat));
+    return;
+  }
+#if defined (__SSE2__)
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps (out + i, _mm_sub_ps (_mm_loadu_ps (total + i),
+            _mm_loadu_ps (own + i)));
+  }
+#elif defined (KMS_MIX_MINUS_NEON)
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32 (out + i, vsubq_f32 (vld1q_f32 (total + i),
+            vld1q_f32 (own + i)));
+  }
+#endif
+
+  for (; i < n; i++) {
+    out[i] = total[i] - own[i];
+  }
+}
+
+static void
+kms_mix_minus_pad_release_buffer (KmsMixMinusPad * pad)
+{
+  if (pad->buffer != NULL) {
+    gst_buffer_unmap (pad->buffer, &pad->map);
+    gst_buffer_unref (pad->buffer);
+    pad->buffer = NULL;
+  }
+
+  pad->position = 0;
+}
+
+static void
+kms_mix_minus_pad_reset (KmsMixMinusPad * pad)
+{
+  kms_mix_minus_pad_release_buffer (pad);
+  pad->filled = 0;
+  pad->contributed = FALSE;
+}
+
+static void
+kms_mix_minus_pad_finalize (GObject * object)
+{
+  KmsMixMinusPad *pad = KMS_MIX_MINUS_PAD (object);
+
+  kms_mix_minus_pad_reset (pad);
+  g_free (pad->frame);
+
+  G_OBJECT_CLASS (kms_mix_minus_pad_parent_class)->finalize (object);
+}
+
+static void
+kms_mix_minus_pad_class_init (KmsMixMinusPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_mix_minus_pad_finalize);
+}
+
+static void
+kms_mix_minus_pad_init (KmsMixMinusPad * pad)
+{
+}
+
+/* Running time where @buffer starts, or ends if @end is TRUE */
+static GstClockTime
+kms_mix_minus_pad_running_time (KmsMixMinusPad * pad, GstBuffer * buffer,
+    gboolean end)
+{
+  GstAggregatorPad *aggpad = GST_AGGREGATOR_PAD (pad);
+  GstClockTime ts = GST_BUFFER_PTS (buffer);
+
+  if (!GST_CLOCK_TIME_IS_VALID (ts)) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  if (end) {
+    if (!GST_BUFFER_DURATION_IS_VALID (buffer)) {
+      return GST_CLOCK_TIME_NONE;
+    }
+
+    ts += GST_BUFFER_DURATION (buffer);
+  }
+
+  GST_OBJECT_LOCK (pad);
+  ts = gst_segment_to_running_time (&aggpad->segment, GST_FORMAT_TIME, ts);
+  GST_OBJECT_UNLOCK (pad);
+
+  return ts;
+}
+
+static gboolean
+kms_mix_minus_pad_is_eos (KmsMixMinusPad * pad)
+{
+  GstAggregatorPad *aggpad = GST_AGGREGATOR_PAD (pad);
+  GstBuffer *buffer;
+
+  if (pad->buffer != NULL || !gst_aggregator_pad_is_eos (aggpad)) {
+    return FALSE;
+  }
+
+  buffer = gst_aggregator_pad_get_buffer (aggpad);
+
+  if (buffer != NULL) {
+    gst_buffer_unref (buffer);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Copies queued samples into the frame of @pad until it is complete.
+ * Returns FALSE if the input ran out of data before that.
+ */
+static gboolean
+kms_mix_minus_pad_fill (KmsMixMinusPad * pad, gsize frame_size,
+    GstClockTime frame_start)
+{
+  if (pad->frame_size != frame_size) {
+    g_free (pad->frame);
+    pad->frame = g_malloc (frame_size);
+    pad->frame_size = frame_size;
+    pad->filled = 0;
+  }
+
+  while (pad->filled < frame_size) {
+    gsize n;
+
+    if (pad->buffer == NULL) {
+      GstBuffer *buffer;
+      GstClockTime end;
+
+      buffer = gst_aggregator_pad_steal_buffer (GST_AGGREGATOR_PAD (pad));
+
+      if (buffer == NULL) {
+        return FALSE;
+      }
+
+      end = kms_mix_minus_pad_running_time (pad, buffer, TRUE);
+
+      if (pad->filled == 0 && GST_CLOCK_TIME_IS_VALID (end)
+          && end <= frame_start) {
+        /* Data that arrived after its frame was mixed without it */
+        GST_LOG_OBJECT (pad, "Dropping late buffer %" GST_PTR_FORMAT, buffer);
+        gst_buffer_unref (buffer);
+        continue;
+      }
+
+      if (!gst_buffer_map (buffer, &pad->map, GST_MAP_READ)) {
+        gst_buffer_unref (buffer);
+        continue;
+      }
+
+      pad->buffer = buffer;
+      pad->position = 0;
+    }
+
+    n = MIN (pad->map.size - pad->position, frame_size - pad->filled);
+
+    if (GST_BUFFER_FLAG_IS_SET (pad->buffer, GST_BUFFER_FLAG_GAP)) {
+      /* Silent or not selected input, nothing to add or subtract */
+      memset (pad->frame + pad->filled, 0, n);
+    } else {
+      memcpy (pad->frame + pad->filled, pad->map.data + pad->position, n);
+      pad->contributed = TRUE;
+    }
+
+    pad->filled += n;
+    pad->position += n;
+
+    if (pad->position >= pad->map.size) {
+      kms_mix_minus_pad_release_buffer (pad);
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+kms_mix_minus_output_free (gpointer output)
+{
+  g_slice_free (KmsMixMinusOutput, output);
+}
+
+static gboolean
+get_pad_id (const gchar * name, const gchar * prefix, guint * id)
+{
+  guint64 val;
+  gchar *end;
+
+  if (name == NULL || !g_str_has_prefix (name, prefix)) {
+    return FALSE;
+  }
+
+  val = g_ascii_strtoull (name + strlen (prefix), &end, 10);
+
+  if (*end != '\0' || val > G_MAXUINT) {
+    return FALSE;
+  }
+
+  *id = val;
+
+  return TRUE;
+}
+
+static GList *
+kms_mix_minus_get_inputs (KmsMixMinus * self)
+{
+  GList *pads;
+
+  GST_OBJECT_LOCK (self);
+  pads = g_list_copy_deep (GST_ELEMENT (self)->sinkpads,
+      (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return pads;
+}
+
+static void
+kms_mix_minus_reset_timing (KmsMixMinus * self)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+  self->priv->base_time = GST_CLOCK_TIME_NONE;
+  self->priv->offset = 0;
+  gst_segment_init (&GST_AGGREGATOR (self)->segment, GST_FORMAT_TIME);
+
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    ((KmsMixMinusOutput *) l->data)->segment = TRUE;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static GstCaps *
+kms_mix_minus_get_caps (KmsMixMinus * self, GstPad * pad, GstCaps * filter)
+{
+  GstCaps *caps;
+
+  GST_OBJECT_LOCK (self);
+  if (self->priv->caps != NULL) {
+    caps = gst_caps_ref (self->priv->caps);
+  } else {
+    caps = gst_pad_get_pad_template_caps (pad);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  if (filter != NULL) {
+    GstCaps *aux = gst_caps_intersect_full (filter, caps,
+        GST_CAPS_INTERSECT_FIRST);
+
+    gst_caps_unref (caps);
+    caps = aux;
+  }
+
+  return caps;
+}
+
+static void
+kms_mix_minus_reconfigure_inputs (KmsMixMinus * self, GstPad * except)
+{
+  GList *pads, *l;
+
+  pads = kms_mix_minus_get_inputs (self);
+
+  for (l = pads; l != NULL; l = l->next) {
+    if (l->data != except) {
+      gst_pad_push_event (GST_PAD (l->data), gst_event_new_reconfigure ());
+    }
+  }
+
+  g_list_free_full (pads, gst_object_unref);
+}
+
+/* All inputs have to be configured with the same caps */
+static gboolean
+kms_mix_minus_set_caps (KmsMixMinus * self, GstPad * pad, GstCaps * caps)
+{
+  const gchar *format;
+  GstStructure *st;
+  gint rate, channels;
+  gboolean first = FALSE, ret = TRUE;
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+
+  if (self->priv->caps != NULL) {
+    ret = gst_caps_is_equal (self->priv->caps, caps);
+    goto end;
+  }
+
+  st = gst_caps_get_structure (caps, 0);
+  format = gst_structure_get_string (st, "format");
+
+  if (format == NULL || !gst_structure_get_int (st, "rate", &rate) ||
+      !gst_structure_get_int (st, "channels", &channels)) {
+    ret = FALSE;
+    goto end;
+  }
+
+  self->priv->is_float = g_str_equal (format, FORMAT_F32);
+  self->priv->rate = rate;
+  self->priv->bpf =
+      channels * (self->priv->is_float ? sizeof (gfloat) : sizeof (gint16));
+  self->priv->caps = gst_caps_ref (caps);
+
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    ((KmsMixMinusOutput *) l->data)->caps = TRUE;
+  }
+
+  first = TRUE;
+
+end:
+  GST_OBJECT_UNLOCK (self);
+
+  if (!ret) {
+    GST_WARNING_OBJECT (pad, "Caps %" GST_PTR_FORMAT " not accepted", caps);
+  } else if (first) {
+    GST_DEBUG_OBJECT (self, "Mixing %" GST_PTR_FORMAT, caps);
+    gst_aggregator_set_src_caps (GST_AGGREGATOR (self), caps);
+    /* Inputs linked before this point have to negotiate again */
+    kms_mix_minus_reconfigure_inputs (self, pad);
+  }
+
+  return ret;
+}
+
+static gboolean
+kms_mix_minus_sink_event (GstAggregator * agg, GstAggregatorPad * pad,
+    GstEvent * event)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (agg);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstCaps *caps;
+      gboolean ret;
+
+      gst_event_parse_caps (event, &caps);
+      ret = kms_mix_minus_set_caps (self, GST_PAD (pad), caps);
+      gst_event_unref (event);
+
+      return ret;
+    }
+    case GST_EVENT_STREAM_START:
+    case GST_EVENT_TAG:
+      /* Outputs only receive events generated by this element */
+      gst_event_unref (event);
+      return TRUE;
+    default:
+      break;
+  }
+
+  return GST_AGGREGATOR_CLASS (kms_mix_minus_parent_class)->sink_event (agg,
+      pad, event);
+}
+
+static gboolean
+kms_mix_minus_sink_query (GstAggregator * agg, GstAggregatorPad * pad,
+    GstQuery * query)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (agg);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:{
+      GstCaps *filter, *caps;
+
+      gst_query_parse_caps (query, &filter);
+      caps = kms_mix_minus_get_caps (self, GST_PAD (pad), filter);
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+
+      return TRUE;
+    }
+    case GST_QUERY_ACCEPT_CAPS:{
+      GstCaps *caps, *allowed;
+
+      gst_query_parse_accept_caps (query, &caps);
+      allowed = kms_mix_minus_get_caps (self, GST_PAD (pad), NULL);
+      gst_query_set_accept_caps_result (query,
+          gst_caps_can_intersect (caps, allowed));
+      gst_caps_unref (allowed);
+
+      return TRUE;
+    }
+    default:
+      return GST_AGGREGATOR_CLASS (kms_mix_minus_parent_class)->sink_query
+          (agg, pad, query);
+  }
+}
+
+static gboolean
+kms_mix_minus_src_query (GstAggregator * agg, GstQuery * query)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (agg);
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_CAPS) {
+    GstCaps *filter, *caps;
+
+    gst_query_parse_caps (query, &filter);
+    caps = kms_mix_minus_get_caps (self, agg->srcpad, filter);
+    gst_query_set_caps_result (query, caps);
+    gst_caps_unref (caps);
+
+    return TRUE;
+  }
+
+  return GST_AGGREGATOR_CLASS (kms_mix_minus_parent_class)->src_query (agg,
+      query);
+}
+
+static gboolean
+kms_mix_minus_output_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+    case GST_QUERY_LATENCY:
+      /* The aggregator only times out stalled inputs once it knows that
+       * the pipeline is live, which it learns answering this query */
+      return kms_mix_minus_src_query (GST_AGGREGATOR (parent), query);
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static gboolean
+kms_mix_minus_output_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  gboolean ret = TRUE;
+
+  /* Outputs are not seekable, other upstream events are consumed here */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_SEEK) {
+    ret = FALSE;
+  }
+
+  gst_event_unref (event);
+
+  return ret;
+}
+
+static void
+kms_mix_minus_push_pending_events (KmsMixMinus * self,
+    KmsMixMinusOutput * output, GstCaps * caps, const GstSegment * segment)
+{
+  if (output->stream_start) {
+    gchar *stream_id;
+
+    stream_id = gst_pad_create_stream_id (output->pad, GST_ELEMENT (self),
+        NULL);
+    gst_pad_push_event (output->pad, gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+  }
+
+  if (output->caps) {
+    gst_pad_push_event (output->pad, gst_event_new_caps (caps));
+  }
+
+  if (output->segment) {
+    gst_pad_push_event (output->pad, gst_event_new_segment (segment));
+  }
+}
+
+static KmsMixMinusPad *
+kms_mix_minus_find_input (GList * pads, guint id)
+{
+  GList *l;
+
+  for (l = pads; l != NULL; l = l->next) {
+    KmsMixMinusPad *pad = l->data;
+
+    if (pad->id == id) {
+      return pad;
+    }
+  }
+
+  return NULL;
+}
+
+/* Takes the outputs to be pushed, along with their pending events */
+static GArray *
+kms_mix_minus_take_outputs (KmsMixMinus * self)
+{
+  GArray *outputs;
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+
+  outputs = g_array_sized_new (FALSE, FALSE, sizeof (KmsMixMinusOutput),
+      g_list_length (self->priv->outputs));
+
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    KmsMixMinusOutput *output = l->data;
+    KmsMixMinusOutput copy = *output;
+
+    copy.pad = g_object_ref (output->pad);
+    g_array_append_val (outputs, copy);
+
+    output->stream_start = output->caps = output->segment = FALSE;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  return outputs;
+}
+
+/* Total mix without @own, which can be NULL */
+static GstBuffer *
+kms_mix_minus_make_buffer (KmsMixMinus * self, gconstpointer own,
+    gsize size, GstClockTime pts, GstClockTime duration)
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+
+  buffer = gst_buffer_new_allocate (NULL, size, NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+
+  if (self->priv->is_float) {
+    mix_f32_minus ((gfloat *) map.data, self->priv->total, own,
+        size / sizeof (gfloat));
+  } else {
+    mix_s16_minus ((gint16 *) map.data, self->priv->total, own,
+        size / sizeof (gint16));
+  }
+
+  gst_buffer_unmap (buffer, &map);
+
+  GST_BUFFER_PTS (buffer) = pts;
+  GST_BUFFER_DURATION (buffer) = duration;
+  GST_BUFFER_OFFSET (buffer) = self->priv->offset;
+  GST_BUFFER_OFFSET_END (buffer) = self->priv->offset + size / self->priv->bpf;
+
+  return buffer;
+}
+
+static GstFlowReturn
+kms_mix_minus_push_outputs (KmsMixMinus * self, GList * pads, GstCaps * caps,
+    gsize size, GstClockTime pts, GstClockTime duration)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  gboolean eos = TRUE;
+  GstSegment segment;
+  GArray *outputs;
+  guint i;
+
+  GST_OBJECT_LOCK (self);
+  gst_segment_copy_into (&GST_AGGREGATOR (self)->segment, &segment);
+  GST_OBJECT_UNLOCK (self);
+
+  outputs = kms_mix_minus_take_outputs (self);
+
+  for (i = 0; i < outputs->len; i++) {
+    KmsMixMinusOutput *output = &g_array_index (outputs, KmsMixMinusOutput, i);
+    KmsMixMinusPad *input;
+    GstFlowReturn flow;
+
+    kms_mix_minus_push_pending_events (self, output, caps, &segment);
+
+    input = kms_mix_minus_find_input (pads, output->id);
+
+    flow = gst_pad_push (output->pad, kms_mix_minus_make_buffer (self,
+            input != NULL && input->contributed ? input->frame : NULL, size,
+            pts, duration));
+
+    if (flow == GST_FLOW_FLUSHING) {
+      ret = flow;
+    } else if (flow != GST_FLOW_EOS) {
+      eos = FALSE;
+
+      if (flow <= GST_FLOW_NOT_NEGOTIATED) {
+        GST_ELEMENT_ERROR (self, STREAM, FAILED, (NULL),
+            ("Error pushing on %" GST_PTR_FORMAT ": %s", output->pad,
+                gst_flow_get_name (flow)));
+        ret = flow;
+      } else if (flow != GST_FLOW_OK && flow != GST_FLOW_NOT_LINKED) {
+        GST_WARNING_OBJECT (output->pad, "Flow return %s",
+            gst_flow_get_name (flow));
+      }
+    }
+
+    g_object_unref (output->pad);
+  }
+
+  if (ret == GST_FLOW_OK && eos && outputs->len > 0) {
+    ret = GST_FLOW_EOS;
+  }
+
+  g_array_free (outputs, TRUE);
+
+  return ret;
+}
+
+static void
+kms_mix_minus_push_eos (KmsMixMinus * self)
+{
+  GList *outputs = NULL, *l;
+
+  GST_OBJECT_LOCK (self);
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    outputs = g_list_prepend (outputs,
+        g_object_ref (((KmsMixMinusOutput *) l->data)->pad));
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  for (l = outputs; l != NULL; l = l->next) {
+    gst_pad_push_event (GST_PAD (l->data), gst_event_new_eos ());
+  }
+
+  g_list_free_full (outputs, g_object_unref);
+}
+
+/* Running time of the earliest buffer queued in any input */
+static GstClockTime
+kms_mix_minus_first_input_time (GList * pads)
+{
+  GstClockTime first = GST_CLOCK_TIME_NONE;
+  GList *l;
+
+  for (l = pads; l != NULL; l = l->next) {
+    KmsMixMinusPad *pad = l->data;
+    GstClockTime ts;
+    GstBuffer *buffer;
+
+    buffer = gst_aggregator_pad_get_buffer (GST_AGGREGATOR_PAD (pad));
+
+    if (buffer == NULL) {
+      continue;
+    }
+
+    ts = kms_mix_minus_pad_running_time (pad, buffer, FALSE);
+    gst_buffer_unref (buffer);
+
+    if (!GST_CLOCK_TIME_IS_VALID (ts)) {
+      /* Untimed input, mix it from the beginning */
+      ts = 0;
+    }
+
+    if (!GST_CLOCK_TIME_IS_VALID (first) || ts < first) {
+      first = ts;
+    }
+  }
+
+  return first;
+}
+
+static GstFlowReturn
+kms_mix_minus_aggregate (GstAggregator * agg, gboolean timeout)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (agg);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime pts, end;
+  gboolean ready = TRUE, eos;
+  gsize frame_size, total_size;
+  guint frames, samples;
+  GstCaps *caps;
+  GList *pads, *l;
+
+  pads = kms_mix_minus_get_inputs (self);
+
+  eos = pads != NULL;
+  for (l = pads; l != NULL && eos; l = l->next) {
+    eos = kms_mix_minus_pad_is_eos (l->data);
+  }
+
+  if (eos) {
+    GST_DEBUG_OBJECT (self, "All inputs are EOS");
+    kms_mix_minus_push_eos (self);
+    g_list_free_full (pads, gst_object_unref);
+    return GST_FLOW_EOS;
+  }
+
+  GST_OBJECT_LOCK (self);
+  caps = self->priv->caps != NULL ? gst_caps_ref (self->priv->caps) : NULL;
+  GST_OBJECT_UNLOCK (self);
+
+  if (caps == NULL) {
+    if (!timeout) {
+      GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
+          ("Received data before caps"));
+      ret = GST_FLOW_NOT_NEGOTIATED;
+    }
+    goto end;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (self->priv->base_time)) {
+    GstClockTime first = kms_mix_minus_first_input_time (pads);
+
+    if (!GST_CLOCK_TIME_IS_VALID (first)) {
+      /* Nothing to mix yet */
+      goto end;
+    }
+
+    kms_mix_minus_reset_timing (self);
+
+    GST_OBJECT_LOCK (self);
+    self->priv->base_time = first;
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  frames = gst_util_uint64_scale_int (FRAME_DURATION, self->priv->rate,
+      GST_SECOND);
+  frames = MAX (frames, 1);
+  frame_size = frames * self->priv->bpf;
+
+  pts = self->priv->base_time + gst_util_uint64_scale_int (self->priv->offset,
+      GST_SECOND, self->priv->rate);
+  end = self->priv->base_time + gst_util_uint64_scale_int (self->priv->offset
+      + frames, GST_SECOND, self->priv->rate);
+
+  for (l = pads; l != NULL; l = l->next) {
+    KmsMixMinusPad *pad = l->data;
+
+    if (!kms_mix_minus_pad_fill (pad, frame_size, pts)
+        && !kms_mix_minus_pad_is_eos (pad)) {
+      ready = FALSE;
+    }
+  }
+
+  if (!ready && !timeout) {
+    /* Wait for the rest of the frame, or for the aggregator to time out */
+    goto end;
+  }
+
+  if (self->priv->is_float) {
+    samples = frame_size / sizeof (gfloat);
+    total_size = samples * sizeof (gfloat);
+  } else {
+    samples = frame_size / sizeof (gint16);
+    total_size = samples * sizeof (gint32);
+  }
+
+  if (self->priv->total_size < total_size) {
+    g_free (self->priv->total);
+    self->priv->total = g_malloc (total_size);
+    self->priv->total_size = total_size;
+  }
+
+  memset (self->priv->total, 0, total_size);
+
+  for (l = pads; l != NULL; l = l->next) {
+    KmsMixMinusPad *pad = l->data;
+
+    if (!pad->contributed) {
+      continue;
+    }
+
+    if (pad->filled < frame_size) {
+      GST_LOG_OBJECT (pad, "Input short of data, mixing it partially");
+      memset (pad->frame + pad->filled, 0, frame_size - pad->filled);
+    }
+
+    if (self->priv->is_float) {
+      mix_f32_accumulate (self->priv->total, (const gfloat *) pad->frame,
+          samples);
+    } else {
+      mix_s16_accumulate (self->priv->total, (const gint16 *) pad->frame,
+          samples);
+    }
+  }
+
+  ret = kms_mix_minus_push_outputs (self, pads, caps, frame_size, pts,
+      end - pts);
+
+  if (ret == GST_FLOW_OK && gst_pad_is_linked (agg->srcpad)) {
+    ret = gst_aggregator_finish_buffer (agg,
+        kms_mix_minus_make_buffer (self, NULL, frame_size, pts, end - pts));
+
+    if (ret == GST_FLOW_NOT_LINKED) {
+      /* Unlinked while pushing, outputs keep being served */
+      ret = GST_FLOW_OK;
+    }
+  }
+
+  for (l = pads; l != NULL; l = l->next) {
+    KmsMixMinusPad *pad = l->data;
+
+    pad->filled = 0;
+    pad->contributed = FALSE;
+  }
+
+  GST_OBJECT_LOCK (self);
+  self->priv->offset += frames;
+  agg->segment.position = end;
+  GST_OBJECT_UNLOCK (self);
+
+end:
+  if (caps != NULL) {
+    gst_caps_unref (caps);
+  }
+
+  g_list_free_full (pads, gst_object_unref);
+
+  return ret;
+}
+
+/* Inputs without data when this time is reached are left out of the frame */
+static GstClockTime
+kms_mix_minus_get_next_time (GstAggregator * agg)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (agg);
+  GstClockTime next = GST_CLOCK_TIME_NONE;
+  GstClock *clock;
+
+  GST_OBJECT_LOCK (self);
+
+  if (GST_CLOCK_TIME_IS_VALID (self->priv->base_time)) {
+    guint frames = gst_util_uint64_scale_int (FRAME_DURATION,
+        self->priv->rate, GST_SECOND);
+
+    next = self->priv->base_time +
+        gst_util_uint64_scale_int (self->priv->offset + MAX (frames, 1),
+        GST_SECOND, self->priv->rate);
+  } else if ((clock = GST_ELEMENT_CLOCK (self)) != NULL) {
+    /* Nothing mixed yet, check again for data in a frame */
+    next = gst_clock_get_time (clock) - GST_ELEMENT (self)->base_time +
+        FRAME_DURATION;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  return next;
+}
+
+static void
+kms_mix_minus_reset_inputs (KmsMixMinus * self)
+{
+  GList *pads;
+
+  pads = kms_mix_minus_get_inputs (self);
+  g_list_foreach (pads, (GFunc) kms_mix_minus_pad_reset, NULL);
+  g_list_free_full (pads, gst_object_unref);
+}
+
+static GstFlowReturn
+kms_mix_minus_flush (GstAggregator * agg)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (agg);
+
+  kms_mix_minus_reset_inputs (self);
+
+  GST_OBJECT_LOCK (self);
+  self->priv->base_time = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (self);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+kms_mix_minus_start (GstAggregator * agg)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (agg);
+
+  kms_mix_minus_reset_timing (self);
+
+  return TRUE;
+}
+
+static gboolean
+kms_mix_minus_stop (GstAggregator * agg)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (agg);
+
+  kms_mix_minus_reset_inputs (self);
+  kms_mix_minus_reset_timing (self);
+
+  return TRUE;
+}
+
+static GstPad *
+kms_mix_minus_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (element);
+  GstPadDirection direction = GST_PAD_TEMPLATE_DIRECTION (templ);
+  const gchar *prefix;
+  GstPad *pad;
+  guint id;
+
+  prefix = direction == GST_PAD_SINK ? SINK_PAD_PREFIX : SRC_PAD_PREFIX;
+
+  if (!get_pad_id (name, prefix, &id)) {
+    GST_ERROR_OBJECT (self, "Pads have to be requested by name (%s%%u)",
+        prefix);
+    return NULL;
+  }
+
+  pad = gst_element_get_static_pad (element, name);
+  if (pad != NULL) {
+    GST_ERROR_OBJECT (self, "Pad %s already exists", name);
+    g_object_unref (pad);
+    return NULL;
+  }
+
+  if (direction == GST_PAD_SINK) {
+    /* Created here instead of by the aggregator to keep the requested id */
+    pad = g_object_new (KMS_TYPE_MIX_MINUS_PAD, "name", name, "direction",
+        GST_PAD_SINK, "template", templ, NULL);
+    KMS_MIX_MINUS_PAD (pad)->id = id;
+  } else {
+    KmsMixMinusOutput *output = g_slice_new0 (KmsMixMinusOutput);
+
+    pad = gst_pad_new_from_template (templ, name);
+    gst_pad_set_query_function (pad,
+        GST_DEBUG_FUNCPTR (kms_mix_minus_output_query));
+    gst_pad_set_event_function (pad,
+        GST_DEBUG_FUNCPTR (kms_mix_minus_output_event));
+
+    output->pad = pad;
+    output->id = id;
+    output->stream_start = output->caps = output->segment = TRUE;
+
+    GST_OBJECT_LOCK (self);
+    self->priv->outputs = g_list_prepend (self->priv->outputs, output);
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  if (GST_STATE (element) >= GST_STATE_PAUSED
+      || GST_STATE_PENDING (element) >= GST_STATE_PAUSED
+      || GST_STATE_TARGET (element) >= GST_STATE_PAUSED) {
+    gst_pad_set_active (pad, TRUE);
+  }
+
+  gst_element_add_pad (element, pad);
+
+  return pad;
+}
+
+static void
+kms_mix_minus_release_pad (GstElement * element, GstPad * pad)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (element);
+  GstPad *srcpad = GST_AGGREGATOR (self)->srcpad;
+  KmsMixMinusOutput *output = NULL;
+  GList *l;
+
+  GST_DEBUG_OBJECT (self, "Release pad %" GST_PTR_FORMAT, pad);
+
+  if (gst_pad_get_direction (pad) == GST_PAD_SINK) {
+    /* The input state is freed with the pad, after the running frame */
+    GST_ELEMENT_CLASS (kms_mix_minus_parent_class)->release_pad (element, pad);
+    return;
+  }
+
+  /* Wait for the frame being pushed, if any */
+  GST_PAD_STREAM_LOCK (srcpad);
+  GST_OBJECT_LOCK (self);
+
+  for (l = self->priv->outputs; l != NULL; l = l->next) {
+    if (((KmsMixMinusOutput *) l->data)->pad == pad) {
+      output = l->data;
+      self->priv->outputs = g_list_delete_link (self->priv->outputs, l);
+      break;
+    }
+  }
+
+  GST_OBJECT_UNLOCK (self);
+  GST_PAD_STREAM_UNLOCK (srcpad);
+
+  if (output != NULL) {
+    kms_mix_minus_output_free (output);
+  }
+
+  if (GST_STATE (element) >= GST_STATE_PAUSED
+      || GST_STATE_PENDING (element) >= GST_STATE_PAUSED
+      || GST_STATE_TARGET (element) >= GST_STATE_PAUSED) {
+    gst_pad_set_active (pad, FALSE);
+  }
+
+  gst_element_remove_pad (element, pad);
+}
+
+static void
+kms_mix_minus_finalize (GObject * object)
+{
+  KmsMixMinus *self = KMS_MIX_MINUS (object);
+
+  GST_DEBUG_OBJECT (self, "finalize");
+
+  g_list_free_full (self->priv->outputs, kms_mix_minus_output_free);
+  g_free (self->priv->total);
+
+  if (self->priv->caps != NULL) {
+    gst_caps_unref (self->priv->caps);
+  }
+
+  G_OBJECT_CLASS (kms_mix_minus_parent_class)->finalize (object);
+}
+
+static void
+kms_mix_minus_class_init (KmsMixMinusClass * klass)
+{
+  GstAggregatorClass *aggregator_class = GST_AGGREGATOR_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "MixMinus", "Generic/Audio",
+      "Mixes all inputs once and outputs the mix without each input",
+      "Kurento <kurento@googlegroups.com>");
+
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (kms_mix_minus_request_new_pad);
+  gstelement_class->release_pad = GST_DEBUG_FUNCPTR (kms_mix_minus_release_pad);
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&output_factory));
+
+  aggregator_class->sinkpads_type = KMS_TYPE_MIX_MINUS_PAD;
+  aggregator_class->aggregate = GST_DEBUG_FUNCPTR (kms_mix_minus_aggregate);
+  aggregator_class->get_next_time =
+      GST_DEBUG_FUNCPTR (kms_mix_minus_get_next_time);
+  aggregator_class->flush = GST_DEBUG_FUNCPTR (kms_mix_minus_flush);
+  aggregator_class->start = GST_DEBUG_FUNCPTR (kms_mix_minus_start);
+  aggregator_class->stop = GST_DEBUG_FUNCPTR (kms_mix_minus_stop);
+  aggregator_class->sink_event = GST_DEBUG_FUNCPTR (kms_mix_minus_sink_event);
+  aggregator_class->sink_query = GST_DEBUG_FUNCPTR (kms_mix_minus_sink_query);
+  aggregator_class->src_query = GST_DEBUG_FUNCPTR (kms_mix_minus_src_query);
+
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_mix_minus_finalize);
+
+  /* Registers a private structure for the instantiatable type */
+  g_type_class_add_private (klass, sizeof (KmsMixMinusPrivate));
+}
+
+static void
+kms_mix_minus_init (KmsMixMinus * self)
+{
+  self->priv = KMS_MIX_MINUS_GET_PRIVATE (self);
+
+  self->priv->base_time = GST_CLOCK_TIME_NONE;
+}
+
+gboolean
+kms_mix_minus_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_MIX_MINUS);
+}
@@ -0,0 +1,83 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_MIX_MINUS_H_
+#define _KMS_MIX_MINUS_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstaggregator.h>
+
+G_BEGIN_DECLS
+#define KMS_TYPE_MIX_MINUS kms_mix_minus_get_type()
+
+#define KMS_MIX_MINUS(obj) ( \
+  G_TYPE_CHECK_INSTANCE_CAST(  \
+    (obj),                     \
+    KMS_TYPE_MIX_MINUS,        \
+    KmsMixMinus                \
+  )                            \
+)
+
+#define KMS_MIX_MINUS_CLASS(klass) ( \
+  G_TYPE_CHECK_CLASS_CAST (          \
+    (klass),                         \
+    KMS_TYPE_MIX_MINUS,              \
+    KmsMixMinusClass                 \
+  )                                  \
+)
+#define KMS_IS_MIX_MINUS(obj) ( \
+  G_TYPE_CHECK_INSTANCE_TYPE (  \
+    (obj),                      \
+    KMS_TYPE_MIX_MINUS          \
+  )                             \
+)
+#define KMS_IS_MIX_MINUS_CLASS(klass) ( \
+  G_TYPE_CHECK_CLASS_TYPE((klass),      \
+  KMS_TYPE_MIX_MINUS)                   \
+)
+
+typedef struct _KmsMixMinus KmsMixMinus;
+typedef struct _KmsMixMinusClass KmsMixMinusClass;
+typedef struct _KmsMixMinusPrivate KmsMixMinusPrivate;
+
+/**
+ * KmsMixMinus:
+ *
+ * Mixes every sink_%u pad once per frame and pushes on each src_%u pad the
+ * total mix minus the contribution of the sink pad with the same id. The
+ * always src pad carries the total mix.
+ *
+ * Frames are scheduled by #GstAggregator: in live pipelines an input without
+ * data when the frame is due is left out of that frame instead of stopping
+ * the mix.
+ */
+struct _KmsMixMinus
+{
+  GstAggregator parent;
+
+  /*< private > */
+  KmsMixMinusPrivate *priv;
+};
+
+struct _KmsMixMinusClass
+{
+  GstAggregatorClass parent_class;
+};
+
+GType kms_mix_minus_get_type (void);
+
+gboolean kms_mix_minus_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif /* _KMS_MIX_MINUS_H_ */
@@ -18,6 +18,7 @@
 #endif
 
 #include "kmsparsetreebin.h"
+#include "kmsutils.h"
 
 #define GST_DEFAULT_NAME "parsetreebin"
 #define GST_CAT_DEFAULT kms_parse_tree_bin_debug
@@ -42,15 +43,13 @@ struct _KmsParseTreeBinPrivate
 static GstElement *
 create_parser_for_caps (const GstCaps * caps)
 {
-  GList *parser_list, *filtered_list, *l;
+  GList *filtered_list, *l;
   GstElementFactory *parser_factory = NULL;
   GstElement *parser = NULL;
 
-  parser_list =
-      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_PARSER,
-      GST_RANK_NONE);
   filtered_list =
-      gst_element_factory_list_filter (parser_list, caps, GST_PAD_SINK, FALSE);
+      kms_utils_get_element_factories_for_caps (GST_ELEMENT_FACTORY_TYPE_PARSER,
+      caps, NULL);
 
   for (l = filtered_list; l != NULL && parser_factory == NULL; l = l->next) {
     parser_factory = GST_ELEMENT_FACTORY (l->data);
@@ -65,7 +64,6 @@ create_parser_for_caps (const GstCaps * caps)
   }
 
   gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (parser_list);
 
   return parser;
 }
@@ -0,0 +1,397 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmstranscoderregistry.h"
+#include "kmsrefstruct.h"
+
+#define GST_DEFAULT_NAME "transcoderregistry"
+#define GST_CAT_DEFAULT kms_transcoder_registry_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+/* Encoders configured within the same tier are considered equivalent */
+#define BITRATE_TIER 100000
+
+#define REGISTRY_KEY "kms-transcoder-registry"
+#define STREAM_ID_KEY "kms-transcoder-stream-id"
+
+struct _KmsTranscoderRegistry
+{
+  KmsRefStruct ref;
+
+  GMutex mutex;
+  /* "stream_id/tier" -> GList of KmsTranscoderBranch */
+  GHashTable *branches;
+};
+
+typedef struct _KmsTranscoderBranch
+{
+  GstElement *tee;
+  gpointer owner;
+  gint bitrate;
+} KmsTranscoderBranch;
+
+G_LOCK_DEFINE_STATIC (registries);
+static volatile gint last_stream_id = 0;
+
+static void
+kms_transcoder_branch_destroy (KmsTranscoderBranch * branch)
+{
+  g_object_unref (branch->tee);
+  g_slice_free (KmsTranscoderBranch, branch);
+}
+
+static void
+kms_transcoder_branch_list_destroy (GList * list)
+{
+  g_list_free_full (list, (GDestroyNotify) kms_transcoder_branch_destroy);
+}
+
+static void
+kms_transcoder_registry_destroy (KmsTranscoderRegistry * self)
+{
+  g_hash_table_unref (self->branches);
+  g_mutex_clear (&self->mutex);
+
+  g_slice_free (KmsTranscoderRegistry, self);
+}
+
+static KmsTranscoderRegistry *
+kms_transcoder_registry_new (void)
+{
+  KmsTranscoderRegistry *self = g_slice_new0 (KmsTranscoderRegistry);
+
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (self),
+      (GDestroyNotify) kms_transcoder_registry_destroy);
+
+  g_mutex_init (&self->mutex);
+  self->branches = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) kms_transcoder_branch_list_destroy);
+
+  return self;
+}
+
+KmsTranscoderRegistry *
+kms_transcoder_registry_ref (KmsTranscoderRegistry * self)
+{
+  return (KmsTranscoderRegistry *)
+      kms_ref_struct_ref (KMS_REF_STRUCT_CAST (self));
+}
+
+void
+kms_transcoder_registry_unref (KmsTranscoderRegistry * self)
+{
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (self));
+}
+
+KmsTranscoderRegistry *
+kms_transcoder_registry_get (GstElement * element)
+{
+  KmsTranscoderRegistry *registry = NULL;
+  GstObject *top, *parent;
+
+  top = gst_object_ref (GST_OBJECT (element));
+
+  while ((parent = gst_object_get_parent (top)) != NULL) {
+    gst_object_unref (top);
+    top = parent;
+  }
+
+  if (!GST_IS_PIPELINE (top)) {
+    goto end;
+  }
+
+  G_LOCK (registries);
+
+  registry = g_object_get_data (G_OBJECT (top), REGISTRY_KEY);
+
+  if (registry == NULL) {
+    registry = kms_transcoder_registry_new ();
+    g_object_set_data_full (G_OBJECT (top), REGISTRY_KEY, registry,
+        (GDestroyNotify) kms_transcoder_registry_unref);
+  }
+
+  kms_transcoder_registry_ref (registry);
+
+  G_UNLOCK (registries);
+
+end:
+  gst_object_unref (top);
+
+  return registry;
+}
+
+guint
+kms_transcoder_registry_get_stream_id (GstElement * tee)
+{
+  guint id;
+
+  G_LOCK (registries);
+
+  id = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (tee), STREAM_ID_KEY));
+
+  if (id == 0) {
+    id = g_atomic_int_add (&last_stream_id, 1) + 1;
+    g_object_set_data (G_OBJECT (tee), STREAM_ID_KEY, GUINT_TO_POINTER (id));
+  }
+
+  G_UNLOCK (registries);
+
+  return id;
+}
+
+static gchar *
+branch_key (guint stream_id, gint bitrate)
+{
+  return g_strdup_printf ("%u/%d", stream_id, bitrate / BITRATE_TIER);
+}
+
+void
+kms_transcoder_registry_publish (KmsTranscoderRegistry * self,
+    guint stream_id, gint bitrate, GstElement * tee, gpointer owner)
+{
+  KmsTranscoderBranch *branch;
+  gchar *key = branch_key (stream_id, bitrate);
+  GList *list;
+
+  branch = g_slice_new0 (KmsTranscoderBranch);
+  branch->tee = g_object_ref (tee);
+  branch->owner = owner;
+  branch->bitrate = bitrate;
+
+  g_mutex_lock (&self->mutex);
+
+  list = g_hash_table_lookup (self->branches, key);
+
+  if (list != NULL) {
+    /* Appending keeps the list head, the key is not needed */
+    list = g_list_append (list, branch);
+    g_free (key);
+  } else {
+    g_hash_table_insert (self->branches, key, g_list_append (NULL, branch));
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  GST_DEBUG ("Published %" GST_PTR_FORMAT " for stream %u", tee, stream_id);
+}
+
+/* Called with the registry locked */
+static KmsTranscoderBranch *
+kms_transcoder_registry_find (KmsTranscoderRegistry * self, GstElement * tee)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, self->branches);
+
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    GList *l;
+
+    for (l = value; l != NULL; l = l->next) {
+      KmsTranscoderBranch *branch = l->data;
+
+      if (branch->tee == tee) {
+        return branch;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* Called with the registry locked, returns the branch to be destroyed */
+static KmsTranscoderBranch *
+kms_transcoder_registry_remove (KmsTranscoderRegistry * self,
+    GstElement * tee)
+{
+  KmsTranscoderBranch *found = NULL;
+  GList *remaining = NULL;
+  gpointer found_key = NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, self->branches);
+
+  while (found == NULL && g_hash_table_iter_next (&iter, &key, &value)) {
+    GList *l;
+
+    for (l = value; l != NULL; l = l->next) {
+      KmsTranscoderBranch *branch = l->data;
+
+      if (branch->tee == tee) {
+        found = branch;
+        found_key = key;
+        remaining = g_list_delete_link (value, l);
+        /* Removed without destroying the list, it is inserted again below */
+        g_hash_table_iter_steal (&iter);
+        break;
+      }
+    }
+  }
+
+  if (remaining != NULL) {
+    g_hash_table_insert (self->branches, found_key, remaining);
+  } else {
+    g_free (found_key);
+  }
+
+  return found;
+}
+
+void
+kms_transcoder_registry_withdraw (KmsTranscoderRegistry * self,
+    GstElement * tee)
+{
+  KmsTranscoderBranch *found;
+
+  g_mutex_lock (&self->mutex);
+  found = kms_transcoder_registry_remove (self, tee);
+  g_mutex_unlock (&self->mutex);
+
+  if (found != NULL) {
+    GST_DEBUG ("Withdrawn %" GST_PTR_FORMAT, tee);
+    kms_transcoder_branch_destroy (found);
+  }
+}
+
+gboolean
+kms_transcoder_registry_update_bitrate (KmsTranscoderRegistry * self,
+    GstElement * tee, gint bitrate)
+{
+  KmsTranscoderBranch *found;
+
+  g_mutex_lock (&self->mutex);
+
+  found = kms_transcoder_registry_find (self, tee);
+
+  if (found == NULL
+      || found->bitrate / BITRATE_TIER == bitrate / BITRATE_TIER) {
+    g_mutex_unlock (&self->mutex);
+    return FALSE;
+  }
+
+  kms_transcoder_registry_remove (self, tee);
+
+  g_mutex_unlock (&self->mutex);
+
+  GST_DEBUG ("Withdrawn %" GST_PTR_FORMAT ", adapted from %d to %d bps", tee,
+      found->bitrate, bitrate);
+  kms_transcoder_branch_destroy (found);
+
+  return TRUE;
+}
+
+static gboolean
+tee_can_produce (GstElement * tee, const GstCaps * caps)
+{
+  GstPad *tee_sink = gst_element_get_static_pad (tee, "sink");
+  GstCaps *current_caps;
+  gboolean ret = FALSE;
+
+  if (tee_sink == NULL) {
+    return FALSE;
+  }
+
+  current_caps = gst_pad_get_current_caps (tee_sink);
+
+  if (current_caps == NULL) {
+    current_caps = gst_pad_get_allowed_caps (tee_sink);
+  }
+
+  if (current_caps != NULL) {
+    ret = gst_caps_can_intersect (caps, current_caps);
+    gst_caps_unref (current_caps);
+  }
+
+  g_object_unref (tee_sink);
+
+  return ret;
+}
+
+/* Called with the registry locked */
+static gboolean
+kms_transcoder_registry_is_published (KmsTranscoderRegistry * self,
+    const gchar * key, GstElement * tee)
+{
+  GList *l;
+
+  for (l = g_hash_table_lookup (self->branches, key); l != NULL; l = l->next) {
+    if (((KmsTranscoderBranch *) l->data)->tee == tee) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+gboolean
+kms_transcoder_registry_attach (KmsTranscoderRegistry * self,
+    guint stream_id, gint bitrate, const GstCaps * caps, gpointer requester,
+    KmsTranscoderAttachFunc func, gpointer user_data)
+{
+  gchar *key = branch_key (stream_id, bitrate);
+  GList *candidates = NULL, *l;
+  gboolean ret = FALSE;
+
+  g_mutex_lock (&self->mutex);
+
+  for (l = g_hash_table_lookup (self->branches, key); l != NULL; l = l->next) {
+    KmsTranscoderBranch *branch = l->data;
+
+    if (branch->owner != requester) {
+      candidates = g_list_append (candidates, g_object_ref (branch->tee));
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  /* Caps queries go upstream, they are done without the registry locked */
+  for (l = candidates; l != NULL && !ret; l = l->next) {
+    GstElement *tee = l->data;
+
+    if (!tee_can_produce (tee, caps)) {
+      continue;
+    }
+
+    g_mutex_lock (&self->mutex);
+
+    /* It may have been withdrawn while its caps were checked */
+    if (kms_transcoder_registry_is_published (self, key, tee)) {
+      GST_DEBUG ("Attaching to %" GST_PTR_FORMAT " for stream %u", tee,
+          stream_id);
+      ret = func (tee, user_data);
+    }
+
+    g_mutex_unlock (&self->mutex);
+  }
+
+  g_list_free_full (candidates, g_object_unref);
+  g_free (key);
+
+  return ret;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
@@ -0,0 +1,71 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef __KMS_TRANSCODER_REGISTRY_H__
+#define __KMS_TRANSCODER_REGISTRY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Transcoding branches of every agnosticbin in a pipeline, indexed by the
+ * stream they are fed from and the bitrate they encode to. An agnosticbin
+ * receiving the same stream as another one can feed its outputs from the
+ * branches already built by the other, instead of decoding and encoding the
+ * same media again.
+ *
+ * Branches are identified by their output tee.
+ */
+typedef struct _KmsTranscoderRegistry KmsTranscoderRegistry;
+
+/*
+ * Called with the registry locked, the branch cannot be withdrawn meanwhile.
+ * Returns FALSE if @tee could not be attached to.
+ */
+typedef gboolean (*KmsTranscoderAttachFunc) (GstElement * tee,
+    gpointer user_data);
+
+/* Registry of the pipeline holding @element, NULL if it is not in one */
+KmsTranscoderRegistry * kms_transcoder_registry_get (GstElement * element);
+KmsTranscoderRegistry * kms_transcoder_registry_ref (KmsTranscoderRegistry * self);
+void kms_transcoder_registry_unref (KmsTranscoderRegistry * self);
+
+/* Process-wide unique, non zero, identifier of the stream of @tee */
+guint kms_transcoder_registry_get_stream_id (GstElement * tee);
+
+void kms_transcoder_registry_publish (KmsTranscoderRegistry * self,
+    guint stream_id, gint bitrate, GstElement * tee, gpointer owner);
+void kms_transcoder_registry_withdraw (KmsTranscoderRegistry * self,
+    GstElement * tee);
+
+/*
+ * Reports the bitrate the branch of @tee was adapted to. Its consumers asked
+ * for the bitrate it was published with, so the branch is withdrawn once it
+ * leaves that tier. Returns TRUE if it was withdrawn.
+ */
+gboolean kms_transcoder_registry_update_bitrate (KmsTranscoderRegistry * self,
+    GstElement * tee, gint bitrate);
+
+/*
+ * Calls @func with the tee of a branch of another owner able to produce
+ * @caps, until one is attached to. Returns FALSE if there is none.
+ */
+gboolean kms_transcoder_registry_attach (KmsTranscoderRegistry * self,
+    guint stream_id, gint bitrate, const GstCaps * caps, gpointer requester,
+    KmsTranscoderAttachFunc func, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __KMS_TRANSCODER_REGISTRY_H__ */
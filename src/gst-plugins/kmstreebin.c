@@ -93,16 +93,12 @@ kms_tree_bin_unlink_input_element_from_tee (KmsTreeBin * self)
 static void
 kms_tree_bin_init (KmsTreeBin * self)
 {
-  GstElement *fakesink;
-
   self->priv = KMS_TREE_BIN_GET_PRIVATE (self);
 
-  self->priv->output_tee = gst_element_factory_make ("tee", NULL);
-  fakesink = gst_element_factory_make ("fakesink", NULL);
-  g_object_set (fakesink, "async", FALSE, NULL);
+  /* Consumers do not need a queue, the fan-out pushes from its own pool */
+  self->priv->output_tee = gst_element_factory_make ("kmsfanout", NULL);
 
-  gst_bin_add_many (GST_BIN (self), self->priv->output_tee, fakesink, NULL);
-  gst_element_link (self->priv->output_tee, fakesink);
+  gst_bin_add (GST_BIN (self), self->priv->output_tee);
 }
 
 static void
@@ -53,6 +53,7 @@ GType kms_tree_bin_get_type (void);
 GstElement * kms_tree_bin_get_input_element (KmsTreeBin * self);
 void kms_tree_bin_set_input_element (KmsTreeBin * self,
     GstElement * input_element);
+/* Returns the kmsfanout distributing the output of the tree */
 GstElement * kms_tree_bin_get_output_tee (KmsTreeBin * self);
 
 void kms_tree_bin_unlink_input_element_from_tee (KmsTreeBin * self);
@@ -0,0 +1,622 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "Cbor.hpp"
+
+#include <KurentoException.hpp>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#define MAX_DEPTH 128
+
+#define MAJOR_UNSIGNED 0
+#define MAJOR_NEGATIVE 1
+#define MAJOR_BYTES 2
+#define MAJOR_TEXT 3
+#define MAJOR_ARRAY 4
+#define MAJOR_MAP 5
+#define MAJOR_TAG 6
+#define MAJOR_SIMPLE 7
+
+#define SIMPLE_FALSE 20
+#define SIMPLE_TRUE 21
+#define SIMPLE_NULL 22
+#define SIMPLE_UNDEFINED 23
+#define SIMPLE_HALF 25
+#define SIMPLE_FLOAT 26
+#define SIMPLE_DOUBLE 27
+
+namespace kurento
+{
+
+static void
+malformed (const std::string &reason)
+{
+  throw KurentoException (MARSHALL_ERROR, "Malformed CBOR message: " + reason);
+}
+
+void
+CborWriter::writeHead (uint8_t major, uint64_t value)
+{
+  uint8_t head = major << 5;
+  int bytes;
+
+  if (value < 24) {
+    out.push_back (head | value);
+    return;
+  } else if (value <= 0xff) {
+    out.push_back (head | 24);
+    bytes = 1;
+  } else if (value <= 0xffff) {
+    out.push_back (head | 25);
+    bytes = 2;
+  } else if (value <= 0xffffffff) {
+    out.push_back (head | 26);
+    bytes = 4;
+  } else {
+    out.push_back (head | 27);
+    bytes = 8;
+  }
+
+  for (int i = bytes - 1; i >= 0; i--) {
+    out.push_back ( (value >> (i * 8) ) & 0xff);
+  }
+}
+
+void
+CborWriter::writeUInt (uint64_t value)
+{
+  writeHead (MAJOR_UNSIGNED, value);
+}
+
+void
+CborWriter::writeInt (int64_t value)
+{
+  if (value >= 0) {
+    writeHead (MAJOR_UNSIGNED, value);
+  } else {
+    writeHead (MAJOR_NEGATIVE, - (value + 1) );
+  }
+}
+
+void
+CborWriter::writeDouble (double value)
+{
+  uint64_t bits;
+
+  std::memcpy (&bits, &value, sizeof (bits) );
+  out.push_back ( (MAJOR_SIMPLE << 5) | SIMPLE_DOUBLE);
+
+  for (int i = 7; i >= 0; i--) {
+    out.push_back ( (bits >> (i * 8) ) & 0xff);
+  }
+}
+
+void
+CborWriter::writeBool (bool value)
+{
+  out.push_back ( (MAJOR_SIMPLE << 5) | (value ? SIMPLE_TRUE : SIMPLE_FALSE) );
+}
+
+void
+CborWriter::writeNull ()
+{
+  out.push_back ( (MAJOR_SIMPLE << 5) | SIMPLE_NULL);
+}
+
+void
+CborWriter::writeString (const char *str, size_t len)
+{
+  writeHead (MAJOR_TEXT, len);
+  out.append (str, len);
+}
+
+void
+CborWriter::writeArray (size_t len)
+{
+  writeHead (MAJOR_ARRAY, len);
+}
+
+void
+CborWriter::writeMap (size_t len)
+{
+  writeHead (MAJOR_MAP, len);
+}
+
+void
+CborWriter::write (const Json::Value &value)
+{
+  switch (value.type () ) {
+  case Json::nullValue:
+    writeNull ();
+    break;
+
+  case Json::intValue:
+    writeInt (value.asLargestInt () );
+    break;
+
+  case Json::uintValue:
+    writeUInt (value.asLargestUInt () );
+    break;
+
+  case Json::realValue:
+    writeDouble (value.asDouble () );
+    break;
+
+  case Json::stringValue:
+    writeString (value.asString () );
+    break;
+
+  case Json::booleanValue:
+    writeBool (value.asBool () );
+    break;
+
+  case Json::arrayValue:
+    writeArray (value.size () );
+
+    for (const Json::Value &item : value) {
+      write (item);
+    }
+
+    break;
+
+  case Json::objectValue:
+    writeMap (value.size () );
+
+    for (auto it = value.begin (); it != value.end (); ++it) {
+      writeString (it.name () );
+      write (*it);
+    }
+
+    break;
+  }
+}
+
+const uint8_t *
+CborReader::take (size_t len)
+{
+  const uint8_t *data = pos;
+
+  if (len > (size_t) (end - pos) ) {
+    malformed ("truncated item");
+  }
+
+  pos += len;
+  return data;
+}
+
+uint64_t
+CborReader::readHead (uint8_t &major, uint8_t &info)
+{
+  uint8_t head = *take (1);
+  uint64_t value = 0;
+  int bytes;
+
+  major = head >> 5;
+  info = head & 0x1f;
+
+  if (info < 24) {
+    return info;
+  }
+
+  switch (info) {
+  case 24:
+    bytes = 1;
+    break;
+
+  case 25:
+    bytes = 2;
+    break;
+
+  case 26:
+    bytes = 4;
+    break;
+
+  case 27:
+    bytes = 8;
+    break;
+
+  default:
+    malformed ("indefinite lengths are not supported");
+    return 0;
+  }
+
+  const uint8_t *data = take (bytes);
+
+  for (int i = 0; i < bytes; i++) {
+    value = (value << 8) | data[i];
+  }
+
+  return value;
+}
+
+void
+CborReader::skipTags ()
+{
+  while (pos < end && (*pos >> 5) == MAJOR_TAG) {
+    uint8_t major, info;
+
+    readHead (major, info);
+  }
+}
+
+CborReader::Type
+CborReader::peek ()
+{
+  skipTags ();
+
+  if (pos == end) {
+    return END;
+  }
+
+  switch (*pos >> 5) {
+  case MAJOR_UNSIGNED:
+    return UNSIGNED;
+
+  case MAJOR_NEGATIVE:
+    return NEGATIVE;
+
+  case MAJOR_BYTES:
+    return BYTES;
+
+  case MAJOR_TEXT:
+    return TEXT;
+
+  case MAJOR_ARRAY:
+    return ARRAY;
+
+  case MAJOR_MAP:
+    return MAP;
+
+  default:
+    break;
+  }
+
+  switch (*pos & 0x1f) {
+  case SIMPLE_FALSE:
+  case SIMPLE_TRUE:
+    return BOOLEAN;
+
+  case SIMPLE_NULL:
+  case SIMPLE_UNDEFINED:
+    return NONE;
+
+  case SIMPLE_HALF:
+  case SIMPLE_FLOAT:
+  case SIMPLE_DOUBLE:
+    return FLOAT;
+
+  default:
+    malformed ("unsupported simple value");
+    return END;
+  }
+}
+
+uint64_t
+CborReader::readLength (uint8_t expected)
+{
+  uint8_t major, info;
+  uint64_t value;
+
+  skipTags ();
+  value = readHead (major, info);
+
+  if (major != expected) {
+    malformed ("unexpected item type");
+  }
+
+  return value;
+}
+
+uint64_t
+CborReader::readUInt ()
+{
+  return readLength (MAJOR_UNSIGNED);
+}
+
+int64_t
+CborReader::readInt ()
+{
+  Type type = peek ();
+  uint64_t value;
+
+  if (type != UNSIGNED && type != NEGATIVE) {
+    malformed ("expected an integer");
+  }
+
+  value = readLength (type == UNSIGNED ? MAJOR_UNSIGNED : MAJOR_NEGATIVE);
+
+  if (value > (uint64_t) std::numeric_limits<int64_t>::max () ) {
+    malformed ("integer out of range");
+  }
+
+  return type == UNSIGNED ? (int64_t) value : -1 - (int64_t) value;
+}
+
+static double
+halfToDouble (uint16_t half)
+{
+  int exponent = (half >> 10) & 0x1f;
+  int mantissa = half & 0x3ff;
+  double value;
+
+  if (exponent == 0) {
+    value = std::ldexp (mantissa, -24);
+  } else if (exponent != 31) {
+    value = std::ldexp (mantissa + 1024, exponent - 25);
+  } else {
+    value = mantissa == 0 ? std::numeric_limits<double>::infinity () :
+            std::numeric_limits<double>::quiet_NaN ();
+  }
+
+  return (half & 0x8000) ? -value : value;
+}
+
+double
+CborReader::readDouble ()
+{
+  Type type = peek ();
+  uint8_t major, info;
+  uint64_t bits;
+
+  if (type == UNSIGNED || type == NEGATIVE) {
+    return readInt ();
+  } else if (type != FLOAT) {
+    malformed ("expected a number");
+  }
+
+  bits = readHead (major, info);
+
+  if (info == SIMPLE_HALF) {
+    return halfToDouble (bits);
+  } else if (info == SIMPLE_FLOAT) {
+    uint32_t bits32 = bits;
+    float value;
+
+    std::memcpy (&value, &bits32, sizeof (value) );
+    return value;
+  } else {
+    double value;
+
+    std::memcpy (&value, &bits, sizeof (value) );
+    return value;
+  }
+}
+
+bool
+CborReader::readBool ()
+{
+  uint8_t major, info;
+
+  if (peek () != BOOLEAN) {
+    malformed ("expected a boolean");
+  }
+
+  readHead (major, info);
+
+  return info == SIMPLE_TRUE;
+}
+
+void
+CborReader::readNull ()
+{
+  uint8_t major, info;
+
+  if (peek () != NONE) {
+    malformed ("expected null");
+  }
+
+  readHead (major, info);
+}
+
+void
+CborReader::readString (const char *&str, size_t &len)
+{
+  Type type = peek ();
+  uint64_t length;
+
+  if (type != TEXT && type != BYTES) {
+    malformed ("expected a string");
+  }
+
+  length = readLength (type == TEXT ? MAJOR_TEXT : MAJOR_BYTES);
+
+  if (length > (uint64_t) (end - pos) ) {
+    malformed ("truncated string");
+  }
+
+  str = reinterpret_cast<const char *> (take (length) );
+  len = length;
+}
+
+std::string
+CborReader::readString ()
+{
+  const char *str;
+  size_t len;
+
+  readString (str, len);
+
+  return std::string (str, len);
+}
+
+size_t
+CborReader::readArray ()
+{
+  uint64_t len = readLength (MAJOR_ARRAY);
+
+  /* Every item takes at least one byte */
+  if (len > (uint64_t) (end - pos) ) {
+    malformed ("truncated array");
+  }
+
+  return len;
+}
+
+size_t
+CborReader::readMap ()
+{
+  uint64_t len = readLength (MAJOR_MAP);
+
+  if (len > (uint64_t) (end - pos) / 2) {
+    malformed ("truncated map");
+  }
+
+  return len;
+}
+
+void
+CborReader::skip ()
+{
+  skip (0);
+}
+
+void
+CborReader::skip (int depth)
+{
+  const char *str;
+  size_t len;
+
+  if (depth > MAX_DEPTH) {
+    malformed ("too deeply nested");
+  }
+
+  switch (peek () ) {
+  case UNSIGNED:
+  case NEGATIVE:
+  case BOOLEAN:
+  case NONE:
+  case FLOAT: {
+    uint8_t major, info;
+
+    readHead (major, info);
+    break;
+  }
+
+  case BYTES:
+  case TEXT:
+    readString (str, len);
+    break;
+
+  case ARRAY:
+    for (size_t i = readArray (); i > 0; i--) {
+      skip (depth + 1);
+    }
+
+    break;
+
+  case MAP:
+    for (size_t i = readMap (); i > 0; i--) {
+      skip (depth + 1);
+      skip (depth + 1);
+    }
+
+    break;
+
+  case END:
+    malformed ("truncated item");
+  }
+}
+
+void
+CborReader::read (Json::Value &value)
+{
+  read (value, 0);
+}
+
+void
+CborReader::read (Json::Value &value, int depth)
+{
+  const char *str;
+  size_t len;
+
+  if (depth > MAX_DEPTH) {
+    malformed ("too deeply nested");
+  }
+
+  switch (peek () ) {
+  case UNSIGNED: {
+    uint64_t number = readUInt ();
+
+    /* Same types Json::Reader would give to the number */
+    if (number <= (uint64_t) std::numeric_limits<Json::Value::LargestInt>::max () ) {
+      value = Json::Value (static_cast<Json::Value::LargestInt> (number) );
+    } else {
+      value = Json::Value (static_cast<Json::Value::LargestUInt> (number) );
+    }
+
+    break;
+  }
+
+  case NEGATIVE:
+    value = Json::Value (static_cast<Json::Value::LargestInt> (readInt () ) );
+    break;
+
+  case FLOAT:
+    value = Json::Value (readDouble () );
+    break;
+
+  case BOOLEAN:
+    value = Json::Value (readBool () );
+    break;
+
+  case NONE:
+    readNull ();
+    value = Json::Value ();
+    break;
+
+  case BYTES:
+  case TEXT:
+    readString (str, len);
+    value = Json::Value (str, str + len);
+    break;
+
+  case ARRAY: {
+    size_t size = readArray ();
+
+    value = Json::Value (Json::arrayValue);
+
+    if (size > 0) {
+      value.resize (size);
+    }
+
+    for (size_t i = 0; i < size; i++) {
+      read (value[ (Json::ArrayIndex) i], depth + 1);
+    }
+
+    break;
+  }
+
+  case MAP: {
+    size_t size = readMap ();
+
+    value = Json::Value (Json::objectValue);
+
+    for (size_t i = 0; i < size; i++) {
+      std::string key = readString ();
+
+      read (value[key], depth + 1);
+    }
+
+    break;
+  }
+
+  case END:
+    malformed ("truncated item");
+  }
+}
+
+} /* kurento */
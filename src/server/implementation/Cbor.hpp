@@ -0,0 +1,110 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __CBOR_HPP__
+#define __CBOR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <json/json.h>
+
+namespace kurento
+{
+
+/* Appends CBOR (RFC 7049) items to a buffer, always with definite lengths */
+class CborWriter
+{
+public:
+  CborWriter (std::string &out) : out (out) {}
+
+  void writeUInt (uint64_t value);
+  void writeInt (int64_t value);
+  void writeDouble (double value);
+  void writeBool (bool value);
+  void writeNull ();
+  void writeString (const char *str, size_t len);
+  void writeString (const std::string &str)
+  {
+    writeString (str.data(), str.size() );
+  }
+
+  /* Must be followed by @len items, or @len key and value pairs for maps */
+  void writeArray (size_t len);
+  void writeMap (size_t len);
+
+  void write (const Json::Value &value);
+
+private:
+  void writeHead (uint8_t major, uint64_t value);
+
+  std::string &out;
+};
+
+/*
+ * Reads CBOR items in place. Strings are returned as pointers into the
+ * buffer, so callers can compare or copy only what they need. Every read
+ * method throws KurentoException if the next item is not of the requested
+ * type or the buffer is truncated.
+ */
+class CborReader
+{
+public:
+  enum Type {
+    UNSIGNED, NEGATIVE, BYTES, TEXT, ARRAY, MAP, BOOLEAN, NONE, FLOAT, END
+  };
+
+  CborReader (const char *data, size_t size) :
+    pos (reinterpret_cast<const uint8_t *> (data) ),
+    end (reinterpret_cast<const uint8_t *> (data) + size) {}
+
+  Type peek ();
+
+  uint64_t readUInt ();
+  int64_t readInt ();
+  double readDouble ();
+  bool readBool ();
+  void readNull ();
+  /* Text and byte strings */
+  void readString (const char *&str, size_t &len);
+  std::string readString ();
+  size_t readArray ();
+  size_t readMap ();
+
+  /* Skips the next item, including its children */
+  void skip ();
+
+  void read (Json::Value &value);
+
+  bool atEnd () const
+  {
+    return pos == end;
+  }
+
+private:
+  uint64_t readHead (uint8_t &major, uint8_t &info);
+  uint64_t readLength (uint8_t expected);
+  const uint8_t *take (size_t len);
+  void skipTags ();
+  void read (Json::Value &value, int depth);
+  void skip (int depth);
+
+  const uint8_t *pos;
+  const uint8_t *end;
+};
+
+} /* kurento */
+
+#endif /* __CBOR_HPP__ */
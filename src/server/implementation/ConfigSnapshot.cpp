@@ -0,0 +1,155 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "ConfigSnapshot.hpp"
+
+#include <CodecConfiguration.hpp>
+#include <mutex>
+#include <vector>
+
+namespace kurento
+{
+
+/* Same conversion as boost::property_tree::write_json */
+static Json::Value
+toJson (const boost::property_tree::ptree &tree)
+{
+  Json::Value value;
+
+  if (tree.empty () ) {
+    return Json::Value (tree.data () );
+  }
+
+  bool isArray = tree.count ("") == tree.size ();
+
+  for (auto &child : tree) {
+    if (isArray) {
+      value.append (toJson (child.second) );
+    } else {
+      value[child.first] = toJson (child.second);
+    }
+  }
+
+  return value;
+}
+
+/* A value that cannot be read as T is left to fail again when requested */
+template <class T>
+void
+ConfigSnapshot::precompute (const std::string &path)
+{
+  std::shared_ptr<Precomputed<T>> typed (new Precomputed<T> () );
+
+  try {
+    if (deserialize (path, typed->value) ) {
+      precomputed[path] = typed;
+    }
+  } catch (std::exception &e) {
+  }
+}
+
+ConfigSnapshot::ConfigSnapshot (const boost::property_tree::ptree &config)
+{
+  Json::Value root = toJson (config);
+
+  if (root.isObject () ) {
+    for (auto &name : root.getMemberNames () ) {
+      index (name, root[name]);
+    }
+  }
+
+  /* Keys read by every new element, under any module and type */
+  for (auto &value : values) {
+    const std::string &path = value.first;
+    std::string key = path.substr (path.rfind ('.') + 1);
+
+    if (key == "outputBitrate") {
+      precompute<int> (path);
+    } else if (key == "numAudioMedias" || key == "numVideoMedias") {
+      precompute<unsigned int> (path);
+    } else if (key == "audioCodecs" || key == "videoCodecs") {
+      precompute<std::vector<std::shared_ptr<CodecConfiguration>>> (path);
+    }
+  }
+}
+
+void
+ConfigSnapshot::index (const std::string &path, const Json::Value &value)
+{
+  values[path] = value;
+
+  if (!value.isObject () ) {
+    return;
+  }
+
+  for (auto &name : value.getMemberNames () ) {
+    index (path + "." + name, value[name]);
+  }
+}
+
+const Json::Value *
+ConfigSnapshot::find (const std::string &path) const
+{
+  auto it = values.find (path);
+
+  if (it == values.end () ) {
+    return NULL;
+  }
+
+  return &it->second;
+}
+
+static std::mutex publishedMutex;
+static const boost::property_tree::ptree *publishedConfig = NULL;
+static std::shared_ptr<const ConfigSnapshot> publishedSnapshot;
+
+void
+ConfigSnapshot::publish (const boost::property_tree::ptree &config)
+{
+  std::shared_ptr<const ConfigSnapshot> snapshot (new ConfigSnapshot (config) );
+  std::unique_lock<std::mutex> lock (publishedMutex);
+
+  publishedConfig = &config;
+  publishedSnapshot.swap (snapshot);
+}
+
+void
+ConfigSnapshot::withdraw (const boost::property_tree::ptree &config)
+{
+  std::shared_ptr<const ConfigSnapshot> snapshot;
+  std::unique_lock<std::mutex> lock (publishedMutex);
+
+  /* Another tree could be created later at the same address */
+  if (publishedConfig == &config) {
+    publishedConfig = NULL;
+    publishedSnapshot.swap (snapshot);
+  }
+}
+
+std::shared_ptr<const ConfigSnapshot>
+ConfigSnapshot::get (const boost::property_tree::ptree &config)
+{
+  {
+    std::unique_lock<std::mutex> lock (publishedMutex);
+
+    if (publishedConfig == &config) {
+      return publishedSnapshot;
+    }
+  }
+
+  return std::shared_ptr<const ConfigSnapshot> (new ConfigSnapshot (config) );
+}
+
+} /* kurento */
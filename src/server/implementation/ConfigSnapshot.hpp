@@ -0,0 +1,121 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __CONFIG_SNAPSHOT_HPP__
+#define __CONFIG_SNAPSHOT_HPP__
+
+#include <boost/property_tree/ptree.hpp>
+#include <json/json.h>
+#include <jsonrpc/JsonSerializer.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace kurento
+{
+
+/*
+ * Immutable view of a configuration tree, indexed by full path, so values can
+ * be read without walking the tree or parsing it again. Reads take no lock.
+ */
+class ConfigSnapshot
+{
+public:
+  ConfigSnapshot (const boost::property_tree::ptree &config);
+
+  /*
+   * Builds the snapshot of @config returned by get. It has to be called again
+   * every time @config is reloaded, and withdrawn before @config is destroyed.
+   */
+  static void publish (const boost::property_tree::ptree &config);
+  static void withdraw (const boost::property_tree::ptree &config);
+
+  /* Snapshot published for @config, or a new one if there is none */
+  static std::shared_ptr<const ConfigSnapshot> get (const
+      boost::property_tree::ptree &config);
+
+  /* Returns NULL if @path is not in the configuration */
+  const Json::Value *find (const std::string &path) const;
+
+  /*
+   * Returns false if @path is not in the configuration, throws
+   * KurentoException if it cannot be read as T. Values read for every new
+   * element (output bitrate, media counts and codec lists) are deserialized
+   * once, when the snapshot is built, and copied from there. The codec
+   * objects of those lists are shared by every reader and must not be
+   * modified.
+   */
+  template <class T>
+  bool get (const std::string &path, T &value) const
+  {
+    auto it = precomputed.find (path);
+
+    if (it != precomputed.end () ) {
+      const Precomputed<T> *typed =
+        dynamic_cast<const Precomputed<T> *> (it->second.get () );
+
+      if (typed != NULL) {
+        value = typed->value;
+        return true;
+      }
+    }
+
+    return deserialize (path, value);
+  }
+
+private:
+  class PrecomputedBase
+  {
+  public:
+    virtual ~PrecomputedBase () {};
+  };
+
+  template <class T>
+  class Precomputed : public PrecomputedBase
+  {
+  public:
+    T value {};
+  };
+
+  template <class T>
+  bool deserialize (const std::string &path, T &value) const
+  {
+    const Json::Value *json = find (path);
+
+    if (json == NULL) {
+      return false;
+    }
+
+    kurento::JsonSerializer serializer (false);
+
+    serializer.JsonValue["val"] = *json;
+    serializer.Serialize ("val", value);
+
+    return true;
+  }
+
+  template <class T>
+  void precompute (const std::string &path);
+
+  void index (const std::string &path, const Json::Value &value);
+
+  std::unordered_map<std::string, Json::Value> values;
+  std::unordered_map<std::string, std::shared_ptr<const PrecomputedBase>>
+      precomputed;
+};
+
+} /* kurento */
+
+#endif /* __CONFIG_SNAPSHOT_HPP__ */
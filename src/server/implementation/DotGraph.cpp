@@ -15,6 +15,10 @@
 
 #include "DotGraph.hpp"
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
 
 namespace kurento
 {
@@ -103,12 +107,11 @@ debug_dump_make_object_name (GstObject *obj)
   return ret;
 }
 
-static std::string
-debug_dump_pad (GstPad *pad, const std::string &colorName,
+static void
+debug_dump_pad (GraphSink &out, GstPad *pad, const std::string &colorName,
                 const std::string &elementName, GstDebugGraphDetails details,
                 const std::string &indentStr)
 {
-  std::string ret;
   GstPadTemplate *pad_templ;
   GstPadPresence presence;
   std::string padName;
@@ -165,25 +168,23 @@ debug_dump_pad (GstPad *pad, const std::string &colorName,
     padFlags.append (GST_OBJECT_FLAG_IS_SET (pad,
                      GST_PAD_FLAG_BLOCKING) ? "B" : "b");
 
-    ret += indentStr + "  " + elementName + "_" + padName +
-           " [color=black, fillcolor=\"" + colorName + "\", label=\"" + std::string (
-             GST_OBJECT_NAME (pad) ) + "\\n[" + activationMode[pad->mode] + "][" + padFlags +
-           "]" + taskMode + "\", height=\"0.2\", style=\"" + styleName + "\"];\n";
+    out.write (indentStr + "  " + elementName + "_" + padName +
+               " [color=black, fillcolor=\"" + colorName + "\", label=\"" + std::string (
+                 GST_OBJECT_NAME (pad) ) + "\\n[" + activationMode[pad->mode] + "][" +
+               padFlags + "]" + taskMode + "\", height=\"0.2\", style=\"" + styleName +
+               "\"];\n");
   } else {
-    ret += indentStr + "  " + elementName + "_" + padName +
-           " [color=black, fillcolor=\"" + colorName + "\", label=\"" + std::string (
-             GST_OBJECT_NAME (pad) ) + "\", height=\"0.2\", style=\"" + styleName + "\"];\n";
+    out.write (indentStr + "  " + elementName + "_" + padName +
+               " [color=black, fillcolor=\"" + colorName + "\", label=\"" + std::string (
+                 GST_OBJECT_NAME (pad) ) + "\", height=\"0.2\", style=\"" + styleName +
+               "\"];\n");
   }
-
-  return ret;
 }
 
-static std::string
-debug_dump_element_pad (GstPad *pad, GstElement *element,
+static void
+debug_dump_element_pad (GraphSink &out, GstPad *pad, GstElement *element,
                         GstDebugGraphDetails details, const gint indent)
 {
-  std::string ret;
-
   GstElement *target_element;
   GstPad *target_pad, *tmp_pad;
   GstPadDirection dir;
@@ -211,18 +212,19 @@ debug_dump_element_pad (GstPad *pad, GstElement *element,
             debug_dump_make_object_name (GST_OBJECT (target_element) );
         }
 
-        ret += debug_dump_pad (target_pad, colorName, targetElementName, details,
-                               indentStr);
+        debug_dump_pad (out, target_pad, colorName, targetElementName, details,
+                        indentStr);
         /* src ghostpad relationship */
         padName = debug_dump_make_object_name (GST_OBJECT (pad) );
         targetPadName = debug_dump_make_object_name (GST_OBJECT (target_pad) );
 
         if (dir == GST_PAD_SRC) {
-          ret += indentStr + targetElementName + "_" + targetPadName + " -> " +
-                 elementName + "_" + padName + " [style=dashed, minlen=0]\n";
+          out.write (indentStr + targetElementName + "_" + targetPadName + " -> " +
+                     elementName + "_" + padName + " [style=dashed, minlen=0]\n");
         } else {
-          ret += indentStr + elementName + "_" + padName + " -> " + targetElementName +
-                 "_" + targetPadName + " [style=dashed, minlen=0]\n";
+          out.write (indentStr + elementName + "_" + padName + " -> " +
+                     targetElementName + "_" + targetPadName +
+                     " [style=dashed, minlen=0]\n");
         }
 
         if (target_element) {
@@ -241,20 +243,17 @@ debug_dump_element_pad (GstPad *pad, GstElement *element,
   }
 
   /* pads */
-  ret += debug_dump_pad (pad, colorName, elementName, details, indentStr);
-
-  return ret;
+  debug_dump_pad (out, pad, colorName, elementName, details, indentStr);
 }
 
-static std::string
-debug_dump_element_pads (GstIterator *pad_iter, GstPad *pad,
+static void
+debug_dump_element_pads (GraphSink &out, GstIterator *pad_iter, GstPad *pad,
                          GstElement *element, GstDebugGraphDetails details, const gint indent,
                          guint *src_pads, guint *sink_pads)
 {
   GValue item = { 0, };
   gboolean pads_done;
   GstPadDirection dir;
-  std::string ret;
 
   pads_done = FALSE;
 
@@ -262,7 +261,7 @@ debug_dump_element_pads (GstIterator *pad_iter, GstPad *pad,
     switch (gst_iterator_next (pad_iter, &item) ) {
     case GST_ITERATOR_OK:
       pad = GST_PAD (g_value_get_object (&item) );
-      ret += debug_dump_element_pad (pad, element, details, indent);
+      debug_dump_element_pad (out, pad, element, details, indent);
       dir = gst_pad_get_direction (pad);
 
       if (dir == GST_PAD_SRC) {
@@ -284,8 +283,6 @@ debug_dump_element_pads (GstIterator *pad_iter, GstPad *pad,
       break;
     }
   }
-
-  return ret;
 }
 
 static gboolean
@@ -395,11 +392,10 @@ debug_dump_describe_caps (GstCaps *caps, GstDebugGraphDetails details)
   return media;
 }
 
-static std::string
-debug_dump_element_pad_link (GstPad *pad, GstElement *element,
+static void
+debug_dump_element_pad_link (GraphSink &out, GstPad *pad, GstElement *element,
                              GstDebugGraphDetails details, const std::string &indentStr)
 {
-  std::string ret;
   GstElement *peer_element;
   GstPad *peer_pad;
   GstCaps *caps, *peer_caps;
@@ -461,17 +457,17 @@ debug_dump_element_pad_link (GstPad *pad, GstElement *element,
     }
 
     /* pad link */
-    ret += indentStr + elementName + "_" + padName + " -> " + peerElementName +
-           "_" + peerPadName;
+    out.write (indentStr + elementName + "_" + padName + " -> " + peerElementName +
+               "_" + peerPadName);
 
     if (!media.empty() ) {
-      ret += " [label=\"" + media + "\"]\n";
+      out.write (" [label=\"" + media + "\"]\n");
     } else if (!mediaSrc.empty() && !mediaSink.empty() ) {
       /* dot has some issues with placement of head and taillabels,
        * we need an empty label to make space */
-      ret += " [labeldistance=\"10\", labelangle=\"0\", "
-             "label=\"                                                  \", "
-             "taillabel=\"" + mediaSrc + "\", headlabel=\"" + mediaSink + "\"]\n";
+      out.write (" [labeldistance=\"10\", labelangle=\"0\", "
+                 "label=\"                                                  \", "
+                 "taillabel=\"" + mediaSrc + "\", headlabel=\"" + mediaSink + "\"]\n");
     }
 
     if (peer_element) {
@@ -480,21 +476,78 @@ debug_dump_element_pad_link (GstPad *pad, GstElement *element,
 
     gst_object_unref (peer_pad);
   }
-
-  return ret;
 }
 
-static std::string
-debug_dump_element (GstBin *bin, GstDebugGraphDetails details,
-                    const gint indent)
+/* Whether a bin at @level, the root being 1, shows its children */
+static bool
+expand_bin (const gint level, const gint depth)
 {
-  std::string ret;
+  return depth <= 0 || level <= depth;
+}
 
-  GstIterator *element_iter, *pad_iter;
-  gboolean elements_done, pads_done;
+static void debug_dump_element (GraphSink &out, GstBin *bin,
+                                GstDebugGraphDetails details, const gint indent, const gint level,
+                                const gint depth);
+
+static void
+debug_dump_element_links (GraphSink &out, GstElement *element,
+                          GstDebugGraphDetails details, const std::string &indentStr)
+{
+  GstIterator *pad_iter;
+  gboolean pads_done;
   GValue item = { 0, };
-  GValue item2 = { 0, };
-  GstElement *element;
+  GstPad *pad;
+
+  if ( (pad_iter = gst_element_iterate_pads (element) ) ) {
+    pads_done = FALSE;
+
+    while (!pads_done) {
+      switch (gst_iterator_next (pad_iter, &item) ) {
+      case GST_ITERATOR_OK:
+        pad = GST_PAD (g_value_get_object (&item) );
+
+        if (gst_pad_is_linked (pad) ) {
+          if (gst_pad_get_direction (pad) == GST_PAD_SRC) {
+            debug_dump_element_pad_link (out, pad, element, details, indentStr);
+          } else {
+            GstPad *peer_pad = gst_pad_get_peer (pad);
+
+            if (peer_pad) {
+              if (!GST_IS_GHOST_PAD (peer_pad)
+                  && GST_IS_PROXY_PAD (peer_pad) ) {
+                debug_dump_element_pad_link (out, peer_pad, NULL, details, indentStr);
+              }
+
+              gst_object_unref (peer_pad);
+            }
+          }
+        }
+
+        g_value_reset (&item);
+        break;
+
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (pad_iter);
+        break;
+
+      case GST_ITERATOR_ERROR:
+      case GST_ITERATOR_DONE:
+        pads_done = TRUE;
+        break;
+      }
+    }
+
+    g_value_unset (&item);
+    gst_iterator_free (pad_iter);
+  }
+}
+
+static void
+debug_dump_single_element (GraphSink &out, GstElement *element,
+                           GstDebugGraphDetails details, const gint indent, const gint level,
+                           const gint depth)
+{
+  GstIterator *pad_iter;
   GstPad *pad = NULL;
   guint src_pads, sink_pads;
   std::string elementName;
@@ -502,173 +555,825 @@ debug_dump_element (GstBin *bin, GstDebugGraphDetails details,
   std::string params;
   std::string indentStr (indent * 2, ' ');
 
+  elementName = debug_dump_make_object_name (GST_OBJECT (element) );
+
+  if (details & GST_DEBUG_GRAPH_SHOW_STATES) {
+    stateName = debug_dump_get_element_state (GST_ELEMENT (element) );
+  }
+
+  if (details & GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS) {
+    params = debug_dump_get_element_params (GST_ELEMENT (element) );
+  }
+
+  /* elements */
+  out.write (indentStr + "subgraph cluster_" + elementName + " {\n");
+  out.write (indentStr + "  fontname=\"Bitstream Vera Sans\";\n");
+  out.write (indentStr + "  fontsize=\"8\";\n");
+  out.write (indentStr + "  style=filled;\n");
+  out.write (indentStr + "  color=black;\n\n");
+  out.write (indentStr + "  label=\"" + std::string (G_OBJECT_TYPE_NAME (
+               element) ) + "\\n" + std::string (GST_OBJECT_NAME (element) ) + stateName +
+             params + "\";\n");
+
+  src_pads = sink_pads = 0;
+
+  if ( (pad_iter = gst_element_iterate_sink_pads (element) ) ) {
+    debug_dump_element_pads (out, pad_iter, pad, element, details, indent,
+                             &src_pads, &sink_pads);
+    gst_iterator_free (pad_iter);
+  }
+
+  if ( (pad_iter = gst_element_iterate_src_pads (element) ) ) {
+    debug_dump_element_pads (out, pad_iter, pad, element, details, indent,
+                             &src_pads, &sink_pads);
+    gst_iterator_free (pad_iter);
+  }
+
+  if (GST_IS_BIN (element) ) {
+    out.write (indentStr + "  fillcolor=\"#ffffff\";\n");
+
+    /* recurse, unless the depth limit is reached */
+    if (expand_bin (level, depth) ) {
+      debug_dump_element (out, GST_BIN (element), details, indent + 1, level + 1,
+                          depth);
+    }
+  } else {
+    if (src_pads && !sink_pads) {
+      out.write (indentStr + "  fillcolor=\"#ffaaaa\";\n");
+    } else if (!src_pads && sink_pads) {
+      out.write (indentStr + "  fillcolor=\"#aaaaff\";\n");
+    } else if (src_pads && sink_pads) {
+      out.write (indentStr + "  fillcolor=\"#aaffaa\";\n");
+    } else {
+      out.write (indentStr + "  fillcolor=\"#ffffff\";\n");
+    }
+  }
+
+  out.write (indentStr + "}\n\n");
+
+  debug_dump_element_links (out, element, details, indentStr);
+}
+
+static void
+debug_dump_element (GraphSink &out, GstBin *bin, GstDebugGraphDetails details,
+                    const gint indent, const gint level, const gint depth)
+{
+  GstIterator *element_iter;
+  gboolean elements_done;
+  GValue item = { 0, };
+
   element_iter = gst_bin_iterate_elements (bin);
   elements_done = FALSE;
 
   while (!elements_done) {
     switch (gst_iterator_next (element_iter, &item) ) {
     case GST_ITERATOR_OK:
-      element = GST_ELEMENT (g_value_get_object (&item) );
-      elementName = debug_dump_make_object_name (GST_OBJECT (element) );
+      debug_dump_single_element (out, GST_ELEMENT (g_value_get_object (&item) ),
+                                 details, indent, level, depth);
+      g_value_reset (&item);
+      break;
 
-      if (details & GST_DEBUG_GRAPH_SHOW_STATES) {
-        stateName = debug_dump_get_element_state (GST_ELEMENT (element) );
-      }
+    case GST_ITERATOR_RESYNC:
+      gst_iterator_resync (element_iter);
+      break;
 
-      if (details & GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS) {
-        params = debug_dump_get_element_params (GST_ELEMENT (element) );
-      }
+    case GST_ITERATOR_ERROR:
+    case GST_ITERATOR_DONE:
+      elements_done = TRUE;
+      break;
+    }
+  }
 
-      /* elements */
-      ret += indentStr + "subgraph cluster_" + elementName + " {\n";
-      ret += indentStr + "  fontname=\"Bitstream Vera Sans\";\n";
-      ret += indentStr + "  fontsize=\"8\";\n";
-      ret += indentStr + "  style=filled;\n";
-      ret += indentStr + "  color=black;\n\n";
-      ret += indentStr + "  label=\"" + std::string (G_OBJECT_TYPE_NAME (
-               element) ) + "\\n" + std::string (GST_OBJECT_NAME (element) ) + stateName +
-             params + "\";\n",
+  g_value_unset (&item);
+  gst_iterator_free (element_iter);
+}
 
-             src_pads = sink_pads = 0;
+/* Returns a new reference to the element the graph starts from */
+static GstElement *
+get_graph_root (GstBin *bin, const GraphFilter &filter)
+{
+  if (filter.root.empty () ) {
+    return GST_ELEMENT (gst_object_ref (bin) );
+  }
 
-      if ( (pad_iter = gst_element_iterate_sink_pads (element) ) ) {
-        ret += debug_dump_element_pads (pad_iter, pad, element, details, indent,
-                                        &src_pads, &sink_pads);
-        gst_iterator_free (pad_iter);
-      }
+  return gst_bin_get_by_name (bin, filter.root.c_str () );
+}
 
-      if ( (pad_iter = gst_element_iterate_src_pads (element) ) ) {
-        ret += debug_dump_element_pads (pad_iter, pad, element, details, indent,
-                                        &src_pads, &sink_pads);
-        gst_iterator_free (pad_iter);
-      }
+std::string
+generateDotGraph (GstBin *bin, GstDebugGraphDetails details)
+{
+  StringGraphSink sink;
 
-      if (GST_IS_BIN (element) ) {
-        ret += indentStr + "  fillcolor=\"#ffffff\";\n";
-        /* recurse */
-        ret += debug_dump_element (GST_BIN (element), details, indent + 1);
+  g_return_val_if_fail (GST_IS_BIN (bin), "");
+
+  generateDotGraph (bin, details, sink);
+
+  return std::move (sink.getString () );
+}
+
+bool
+generateDotGraph (GstBin *bin, GstDebugGraphDetails details, GraphSink &sink,
+                  const GraphFilter &filter)
+{
+  GstElement *root;
+  std::string stateName;
+  std::string params;
+
+  g_return_val_if_fail (GST_IS_BIN (bin), false);
+
+  root = get_graph_root (bin, filter);
+
+  if (root == NULL) {
+    return false;
+  }
+
+  if (details & GST_DEBUG_GRAPH_SHOW_STATES) {
+    stateName = debug_dump_get_element_state (root);
+  }
+
+  if (details & GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS) {
+    params = debug_dump_get_element_params (root);
+  }
+
+  /* write header */
+  sink.write (
+    "digraph pipeline {\n"
+    "  rankdir=LR;\n"
+    "  fontname=\"sans\";\n"
+    "  fontsize=\"10\";\n"
+    "  labelloc=t;\n"
+    "  nodesep=.1;\n"
+    "  ranksep=.2;\n"
+    "  label=\"<" + std::string (G_OBJECT_TYPE_NAME (root) ) + ">\\n" + std::string (
+      GST_OBJECT_NAME (root) ) + stateName + params + "\";\n"
+    "  node [style=filled, shape=box, fontsize=\"9\", fontname=\"sans\", margin=\"0.0,0.0\"];\n"
+    "  edge [labelfontsize=\"6\", fontsize=\"9\", fontname=\"monospace\"];\n"
+    "  \n"
+    "  legend [\n"
+    "    pos=\"0,0!\",\n"
+    "    margin=\"0.05,0.05\",\n"
+    "    label=\"Legend\\lElement-States: [~] void-pending, [0] null, [-] ready, [=] paused, [>] playing\\lPad-Activation: [-] none, [>] push, [<] pull\\lPad-Flags: [b]locked, [f]lushing, [b]locking; upper-case is set\\lPad-Task: [T] has started task, [t] has paused task\\l\"\n"
+    "  ];"
+    "\n");
+
+  /* Children of the root are at level 2 */
+  if (GST_IS_BIN (root) ) {
+    debug_dump_element (sink, GST_BIN (root), details, 1, 2, filter.depth);
+  } else {
+    debug_dump_single_element (sink, root, details, 1, 1, filter.depth);
+  }
+
+  /* write footer */
+  sink.write ("}\n");
+  sink.flush ();
+
+  gst_object_unref (root);
+
+  return true;
+}
+
+static void
+json_write_string (GraphSink &out, const char *str)
+{
+  std::string escaped ("\"");
+
+  for (const char *c = str; c != NULL && *c != '\0'; c++) {
+    switch (*c) {
+    case '"':
+      escaped += "\\\"";
+      break;
+
+    case '\\':
+      escaped += "\\\\";
+      break;
+
+    case '\n':
+      escaped += "\\n";
+      break;
+
+    default:
+      if ( (guchar) * c < 0x20) {
+        gchar hex[7];
+
+        g_snprintf (hex, sizeof (hex), "\\u%04x", (guchar) * c);
+        escaped += hex;
       } else {
-        if (src_pads && !sink_pads) {
-          ret += indentStr + "  fillcolor=\"#ffaaaa\";\n";
-        } else if (!src_pads && sink_pads) {
-          ret += indentStr + "  fillcolor=\"#aaaaff\";\n";
-        } else if (src_pads && sink_pads) {
-          ret += indentStr + "  fillcolor=\"#aaffaa\";\n";
-        } else {
-          ret += indentStr + "  fillcolor=\"#ffffff\";\n";
-        }
+        escaped += *c;
       }
+    }
+  }
+
+  escaped += "\"";
+  out.write (escaped);
+}
+
+static void
+json_write_path (GraphSink &out, GstObject *object)
+{
+  gchar *path = gst_object_get_path_string (object);
+
+  json_write_string (out, path);
+  g_free (path);
+}
 
-      ret += indentStr + "}\n\n";
+static void
+json_dump_caps (GraphSink &out, GstPad *pad, GstDebugGraphDetails details)
+{
+  GstCaps *caps = gst_pad_get_current_caps (pad);
 
-      if ( (pad_iter = gst_element_iterate_pads (element) ) ) {
-        pads_done = FALSE;
+  if (caps == NULL) {
+    return;
+  }
 
-        while (!pads_done) {
-          switch (gst_iterator_next (pad_iter, &item2) ) {
-          case GST_ITERATOR_OK:
-            pad = GST_PAD (g_value_get_object (&item2) );
+  out.write (", \"caps\": ");
 
-            if (gst_pad_is_linked (pad) ) {
-              if (gst_pad_get_direction (pad) == GST_PAD_SRC) {
-                ret += debug_dump_element_pad_link (pad, element, details, indentStr);
-              } else {
-                GstPad *peer_pad = gst_pad_get_peer (pad);
+  if (details & GST_DEBUG_GRAPH_SHOW_CAPS_DETAILS) {
+    gchar *str = gst_caps_to_string (caps);
 
-                if (peer_pad) {
-                  if (!GST_IS_GHOST_PAD (peer_pad)
-                      && GST_IS_PROXY_PAD (peer_pad) ) {
-                    ret += debug_dump_element_pad_link (peer_pad, NULL, details, indentStr);
-                  }
+    json_write_string (out, str);
+    g_free (str);
+  } else if (GST_CAPS_IS_SIMPLE (caps) ) {
+    json_write_string (out,
+                       gst_structure_get_name (gst_caps_get_structure (caps, 0) ) );
+  } else {
+    json_write_string (out, "*");
+  }
 
-                  gst_object_unref (peer_pad);
-                }
-              }
-            }
+  gst_caps_unref (caps);
+}
 
-            g_value_reset (&item2);
-            break;
+static void
+json_dump_pad (GraphSink &out, GstPad *pad, GstDebugGraphDetails details)
+{
+  GstPad *peer;
 
-          case GST_ITERATOR_RESYNC:
-            gst_iterator_resync (pad_iter);
-            break;
+  out.write ("{\"name\": ");
+  json_write_string (out, GST_OBJECT_NAME (pad) );
+  out.write (", \"direction\": ");
+  json_write_string (out, gst_pad_get_direction (pad) == GST_PAD_SRC ? "src" :
+                     gst_pad_get_direction (pad) == GST_PAD_SINK ? "sink" : "unknown");
 
-          case GST_ITERATOR_ERROR:
-          case GST_ITERATOR_DONE:
-            pads_done = TRUE;
-            break;
-          }
-        }
+  if (GST_IS_GHOST_PAD (pad) ) {
+    GstPad *target = gst_ghost_pad_get_target (GST_GHOST_PAD (pad) );
+
+    if (target) {
+      GstPad *internal = gst_pad_get_peer (target);
 
-        g_value_unset (&item2);
-        gst_iterator_free (pad_iter);
+      if (internal) {
+        out.write (", \"target\": ");
+        json_write_path (out, GST_OBJECT (internal) );
+        gst_object_unref (internal);
       }
 
+      gst_object_unref (target);
+    }
+  }
+
+  if ( (peer = gst_pad_get_peer (pad) ) ) {
+    out.write (", \"peer\": ");
+    json_write_path (out, GST_OBJECT (peer) );
+    gst_object_unref (peer);
+
+    if ( (details & GST_DEBUG_GRAPH_SHOW_MEDIA_TYPE) ||
+         (details & GST_DEBUG_GRAPH_SHOW_CAPS_DETAILS) ) {
+      json_dump_caps (out, pad, details);
+    }
+  }
+
+  out.write ("}");
+}
+
+static void
+json_dump_params (GraphSink &out, GstElement *element)
+{
+  GParamSpec **properties;
+  guint number_of_properties;
+  gboolean first = TRUE;
+
+  properties =
+    g_object_class_list_properties (G_OBJECT_CLASS (GST_ELEMENT_GET_CLASS
+                                    (element) ), &number_of_properties);
+
+  out.write (", \"params\": {");
+
+  for (guint i = 0; properties != NULL && i < number_of_properties; i++) {
+    GParamSpec *property = properties[i];
+    GValue value = { 0, };
+
+    if (! (property->flags & G_PARAM_READABLE) ||
+        !strcmp (property->name, "name") ) {
+      continue;
+    }
+
+    g_value_init (&value, property->value_type);
+    g_object_get_property (G_OBJECT (element), property->name, &value);
+
+    if (! (g_param_value_defaults (property, &value) ) ) {
+      gchar *value_str = g_strdup_value_contents (&value);
+
+      out.write (first ? "" : ", ");
+      json_write_string (out, property->name);
+      out.write (": ");
+      json_write_string (out, value_str);
+      g_free (value_str);
+      first = FALSE;
+    }
+
+    g_value_unset (&value);
+  }
+
+  g_free (properties);
+  out.write ("}");
+}
+
+static void
+json_dump_element (GraphSink &out, GstElement *element,
+                   GstDebugGraphDetails details, const gint level, const gint depth)
+{
+  static const gchar *states[] = {"VOID_PENDING", "NULL", "READY", "PAUSED", "PLAYING"};
+  GstIterator *iter;
+  gboolean done;
+  gboolean first;
+  GValue item = { 0, };
+
+  out.write ("{\"name\": ");
+  json_write_string (out, GST_OBJECT_NAME (element) );
+  out.write (", \"type\": ");
+  json_write_string (out, G_OBJECT_TYPE_NAME (element) );
+
+  if (details & GST_DEBUG_GRAPH_SHOW_STATES) {
+    GstState state = GST_STATE_VOID_PENDING;
+    GstState pending = GST_STATE_VOID_PENDING;
+
+    gst_element_get_state (element, &state, &pending, 0);
+    out.write (", \"state\": ");
+    json_write_string (out, states[state]);
+
+    if (pending != GST_STATE_VOID_PENDING) {
+      out.write (", \"pending\": ");
+      json_write_string (out, states[pending]);
+    }
+  }
+
+  if (details & GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS) {
+    json_dump_params (out, element);
+  }
+
+  out.write (", \"pads\": [");
+  iter = gst_element_iterate_pads (element);
+  done = FALSE;
+  first = TRUE;
+
+  while (!done) {
+    switch (gst_iterator_next (iter, &item) ) {
+    case GST_ITERATOR_OK:
+      out.write (first ? "" : ", ");
+      json_dump_pad (out, GST_PAD (g_value_get_object (&item) ), details);
+      first = FALSE;
       g_value_reset (&item);
       break;
 
     case GST_ITERATOR_RESYNC:
-      gst_iterator_resync (element_iter);
+      gst_iterator_resync (iter);
       break;
 
     case GST_ITERATOR_ERROR:
     case GST_ITERATOR_DONE:
-      elements_done = TRUE;
+      done = TRUE;
       break;
     }
   }
 
   g_value_unset (&item);
-  gst_iterator_free (element_iter);
+  gst_iterator_free (iter);
+  out.write ("]");
+
+  if (GST_IS_BIN (element) && expand_bin (level, depth) ) {
+    out.write (", \"children\": [");
+    iter = gst_bin_iterate_elements (GST_BIN (element) );
+    done = FALSE;
+    first = TRUE;
+
+    while (!done) {
+      switch (gst_iterator_next (iter, &item) ) {
+      case GST_ITERATOR_OK:
+        out.write (first ? "" : ", ");
+        json_dump_element (out, GST_ELEMENT (g_value_get_object (&item) ), details,
+                           level + 1, depth);
+        first = FALSE;
+        g_value_reset (&item);
+        break;
 
-  return ret;
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (iter);
+        break;
+
+      case GST_ITERATOR_ERROR:
+      case GST_ITERATOR_DONE:
+        done = TRUE;
+        break;
+      }
+    }
+
+    g_value_unset (&item);
+    gst_iterator_free (iter);
+    out.write ("]");
+  }
+
+  out.write ("}");
 }
 
-std::string
-generateDotGraph (GstBin *bin, GstDebugGraphDetails details)
+bool
+generateJsonGraph (GstBin *bin, GstDebugGraphDetails details, GraphSink &sink,
+                   const GraphFilter &filter)
 {
-  std::string retString;
+  GstElement *root;
 
-  g_return_val_if_fail (GST_IS_BIN (bin), "");
+  g_return_val_if_fail (GST_IS_BIN (bin), false);
 
-  std::string stateName;
-  std::string params;
+  root = get_graph_root (bin, filter);
 
-  if (details & GST_DEBUG_GRAPH_SHOW_STATES) {
-    stateName = debug_dump_get_element_state (GST_ELEMENT (bin) );
+  if (root == NULL) {
+    return false;
   }
 
-  if (details & GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS) {
-    params = debug_dump_get_element_params (GST_ELEMENT (bin) );
+  json_dump_element (sink, root, details, 1, filter.depth);
+  sink.write ("\n");
+  sink.flush ();
+
+  gst_object_unref (root);
+
+  return true;
+}
+
+/* Counters of a watched bin, freed along with it */
+class GraphVersion
+{
+public:
+  ~GraphVersion ()
+  {
+    if (bus != NULL) {
+      g_signal_handler_disconnect (bus, stateHandler);
+      gst_bus_disable_sync_message_emission (bus);
+      gst_object_unref (bus);
+    }
   }
 
-  /* write header */
-  retString = (
-                "digraph pipeline {\n"
-                "  rankdir=LR;\n"
-                "  fontname=\"sans\";\n"
-                "  fontsize=\"10\";\n"
-                "  labelloc=t;\n"
-                "  nodesep=.1;\n"
-                "  ranksep=.2;\n"
-                "  label=\"<" + std::string (G_OBJECT_TYPE_NAME (bin) ) + ">\\n" + std::string (
-                  GST_OBJECT_NAME (bin) ) + stateName + params + "\";\n"
-                "  node [style=filled, shape=box, fontsize=\"9\", fontname=\"sans\", margin=\"0.0,0.0\"];\n"
-                "  edge [labelfontsize=\"6\", fontsize=\"9\", fontname=\"monospace\"];\n"
-                "  \n"
-                "  legend [\n"
-                "    pos=\"0,0!\",\n"
-                "    margin=\"0.05,0.05\",\n"
-                "    label=\"Legend\\lElement-States: [~] void-pending, [0] null, [-] ready, [=] paused, [>] playing\\lPad-Activation: [-] none, [>] push, [<] pull\\lPad-Flags: [b]locked, [f]lushing, [b]locking; upper-case is set\\lPad-Task: [T] has started task, [t] has paused task\\l\"\n"
-                "  ];"
-                "\n");
-
-  retString += debug_dump_element (bin, details, 1);
+  std::atomic<guint64> structure {0};
+  std::atomic<guint64> properties {0};
 
-  /* write footer */
-  retString += "}\n";
+  GstBus *bus = NULL;
+  gulong stateHandler = 0;
+};
+
+static void watch_element (GstElement *element, GraphVersion *version);
+
+static void
+structure_changed (GraphVersion *version)
+{
+  version->structure++;
+}
 
-  return retString;
+static void
+pad_link_changed (GstPad *pad, GstPad *peer, gpointer data)
+{
+  structure_changed ( (GraphVersion *) data);
+}
+
+static void
+pad_caps_changed (GObject *pad, GParamSpec *pspec, gpointer data)
+{
+  structure_changed ( (GraphVersion *) data);
+}
+
+static void
+element_state_changed (GstBus *bus, GstMessage *message, gpointer data)
+{
+  structure_changed ( (GraphVersion *) data);
+}
+
+static void
+properties_changed (GstObject *object, GstObject *origin, GParamSpec *pspec,
+                    gpointer data)
+{
+  ( (GraphVersion *) data)->properties++;
+}
+
+static void
+watch_pad (GstPad *pad, GraphVersion *version)
+{
+  g_signal_connect (pad, "linked", G_CALLBACK (pad_link_changed), version);
+  g_signal_connect (pad, "unlinked", G_CALLBACK (pad_link_changed), version);
+  g_signal_connect (pad, "notify::caps", G_CALLBACK (pad_caps_changed),
+                    version);
+}
+
+static void
+pad_added (GstElement *element, GstPad *pad, gpointer data)
+{
+  watch_pad (pad, (GraphVersion *) data);
+  structure_changed ( (GraphVersion *) data);
+}
+
+static void
+pad_removed (GstElement *element, GstPad *pad, gpointer data)
+{
+  g_signal_handlers_disconnect_by_data (pad, data);
+  structure_changed ( (GraphVersion *) data);
+}
+
+/* Handlers are disconnected from the element, its pads and its children */
+static void
+unwatch_element (GstElement *element, GraphVersion *version)
+{
+  std::vector<GstPad *> pads;
+  std::vector<GstElement *> children;
+  GList *l;
+
+  g_signal_handlers_disconnect_by_data (element, version);
+
+  GST_OBJECT_LOCK (element);
+
+  for (l = element->pads; l != NULL; l = l->next) {
+    pads.push_back (GST_PAD (gst_object_ref (l->data) ) );
+  }
+
+  if (GST_IS_BIN (element) ) {
+    for (l = GST_BIN (element)->children; l != NULL; l = l->next) {
+      children.push_back (GST_ELEMENT (gst_object_ref (l->data) ) );
+    }
+  }
+
+  GST_OBJECT_UNLOCK (element);
+
+  for (GstPad *pad : pads) {
+    g_signal_handlers_disconnect_by_data (pad, version);
+    gst_object_unref (pad);
+  }
+
+  for (GstElement *child : children) {
+    unwatch_element (child, version);
+    gst_object_unref (child);
+  }
+}
+
+static void
+element_added (GstBin *bin, GstElement *element, gpointer data)
+{
+  watch_element (element, (GraphVersion *) data);
+  structure_changed ( (GraphVersion *) data);
+}
+
+static void
+element_removed (GstBin *bin, GstElement *element, gpointer data)
+{
+  unwatch_element (element, (GraphVersion *) data);
+  structure_changed ( (GraphVersion *) data);
+}
+
+/*
+ * Signals are connected before the existing pads and children are listed,
+ * so nothing added meanwhile is missed. Something seen twice is only
+ * counted twice.
+ */
+static void
+watch_element (GstElement *element, GraphVersion *version)
+{
+  std::vector<GstPad *> pads;
+  std::vector<GstElement *> children;
+  GList *l;
+
+  g_signal_connect (element, "pad-added", G_CALLBACK (pad_added), version);
+  g_signal_connect (element, "pad-removed", G_CALLBACK (pad_removed), version);
+
+  if (GST_IS_BIN (element) ) {
+    g_signal_connect (element, "element-added", G_CALLBACK (element_added),
+                      version);
+    g_signal_connect (element, "element-removed", G_CALLBACK (element_removed),
+                      version);
+  }
+
+  GST_OBJECT_LOCK (element);
+
+  for (l = element->pads; l != NULL; l = l->next) {
+    pads.push_back (GST_PAD (gst_object_ref (l->data) ) );
+  }
+
+  if (GST_IS_BIN (element) ) {
+    for (l = GST_BIN (element)->children; l != NULL; l = l->next) {
+      children.push_back (GST_ELEMENT (gst_object_ref (l->data) ) );
+    }
+  }
+
+  GST_OBJECT_UNLOCK (element);
+
+  for (GstPad *pad : pads) {
+    watch_pad (pad, version);
+    gst_object_unref (pad);
+  }
+
+  for (GstElement *child : children) {
+    watch_element (child, version);
+    gst_object_unref (child);
+  }
+}
+
+static void
+graph_version_free (gpointer data)
+{
+  delete (GraphVersion *) data;
+}
+
+/*
+ * Children are removed, and so unwatched, before the bin is finalized.
+ * States are seen through the bus, that carries the messages of every
+ * element in the bin.
+ */
+static GraphVersion *
+get_graph_version (GstBin *bin)
+{
+  static GQuark quark = g_quark_from_static_string ("kms-graph-version");
+  static std::mutex mutex;
+  std::unique_lock<std::mutex> lock (mutex);
+  GraphVersion *version;
+
+  version = (GraphVersion *) g_object_get_qdata (G_OBJECT (bin), quark);
+
+  if (version != NULL) {
+    return version;
+  }
+
+  version = new GraphVersion ();
+  g_object_set_qdata_full (G_OBJECT (bin), quark, version, graph_version_free);
+
+  version->bus = gst_element_get_bus (GST_ELEMENT (bin) );
+
+  if (version->bus != NULL) {
+    gst_bus_enable_sync_message_emission (version->bus);
+    version->stateHandler = g_signal_connect (version->bus,
+                            "sync-message::state-changed",
+                            G_CALLBACK (element_state_changed), version);
+  }
+
+  g_signal_connect (bin, "deep-notify", G_CALLBACK (properties_changed),
+                    version);
+  watch_element (GST_ELEMENT (bin), version);
+
+  return version;
+}
+
+guint64
+getGraphVersion (GstBin *bin, bool properties)
+{
+  GraphVersion *version;
+
+  g_return_val_if_fail (GST_IS_BIN (bin), 0);
+
+  version = get_graph_version (bin);
+
+  /* Both counters only grow, so does their sum */
+  return version->structure.load () +
+         (properties ? version->properties.load () : 0);
+}
+
+GraphCache::~GraphCache ()
+{
+  if (cached != nullptr) {
+    gst_object_unref (cached);
+  }
+}
+
+std::shared_ptr<const std::string>
+GraphCache::get (GstBin *bin, GraphFormat format, GstDebugGraphDetails details,
+                 const GraphFilter &filter)
+{
+  std::shared_ptr<std::string> graph;
+  StringGraphSink sink;
+  guint64 version;
+  std::string key = std::to_string (format) + "/" + std::to_string (
+                      details) + "/" + std::to_string (filter.depth) + "/" + filter.root;
+
+  g_return_val_if_fail (GST_IS_BIN (bin), nullptr);
+
+  /*
+   * Read before the graph is generated, a change meanwhile invalidates the
+   * entry on the next call. Properties changed without a notification are
+   * not seen until something else changes.
+   */
+  version = getGraphVersion (bin,
+                             details & GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS);
+
+  {
+    std::unique_lock<std::mutex> lock (mutex);
+
+    if (cached != bin) {
+      if (cached != nullptr) {
+        gst_object_unref (cached);
+      }
+
+      cached = GST_BIN (gst_object_ref (bin) );
+      entries.clear ();
+      used.clear ();
+    }
+
+    auto it = entries.find (key);
+
+    if (it != entries.end () && it->second.version == version) {
+      used.splice (used.begin (), used, it->second.used);
+      hits++;
+      return it->second.graph;
+    }
+  }
+
+  if (format == GRAPH_FORMAT_JSON) {
+    if (!generateJsonGraph (bin, details, sink, filter) ) {
+      return nullptr;
+    }
+  } else if (!generateDotGraph (bin, details, sink, filter) ) {
+    return nullptr;
+  }
+
+  graph = std::make_shared<std::string> (std::move (sink.getString () ) );
+
+  std::unique_lock<std::mutex> lock (mutex);
+  auto it = entries.find (key);
+
+  if (it != entries.end () ) {
+    used.splice (used.begin (), used, it->second.used);
+  } else {
+    if (entries.size () >= MAX_ENTRIES) {
+      entries.erase (used.back () );
+      used.pop_back ();
+    }
+
+    used.push_front (key);
+    it = entries.emplace (key, Entry () ).first;
+    it->second.used = used.begin ();
+  }
+
+  it->second.version = version;
+  it->second.graph = graph;
+
+  return graph;
+}
+
+FdGraphSink::~FdGraphSink ()
+{
+  flush ();
+}
+
+void
+FdGraphSink::write (const char *data, size_t length)
+{
+  buffer.append (data, length);
+
+  if (buffer.size () >= BUFFER_SIZE) {
+    flush ();
+  }
+}
+
+void
+FdGraphSink::flush ()
+{
+  size_t written = 0;
+
+  while (ok && written < buffer.size () ) {
+    ssize_t ret = ::write (fd, buffer.data () + written, buffer.size () - written);
+
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    } else if (ret < 0) {
+      ok = false;
+    } else {
+      written += ret;
+    }
+  }
+
+  buffer.clear ();
+}
+
+ChunkedGraphSink::~ChunkedGraphSink ()
+{
+  flush ();
+}
+
+void
+ChunkedGraphSink::write (const char *data, size_t length)
+{
+  buffer.append (data, length);
+
+  if (buffer.size () >= chunkSize) {
+    flush ();
+  }
+}
+
+void
+ChunkedGraphSink::flush ()
+{
+  if (!buffer.empty () ) {
+    callback (buffer);
+    buffer.clear ();
+  }
 }
 
 } /* kurento */
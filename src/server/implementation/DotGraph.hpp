@@ -17,14 +17,183 @@
 #define __KMS_DOT_GRAPH_H__
 
 #include <gst/gst.h>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
 namespace kurento
 {
 
+/* Receives the graph while it is being generated */
+class GraphSink
+{
+public:
+  virtual ~GraphSink () {};
+
+  virtual void write (const char *data, size_t length) = 0;
+  virtual void flush () {};
+
+  void write (const std::string &data)
+  {
+    write (data.data (), data.size () );
+  }
+};
+
+class StringGraphSink : public GraphSink
+{
+public:
+  using GraphSink::write;
+
+  void write (const char *data, size_t length)
+  {
+    str.append (data, length);
+  }
+
+  std::string &getString ()
+  {
+    return str;
+  }
+
+private:
+  std::string str;
+};
+
+/* Buffered writes to a file descriptor, that is not closed */
+class FdGraphSink : public GraphSink
+{
+public:
+  FdGraphSink (int fd) : fd (fd) {};
+  ~FdGraphSink ();
+
+  using GraphSink::write;
+
+  void write (const char *data, size_t length);
+  void flush ();
+
+  /* False if any write to the file descriptor failed */
+  bool isOk ()
+  {
+    return ok;
+  }
+
+private:
+  static const size_t BUFFER_SIZE = 64 * 1024;
+
+  int fd;
+  bool ok = true;
+  std::string buffer;
+};
+
+/* Passes the graph to @callback in chunks of about @chunkSize bytes */
+class ChunkedGraphSink : public GraphSink
+{
+public:
+  ChunkedGraphSink (size_t chunkSize,
+                    std::function<void (const std::string &chunk) > callback) :
+    chunkSize (chunkSize), callback (callback) {};
+  ~ChunkedGraphSink ();
+
+  using GraphSink::write;
+
+  void write (const char *data, size_t length);
+  void flush ();
+
+private:
+  size_t chunkSize;
+  std::function<void (const std::string &chunk) > callback;
+  std::string buffer;
+};
+
+enum GraphFormat {
+  GRAPH_FORMAT_DOT,
+  GRAPH_FORMAT_JSON
+};
+
+class GraphFilter
+{
+public:
+  /* Name of the element whose subtree is generated, empty for the whole bin */
+  std::string root;
+  /*
+   * Levels of nested bins that are expanded, zero or negative for all. The
+   * root is level 1, so 1 shows only its direct children.
+   */
+  int depth = 0;
+};
+
 std::string
 generateDotGraph (GstBin *bin, GstDebugGraphDetails details);
 
+/* Return false if the root element of @filter is not found */
+bool
+generateDotGraph (GstBin *bin, GstDebugGraphDetails details, GraphSink &sink,
+                  const GraphFilter &filter = GraphFilter () );
+
+/*
+ * Topology of @bin as a JSON document: every element with its type, state,
+ * pads and their peers, and its children if it is a bin.
+ */
+bool
+generateJsonGraph (GstBin *bin, GstDebugGraphDetails details, GraphSink &sink,
+                   const GraphFilter &filter = GraphFilter () );
+
+/*
+ * Counter increased whenever something a graph of @bin shows changes:
+ * elements added or removed, pads added or removed, links, negotiated caps
+ * and element states. With @properties, property notifications of the bin
+ * and its children count too. @bin is watched from the first call until it
+ * is finalized, so reading the version does not walk the graph.
+ */
+guint64
+getGraphVersion (GstBin *bin, bool properties = false);
+
+/*
+ * Keeps the graphs last used for a bin and returns them again while its
+ * version does not change.
+ */
+class GraphCache
+{
+public:
+  GraphCache () {};
+  ~GraphCache ();
+
+  /* Returns nullptr if the root element of @filter is not found */
+  std::shared_ptr<const std::string> get (GstBin *bin, GraphFormat format,
+                                          GstDebugGraphDetails details,
+                                          const GraphFilter &filter = GraphFilter () );
+
+  guint64 getHits ()
+  {
+    std::unique_lock<std::mutex> lock (mutex);
+
+    return hits;
+  }
+
+private:
+  static const size_t MAX_ENTRIES = 16;
+
+  class Entry
+  {
+  public:
+    guint64 version;
+    std::shared_ptr<const std::string> graph;
+    /* Position in the recently used list */
+    std::list<std::string>::iterator used;
+  };
+
+  std::mutex mutex;
+  std::map<std::string, Entry> entries;
+  /* Keys from the most to the least recently used */
+  std::list<std::string> used;
+  guint64 hits = 0;
+
+  /* Bin the entries belong to */
+  GstBin *cached = nullptr;
+};
+
 } /* kurento */
 
 #endif /* __KMS_DOT_GRAPH_H__ */
@@ -0,0 +1,240 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "ElementPool.hpp"
+
+#define GST_CAT_DEFAULT kurento_element_pool
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoElementPool"
+
+namespace kurento
+{
+
+/* Not a valid factory name, so it never clashes with an element pool */
+const std::string ElementPool::PIPELINE = "<pipeline>";
+
+ElementPool &
+ElementPool::get ()
+{
+  /* Never destroyed, objects may be created from other static objects */
+  static ElementPool *pool = new ElementPool ();
+
+  return *pool;
+}
+
+ElementPool::ElementPool ()
+{
+  thread = std::thread (&ElementPool::run, this);
+}
+
+GstElement *
+ElementPool::create (const std::string &name)
+{
+  GstElement *element;
+
+  if (name != PIPELINE) {
+    element = gst_element_factory_make (name.c_str(), NULL);
+
+    if (element != NULL) {
+      gst_object_ref_sink (element);
+    }
+
+    return element;
+  }
+
+  GstClock *clock;
+
+  element = gst_pipeline_new (NULL);
+
+  if (element == NULL) {
+    return NULL;
+  }
+
+  gst_object_ref_sink (element);
+  g_object_set (G_OBJECT (element), "async-handling", TRUE, NULL);
+
+  clock = gst_system_clock_obtain ();
+  gst_pipeline_use_clock (GST_PIPELINE (element), clock);
+  g_object_unref (clock);
+
+  gst_element_set_state (element, GST_STATE_PLAYING);
+
+  return element;
+}
+
+GstElement *
+ElementPool::take (const std::string &factoryName, int size)
+{
+  GstElement *element = NULL;
+
+  if (size <= 0 && nPools == 0) {
+    /* Pooling is not used at all */
+    return create (factoryName);
+  }
+
+  std::unique_lock<std::mutex> lock (mutex);
+  auto it = pools.find (factoryName);
+
+  if (it == pools.end () ) {
+    if (size <= 0) {
+      lock.unlock ();
+      return create (factoryName);
+    }
+
+    it = pools.insert (std::make_pair (factoryName, Pool () ) ).first;
+    nPools++;
+  }
+
+  Pool &pool = it->second;
+
+  pool.size = size > 0 ? size : 0;
+
+  if (!pool.ready.empty () ) {
+    element = pool.ready.front ();
+    pool.ready.pop_front ();
+    pool.hits++;
+  } else if (pool.size > 0) {
+    pool.misses++;
+  }
+
+  while (pool.ready.size () + pool.creating < pool.size) {
+    pool.creating++;
+    pending.push_back (factoryName);
+    cond.notify_one ();
+  }
+
+  if (element != NULL) {
+    return element;
+  }
+
+  lock.unlock ();
+
+  GST_DEBUG ("No %s ready, creating it", factoryName.c_str () );
+
+  return create (factoryName);
+}
+
+GstElement *
+ElementPool::takePipeline (int size)
+{
+  return take (PIPELINE, size);
+}
+
+size_t
+ElementPool::getReady (const std::string &factoryName)
+{
+  std::unique_lock<std::mutex> lock (mutex);
+  auto it = pools.find (factoryName);
+
+  return it != pools.end () ? it->second.ready.size () : 0;
+}
+
+uint64_t
+ElementPool::getHits (const std::string &factoryName)
+{
+  std::unique_lock<std::mutex> lock (mutex);
+  auto it = pools.find (factoryName);
+
+  return it != pools.end () ? it->second.hits : 0;
+}
+
+uint64_t
+ElementPool::getMisses (const std::string &factoryName)
+{
+  std::unique_lock<std::mutex> lock (mutex);
+  auto it = pools.find (factoryName);
+
+  return it != pools.end () ? it->second.misses : 0;
+}
+
+uint64_t
+ElementPool::getHits ()
+{
+  std::unique_lock<std::mutex> lock (mutex);
+  uint64_t hits = 0;
+
+  for (auto &it : pools) {
+    hits += it.second.hits;
+  }
+
+  return hits;
+}
+
+uint64_t
+ElementPool::getMisses ()
+{
+  std::unique_lock<std::mutex> lock (mutex);
+  uint64_t misses = 0;
+
+  for (auto &it : pools) {
+    misses += it.second.misses;
+  }
+
+  return misses;
+}
+
+void
+ElementPool::run ()
+{
+  std::unique_lock<std::mutex> lock (mutex);
+
+  while (true) {
+    while (pending.empty () ) {
+      cond.wait (lock);
+    }
+
+    std::string name = pending.front ();
+    pending.pop_front ();
+
+    lock.unlock ();
+    GstElement *element = create (name);
+    lock.lock ();
+
+    Pool &pool = pools[name];
+
+    pool.creating--;
+
+    if (element == NULL) {
+      GST_WARNING ("Cannot create %s, disabling its pool", name.c_str () );
+      pool.size = 0;
+      continue;
+    }
+
+    if (pool.ready.size () >= pool.size) {
+      /* Pool shrunk meanwhile, not needed anymore */
+      lock.unlock ();
+      gst_element_set_state (element, GST_STATE_NULL);
+      g_object_unref (element);
+      lock.lock ();
+      continue;
+    }
+
+    pool.ready.push_back (element);
+
+    GST_LOG ("%s pool has %zu elements ready, hits: %" G_GUINT64_FORMAT
+             ", misses: %" G_GUINT64_FORMAT, name.c_str (), pool.ready.size (),
+             pool.hits, pool.misses);
+  }
+}
+
+ElementPool::StaticConstructor ElementPool::staticConstructor;
+
+ElementPool::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} /* kurento */
@@ -0,0 +1,101 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __ELEMENT_POOL_HPP__
+#define __ELEMENT_POOL_HPP__
+
+#include <gst/gst.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace kurento
+{
+
+/*
+ * Keeps gstreamer elements created in advance, so object creation does not
+ * wait for element construction. Pipelines are kept already running with the
+ * system clock. Other elements are kept constructed but stopped, as their
+ * media objects still have to configure them before they start.
+ *
+ * Pools start empty and are sized by the first request. Every element handed
+ * out is replaced from a background thread. Elements are never returned to
+ * the pool once used.
+ */
+class ElementPool
+{
+public:
+  static ElementPool &get ();
+
+  /*
+   * Returns a new, non floating, reference to an element of @factoryName
+   * that is not in any bin, or NULL if it cannot be created. The pool of
+   * @factoryName is resized to @size, 0 disables it.
+   */
+  GstElement *take (const std::string &factoryName, int size);
+
+  /* Same as take, for a running pipeline */
+  GstElement *takePipeline (int size);
+
+  size_t getReady (const std::string &factoryName);
+  uint64_t getHits (const std::string &factoryName);
+  uint64_t getMisses (const std::string &factoryName);
+  uint64_t getHits ();
+  uint64_t getMisses ();
+
+  static const std::string PIPELINE;
+
+private:
+  ElementPool ();
+  ~ElementPool() {};
+
+  void run ();
+  static GstElement *create (const std::string &name);
+
+  class Pool
+  {
+  public:
+    std::deque<GstElement *> ready;
+    size_t size = 0;
+    size_t creating = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::map<std::string, Pool> pools;
+  /* Entries in pools, they are never removed */
+  std::atomic<size_t> nPools {0};
+  std::deque<std::string> pending;
+  std::thread thread;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} /* kurento */
+
+#endif /* __ELEMENT_POOL_HPP__ */
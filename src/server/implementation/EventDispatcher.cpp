@@ -0,0 +1,287 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <gst/gst.h>
+
+#include "EventDispatcher.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#define GST_CAT_DEFAULT kurento_event_dispatcher
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoEventDispatcher"
+
+namespace kurento
+{
+
+EventDispatcher &
+EventDispatcher::get ()
+{
+  /*
+   * Never destroyed, objects may post events from static destructors. The
+   * workers are joined at exit and events posted afterwards are discarded.
+   */
+  static EventDispatcher *dispatcher = [] () {
+    EventDispatcher *d = new EventDispatcher (std::max (2u,
+                         std::thread::hardware_concurrency () / 2) );
+
+    std::atexit ([] () {
+      get ().shutdown ();
+    });
+
+    return d;
+  } ();
+
+  return *dispatcher;
+}
+
+EventDispatcher::EventDispatcher (int threads)
+{
+  for (int i = 0; i < threads; i++) {
+    this->threads.push_back (std::thread (&EventDispatcher::work, this) );
+  }
+}
+
+EventDispatcher::~EventDispatcher ()
+{
+  shutdown ();
+}
+
+void
+EventDispatcher::shutdown ()
+{
+  std::vector<std::thread> workers;
+  std::unique_lock <std::mutex> lock (mutex);
+
+  if (stopping) {
+    return;
+  }
+
+  stopping = true;
+  workers.swap (threads);
+  cond.notify_all ();
+  lock.unlock ();
+
+  for (std::thread &worker : workers) {
+    if (worker.get_id () == std::this_thread::get_id () ) {
+      /* Called while delivering an event, it exits once this returns */
+      worker.detach ();
+    } else {
+      worker.join ();
+    }
+  }
+}
+
+void
+EventDispatcher::post (ObjectHandle queue, Event event)
+{
+  post (queue, queue, "", event);
+}
+
+/* Drops the oldest pending event that is not reliable, if any */
+bool
+EventDispatcher::drop (Queue &q, Event &discarded)
+{
+  for (auto it = q.entries.begin (); it != q.entries.end (); it++) {
+    if (it->flags & RELIABLE) {
+      continue;
+    }
+
+    discarded.swap (it->event);
+    droppedBySource[it->source][it->type]++;
+    dropped++;
+    q.entries.erase (it);
+
+    return true;
+  }
+
+  return false;
+}
+
+void
+EventDispatcher::post (ObjectHandle queue, ObjectHandle source,
+                       const std::string &type, Event event, int flags)
+{
+  /* Declared before the lock so it is destroyed out of it */
+  Event discarded;
+  std::unique_lock <std::mutex> lock (mutex);
+  Entry entry;
+
+  if (stopping) {
+    discarded.swap (event);
+    return;
+  }
+
+  Queue &q = queues[queue];
+
+  if (flags & COALESCE) {
+    for (auto &pending : q.entries) {
+      if (pending.source == source && pending.type == type
+          && (pending.flags & COALESCE) ) {
+        /* Superseded before being delivered, keep the latest one */
+        discarded.swap (pending.event);
+        pending.event.swap (event);
+        pending.flags = flags;
+        coalesced++;
+        return;
+      }
+    }
+  }
+
+  if (q.entries.size () >= QUEUE_CAPACITY && !drop (q, discarded) ) {
+    if (! (flags & RELIABLE) ) {
+      GST_DEBUG ("Event queue %" G_GUINT64_FORMAT " full of reliable events,"
+                 " dropping %s", queue, type.c_str () );
+      discarded.swap (event);
+      droppedBySource[source][type]++;
+      dropped++;
+      return;
+    }
+
+    GST_DEBUG ("Event queue %" G_GUINT64_FORMAT " grows past its capacity",
+               queue);
+  }
+
+  entry.source = source;
+  entry.type = type;
+  entry.flags = flags;
+  entry.event.swap (event);
+  entry.posted = std::chrono::steady_clock::now ();
+  q.entries.push_back (std::move (entry) );
+
+  if (!q.scheduled) {
+    q.scheduled = true;
+    ready.push_back (queue);
+    cond.notify_one ();
+  }
+}
+
+void
+EventDispatcher::forget (ObjectHandle handle)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  auto it = queues.find (handle);
+
+  if (it != queues.end () && !it->second.scheduled) {
+    queues.erase (it);
+  }
+
+  droppedBySource.erase (handle);
+}
+
+void
+EventDispatcher::work ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  while (true) {
+    ObjectHandle id;
+    Entry entry;
+
+    while (ready.empty () && !stopping) {
+      cond.wait (lock);
+    }
+
+    if (stopping) {
+      return;
+    }
+
+    id = ready.front ();
+    ready.pop_front ();
+
+    Queue &q = queues[id];
+    entry = std::move (q.entries.front () );
+    q.entries.pop_front ();
+
+    lock.unlock ();
+
+    latency.record (std::chrono::duration_cast<std::chrono::microseconds>
+                    (std::chrono::steady_clock::now () - entry.posted).count () );
+
+    try {
+      entry.event ();
+    } catch (std::exception &e) {
+      GST_WARNING ("Error delivering event: %s", e.what () );
+    } catch (...) {
+      GST_WARNING ("Unknown error delivering event");
+    }
+
+    /* Release what the event holds before taking the lock again */
+    entry.event = Event ();
+
+    lock.lock ();
+    delivered++;
+
+    Queue &current = queues[id];
+
+    if (current.entries.empty () ) {
+      queues.erase (id);
+    } else {
+      /* Keep order inside the queue, let other queues run meanwhile */
+      ready.push_back (id);
+      cond.notify_one ();
+    }
+  }
+}
+
+uint64_t
+EventDispatcher::getDropped (ObjectHandle source, const std::string &type)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  auto it = droppedBySource.find (source);
+
+  if (it == droppedBySource.end () ) {
+    return 0;
+  }
+
+  auto it2 = it->second.find (type);
+
+  return it2 == it->second.end () ? 0 : it2->second;
+}
+
+uint64_t
+EventDispatcher::getDropped ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  return dropped;
+}
+
+uint64_t
+EventDispatcher::getCoalesced ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  return coalesced;
+}
+
+uint64_t
+EventDispatcher::getDelivered ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  return delivered;
+}
+
+EventDispatcher::StaticConstructor EventDispatcher::staticConstructor;
+
+EventDispatcher::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} /* kurento */
@@ -0,0 +1,155 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __EVENT_DISPATCHER_HPP__
+#define __EVENT_DISPATCHER_HPP__
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Histogram.hpp"
+#include "ObjectHandle.hpp"
+
+namespace kurento
+{
+
+/*
+ * Delivers events out of the thread that raised them, so that serializing
+ * and sending them to subscribers never runs on a streaming thread.
+ *
+ * Events are posted to a queue, usually the one of the pipeline of the
+ * object raising them. Events in the same queue are delivered in order, one
+ * at a time, while different queues are served in parallel by the pool.
+ * Queues are bounded: when subscribers fall behind, the oldest pending event
+ * that may be dropped is discarded and accounted to the subscriptions to its
+ * type on its source object. Events posted with COALESCE replace the pending
+ * event of the same type and source, taking its place in the queue. As only
+ * the latest one is delivered, it must not depend on what it replaces, such
+ * as the previous state of a transition; those are better built on delivery.
+ *
+ * Queues and drop accounting are per pipeline, not per subscribing session.
+ * An event is a single signal emission that runs the handlers of every
+ * session subscribed to it, so it can neither be split between session
+ * queues nor dropped for only one of them. The trade-off is that an
+ * EventHandler::sendEvent that blocks holds the whole queue, delaying every
+ * subscriber of that pipeline (not other pipelines), and drops are counted
+ * for all of them. Transports have to queue per session and not block here.
+ */
+class EventDispatcher
+{
+public:
+  typedef std::function<void () > Event;
+
+  /* Flags of post () */
+  static const int COALESCE = 1 << 0;
+  /* Never dropped, even if the queue grows past its capacity */
+  static const int RELIABLE = 1 << 1;
+
+  static const size_t QUEUE_CAPACITY = 256;
+
+  static EventDispatcher &get ();
+
+  EventDispatcher (int threads);
+  ~EventDispatcher ();
+
+  void post (ObjectHandle queue, Event event);
+  void post (ObjectHandle queue, ObjectHandle source, const std::string &type,
+             Event event, int flags = 0);
+
+  /*
+   * Discards the queue and drop accounting of an object that will not post
+   * events anymore
+   */
+  void forget (ObjectHandle handle);
+
+  /*
+   * Stops and joins the workers, pending events are not delivered and events
+   * posted afterwards are discarded
+   */
+  void shutdown ();
+
+  /*
+   * Events of @type from @source dropped because their queue was full,
+   * missed by every session subscribed to them
+   */
+  uint64_t getDropped (ObjectHandle source, const std::string &type);
+  uint64_t getDropped ();
+  uint64_t getCoalesced ();
+  uint64_t getDelivered ();
+
+  /* Microseconds since an event is posted until it is delivered */
+  const Histogram &getLatencyHistogram () const
+  {
+    return latency;
+  }
+
+private:
+  class Entry
+  {
+  public:
+    ObjectHandle source;
+    std::string type;
+    int flags;
+    Event event;
+    std::chrono::steady_clock::time_point posted;
+  };
+
+  class Queue
+  {
+  public:
+    std::deque<Entry> entries;
+    /* Either waiting in the ready list or being delivered */
+    bool scheduled = false;
+  };
+
+  void work ();
+  bool drop (Queue &q, Event &discarded);
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::unordered_map<ObjectHandle, Queue> queues;
+  std::deque<ObjectHandle> ready;
+  std::vector<std::thread> threads;
+  bool stopping = false;
+
+  /* Dropped events by source object and type */
+  std::unordered_map<ObjectHandle, std::unordered_map<std::string, uint64_t>>
+      droppedBySource;
+
+  uint64_t dropped = 0;
+  uint64_t coalesced = 0;
+  uint64_t delivered = 0;
+
+  Histogram latency;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} /* kurento */
+
+#endif /* __EVENT_DISPATCHER_HPP__ */
@@ -33,6 +33,11 @@ public:
 
   virtual ~EventHandler();
 
+  /*
+   * Runs in the event queue of the pipeline, shared by every session
+   * subscribed to its objects: it must hand @value to the session without
+   * waiting for the client. See EventDispatcher.
+   */
   virtual void sendEvent (Json::Value &value) = 0;
 
   void setConnection (sigc::connection conn)
@@ -0,0 +1,109 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __HISTOGRAM_HPP__
+#define __HISTOGRAM_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Lock free histogram with power of two buckets. Bucket 0 counts zeros and
+ * bucket i counts values in [2^(i-1), 2^i).
+ */
+class Histogram
+{
+public:
+  static const int BUCKETS = 40;
+
+  Histogram ()
+  {
+    for (auto &bucket : buckets) {
+      bucket = 0;
+    }
+  }
+
+  void record (uint64_t value)
+  {
+    int bucket = 0;
+
+    if (value > 0) {
+      bucket = 64 - __builtin_clzll (value);
+    }
+
+    if (bucket >= BUCKETS) {
+      bucket = BUCKETS - 1;
+    }
+
+    buckets[bucket]++;
+    count++;
+    sum += value;
+  }
+
+  uint64_t getCount () const
+  {
+    return count;
+  }
+
+  uint64_t getSum () const
+  {
+    return sum;
+  }
+
+  std::vector<uint64_t> getBuckets () const
+  {
+    std::vector<uint64_t> ret;
+
+    for (auto &bucket : buckets) {
+      ret.push_back (bucket);
+    }
+
+    return ret;
+  }
+
+  /* Upper bound of the bucket holding the requested percentile (0-100) */
+  uint64_t getPercentile (double percentile) const
+  {
+    uint64_t total = count;
+    uint64_t accumulated = 0;
+
+    if (total == 0) {
+      return 0;
+    }
+
+    for (int i = 0; i < BUCKETS; i++) {
+      accumulated += buckets[i];
+
+      if (accumulated * 100.0 >= percentile * total) {
+        return (i == 0) ? 0 : (UINT64_C (1) << i) - 1;
+      }
+    }
+
+    return (UINT64_C (1) << (BUCKETS - 1) ) - 1;
+  }
+
+private:
+  std::atomic<uint64_t> buckets[BUCKETS];
+  std::atomic<uint64_t> count {0};
+  std::atomic<uint64_t> sum {0};
+};
+
+} /* kurento */
+
+#endif /* __HISTOGRAM_HPP__ */
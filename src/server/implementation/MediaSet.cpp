@@ -20,6 +20,7 @@
 #include <MediaPipelineImpl.hpp>
 #include <ServerManagerImpl.hpp>
 
+#include <algorithm>
 #include <functional>
 
 /* This is included to avoid problems with slots and lamdas */
@@ -41,7 +42,9 @@ struct functor_trait<Functor, false> {
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoMediaSet"
 
-const int MEDIASET_THREADS_DEFAULT = 1;
+/* Pipelines are torn down in parallel, one per core */
+static const int MEDIASET_THREADS_DEFAULT = std::max (1u,
+    std::thread::hardware_concurrency () );
 
 namespace kurento
 {
@@ -50,6 +53,10 @@ static const std::chrono::seconds COLLECTOR_INTERVAL_DEFAULT =
   std::chrono::seconds (
     240);
 
+/* Session timeouts are detected with one second resolution */
+static const std::chrono::seconds SESSION_TIMER_TICK = std::chrono::seconds (1);
+static const size_t SESSION_TIMER_SLOTS = 512;
+
 std::chrono::seconds MediaSet::collectorInterval = COLLECTOR_INTERVAL_DEFAULT;
 
 void
@@ -94,6 +101,8 @@ MediaSet::deleteMediaSet()
 
   if (!pipes.empty() ) {
     bool empty = false;
+    uint64_t initiallyDone = mediaSet->teardown.getCompleted();
+    size_t total = pipes.size();
 
     auto sig = mediaSet->signalEmpty.connect ([&cv, &empty] () {
       std::unique_lock <std::recursive_mutex> lock (mutex);
@@ -101,8 +110,15 @@ MediaSet::deleteMediaSet()
       cv.notify_all();
     });
 
+    auto progress = mediaSet->teardown.signalProgress.connect ([initiallyDone,
+    total] (uint64_t done, size_t remaining) {
+      GST_INFO ("Destroyed %" G_GUINT64_FORMAT " of %" G_GSIZE_FORMAT
+                " pipelines", done - initiallyDone, total);
+    });
+
     GST_INFO ("Destroying %ld pipelines that are already alive", pipes.size() );
 
+    /* Release is just bookkeeping, teardown work fans out to the workers */
     for (auto it : pipes) {
       mediaSet->release (it);
     }
@@ -114,6 +130,11 @@ MediaSet::deleteMediaSet()
     }
 
     sig->disconnect();
+    progress->disconnect();
+
+    GST_INFO ("All pipelines destroyed, p99 teardown latency %"
+              G_GUINT64_FORMAT " us",
+              mediaSet->teardown.getLatencyHistogram().getPercentile (99) );
   }
 
   GST_INFO ("Destroying mediaSet");
@@ -121,52 +142,70 @@ MediaSet::deleteMediaSet()
   mediaSet.reset();
 }
 
-void MediaSet::doGarbageCollection ()
+void MediaSet::expireSessions ()
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
-  auto sessions = sessionInUse;
+  SessionTimers::Clock::time_point now = SessionTimers::Clock::now();
+  std::chrono::seconds interval = collectorInterval;
 
-  lock.unlock();
+  for (auto sessionId : sessionTimers.expire (now) ) {
+    SessionTimers::Clock::time_point lastSeen;
 
-  GST_DEBUG ("Running garbage collector");
+    if (!sessionLastSeen.get (sessionId, lastSeen) ) {
+      /* Already released */
+      continue;
+    }
 
-  for (auto it : sessions) {
-    if (it.second) {
-      lock.lock();
-      sessionInUse[it.first] = false;
-      lock.unlock();
-    } else {
-      GST_WARNING ("Session timeout: %s", it.first.c_str() );
-      unrefSession (it.first);
+    if (now - lastSeen < interval) {
+      /* Kept alive since the timer was armed, wait for the remaining time */
+      sessionTimers.schedule (sessionId, lastSeen + interval);
+      continue;
     }
+
+    GST_WARNING ("Session timeout: %s", sessionId.c_str() );
+    unrefSession (sessionId);
   }
 }
 
-MediaSet::MediaSet()
+MediaSet::MediaSet() : sessionTimers (SESSION_TIMER_TICK, SESSION_TIMER_SLOTS),
+  teardown ([this] (std::function<void () > f) {
+  post (f, WorkerPool::TEARDOWN);
+})
 {
   terminated = false;
+  expiring = false;
 
   workers = std::shared_ptr<WorkerPool> (new WorkerPool (
       MEDIASET_THREADS_DEFAULT) );
 
   thread = std::thread ( [&] () {
-    std::unique_lock <std::recursive_mutex> lock (recMutex);
-
+    std::unique_lock <std::mutex> lock (expiryMutex);
 
-    while (!terminated && waitCond.wait_for (lock,
-           collectorInterval) == std::cv_status::timeout) {
+    while (!terminated) {
+      expiryCond.wait_for (lock, sessionTimers.getTick() );
 
       if (terminated) {
         return;
       }
 
-      try {
-        doGarbageCollection();
-      } catch (...) {
-        GST_ERROR ("Error during garbage collection");
+      /* Runs in the background lane, skipped if the last one did not finish */
+      if (!expiring.exchange (true) ) {
+        lock.unlock();
+
+        post ([this] () {
+          try {
+            if (!terminated) {
+              expireSessions();
+            }
+          } catch (...) {
+            GST_ERROR ("Error during session expiration");
+          }
+
+          expiring = false;
+        }, WorkerPool::BACKGROUND);
+
+        lock.lock();
       }
     }
-
   });
 }
 
@@ -181,11 +220,16 @@ MediaSet::~MediaSet ()
 
   terminated = true;
 
-  serverManager.reset();
-  waitCond.notify_all();
+  std::atomic_store (&serverManager, std::shared_ptr <ServerManagerImpl> () );
 
   lock.unlock();
 
+  {
+    std::unique_lock <std::mutex> expiryLock (expiryMutex);
+
+    expiryCond.notify_all();
+  }
+
   workers.reset();
 
   if (std::this_thread::get_id() != thread.get_id() ) {
@@ -206,12 +250,12 @@ MediaSet::~MediaSet ()
 }
 
 void
-MediaSet::post (std::function<void (void) > f)
+MediaSet::post (std::function<void (void) > f, WorkerPool::Priority priority)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
 
   if (!terminated && workers) {
-    workers->post (f);
+    workers->post (f, priority);
   } else {
     lock.unlock();
     f();
@@ -226,7 +270,8 @@ MediaSet::setServerManager (std::shared_ptr <ServerManagerImpl> serverManager)
   if (this->serverManager) {
     GST_WARNING ("ServerManager can only set once, ignoring");
   } else {
-    this->serverManager = serverManager;
+    /* Lookups read it without holding recMutex */
+    std::atomic_store (&this->serverManager, serverManager);
   }
 }
 
@@ -254,14 +299,21 @@ MediaSet::ref (MediaObjectImpl *mediaObjectPtr)
     });
   }
 
-  objectsMap[mediaObject->getId()] = std::weak_ptr<MediaObjectImpl> (mediaObject);
+  ObjectHandleTable::get().publish (mediaObject->getHandle(), mediaObject);
+  /* Creates the entry if it is not registered yet */
+  objectsMap.update (mediaObject->getHandle(), [] (RegisteredObject & entry) {
+  });
+  handlesMap.set (mediaObject->getId(), mediaObject->getHandle() );
 
   if (mediaObject->getParent() ) {
     std::shared_ptr<MediaObjectImpl> parent = std::dynamic_pointer_cast
         <MediaObjectImpl> (mediaObject->getParent() );
 
     ref (parent.get() );
-    childrenMap[parent->getId()][mediaObject->getId()] = mediaObject;
+    childrenMap.update (parent->getHandle(), [&mediaObject] (
+    ObjectsTable & children) {
+      children[mediaObject->getHandle()] = mediaObject;
+    });
   }
 
   if (this->serverManager && created) {
@@ -279,7 +331,7 @@ MediaSet::ref (const std::string &sessionId,
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
 
-  if (objectsMap.find (mediaObject->getId() ) == objectsMap.end() ) {
+  if (!objectsMap.contains (mediaObject->getHandle() ) ) {
     throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
                             "Cannot register media object, it was not created by MediaSet");
   }
@@ -291,8 +343,15 @@ MediaSet::ref (const std::string &sessionId,
          std::dynamic_pointer_cast<MediaObjectImpl> (mediaObject->getParent() ) );
   }
 
-  sessionMap[sessionId][mediaObject->getId()] = mediaObject;
-  reverseSessionMap[mediaObject->getId()].insert (sessionId);
+  sessionMap.update (sessionId, [&mediaObject] (ObjectsTable & objects) {
+    objects[mediaObject->getHandle()] = mediaObject;
+  });
+  objectsMap.modify (mediaObject->getHandle(), [&sessionId, &mediaObject] (
+  RegisteredObject & entry) {
+    entry.sessions.insert (sessionId);
+    ObjectHandleTable::get().setSessions (mediaObject->getHandle(),
+                                          entry.sessions.size() );
+  });
   ref (mediaObject.get() );
 }
 
@@ -314,18 +373,29 @@ MediaSet::keepAliveSession (const std::string &sessionId)
 void
 MediaSet::keepAliveSession (const std::string &sessionId, bool create)
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  SessionTimers::Clock::time_point now = SessionTimers::Clock::now();
+  bool created = false;
 
-  auto it = sessionInUse.find (sessionId);
+  /* Only the timestamp is refreshed, the timer is rearmed when it fires */
+  if (create) {
+    sessionLastSeen.update (sessionId, [&now, &created] (
+    SessionTimers::Clock::time_point & lastSeen) {
+      created = lastSeen == SessionTimers::Clock::time_point();
+      lastSeen = now;
+    });
 
-  if (it == sessionInUse.end() ) {
-    if (create) {
-      sessionInUse[sessionId] = true;
-    } else {
-      throw KurentoException (INVALID_SESSION, "Invalid session");
+    if (created) {
+      sessionTimers.schedule (sessionId, now + collectorInterval);
     }
-  } else {
-    it->second = true;
+
+    return;
+  }
+
+  if (!sessionLastSeen.modify (sessionId, [&now] (
+  SessionTimers::Clock::time_point & lastSeen) {
+  lastSeen = now;
+}) ) {
+    throw KurentoException (INVALID_SESSION, "Invalid session");
   }
 }
 
@@ -333,19 +403,17 @@ void
 MediaSet::releaseSession (const std::string &sessionId)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
+  ObjectsTable objects;
 
-  auto it = sessionMap.find (sessionId);
-
-  if (it != sessionMap.end() ) {
-    auto objects = it->second;
-
-    for (auto it2 : objects) {
-      release (it2.second);
+  if (sessionMap.get (sessionId, objects) ) {
+    for (auto it : objects) {
+      release (it.second);
     }
   }
 
   sessionMap.erase (sessionId);
-  sessionInUse.erase (sessionId);
+  sessionLastSeen.erase (sessionId);
+  sessionTimers.cancel (sessionId);
   eventHandler.erase (sessionId);
   lock.unlock ();
 
@@ -355,95 +423,92 @@ void
 MediaSet::unrefSession (const std::string &sessionId)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
+  ObjectsTable objects;
 
-  auto it = sessionMap.find (sessionId);
-
-  if (it != sessionMap.end() ) {
-    auto objects = it->second;
-
-    for (auto it2 : objects) {
-      unref (sessionId, it2.second);
+  if (sessionMap.get (sessionId, objects) ) {
+    for (auto it : objects) {
+      unref (sessionId, it.second);
     }
   }
 
   sessionMap.erase (sessionId);
-  sessionInUse.erase (sessionId);
+  sessionLastSeen.erase (sessionId);
+  sessionTimers.cancel (sessionId);
   eventHandler.erase (sessionId);
 
   lock.unlock();
 }
 
-static void
-call_release (std::shared_ptr<MediaObjectImpl> mediaObject)
-{
-  if (mediaObject) {
-    mediaObject->release();
-  }
-}
-
 void
 MediaSet::unref (const std::string &sessionId,
                  std::shared_ptr< MediaObjectImpl > mediaObject)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
   bool released = false;
+  bool inSession = true;
+  bool orphan = false;
+  ObjectsTable children;
+  HandlersTable::mapped_type handlers;
 
   if (!mediaObject) {
     return;
   }
 
-  auto it = sessionMap.find (sessionId);
-
-  if (it != sessionMap.end() ) {
-    auto it2 = it->second.find (mediaObject->getId() );
-
-    if (it2 == it->second.end() ) {
-      return;
-    }
+  sessionMap.modify (sessionId, [&mediaObject, &inSession] (
+  ObjectsTable & objects) {
+    inSession = objects.erase (mediaObject->getHandle() ) > 0;
+  });
 
-    it->second.erase (it2);
+  if (!inSession) {
+    return;
   }
 
-  auto childrenIt = childrenMap.find (mediaObject->getId() );
-
-  if (childrenIt != childrenMap.end() ) {
-    auto childMap = childrenIt->second;
-
-    for (auto child : childMap) {
+  if (childrenMap.get (mediaObject->getHandle(), children) ) {
+    for (auto child : children) {
       unref (sessionId, child.second);
     }
   }
 
-  auto it3 = reverseSessionMap.find (mediaObject->getId() );
-
-  if (it3 != reverseSessionMap.end() ) {
-    it3->second.erase (sessionId);
-
-    if (it3->second.empty() ) {
-      std::shared_ptr<MediaObjectImpl> parent;
+  objectsMap.modify (mediaObject->getHandle(), [&sessionId, &orphan,
+  &mediaObject] (RegisteredObject & entry) {
+    entry.sessions.erase (sessionId);
+    orphan = entry.sessions.empty();
+    ObjectHandleTable::get().setSessions (mediaObject->getHandle(),
+                                          entry.sessions.size() );
+  });
 
-      released = mediaObject.get() != serverManager.get();
+  if (orphan) {
+    std::shared_ptr<MediaObjectImpl> parent;
 
-      if (released) {
-        parent = std::dynamic_pointer_cast<MediaObjectImpl> (mediaObject->getParent() );
+    released = mediaObject.get() != serverManager.get();
 
-        if (parent) {
-          childrenMap[parent->getId()].erase (mediaObject->getId() );
-        }
+    if (released) {
+      parent = std::dynamic_pointer_cast<MediaObjectImpl> (mediaObject->getParent() );
 
-        childrenMap.erase (mediaObject->getId() );
+      if (parent) {
+        childrenMap.modify (parent->getHandle(), [&mediaObject] (
+        ObjectsTable & siblings) {
+          siblings.erase (mediaObject->getHandle() );
+        });
       }
+
+      childrenMap.erase (mediaObject->getHandle() );
     }
   }
 
-  auto eventIt = eventHandler.find (sessionId);
+  /* Handlers are destroyed when leaving, out of the shard lock */
+  eventHandler.modify (sessionId, [&mediaObject, &handlers] (
+  HandlersTable & objects) {
+    auto it = objects.find (mediaObject->getHandle() );
 
-  if (eventIt != eventHandler.end() ) {
-    eventIt->second.erase (mediaObject->getId() );
-  }
+    if (it != objects.end() ) {
+      handlers = std::move (it->second);
+      objects.erase (it);
+    }
+  });
 
   if (released) {
-    post (std::bind (call_release, mediaObject) );
+    teardown.release (mediaObject);
   }
 
   lock.unlock();
@@ -464,22 +529,18 @@ MediaSet::unref (const std::string &sessionId,
   unref (sessionId, object);
 }
 
-static void
-async_delete (MediaObjectImpl *mediaObject, std::string id)
-{
-  GST_DEBUG ("Destroying %s -> %s", mediaObject->getType().c_str(), id.c_str() );
-  /* Deletion of mediaObject weak reference */
-  delete mediaObject;
-}
-
 void MediaSet::releasePointer (MediaObjectImpl *mediaObject)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
   std::string id = mediaObject->getId();
+  ObjectHandle handle = mediaObject->getHandle();
 
-  objectsMap.erase (id );
+  objectsMap.erase (handle);
+  handlesMap.eraseIf (id, [handle] (const ObjectHandle & current) {
+    return current == handle;
+  });
 
-  post (std::bind (async_delete, mediaObject, id) );
+  teardown.destroy (mediaObject, id);
 
   if (this->serverManager && !terminated) {
     serverManager->signalObjectDestroyed (ObjectDestroyed (this->serverManager,
@@ -494,18 +555,18 @@ void MediaSet::releasePointer (MediaObjectImpl *mediaObject)
 void MediaSet::release (std::shared_ptr< MediaObjectImpl > mediaObject)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
+  std::unordered_set<std::string> sessions;
 
-  auto it = reverseSessionMap.find (mediaObject->getId() );
-
-  if (it == reverseSessionMap.end() ) {
+  if (!objectsMap.find (mediaObject->getHandle(), [&sessions] (
+  const RegisteredObject & entry) {
+  sessions = entry.sessions;
+}) ) {
     /* Already released */
     return;
   }
 
-  auto sessions = it->second;
-
-  for (auto it2 : sessions) {
-    unref (it2, mediaObject);
+  for (auto sessionId : sessions) {
+    unref (sessionId, mediaObject);
   }
 
   lock.unlock();
@@ -535,37 +596,39 @@ MediaSet::getMediaObject (const std::string &mediaObjectRef)
                             "object without committing the transaction.");
   }
 
-  std::shared_ptr <MediaObjectImpl> objectLocked;
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
-
-  auto it = objectsMap.find (mediaObjectRef);
+  ObjectHandle handle = INVALID_OBJECT_HANDLE;
 
-  if (it == objectsMap.end() ) {
+  /* Only the shard holding the id is locked */
+  if (!handlesMap.get (mediaObjectRef, handle) ) {
     throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
                             "Object '" + mediaObjectRef + "' not found");
   }
 
-  try {
-    objectLocked = it->second.lock();
-  } catch (...) {
-    throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
-                            "Object '" + mediaObjectRef + "' not found");
-  }
+  return getMediaObject (handle);
+}
+
+std::shared_ptr< MediaObjectImpl >
+MediaSet::getMediaObject (ObjectHandle handle)
+{
+  std::shared_ptr <MediaObjectImpl> objectLocked;
+  size_t sessions = 0;
+
+  objectLocked = ObjectHandleTable::get().lookup (handle, &sessions);
 
   if (!objectLocked) {
-    throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
-                            "Object '" + mediaObjectRef + "' not found");
+    throw KurentoException (MEDIA_OBJECT_NOT_FOUND, "Object not found");
   }
 
-  auto it2 = reverseSessionMap.find (objectLocked->getId() );
+  if (sessions == 0) {
+    std::shared_ptr <ServerManagerImpl> manager = std::atomic_load (
+          &serverManager);
 
-  if (it2 == reverseSessionMap.end() || it2->second.empty() ) {
-    if (serverManager && mediaObjectRef == serverManager->getId() ) {
-      return serverManager;
+    if (manager && handle == manager->getHandle() ) {
+      return manager;
     }
 
     throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
-                            "Object '" + mediaObjectRef + "' not found");
+                            "Object '" + objectLocked->getId() + "' not found");
   }
 
   return objectLocked;
@@ -588,9 +651,17 @@ MediaSet::addEventHandler (const std::string &sessionId,
                            const std::string &subscriptionId,
                            std::shared_ptr<EventHandler> handler)
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  ObjectHandle handle = INVALID_OBJECT_HANDLE;
 
-  eventHandler[sessionId][objectId][subscriptionId] = handler;
+  if (!handlesMap.get (objectId, handle) ) {
+    GST_WARNING ("Cannot subscribe to events of unknown object %s",
+                 objectId.c_str() );
+    return;
+  }
+
+  eventHandler.update (sessionId, [&] (HandlersTable & objects) {
+    objects[handle][subscriptionId] = handler;
+  });
 }
 
 void
@@ -598,16 +669,27 @@ MediaSet::removeEventHandler (const std::string &sessionId,
                               const std::string &objectId,
                               const std::string &handlerId)
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
-  auto it = eventHandler.find (sessionId);
+  std::shared_ptr<EventHandler> handler;
+  ObjectHandle handle = INVALID_OBJECT_HANDLE;
+
+  if (!handlesMap.get (objectId, handle) ) {
+    return;
+  }
 
-  if (it != eventHandler.end() ) {
-    auto it2 = eventHandler[sessionId].find (objectId);
+  eventHandler.modify (sessionId, [&] (HandlersTable & objects) {
+    auto it = objects.find (handle);
 
-    if (it2 != eventHandler[sessionId].end() ) {
-      it2->second.erase (handlerId);
+    if (it == objects.end() ) {
+      return;
     }
-  }
+
+    auto it2 = it->second.find (handlerId);
+
+    if (it2 != it->second.end() ) {
+      handler = it2->second;
+      it->second.erase (it2);
+    }
+  });
 }
 
 void
@@ -637,12 +719,12 @@ MediaSet::empty()
 std::vector<std::string>
 MediaSet::getSessions ()
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
-  std::vector<std::string> ret (sessionMap.size () );
+  std::vector<std::string> ret;
 
-  for (auto it : sessionMap) {
-    ret.push_back (it.first);
-  }
+  sessionMap.forEach ([&ret] (const std::string & sessionId,
+  ObjectsTable & objects) {
+    ret.push_back (sessionId);
+  });
 
   return ret;
 }
@@ -652,12 +734,18 @@ std::list<std::shared_ptr<MediaObjectImpl>>
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
   std::list<std::shared_ptr<MediaObjectImpl>> ret;
+  std::vector<ObjectHandle> handles;
 
-  auto copy = objectsMap;
+  objectsMap.forEach ([&handles] (const ObjectHandle & handle,
+  RegisteredObject & entry) {
+    handles.push_back (handle);
+  });
 
-  for (auto it : copy) {
+  for (auto handle : handles) {
     try {
-      auto obj = getMediaObject (sessionId, it.first);
+      auto obj = getMediaObject (handle);
+
+      ref (sessionId, obj);
 
       if (std::dynamic_pointer_cast <MediaPipelineImpl> (obj) ) {
         ret.push_back (obj);
@@ -672,15 +760,16 @@ std::list<std::shared_ptr<MediaObjectImpl>>
 std::list<std::shared_ptr<MediaObjectImpl>>
     MediaSet::getChilds (std::shared_ptr<MediaObjectImpl> obj)
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
   std::list<std::shared_ptr<MediaObjectImpl>> ret;
+  ObjectsTable children;
 
-  try {
-    for (auto it : childrenMap.at (obj->getId() ) ) {
-      ret.push_back (it.second);
-    }
-  } catch (std::out_of_range) {
+  if (!childrenMap.get (obj->getHandle(), children) ) {
     GST_ERROR ("Cannot get childrens of object %s", obj->getId().c_str() );
+    return ret;
+  }
+
+  for (auto it : children) {
+    ret.push_back (it.second);
   }
 
   return ret;
@@ -19,6 +19,7 @@
 #include <MediaObjectImpl.hpp>
 
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -27,6 +28,10 @@
 #include <atomic>
 
 #include "WorkerPool.hpp"
+#include "ShardedMap.hpp"
+#include "TeardownEngine.hpp"
+#include "TimerWheel.hpp"
+#include "ObjectHandle.hpp"
 
 namespace kurento
 {
@@ -68,6 +73,7 @@ public:
       &mediaObjectRef);
   std::shared_ptr<MediaObjectImpl> getMediaObject (
     const std::string &sessionId, const std::string &mediaObjectRef);
+  std::shared_ptr<MediaObjectImpl> getMediaObject (ObjectHandle handle);
 
   std::vector<std::string> getSessions ();
   std::list<std::shared_ptr<MediaObjectImpl>> getPipelines (
@@ -79,6 +85,11 @@ public:
 
   bool empty();
 
+  TeardownEngine &getTeardownEngine ()
+  {
+    return teardown;
+  }
+
   static const std::shared_ptr<MediaSet> getMediaSet();
   static void deleteMediaSet();
   static void setCollectorInterval (std::chrono::seconds interval);
@@ -90,7 +101,7 @@ public:
 private:
 
   void keepAliveSession (const std::string &sessionId, bool create);
-  void doGarbageCollection ();
+  void expireSessions ();
 
   std::thread thread;
 
@@ -98,31 +109,49 @@ private:
 
   void checkEmpty ();
 
-  void post (std::function<void (void) > f);
+  void post (std::function<void (void) > f,
+             WorkerPool::Priority priority = WorkerPool::INTERACTIVE);
 
   MediaSet ();
 
+  /* Serializes changes in the object graph, lookups do not take it */
   std::recursive_mutex recMutex;
-  std::condition_variable_any waitCond;
   std::atomic<bool> terminated;
 
-  std::shared_ptr <ServerManagerImpl> serverManager;
+  /* Only used to sleep the expiration thread between ticks */
+  std::mutex expiryMutex;
+  std::condition_variable expiryCond;
+  /* Set while an expiration is queued in the workers or running */
+  std::atomic<bool> expiring;
 
-  std::map<std::string, std::weak_ptr <MediaObjectImpl>> objectsMap;
+  std::shared_ptr <ServerManagerImpl> serverManager;
 
-  std::map<std::string, std::map <std::string, std::shared_ptr <MediaObjectImpl>>>
-  childrenMap;
+  /* The object itself is resolved through the ObjectHandleTable */
+  class RegisteredObject
+  {
+  public:
+    std::unordered_set<std::string> sessions;
+  };
 
-  std::map<std::string, std::map <std::string, std::shared_ptr<MediaObjectImpl>>>
-  sessionMap;
+  typedef std::unordered_map <ObjectHandle, std::shared_ptr <MediaObjectImpl>>
+      ObjectsTable;
+  typedef std::unordered_map <ObjectHandle, std::unordered_map <std::string,
+          std::shared_ptr<EventHandler>>> HandlersTable;
 
-  std::map<std::string, bool> sessionInUse;
-  std::map<std::string, std::map<std::string, std::map<std::string, std::shared_ptr<EventHandler>>>>
-  eventHandler;
+  ShardedMap<ObjectHandle, RegisteredObject> objectsMap;
+  /* String ids are only resolved at the API boundary */
+  ShardedMap<std::string, ObjectHandle> handlesMap;
+  ShardedMap<ObjectHandle, ObjectsTable> childrenMap;
+  ShardedMap<std::string, ObjectsTable> sessionMap;
+  typedef TimerWheel<std::string> SessionTimers;
 
-  std::map<std::string, std::unordered_set<std::string>> reverseSessionMap;
+  /* Last keepalive of each session, checked when its timer fires */
+  ShardedMap<std::string, SessionTimers::Clock::time_point> sessionLastSeen;
+  SessionTimers sessionTimers;
+  ShardedMap<std::string, HandlersTable> eventHandler;
 
   std::shared_ptr<WorkerPool> workers;
+  TeardownEngine teardown;
 
   static std::chrono::seconds collectorInterval;
 
@@ -19,7 +19,12 @@
 #include <gst/gst.h>
 #include <KurentoException.hpp>
 #include <sstream>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <cstdio>
 #include <boost/filesystem.hpp>
+#include <json/json.h>
 
 #define GST_CAT_DEFAULT kurento_media_set
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -34,6 +39,24 @@ typedef const char * (*GetDescFunc) ();
 
 int
 ModuleManager::loadModule (std::string modulePath)
+{
+  std::unique_lock<std::recursive_mutex> lock (mutex);
+  boost::filesystem::path path (modulePath);
+
+  if (loadedModules.find (path.filename().string() ) != loadedModules.end() ) {
+    GST_WARNING ("Module named %s already loaded",
+                 path.filename().string().c_str() );
+    return -1;
+  }
+
+  Glib::Module module (modulePath);
+
+  return registerModule (modulePath, module);
+}
+
+int
+ModuleManager::registerModule (const std::string &modulePath,
+                               Glib::Module &module)
 {
   const kurento::FactoryRegistrar *registrar;
   void *registrarFactory, *getVersion = NULL, *getName = NULL,
@@ -42,6 +65,7 @@ ModuleManager::loadModule (std::string modulePath)
   std::string moduleName;
   std::string moduleVersion;
   const char *moduleDescriptor = NULL;
+  ManifestEntry entry;
 
   boost::filesystem::path path (modulePath);
 
@@ -52,8 +76,6 @@ ModuleManager::loadModule (std::string modulePath)
     return -1;
   }
 
-  Glib::Module module (modulePath);
-
   if (!module) {
     GST_WARNING ("Module %s cannot be loaded: %s", modulePath.c_str(),
                  Glib::Module::get_last_error().c_str() );
@@ -71,7 +93,10 @@ ModuleManager::loadModule (std::string modulePath)
     registrar->getFactories();
 
   for (auto it : factories) {
-    if (loadedFactories.find (it.first) != loadedFactories.end() ) {
+    auto lazy = lazyFactories.find (it.first);
+
+    if (loadedFactories.find (it.first) != loadedFactories.end() ||
+        (lazy != lazyFactories.end() && lazy->second != modulePath) ) {
       GST_WARNING ("Factory %s is already registered, skiping module %s",
                    it.first.c_str(), module.get_name().c_str() );
       return -1;
@@ -105,6 +130,24 @@ ModuleManager::loadModule (std::string modulePath)
   loadedModules[moduleFileName] = std::shared_ptr<ModuleData> (new ModuleData (
                                     moduleName, moduleVersion, moduleDescriptor, factories) );
 
+  entry.path = modulePath;
+  entry.name = moduleName;
+
+  try {
+    entry.size = boost::filesystem::file_size (path);
+    entry.mtime = boost::filesystem::last_write_time (path);
+  } catch (boost::filesystem::filesystem_error &e) {
+    entry.size = 0;
+    entry.mtime = 0;
+  }
+
+  for (auto it : factories) {
+    lazyFactories.erase (it.first);
+    entry.factories.push_back (it.first);
+  }
+
+  manifestEntries[moduleFileName] = entry;
+
   GST_INFO ("Loaded %s version %s", moduleName.c_str() , moduleVersion.c_str() );
 
   return 0;
@@ -124,7 +167,8 @@ std::list<std::string> split (const std::string &s, char delim)
 }
 
 void
-ModuleManager::loadModules (std::string dirPath)
+ModuleManager::collectModules (std::string dirPath,
+                               std::vector<std::string> &modules)
 {
   GST_INFO ("Looking for modules in %s", dirPath.c_str() );
   boost::filesystem::path dir (dirPath);
@@ -143,41 +187,246 @@ ModuleManager::loadModules (std::string dirPath)
       boost::filesystem::path extension = itr->path().extension();
 
       if (extension.string() == ".so") {
-
-        loadModule (itr->path().string() );
+        modules.push_back (itr->path().string() );
       }
     } else if (boost::filesystem::is_directory (*itr) ) {
-      this->loadModules (itr->path().string() );
+      this->collectModules (itr->path().string(), modules);
+    }
+  }
+}
+
+/*
+ * Opening a module reads it from disk, relocates it and runs its static
+ * constructors, which is where most of the startup time goes. Modules are
+ * opened concurrently and then registered one by one in the order they were
+ * found, so conflicts are resolved as if they had been loaded serially.
+ */
+void
+ModuleManager::loadModulesInParallel (const std::vector<std::string> &modules)
+{
+  std::vector<std::unique_ptr<Glib::Module>> opened (modules.size() );
+  std::vector<std::thread> workers;
+  std::atomic<size_t> next (0);
+  size_t nWorkers = std::min<size_t> (modules.size(),
+                                      std::max (1u, std::thread::hardware_concurrency() ) );
+
+  auto worker = [&] () {
+    size_t i;
+
+    while ( (i = next++) < modules.size() ) {
+      opened[i].reset (new Glib::Module (modules[i]) );
     }
+  };
+
+  for (size_t i = 1; i < nWorkers; i++) {
+    workers.push_back (std::thread (worker) );
+  }
+
+  worker ();
+
+  for (auto &thread : workers) {
+    thread.join ();
+  }
+
+  for (size_t i = 0; i < modules.size(); i++) {
+    registerModule (modules[i], *opened[i]);
   }
 }
 
 void
 ModuleManager::loadModulesFromDirectories (std::string path)
 {
+  std::unique_lock<std::recursive_mutex> lock (mutex);
   std::list <std::string> locations;
+  std::vector <std::string> found;
+  std::vector <std::string> modules;
+  std::set <std::string> names;
+  std::map <std::string, ManifestEntry> cached;
 
   locations = split (path, ':');
 
   for (std::string location : locations) {
-    this->loadModules (location);
+    this->collectModules (location, found);
   }
 
   //try to load modules from the default path
-  this->loadModules (KURENTO_MODULES_DIR);
+  this->collectModules (KURENTO_MODULES_DIR, found);
+
+  if (!manifest.empty() ) {
+    cached = readManifest ();
+  }
+
+  for (const std::string &modulePath : found) {
+    std::string fileName = boost::filesystem::path (modulePath).filename().string();
+
+    if (loadedModules.find (fileName) != loadedModules.end() ||
+        !names.insert (fileName).second) {
+      GST_WARNING ("Module named %s already loaded", fileName.c_str() );
+      continue;
+    }
+
+    auto entry = cached.find (fileName);
+
+    if (entry != cached.end() && entry->second.path == modulePath &&
+        registerLazyModule (entry->second) ) {
+      continue;
+    }
+
+    modules.push_back (modulePath);
+  }
+
+  loadModulesInParallel (modules);
+
+  if (!manifest.empty() ) {
+    writeManifest ();
+  }
 
   return;
 }
 
+bool
+ModuleManager::registerLazyModule (const ManifestEntry &entry)
+{
+  boost::filesystem::path path (entry.path);
+
+  try {
+    if (boost::filesystem::file_size (path) != entry.size ||
+        boost::filesystem::last_write_time (path) != entry.mtime) {
+      GST_DEBUG ("Module %s changed since the manifest was written",
+                 entry.path.c_str() );
+      return false;
+    }
+  } catch (boost::filesystem::filesystem_error &e) {
+    return false;
+  }
+
+  for (const std::string &factory : entry.factories) {
+    if (loadedFactories.find (factory) != loadedFactories.end() ||
+        lazyFactories.find (factory) != lazyFactories.end() ) {
+      GST_WARNING ("Factory %s is already registered, skiping module %s",
+                   factory.c_str(), entry.path.c_str() );
+      return false;
+    }
+  }
+
+  for (const std::string &factory : entry.factories) {
+    lazyFactories[factory] = entry.path;
+  }
+
+  manifestEntries[path.filename().string()] = entry;
+
+  GST_DEBUG ("Module %s registered, it will be loaded on first use",
+             entry.path.c_str() );
+
+  return true;
+}
+
+std::map <std::string, ModuleManager::ManifestEntry>
+ModuleManager::readManifest ()
+{
+  std::map <std::string, ManifestEntry> entries;
+  std::ifstream file (manifest);
+  Json::Reader reader;
+  Json::Value root;
+
+  if (!file.is_open() ) {
+    GST_INFO ("Module manifest %s not found", manifest.c_str() );
+    return entries;
+  }
+
+  if (!reader.parse (file, root) || !root["modules"].isArray() ) {
+    GST_WARNING ("Invalid module manifest %s", manifest.c_str() );
+    return entries;
+  }
+
+  for (const Json::Value &module : root["modules"]) {
+    ManifestEntry entry;
+
+    if (!module["path"].isString() || !module["name"].isString() ||
+        !module["size"].isNumeric() || !module["mtime"].isNumeric() ||
+        !module["factories"].isArray() ) {
+      GST_WARNING ("Ignoring invalid entry in module manifest %s",
+                   manifest.c_str() );
+      continue;
+    }
+
+    entry.path = module["path"].asString();
+    entry.name = module["name"].asString();
+    entry.size = module["size"].asLargestUInt();
+    entry.mtime = module["mtime"].asLargestInt();
+
+    for (const Json::Value &factory : module["factories"]) {
+      entry.factories.push_back (factory.asString() );
+    }
+
+    entries[boost::filesystem::path (entry.path).filename().string()] = entry;
+  }
+
+  return entries;
+}
+
+void
+ModuleManager::writeManifest ()
+{
+  Json::Value root;
+  Json::StyledWriter writer;
+  std::string tmp = manifest + ".tmp";
+
+  root["modules"] = Json::Value (Json::arrayValue);
+
+  for (auto &it : manifestEntries) {
+    Json::Value module;
+
+    module["path"] = it.second.path;
+    module["name"] = it.second.name;
+    module["size"] = Json::Value::LargestUInt (it.second.size);
+    module["mtime"] = Json::Value::LargestInt (it.second.mtime);
+    module["factories"] = Json::Value (Json::arrayValue);
+
+    for (const std::string &factory : it.second.factories) {
+      module["factories"].append (factory);
+    }
+
+    root["modules"].append (module);
+  }
+
+  {
+    std::ofstream file (tmp, std::ios::trunc);
+
+    file << writer.write (root);
+
+    if (!file.good() ) {
+      GST_WARNING ("Cannot write module manifest %s", manifest.c_str() );
+      return;
+    }
+  }
+
+  if (std::rename (tmp.c_str(), manifest.c_str() ) != 0) {
+    GST_WARNING ("Cannot replace module manifest %s", manifest.c_str() );
+    std::remove (tmp.c_str() );
+  }
+}
+
 const std::map <std::string, std::shared_ptr <kurento::Factory > >
 ModuleManager::getLoadedFactories ()
 {
+  std::unique_lock<std::recursive_mutex> lock (mutex);
+
   return loadedFactories;
 }
 
 std::shared_ptr<kurento::Factory>
 ModuleManager::getFactory (std::string factoryName)
 {
+  std::unique_lock<std::recursive_mutex> lock (mutex);
+  auto lazy = lazyFactories.find (factoryName);
+
+  if (lazy != lazyFactories.end() ) {
+    GST_INFO ("Loading module %s on first use of %s", lazy->second.c_str(),
+              factoryName.c_str() );
+    loadLazyModule (lazy->second);
+  }
+
   try {
     return loadedFactories.at (factoryName);
   } catch (std::exception &e) {
@@ -187,6 +436,59 @@ ModuleManager::getFactory (std::string factoryName)
   }
 }
 
+void
+ModuleManager::loadLazyModule (const std::string &modulePath)
+{
+  /* Copied, it may be a reference to an entry erased here */
+  std::string path = modulePath;
+
+  if (loadModule (path) == 0) {
+    return;
+  }
+
+  for (auto it = lazyFactories.begin(); it != lazyFactories.end();) {
+    if (it->second == path) {
+      it = lazyFactories.erase (it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+const std::map <std::string, std::shared_ptr <ModuleData>>
+ModuleManager::getModules ()
+{
+  std::unique_lock<std::recursive_mutex> lock (mutex);
+
+  return loadedModules;
+}
+
+std::shared_ptr<ModuleData>
+ModuleManager::getModule (const std::string &moduleName)
+{
+  std::unique_lock<std::recursive_mutex> lock (mutex);
+
+  for (auto &it : manifestEntries) {
+    if (it.second.name != moduleName) {
+      continue;
+    }
+
+    if (loadedModules.find (it.first) == loadedModules.end() ) {
+      GST_INFO ("Loading module %s as its data is requested",
+                it.second.path.c_str() );
+      loadLazyModule (it.second.path);
+    }
+
+    auto loaded = loadedModules.find (it.first);
+
+    if (loaded != loadedModules.end() ) {
+      return loaded->second;
+    }
+  }
+
+  return std::shared_ptr<ModuleData> ();
+}
+
 ModuleManager::StaticConstructor ModuleManager::staticConstructor;
 
 ModuleManager::StaticConstructor::StaticConstructor()
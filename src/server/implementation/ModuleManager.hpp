@@ -18,10 +18,14 @@
 
 #include <glibmm/module.h>
 #include <unordered_set>
+#include <cstdint>
+#include <ctime>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <set>
+#include <vector>
 #include <FactoryRegistrar.hpp>
 #include <MediaObjectImpl.hpp>
 
@@ -79,21 +83,66 @@ public:
 
   int loadModule (std::string modulePath);
   void loadModulesFromDirectories (std::string dirPath);
+
+  /*
+   * Factories of the modules loaded so far. Factories of lazy modules are not
+   * listed until their module is loaded, getFactory loads it.
+   */
   const std::map <std::string, std::shared_ptr <kurento::Factory > >
   getLoadedFactories ();
   std::shared_ptr<kurento::Factory> getFactory (std::string symbolName);
 
-  const std::map <std::string, std::shared_ptr <ModuleData>> getModules () const
+  /*
+   * Enables lazy loading, it is disabled by default. It has to be set by the
+   * server before loading modules from directories. Modules listed in the
+   * manifest, and not modified since it was written, get their factories
+   * registered without being loaded. Each one is loaded the first time one of
+   * its factories or its data is requested. The manifest is rewritten every
+   * time modules are loaded from directories.
+   */
+  void setManifest (const std::string &manifestPath)
   {
-    return loadedModules;
+    manifest = manifestPath;
   }
 
+  /* Modules loaded so far, indexed by file name. Lazy modules are not loaded */
+  const std::map <std::string, std::shared_ptr <ModuleData>> getModules ();
+
+  /*
+   * Module named @moduleName, loading it if it is a lazy one. Returns nullptr
+   * if there is no such module.
+   */
+  std::shared_ptr<ModuleData> getModule (const std::string &moduleName);
+
 private:
 
+  class ManifestEntry
+  {
+  public:
+    std::string path;
+    /* As returned by getModuleName */
+    std::string name;
+    uintmax_t size;
+    std::time_t mtime;
+    std::vector<std::string> factories;
+  };
+
+  std::recursive_mutex mutex;
   std::map <std::string, std::shared_ptr <kurento::Factory > > loadedFactories;
   std::map <std::string, std::shared_ptr <ModuleData>> loadedModules;
-  void loadModules (std::string path);
-
+  /* Factories of lazy modules not loaded yet, with the path of their module */
+  std::map <std::string, std::string> lazyFactories;
+  /* Every known module, indexed by file name */
+  std::map <std::string, ManifestEntry> manifestEntries;
+  std::string manifest;
+
+  void collectModules (std::string path, std::vector<std::string> &modules);
+  void loadModulesInParallel (const std::vector<std::string> &modules);
+  int registerModule (const std::string &modulePath, Glib::Module &module);
+  bool registerLazyModule (const ManifestEntry &entry);
+  void loadLazyModule (const std::string &modulePath);
+  std::map <std::string, ManifestEntry> readManifest ();
+  void writeManifest ();
 
   class StaticConstructor
   {
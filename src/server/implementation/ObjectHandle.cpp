@@ -0,0 +1,174 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "ObjectHandle.hpp"
+
+#include <KurentoException.hpp>
+
+namespace kurento
+{
+
+ObjectHandleTable &
+ObjectHandleTable::get ()
+{
+  /* Never destroyed, objects may outlive static destructors */
+  static ObjectHandleTable *table = new ObjectHandleTable();
+
+  return *table;
+}
+
+ObjectHandleTable::ObjectHandleTable ()
+{
+  for (auto &page : pages) {
+    page = NULL;
+  }
+}
+
+ObjectHandleTable::Slot *
+ObjectHandleTable::getSlot (ObjectHandle handle) const
+{
+  uint32_t index = handle & 0xffffffff;
+  uint32_t page = index >> PAGE_BITS;
+  Slot *slots;
+
+  if (page >= MAX_PAGES) {
+    return NULL;
+  }
+
+  slots = pages[page].load (std::memory_order_acquire);
+
+  if (slots == NULL) {
+    return NULL;
+  }
+
+  return &slots[index & (PAGE_SIZE - 1)];
+}
+
+std::shared_ptr<ObjectHandleTable::Entry>
+ObjectHandleTable::getEntry (ObjectHandle handle) const
+{
+  Slot *slot = getSlot (handle);
+  std::shared_ptr<Entry> entry;
+
+  if (slot == NULL) {
+    return entry;
+  }
+
+  entry = std::atomic_load (&slot->entry);
+
+  if (!entry || entry->handle != handle) {
+    return std::shared_ptr<Entry> ();
+  }
+
+  return entry;
+}
+
+ObjectHandle
+ObjectHandleTable::reserve ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  uint32_t index;
+  Slot *slot;
+
+  if (!freeSlots.empty() ) {
+    index = freeSlots.back();
+    freeSlots.pop_back();
+  } else {
+    if (used == MAX_PAGES * PAGE_SIZE) {
+      throw KurentoException (NOT_ENOUGH_RESOURCES,
+                              "Too many media objects alive");
+    }
+
+    index = used++;
+
+    if (pages[index >> PAGE_BITS].load (std::memory_order_relaxed) == NULL) {
+      pages[index >> PAGE_BITS].store (new Slot[PAGE_SIZE],
+                                       std::memory_order_release);
+    }
+  }
+
+  slot = getSlot (index);
+
+  /* Generation 0 is skipped so that no handle is ever 0 */
+  if (++slot->generation == 0) {
+    slot->generation = 1;
+  }
+
+  count++;
+
+  return (static_cast<ObjectHandle> (slot->generation) << 32) | index;
+}
+
+void
+ObjectHandleTable::retire (ObjectHandle handle)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  Slot *slot = getSlot (handle);
+
+  if (slot == NULL || slot->generation != (handle >> 32) ) {
+    return;
+  }
+
+  std::atomic_store (&slot->entry, std::shared_ptr<Entry> () );
+  /* Bumping the generation makes stale copies of the handle unresolvable */
+  slot->generation++;
+  freeSlots.push_back (handle & 0xffffffff);
+  count--;
+}
+
+void
+ObjectHandleTable::publish (ObjectHandle handle,
+                            std::shared_ptr<MediaObjectImpl> object)
+{
+  Slot *slot = getSlot (handle);
+  std::shared_ptr<Entry> entry (new Entry() );
+
+  if (slot == NULL || getEntry (handle) ) {
+    return;
+  }
+
+  entry->handle = handle;
+  entry->object = object;
+
+  std::atomic_store (&slot->entry, entry);
+}
+
+void
+ObjectHandleTable::setSessions (ObjectHandle handle, size_t sessions)
+{
+  std::shared_ptr<Entry> entry = getEntry (handle);
+
+  if (entry) {
+    entry->sessions = sessions;
+  }
+}
+
+std::shared_ptr<MediaObjectImpl>
+ObjectHandleTable::lookup (ObjectHandle handle, size_t *sessions) const
+{
+  std::shared_ptr<Entry> entry = getEntry (handle);
+
+  if (!entry) {
+    return std::shared_ptr<MediaObjectImpl> ();
+  }
+
+  if (sessions != NULL) {
+    *sessions = entry->sessions;
+  }
+
+  return entry->object.lock();
+}
+
+} /* kurento */
@@ -0,0 +1,106 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __OBJECT_HANDLE_HPP__
+#define __OBJECT_HANDLE_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kurento
+{
+
+class MediaObjectImpl;
+
+/*
+ * Compact identifier of a media object inside this process. The string id is
+ * only needed at the API boundary, internal tables are keyed by handle.
+ */
+typedef uint64_t ObjectHandle;
+
+static const ObjectHandle INVALID_OBJECT_HANDLE = 0;
+
+/*
+ * Process wide table resolving handles to live media objects.
+ *
+ * A handle packs the index of a slot in its low 32 bits and the generation of
+ * that slot in the high ones, so slots are reused without a stale handle ever
+ * resolving to a newer object. Slots live in pages that are never freed, so
+ * resolving a handle takes no lock: the page is read with an atomic load and
+ * the slot entry is swapped atomically. The mutex is only taken to reserve
+ * and retire handles.
+ */
+class ObjectHandleTable
+{
+public:
+  static ObjectHandleTable &get ();
+
+  ObjectHandle reserve ();
+  void retire (ObjectHandle handle);
+
+  void publish (ObjectHandle handle, std::shared_ptr<MediaObjectImpl> object);
+
+  /* Number of sessions referencing the object, maintained by MediaSet */
+  void setSessions (ObjectHandle handle, size_t sessions);
+
+  std::shared_ptr<MediaObjectImpl> lookup (ObjectHandle handle,
+      size_t *sessions = NULL) const;
+
+  size_t size () const
+  {
+    return count;
+  }
+
+private:
+  ObjectHandleTable ();
+  ~ObjectHandleTable() {};
+
+  static const uint32_t PAGE_BITS = 12;
+  static const uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+  static const uint32_t MAX_PAGES = 4096;
+
+  class Entry
+  {
+  public:
+    ObjectHandle handle;
+    std::weak_ptr<MediaObjectImpl> object;
+    std::atomic<size_t> sessions {0};
+  };
+
+  class Slot
+  {
+  public:
+    /* Accessed with std::atomic_load and std::atomic_store */
+    std::shared_ptr<Entry> entry;
+    uint32_t generation = 0;
+  };
+
+  Slot *getSlot (ObjectHandle handle) const;
+  std::shared_ptr<Entry> getEntry (ObjectHandle handle) const;
+
+  std::atomic<Slot *> pages[MAX_PAGES];
+
+  std::mutex mutex;
+  std::vector<uint32_t> freeSlots;
+  uint32_t used = 0;
+  std::atomic<size_t> count {0};
+};
+
+} /* kurento */
+
+#endif /* __OBJECT_HANDLE_HPP__ */
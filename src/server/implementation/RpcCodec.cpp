@@ -0,0 +1,116 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include "RpcCodec.hpp"
+#include "Cbor.hpp"
+
+#include <KurentoException.hpp>
+
+namespace kurento
+{
+
+const std::string RpcCodec::JSON = "json";
+const std::string RpcCodec::CBOR = "cbor";
+
+class JsonRpcCodec : public RpcCodec
+{
+public:
+  std::string getName () const
+  {
+    return JSON;
+  }
+
+  void encode (const Json::Value &message, std::string &out) const
+  {
+    Json::FastWriter writer;
+
+    out += writer.write (message);
+  }
+
+  void decode (const char *data, size_t size, Json::Value &message) const
+  {
+    Json::Reader reader;
+
+    if (!reader.parse (data, data + size, message) ) {
+      throw KurentoException (MARSHALL_ERROR, "Malformed JSON message: " +
+                              reader.getFormattedErrorMessages () );
+    }
+  }
+};
+
+class CborRpcCodec : public RpcCodec
+{
+public:
+  std::string getName () const
+  {
+    return CBOR;
+  }
+
+  void encode (const Json::Value &message, std::string &out) const
+  {
+    CborWriter writer (out);
+
+    writer.write (message);
+  }
+
+  void decode (const char *data, size_t size, Json::Value &message) const
+  {
+    CborReader reader (data, size);
+
+    reader.read (message);
+
+    if (!reader.atEnd () ) {
+      throw KurentoException (MARSHALL_ERROR,
+                              "Malformed CBOR message: trailing data");
+    }
+  }
+};
+
+std::shared_ptr<const RpcCodec>
+RpcCodec::get (const std::string &name)
+{
+  static std::shared_ptr<const RpcCodec> json (new JsonRpcCodec () );
+  static std::shared_ptr<const RpcCodec> cbor (new CborRpcCodec () );
+
+  if (name == JSON) {
+    return json;
+  } else if (name == CBOR) {
+    return cbor;
+  }
+
+  return std::shared_ptr<const RpcCodec> ();
+}
+
+std::shared_ptr<const RpcCodec>
+RpcCodec::negotiate (const std::vector<std::string> &offered)
+{
+  for (const std::string &name : offered) {
+    std::shared_ptr<const RpcCodec> codec = get (name);
+
+    if (codec) {
+      return codec;
+    }
+  }
+
+  return get (JSON);
+}
+
+std::vector<std::string>
+RpcCodec::getNames ()
+{
+  return {CBOR, JSON};
+}
+
+} /* kurento */
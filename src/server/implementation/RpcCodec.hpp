@@ -0,0 +1,62 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __RPC_CODEC_HPP__
+#define __RPC_CODEC_HPP__
+
+#include <json/json.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Wire encoding of the messages of a session. Every codec carries the same
+ * Json::Value messages, so invoke and event serialization do not depend on
+ * the encoding negotiated by each client.
+ */
+class RpcCodec
+{
+public:
+  virtual ~RpcCodec () {};
+
+  virtual std::string getName () const = 0;
+
+  /* Appends the encoded @message to @out */
+  virtual void encode (const Json::Value &message, std::string &out) const = 0;
+
+  /* Throws KurentoException if @data is not a valid message */
+  virtual void decode (const char *data, size_t size,
+                       Json::Value &message) const = 0;
+
+  /* Returns NULL if @name is not a supported codec */
+  static std::shared_ptr<const RpcCodec> get (const std::string &name);
+
+  /* First supported codec in @offered, by client preference, or JSON */
+  static std::shared_ptr<const RpcCodec> negotiate (const
+      std::vector<std::string> &offered);
+
+  /* Supported codecs, by server preference */
+  static std::vector<std::string> getNames ();
+
+  static const std::string JSON;
+  static const std::string CBOR;
+};
+
+} /* kurento */
+
+#endif /* __RPC_CODEC_HPP__ */
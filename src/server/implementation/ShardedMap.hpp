@@ -0,0 +1,213 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __SHARDED_MAP_HPP__
+#define __SHARDED_MAP_HPP__
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace kurento
+{
+
+/*
+ * Hash map partitioned in a fixed number of shards, each one protected by its
+ * own lock, so that operations on keys living in different shards never
+ * contend.
+ *
+ * Callbacks are executed with the shard lock held: they must be short and
+ * they must not call back into the same map. Values are always removed from
+ * the map before being destroyed, so destructors never run under the lock.
+ */
+template <typename Key, typename Value, std::size_t Shards = 32>
+class ShardedMap
+{
+  static_assert ( (Shards & (Shards - 1) ) == 0,
+                  "Number of shards must be a power of 2");
+
+public:
+  bool get (const Key &key, Value &value) const
+  {
+    const Shard &shard = getShard (key);
+    std::unique_lock <std::mutex> lock (shard.mutex);
+    auto it = shard.map.find (key);
+
+    if (it == shard.map.end() ) {
+      return false;
+    }
+
+    value = it->second;
+    return true;
+  }
+
+  bool contains (const Key &key) const
+  {
+    const Shard &shard = getShard (key);
+    std::unique_lock <std::mutex> lock (shard.mutex);
+
+    return shard.map.find (key) != shard.map.end();
+  }
+
+  void set (const Key &key, const Value &value)
+  {
+    Value old;
+
+    update (key, [&value, &old] (Value & current) {
+      std::swap (old, current);
+      current = value;
+    });
+  }
+
+  /* Removes the entry, moving its value to @value */
+  bool take (const Key &key, Value &value)
+  {
+    Shard &shard = getShard (key);
+    std::unique_lock <std::mutex> lock (shard.mutex);
+    auto it = shard.map.find (key);
+
+    if (it == shard.map.end() ) {
+      return false;
+    }
+
+    value = std::move (it->second);
+    shard.map.erase (it);
+
+    return true;
+  }
+
+  bool erase (const Key &key)
+  {
+    Value value;
+
+    return take (key, value);
+  }
+
+  /* Removes the entry only if @pred returns true for its value */
+  template <typename F>
+  bool eraseIf (const Key &key, F pred)
+  {
+    Value value;
+    Shard &shard = getShard (key);
+    std::unique_lock <std::mutex> lock (shard.mutex);
+    auto it = shard.map.find (key);
+
+    if (it == shard.map.end() || !pred (static_cast <const Value &>
+                                        (it->second) ) ) {
+      return false;
+    }
+
+    value = std::move (it->second);
+    shard.map.erase (it);
+
+    return true;
+  }
+
+  /* Calls @func with the value for @key, only if it is present */
+  template <typename F>
+  bool find (const Key &key, F func) const
+  {
+    const Shard &shard = getShard (key);
+    std::unique_lock <std::mutex> lock (shard.mutex);
+    auto it = shard.map.find (key);
+
+    if (it == shard.map.end() ) {
+      return false;
+    }
+
+    func (static_cast <const Value &> (it->second) );
+    return true;
+  }
+
+  /* Calls @func with a mutable value for @key, only if it is present */
+  template <typename F>
+  bool modify (const Key &key, F func)
+  {
+    Shard &shard = getShard (key);
+    std::unique_lock <std::mutex> lock (shard.mutex);
+    auto it = shard.map.find (key);
+
+    if (it == shard.map.end() ) {
+      return false;
+    }
+
+    func (it->second);
+    return true;
+  }
+
+  /* Calls @func with a mutable value for @key, creating it if needed */
+  template <typename F>
+  void update (const Key &key, F func)
+  {
+    Shard &shard = getShard (key);
+    std::unique_lock <std::mutex> lock (shard.mutex);
+
+    func (shard.map[key]);
+  }
+
+  /* Visits every entry, locking one shard at a time */
+  template <typename F>
+  void forEach (F func)
+  {
+    for (Shard &shard : shards) {
+      std::unique_lock <std::mutex> lock (shard.mutex);
+
+      for (auto &it : shard.map) {
+        func (it.first, it.second);
+      }
+    }
+  }
+
+  std::size_t size () const
+  {
+    std::size_t ret = 0;
+
+    for (const Shard &shard : shards) {
+      std::unique_lock <std::mutex> lock (shard.mutex);
+
+      ret += shard.map.size();
+    }
+
+    return ret;
+  }
+
+  bool empty () const
+  {
+    return size() == 0;
+  }
+
+private:
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_map <Key, Value> map;
+  };
+
+  Shard &getShard (const Key &key)
+  {
+    return shards[std::hash <Key> () (key) & (Shards - 1)];
+  }
+
+  const Shard &getShard (const Key &key) const
+  {
+    return shards[std::hash <Key> () (key) & (Shards - 1)];
+  }
+
+  std::array <Shard, Shards> shards;
+};
+
+} /* kurento */
+
+#endif /* __SHARDED_MAP_HPP__ */
@@ -17,6 +17,8 @@
 #include "RTCStatsType.hpp"
 #include "RTCInboundRTPStreamStats.hpp"
 #include "RTCOutboundRTPStreamStats.hpp"
+#include <jsonrpc/JsonSerializer.hpp>
+#include <vector>
 
 #define GST_CAT_DEFAULT kurento_statistics
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -32,162 +34,249 @@ namespace kurento
 namespace stats
 {
 
-static std::shared_ptr<RTCInboundRTPStreamStats>
-createRTCInboundRTPStreamStats (const GstStructure *stats)
+/* Weight of the last sample in the smoothed jitter trend */
+#define JITTER_TREND_WEIGHT 0.3
+
+/* Fields are looked up by quark, resolved once at load time */
+static struct {
+  GQuark ssrc;
+  GQuark internal;
+  GQuark id;
+  GQuark packetsReceived;
+  GQuark octetsReceived;
+  GQuark rbPacketsLost;
+  GQuark rbFractionLost;
+  GQuark rbJitter;
+  GQuark sentPliCount;
+  GQuark sentFirCount;
+  GQuark recvPliCount;
+  GQuark recvFirCount;
+  GQuark sentNackCount;
+  GQuark recvNackCount;
+  GQuark remb;
+  GQuark packetsSent;
+  GQuark octetsSent;
+  GQuark bitrate;
+  GQuark rbRoundTrip;
+} quarks;
+
+static void
+initQuarks ()
 {
-  guint64 bytesReceived, packetsReceived;
-  guint jitter, fractionLost, pliCount, firCount, remb;
-  gint packetLost;
+  quarks.ssrc = g_quark_from_static_string ("ssrc");
+  quarks.internal = g_quark_from_static_string ("internal");
+  quarks.id = g_quark_from_static_string ("id");
+  quarks.packetsReceived = g_quark_from_static_string ("packets-received");
+  quarks.octetsReceived = g_quark_from_static_string ("octets-received");
+  quarks.rbPacketsLost = g_quark_from_static_string ("rb-packetslost");
+  quarks.rbFractionLost = g_quark_from_static_string ("rb-fractionlost");
+  quarks.rbJitter = g_quark_from_static_string ("rb-jitter");
+  quarks.sentPliCount = g_quark_from_static_string ("sent-pli-count");
+  quarks.sentFirCount = g_quark_from_static_string ("sent-fir-count");
+  quarks.recvPliCount = g_quark_from_static_string ("recv-pli-count");
+  quarks.recvFirCount = g_quark_from_static_string ("recv-fir-count");
+  quarks.sentNackCount = g_quark_from_static_string ("sent-nack-count");
+  quarks.recvNackCount = g_quark_from_static_string ("recv-nack-count");
+  quarks.remb = g_quark_from_static_string ("remb");
+  quarks.packetsSent = g_quark_from_static_string ("packets-sent");
+  quarks.octetsSent = g_quark_from_static_string ("octets-sent");
+  quarks.bitrate = g_quark_from_static_string ("bitrate");
+  quarks.rbRoundTrip = g_quark_from_static_string ("rb-round-trip");
+}
 
-  packetLost = jitter = fractionLost = pliCount = firCount = remb = 0;
-  bytesReceived = packetsReceived = G_GUINT64_CONSTANT (0);
+/* Values of one SSRC taken from a stats structure */
+class StreamSample
+{
+public:
+  std::string id;
+  guint ssrc = 0;
+  gboolean internal = FALSE;
+  guint64 packets = 0;
+  guint64 bytes = 0;
+  guint64 bitrate = 0;
+  guint64 roundTripTime = 0;
+  gint packetsLost = 0;
+  guint jitter = 0;
+  guint fractionLost = 0;
+  guint pliCount = 0;
+  guint firCount = 0;
+  guint nackCount = 0;
+  guint remb = 0;
+};
+
+/* Values of one stream in a sample, with its rates */
+class StreamValues
+{
+public:
+  StreamSample sample;
+  double bitrate = 0;
+  double packetLossRate = 0;
+  double jitterTrend = 0;
+};
 
-  gst_structure_get (stats, "packets-received", G_TYPE_UINT64, &packetsReceived,
-                     "octets-received", G_TYPE_UINT64, &bytesReceived,
-                     "rb-packetslost", G_TYPE_INT, &packetLost,
-                     "rb-fractionlost", G_TYPE_UINT, &fractionLost,
-                     "rb-jitter", G_TYPE_UINT, &jitter, NULL);
+static void
+parseInboundStream (const GstStructure *stats, StreamSample &sample)
+{
+  gst_structure_id_get (stats, quarks.packetsReceived, G_TYPE_UINT64,
+                        &sample.packets, quarks.octetsReceived, G_TYPE_UINT64, &sample.bytes,
+                        quarks.rbPacketsLost, G_TYPE_INT, &sample.packetsLost,
+                        quarks.rbFractionLost, G_TYPE_UINT, &sample.fractionLost,
+                        quarks.rbJitter, G_TYPE_UINT, &sample.jitter, NULL);
 
   /* Next fields are only available with PLI and FIR statistics patches so */
   /* hey are prone to fail if these patches are not applied in Gstreamer */
-  if (!gst_structure_get (stats, "sent-pli-count", G_TYPE_UINT, &pliCount,
-                          "sent-fir-count", G_TYPE_UINT, &firCount, NULL) ) {
+  if (!gst_structure_id_get (stats, quarks.sentPliCount, G_TYPE_UINT,
+                             &sample.pliCount, quarks.sentFirCount, G_TYPE_UINT, &sample.firCount,
+                             NULL) ) {
     GST_WARNING ("Current version of gstreamer has neither PLI nor FIR statistics patches applied.");
   }
-
-  if (!gst_structure_get (stats, "remb", G_TYPE_UINT, &remb, NULL) ) {
-    GST_TRACE ("No remb stats collected");
-  }
-
-  return std::make_shared <RTCInboundRTPStreamStats> ("",
-         std::make_shared <RTCStatsType> (RTCStatsType::inboundrtp), 0.0, "",
-         "", false, "", "", "", firCount, pliCount, 0, 0, remb,
-         packetsReceived, bytesReceived, packetLost, (float) jitter,
-         (float) fractionLost);
 }
 
-static std::shared_ptr<RTCOutboundRTPStreamStats>
-createRTCOutboundRTPStreamStats (const GstStructure *stats)
+static void
+parseOutboundStream (const GstStructure *stats, StreamSample &sample)
 {
-  guint64 bytesSent, packetsSent, bitRate, roundTripTime;
-  guint pliCount, firCount, remb;
-
-  bytesSent = packetsSent = bitRate = roundTripTime = G_GUINT64_CONSTANT (0);
-  pliCount = firCount = remb = 0;
-
-  gst_structure_get (stats, "packets-sent", G_TYPE_UINT64, &packetsSent,
-                     "octets-sent", G_TYPE_UINT64, &bytesSent, "bitrate",
-                     G_TYPE_UINT64, &bitRate, "rb-round-trip", G_TYPE_UINT64,
-                     &roundTripTime, NULL);
+  gst_structure_id_get (stats, quarks.packetsSent, G_TYPE_UINT64,
+                        &sample.packets, quarks.octetsSent, G_TYPE_UINT64, &sample.bytes,
+                        quarks.bitrate, G_TYPE_UINT64, &sample.bitrate, quarks.rbRoundTrip,
+                        G_TYPE_UINT64, &sample.roundTripTime, NULL);
 
   /* Next fields are only available with PLI and FIR statistics patches so */
   /* hey are prone to fail if these patches are not applied in Gstreamer */
-  if (!gst_structure_get (stats, "recv-pli-count", G_TYPE_UINT, &pliCount,
-                          "recv-fir-count", G_TYPE_UINT, &firCount, NULL) ) {
+  if (!gst_structure_id_get (stats, quarks.recvPliCount, G_TYPE_UINT,
+                             &sample.pliCount, quarks.recvFirCount, G_TYPE_UINT, &sample.firCount,
+                             NULL) ) {
     GST_WARNING ("Current version of gstreamer has neither PLI nor FIR statistics patches applied.");
   }
+}
+
+static void
+parseStream (guint nackSent, guint nackRecv, const GstStructure *stats,
+             StreamSample &sample)
+{
+  gchar *id = NULL;
 
-  if (!gst_structure_get (stats, "remb", G_TYPE_UINT, &remb, NULL) ) {
+  gst_structure_id_get (stats, quarks.ssrc, G_TYPE_UINT, &sample.ssrc,
+                        quarks.internal, G_TYPE_BOOLEAN, &sample.internal, quarks.id,
+                        G_TYPE_STRING, &id, NULL);
+
+  if (sample.internal) {
+    /* Local SSRC */
+    parseOutboundStream (stats, sample);
+    sample.nackCount = nackRecv;
+  } else {
+    /* Remote SSRC */
+    parseInboundStream (stats, sample);
+    sample.nackCount = nackSent;
+  }
+
+  if (!gst_structure_id_get (stats, quarks.remb, G_TYPE_UINT, &sample.remb,
+                             NULL) ) {
     GST_TRACE ("No remb stats collected");
   }
 
-  return std::make_shared <RTCOutboundRTPStreamStats> ("",
-         std::make_shared <RTCStatsType> (RTCStatsType::outboundrtp), 0.0, "",
-         "", false, "", "", "", firCount, pliCount, 0, 0, remb,
-         packetsSent, bytesSent, (float) bitRate, (float) roundTripTime);
+  sample.id = (id != NULL) ? id : "";
+  g_free (id);
 }
 
 static std::shared_ptr<RTCRTPStreamStats>
-createRTCRTPStreamStats (guint nackSent, guint nackRecv,
-                         const GstStructure *stats)
+createRTCRTPStreamStats (double timestamp, const StreamSample &sample,
+                         double bitrate, double packetLossRate, double jitterTrend)
 {
-  std::shared_ptr<RTCRTPStreamStats> rtcStats;
-  gboolean isInternal;
-  gchar *ssrcStr, *id;
-  uint ssrc, nackCount;
+  std::shared_ptr<RTCOutboundRTPStreamStats> outbound;
+  std::shared_ptr<RTCInboundRTPStreamStats> inbound;
+
+  /* Rates are optional properties, not taken by the constructors */
+  if (sample.internal) {
+    outbound = std::make_shared <RTCOutboundRTPStreamStats> (sample.id,
+               std::make_shared <RTCStatsType> (RTCStatsType::outboundrtp), timestamp,
+               std::to_string (sample.ssrc), "", false, "", "", "", sample.firCount,
+               sample.pliCount, sample.nackCount, 0, sample.remb, sample.packets,
+               sample.bytes, (float) sample.bitrate, (float) sample.roundTripTime);
+    outbound->setBitrate ( (float) bitrate);
+
+    return outbound;
+  }
 
-  gst_structure_get (stats, "ssrc", G_TYPE_UINT, &ssrc, "internal",
-                     G_TYPE_BOOLEAN, &isInternal, "id", G_TYPE_STRING, &id, NULL);
+  inbound = std::make_shared <RTCInboundRTPStreamStats> (sample.id,
+            std::make_shared <RTCStatsType> (RTCStatsType::inboundrtp), timestamp,
+            std::to_string (sample.ssrc), "", false, "", "", "", sample.firCount,
+            sample.pliCount, sample.nackCount, 0, sample.remb, sample.packets,
+            sample.bytes, sample.packetsLost, (float) sample.jitter,
+            (float) sample.fractionLost);
+  inbound->setBitrate ( (float) bitrate);
+  inbound->setPacketLossRate ( (float) packetLossRate);
+  inbound->setJitterTrend ( (float) jitterTrend);
+
+  return inbound;
+}
 
-  ssrcStr = g_strdup_printf ("%u", ssrc);
+static const GstStructure *
+getNestedStructure (const GstStructure *stats, const gchar *name)
+{
+  const GValue *value = gst_structure_get_value (stats, name);
 
-  if (isInternal) {
-    /* Local SSRC */
-    rtcStats = createRTCOutboundRTPStreamStats (stats);
-    nackCount = nackRecv;
-  } else {
-    /* Remote SSRC */
-    rtcStats = createRTCInboundRTPStreamStats (stats);
-    nackCount = nackSent;
-  }
+  if (!GST_VALUE_HOLDS_STRUCTURE (value) ) {
+    gchar *str_val;
 
-  rtcStats->setNackCount (nackCount);
-  rtcStats->setSsrc (ssrcStr);
-  rtcStats->setId (id);
+    str_val = g_strdup_value_contents (value);
+    GST_WARNING ("Unexpected field type (%s) = %s", name, str_val);
+    g_free (str_val);
 
-  g_free (ssrcStr);
-  g_free (id);
+    return NULL;
+  }
 
-  return rtcStats;
+  return gst_value_get_structure (value);
 }
 
+/* Appends to @samples from @size on, reusing the entries already there */
 static void
-collectRTCRTPStreamStats (std::map <std::string, std::shared_ptr<RTCStats>>
-                          &rtcStatsReport, double timestamp, const GstStructure *stats)
+collectStreams (const GstStructure *session,
+                std::vector<StreamValues> &samples, size_t &size)
 {
   guint nackSent, nackRecv;
   gint i, n;
 
   nackSent = nackRecv = 0;
 
-  gst_structure_get (stats, "sent-nack-count", G_TYPE_UINT, &nackSent,
-                     "recv-nack-count", G_TYPE_UINT, &nackRecv, NULL);
+  gst_structure_id_get (session, quarks.sentNackCount, G_TYPE_UINT, &nackSent,
+                        quarks.recvNackCount, G_TYPE_UINT, &nackRecv, NULL);
 
-  n = gst_structure_n_fields (stats);
+  n = gst_structure_n_fields (session);
 
   for (i = 0; i < n; i++) {
-    std::shared_ptr<RTCStats> rtcStats;
-    const GValue *value;
+    const GstStructure *stream;
     const gchar *name;
 
-    name = gst_structure_nth_field_name (stats, i);
+    name = gst_structure_nth_field_name (session, i);
 
     if (!g_str_has_prefix (name, KMS_STATISTIC_FIELD_PREFIX_SSRC) ) {
       continue;
     }
 
-    value = gst_structure_get_value (stats, name);
+    stream = getNestedStructure (session, name);
 
-    if (!GST_VALUE_HOLDS_STRUCTURE (value) ) {
-      gchar *str_val;
+    if (stream != NULL) {
+      if (size == samples.size () ) {
+        samples.emplace_back ();
+      }
 
-      str_val = g_strdup_value_contents (value);
-      GST_WARNING ("Unexpected field type (%s) = %s", name, str_val);
-      g_free (str_val);
-
-      continue;
+      samples[size].sample = StreamSample ();
+      parseStream (nackSent, nackRecv, stream, samples[size].sample);
+      size++;
     }
-
-    rtcStats = createRTCRTPStreamStats (nackSent, nackRecv,
-                                        gst_value_get_structure (value) );
-
-    rtcStats->setTimestamp (timestamp);
-
-    rtcStatsReport[rtcStats->getId ()] = rtcStats;
   }
 }
 
-std::map <std::string, std::shared_ptr<RTCStats>> createRTCStatsReport (
-      double timestamp, const GstStructure *stats)
+static void
+collectSessions (const GstStructure *stats, std::vector<StreamValues> &samples,
+                 size_t &size)
 {
-  std::map <std::string, std::shared_ptr<RTCStats>> rtcStatsReport;
   gint i, n;
 
   n = gst_structure_n_fields (stats);
 
   for (i = 0; i < n; i++) {
-    std::shared_ptr<RTCStats> rtcStats;
-    const GValue *value;
+    const GstStructure *session;
     const gchar *name;
 
     name = gst_structure_nth_field_name (stats, i);
@@ -197,23 +286,271 @@ std::map <std::string, std::shared_ptr<RTCStats>> createRTCStatsReport (
       continue;
     }
 
-    value = gst_structure_get_value (stats, name);
+    session = getNestedStructure (stats, name);
 
-    if (!GST_VALUE_HOLDS_STRUCTURE (value) ) {
-      gchar *str_val;
+    if (session != NULL) {
+      collectStreams (session, samples, size);
+    }
+  }
+}
 
-      str_val = g_strdup_value_contents (value);
-      GST_WARNING ("Unexpected field type (%s) = %s", name, str_val);
-      g_free (str_val);
+class StatsSnapshot
+{
+public:
+  double timestamp = 0;
+  /* Only the first size entries are valid, the rest are kept for reuse */
+  std::vector<StreamValues> streams;
+  size_t size = 0;
+
+  /* Built on the first request */
+  RTCStatsReport getReport () const
+  {
+    std::unique_lock<std::mutex> lock (mutex);
+
+    if (!built) {
+      for (size_t i = 0; i < size; i++) {
+        const StreamValues &values = streams[i];
+
+        report[values.sample.id] = createRTCRTPStreamStats (timestamp,
+                                   values.sample, values.bitrate, values.packetLossRate,
+                                   values.jitterTrend);
+      }
+
+      built = true;
+    }
 
-      continue;
+    return report;
+  }
+
+  void reset ()
+  {
+    report.clear ();
+    built = false;
+    size = 0;
+  }
+
+private:
+  mutable std::mutex mutex;
+  mutable bool built = false;
+  mutable RTCStatsReport report;
+};
+
+void
+RTCStatsTracker::update (double timestamp, const GstStructure *stats)
+{
+  std::shared_ptr<StatsSnapshot> next;
+  std::unique_lock<std::mutex> lock (mutex);
+
+  /* Nobody can take the spare one anymore, reuse it once it is released */
+  if (spare && spare.use_count () == 1) {
+    next.swap (spare);
+    next->reset ();
+  } else {
+    next = std::make_shared<StatsSnapshot> ();
+  }
+
+  next->timestamp = timestamp;
+  collectSessions (stats, next->streams, next->size);
+  generation++;
+
+  for (size_t i = 0; i < next->size; i++) {
+    StreamValues &values = next->streams[i];
+    const StreamSample &sample = values.sample;
+    StreamRecord &record = records[sample.id];
+    double elapsed = timestamp - record.timestamp;
+
+    if (record.generation == 0 || sample.packets < record.packets ||
+        sample.bytes < record.bytes) {
+      /* New stream or restarted counters, nothing to compare with */
+      record.bitrate = record.packetLossRate = record.jitterTrend = 0;
+    } else if (elapsed > 0) {
+      guint64 packets = sample.packets - record.packets;
+      gint lost = MAX (sample.packetsLost - record.packetsLost, 0);
+
+      record.bitrate = (sample.bytes - record.bytes) * 8 / elapsed;
+
+      if (!sample.internal) {
+        double expected = packets + lost;
+        double trend = ( (double) sample.jitter - record.jitter) / elapsed;
+
+        record.packetLossRate = (expected > 0) ? lost / expected : 0;
+        record.jitterTrend = JITTER_TREND_WEIGHT * trend +
+                             (1 - JITTER_TREND_WEIGHT) * record.jitterTrend;
+      }
+    }
+
+    record.generation = generation;
+    record.timestamp = timestamp;
+    record.packets = sample.packets;
+    record.bytes = sample.bytes;
+    record.packetsLost = sample.packetsLost;
+    record.jitter = sample.jitter;
+
+    values.bitrate = record.bitrate;
+    values.packetLossRate = record.packetLossRate;
+    values.jitterTrend = record.jitterTrend;
+  }
+
+  /* Drop the records of streams that are gone */
+  for (auto it = records.begin (); it != records.end ();) {
+    if (it->second.generation != generation) {
+      it = records.erase (it);
+    } else {
+      it++;
     }
+  }
+
+  std::atomic_store (&report, std::shared_ptr<const StatsSnapshot> (next) );
+  spare.swap (current);
+  current.swap (next);
+}
+
+RTCStatsReport
+RTCStatsTracker::getReport ()
+{
+  std::shared_ptr<const StatsSnapshot> snapshot = std::atomic_load (&report);
 
-    collectRTCRTPStreamStats (rtcStatsReport, timestamp,
-                              gst_value_get_structure (value) );
+  if (!snapshot) {
+    return RTCStatsReport ();
   }
 
-  return rtcStatsReport;
+  return snapshot->getReport ();
+}
+
+bool
+RTCStatsTracker::hasReport ()
+{
+  return std::atomic_load (&report) != nullptr;
+}
+
+RTCStatsReport
+createRTCStatsReport (double timestamp, const GstStructure *stats)
+{
+  RTCStatsTracker tracker;
+
+  tracker.update (timestamp, stats);
+
+  return tracker.getReport ();
+}
+
+/*
+ * Numeric fields of @stats named as in the serialized stats. They are read
+ * with the getters of the known types, anything else is serialized.
+ */
+static void
+getNumericFields (const std::shared_ptr<RTCStats> &stats,
+                  std::map<std::string, double> &values)
+{
+  std::shared_ptr<RTCRTPStreamStats> stream =
+    std::dynamic_pointer_cast<RTCRTPStreamStats> (stats);
+  std::shared_ptr<RTCInboundRTPStreamStats> inbound;
+  std::shared_ptr<RTCOutboundRTPStreamStats> outbound;
+
+  if (!stream) {
+    JsonSerializer serializer (true);
+
+    serializer.Serialize ("stats", stats);
+    const Json::Value &value = serializer.JsonValue["stats"];
+
+    for (const std::string &name : value.getMemberNames () ) {
+      if (value[name].isNumeric () && !value[name].isBool () ) {
+        values[name] = value[name].asDouble ();
+      }
+    }
+
+    return;
+  }
+
+  values["timestamp"] = stream->getTimestamp ();
+  values["firCount"] = stream->getFirCount ();
+  values["pliCount"] = stream->getPliCount ();
+  values["nackCount"] = stream->getNackCount ();
+  values["sliCount"] = stream->getSliCount ();
+  values["remb"] = stream->getRemb ();
+
+  if ( (inbound = std::dynamic_pointer_cast<RTCInboundRTPStreamStats>
+                  (stats) ) ) {
+    values["packetsReceived"] = inbound->getPacketsReceived ();
+    values["bytesReceived"] = inbound->getBytesReceived ();
+    values["packetsLost"] = inbound->getPacketsLost ();
+    values["jitter"] = inbound->getJitter ();
+    values["fractionLost"] = inbound->getFractionLost ();
+
+    if (inbound->isSetBitrate () ) {
+      values["bitrate"] = inbound->getBitrate ();
+    }
+
+    if (inbound->isSetPacketLossRate () ) {
+      values["packetLossRate"] = inbound->getPacketLossRate ();
+    }
+
+    if (inbound->isSetJitterTrend () ) {
+      values["jitterTrend"] = inbound->getJitterTrend ();
+    }
+  } else if ( (outbound = std::dynamic_pointer_cast<RTCOutboundRTPStreamStats>
+                          (stats) ) ) {
+    values["packetsSent"] = outbound->getPacketsSent ();
+    values["bytesSent"] = outbound->getBytesSent ();
+    values["targetBitrate"] = outbound->getTargetBitrate ();
+    values["roundTripTime"] = outbound->getRoundTripTime ();
+
+    if (outbound->isSetBitrate () ) {
+      values["bitrate"] = outbound->getBitrate ();
+    }
+  }
+}
+
+std::vector<std::shared_ptr<RTCStatsDelta>>
+    RTCStatsDeltaEncoder::encode (const std::map<std::string, RTCStatsReport>
+                                  &reports)
+{
+  std::vector<std::shared_ptr<RTCStatsDelta>> deltas;
+  std::unordered_map<std::string, Entry> current;
+
+  for (auto &report : reports) {
+    for (auto &it : report.second) {
+      std::shared_ptr<RTCStats> stats = it.second;
+      std::map<std::string, double> changes;
+      std::string key = report.first + "/" + it.first;
+      Entry &entry = current[key];
+      auto previous = entries.find (key);
+
+      entry.endpoint = report.first;
+      entry.statsId = it.first;
+      entry.type = stats->getType ();
+      getNumericFields (stats, entry.values);
+
+      for (auto &field : entry.values) {
+        if (previous == entries.end () ) {
+          changes[field.first] = field.second;
+          continue;
+        }
+
+        auto old = previous->second.values.find (field.first);
+
+        if (old == previous->second.values.end () || old->second != field.second) {
+          changes[field.first] = field.second;
+        }
+      }
+
+      if (previous == entries.end () || !changes.empty () ) {
+        deltas.push_back (std::make_shared<RTCStatsDelta> (entry.endpoint,
+                          entry.statsId, entry.type, false, changes) );
+      }
+    }
+  }
+
+  for (auto &it : entries) {
+    if (current.find (it.first) == current.end () ) {
+      deltas.push_back (std::make_shared<RTCStatsDelta> (it.second.endpoint,
+                        it.second.statsId, it.second.type, true,
+                        std::map<std::string, double> () ) );
+    }
+  }
+
+  entries.swap (current);
+
+  return deltas;
 }
 
 } /* statistics */
@@ -227,4 +564,6 @@ init_debug (void)
 {
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
                            GST_DEFAULT_NAME);
+
+  kurento::stats::initQuarks ();
 }
@@ -18,6 +18,12 @@
 
 #include <gst/gst.h>
 #include "RTCStats.hpp"
+#include "RTCStatsDelta.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace kurento
 {
@@ -25,8 +31,93 @@ namespace kurento
 namespace stats
 {
 
-std::map <std::string, std::shared_ptr<RTCStats>> createRTCStatsReport (
-      double timestamp, const GstStructure *stats);
+typedef std::map <std::string, std::shared_ptr<RTCStats>> RTCStatsReport;
+
+RTCStatsReport createRTCStatsReport (double timestamp,
+                                     const GstStructure *stats);
+
+class StatsSnapshot;
+
+/*
+ * Keeps the counters of every stream of an endpoint between samples, so
+ * that each report includes the rates measured since the previous one.
+ * Records are reused while their SSRC is alive and dropped once it is no
+ * longer reported.
+ *
+ * Samples are kept as plain values in preallocated snapshots, two of them
+ * reused in turns while no reader holds the older one. RTCStats objects are
+ * only built when a report is requested, once per sample.
+ */
+class RTCStatsTracker
+{
+public:
+  /* Takes a new sample from the result of the stats signal of an endpoint */
+  void update (double timestamp, const GstStructure *stats);
+
+  /* Latest report, empty if nothing was sampled yet. Never blocks on update */
+  RTCStatsReport getReport ();
+
+  bool hasReport ();
+
+private:
+  class StreamRecord
+  {
+  public:
+    guint64 generation = 0;
+    double timestamp = 0;
+    guint64 packets = 0;
+    guint64 bytes = 0;
+    gint packetsLost = 0;
+    guint jitter = 0;
+
+    double bitrate = 0;
+    double packetLossRate = 0;
+    double jitterTrend = 0;
+  };
+
+  std::mutex mutex;
+  guint64 generation = 0;
+  std::unordered_map<std::string, StreamRecord> records;
+
+  /* Last published snapshot and the one before it, only used by update */
+  std::shared_ptr<StatsSnapshot> current;
+  std::shared_ptr<StatsSnapshot> spare;
+
+  /* Accessed with std::atomic_load and std::atomic_store */
+  std::shared_ptr<const StatsSnapshot> report;
+};
+
+/*
+ * Encodes the reports of several endpoints as the changes in their numeric
+ * fields, timestamp included, since the previous call. Stats seen for the
+ * first time include all of them and stats that are gone are reported as
+ * removed.
+ */
+class RTCStatsDeltaEncoder
+{
+public:
+  /* @reports maps the id of each endpoint to its last report */
+  std::vector<std::shared_ptr<RTCStatsDelta>> encode (const
+      std::map<std::string, RTCStatsReport> &reports);
+
+  /* Forgets previous values, so the next call includes every field */
+  void reset ()
+  {
+    entries.clear ();
+  }
+
+private:
+  class Entry
+  {
+  public:
+    std::string endpoint;
+    std::string statsId;
+    std::shared_ptr<RTCStatsType> type;
+    std::map<std::string, double> values;
+  };
+
+  std::unordered_map<std::string, Entry> entries;
+};
 
 } /* statistics */
 
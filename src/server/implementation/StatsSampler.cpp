@@ -0,0 +1,143 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <gst/gst.h>
+
+#include "StatsSampler.hpp"
+
+#define GST_CAT_DEFAULT kurento_stats_sampler
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoStatsSampler"
+
+#define SAMPLER_TICK std::chrono::milliseconds (100)
+#define SAMPLER_SLOTS 128
+
+namespace kurento
+{
+
+StatsSampler &
+StatsSampler::get ()
+{
+  /* Never destroyed, objects may be released from static destructors */
+  static StatsSampler *sampler = new StatsSampler ();
+
+  return *sampler;
+}
+
+StatsSampler::StatsSampler () : timers (SAMPLER_TICK, SAMPLER_SLOTS)
+{
+  thread = std::thread (&StatsSampler::run, this);
+}
+
+void
+StatsSampler::add (ObjectHandle handle, std::chrono::milliseconds period,
+                   Sample sample)
+{
+  std::unique_lock<std::mutex> lock (mutex);
+  Entry &entry = entries[handle];
+
+  entry.period = period;
+  entry.sample = sample;
+
+  timers.schedule (handle, Timers::Clock::now () + period);
+}
+
+void
+StatsSampler::remove (ObjectHandle handle)
+{
+  Sample sample;
+  std::unique_lock<std::mutex> lock (mutex);
+  auto it = entries.find (handle);
+
+  if (it == entries.end () ) {
+    return;
+  }
+
+  /* Destroyed out of the lock */
+  sample.swap (it->second.sample);
+  entries.erase (it);
+  timers.cancel (handle);
+
+  if (std::this_thread::get_id () == thread.get_id () ) {
+    return;
+  }
+
+  while (sampling == handle) {
+    cond.wait (lock);
+  }
+}
+
+void
+StatsSampler::run ()
+{
+  std::unique_lock<std::mutex> lock (mutex);
+  Timers::Clock::time_point next = Timers::Clock::now ();
+
+  while (true) {
+    Timers::Clock::time_point now;
+
+    /* Wake up on every tick, no matter how long samples took */
+    next += timers.getTick ();
+
+    while (cond.wait_until (lock, next) == std::cv_status::no_timeout) {
+    }
+
+    now = Timers::Clock::now ();
+
+    if (now > next + timers.getTick () ) {
+      next = now;
+    }
+
+    for (ObjectHandle handle : timers.expire (now) ) {
+      auto it = entries.find (handle);
+      Sample sample;
+
+      if (it == entries.end () ) {
+        continue;
+      }
+
+      sample = it->second.sample;
+      /* The wheel rounds deadlines up to the next tick, that is a full tick
+       * since the current one was reached */
+      timers.schedule (handle, now + it->second.period - timers.getTick () );
+      sampling = handle;
+      lock.unlock ();
+
+      try {
+        sample ();
+      } catch (std::exception &e) {
+        GST_WARNING ("Error sampling stats: %s", e.what () );
+      } catch (...) {
+        GST_WARNING ("Unknown error sampling stats");
+      }
+
+      sample = Sample ();
+
+      lock.lock ();
+      sampling = INVALID_OBJECT_HANDLE;
+      cond.notify_all ();
+    }
+  }
+}
+
+StatsSampler::StaticConstructor StatsSampler::staticConstructor;
+
+StatsSampler::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} /* kurento */
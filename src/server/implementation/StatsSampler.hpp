@@ -0,0 +1,87 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __STATS_SAMPLER_HPP__
+#define __STATS_SAMPLER_HPP__
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "ObjectHandle.hpp"
+#include "TimerWheel.hpp"
+
+namespace kurento
+{
+
+/*
+ * Runs the periodic stats collection of every object from a single
+ * background thread, so requests for stats are served from the last sample
+ * instead of querying the media elements.
+ */
+class StatsSampler
+{
+public:
+  typedef std::function<void () > Sample;
+
+  static StatsSampler &get ();
+
+  /* Calls @sample every @period, replacing the previous one of @handle */
+  void add (ObjectHandle handle, std::chrono::milliseconds period,
+            Sample sample);
+
+  /*
+   * Once it returns, the sample of @handle is not running and will not run
+   * again, unless it is called from the sample itself.
+   */
+  void remove (ObjectHandle handle);
+
+private:
+  StatsSampler ();
+  ~StatsSampler() {};
+
+  void run ();
+
+  class Entry
+  {
+  public:
+    std::chrono::milliseconds period;
+    Sample sample;
+  };
+
+  typedef TimerWheel<ObjectHandle> Timers;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::unordered_map<ObjectHandle, Entry> entries;
+  Timers timers;
+  ObjectHandle sampling = INVALID_OBJECT_HANDLE;
+  std::thread thread;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} /* kurento */
+
+#endif /* __STATS_SAMPLER_HPP__ */
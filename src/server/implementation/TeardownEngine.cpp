@@ -0,0 +1,119 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <gst/gst.h>
+
+#include "TeardownEngine.hpp"
+#include <MediaPipelineImpl.hpp>
+
+#define GST_CAT_DEFAULT kurento_teardown_engine
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoTeardownEngine"
+
+namespace kurento
+{
+
+TeardownEngine::TeardownEngine (Dispatcher dispatch) : dispatch (dispatch)
+{
+}
+
+static void
+call_release (std::shared_ptr<MediaObjectImpl> mediaObject)
+{
+  if (mediaObject) {
+    mediaObject->release();
+  }
+}
+
+void
+TeardownEngine::release (std::shared_ptr<MediaObjectImpl> object)
+{
+  if (std::dynamic_pointer_cast<MediaPipelineImpl> (object) ) {
+    std::unique_lock <std::mutex> lock (mutex);
+
+    pending[object->getHandle()] = std::chrono::steady_clock::now();
+  }
+
+  dispatch (std::bind (call_release, object) );
+}
+
+void
+TeardownEngine::destroy (MediaObjectImpl *object, const std::string &id)
+{
+  bool isPipeline = dynamic_cast <MediaPipelineImpl *> (object) != NULL;
+  ObjectHandle handle = object->getHandle();
+
+  dispatch ([this, object, handle, id, isPipeline] () {
+    GST_DEBUG ("Destroying %s -> %s", object->getType().c_str(), id.c_str() );
+    /* Deletion of mediaObject weak reference */
+    delete object;
+
+    if (isPipeline) {
+      pipelineDestroyed (handle, id);
+    }
+  });
+}
+
+void
+TeardownEngine::pipelineDestroyed (ObjectHandle handle, const std::string &id)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  uint64_t done;
+  size_t remaining;
+  auto it = pending.find (handle);
+
+  if (it != pending.end() ) {
+    std::chrono::microseconds elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>
+      (std::chrono::steady_clock::now() - it->second);
+
+    latency.record (elapsed.count() );
+    GST_DEBUG ("Pipeline %s torn down in %" G_GINT64_FORMAT " us", id.c_str(),
+               (gint64) elapsed.count() );
+    pending.erase (it);
+  }
+
+  done = ++completed;
+  remaining = pending.size();
+  lock.unlock();
+
+  signalProgress.emit (done, remaining);
+}
+
+size_t
+TeardownEngine::getPending ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  return pending.size();
+}
+
+uint64_t
+TeardownEngine::getCompleted ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  return completed;
+}
+
+TeardownEngine::StaticConstructor TeardownEngine::staticConstructor;
+
+TeardownEngine::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} /* kurento */
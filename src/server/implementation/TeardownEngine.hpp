@@ -0,0 +1,90 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __TEARDOWN_ENGINE_HPP__
+#define __TEARDOWN_ENGINE_HPP__
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <sigc++/sigc++.h>
+
+#include "Histogram.hpp"
+#include "ObjectHandle.hpp"
+
+namespace kurento
+{
+
+class MediaObjectImpl;
+
+/*
+ * Releases and destroys media objects through the given dispatcher (the
+ * teardown lane of the MediaSet workers), so that pipelines are torn down in
+ * parallel. Children keep a reference to
+ * their parent, so a pipeline is always destroyed after all its elements.
+ *
+ * Keeps track of the pipelines being torn down to report progress and the
+ * time each one takes since it is released until it is destroyed.
+ */
+class TeardownEngine
+{
+public:
+  typedef std::function<void (std::function<void () >) > Dispatcher;
+
+  TeardownEngine (Dispatcher dispatch);
+  ~TeardownEngine() {};
+
+  void release (std::shared_ptr<MediaObjectImpl> object);
+  void destroy (MediaObjectImpl *object, const std::string &id);
+
+  size_t getPending ();
+  uint64_t getCompleted ();
+
+  /* Microseconds since a pipeline is released until it is destroyed */
+  const Histogram &getLatencyHistogram () const
+  {
+    return latency;
+  }
+
+  /* Pipelines destroyed so far and pipelines still being torn down */
+  sigc::signal<void, uint64_t, size_t> signalProgress;
+
+private:
+  void pipelineDestroyed (ObjectHandle handle, const std::string &id);
+
+  Dispatcher dispatch;
+
+  std::mutex mutex;
+  std::unordered_map<ObjectHandle, std::chrono::steady_clock::time_point>
+  pending;
+  uint64_t completed = 0;
+
+  Histogram latency;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} /* kurento */
+
+#endif /* __TEARDOWN_ENGINE_HPP__ */
@@ -0,0 +1,164 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#ifndef __TIMER_WHEEL_HPP__
+#define __TIMER_WHEEL_HPP__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Hashed timing wheel. Deadlines are rounded up to the next tick and stored
+ * in the slot for that tick, so scheduling is O(1) and expiring only visits
+ * the slots elapsed since the previous call. Deadlines further than one
+ * revolution stay in their slot until their tick is reached.
+ *
+ * There is at most one timer per key: scheduling an existing key replaces its
+ * deadline. Replaced and cancelled timers are dropped lazily when their slot
+ * is visited. @Key must be copyable and hashable with std::hash.
+ */
+template <typename Key>
+class TimerWheel
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  TimerWheel (Clock::duration tick, size_t slots) : tick (tick),
+    origin (Clock::now() ), current (0), slots (slots)
+  {
+  }
+
+  ~TimerWheel() {};
+
+  void schedule (const Key &key, Clock::time_point deadline)
+  {
+    std::unique_lock <std::mutex> lock (mutex);
+    Timer timer;
+
+    timer.key = key;
+    timer.tick = toTick (deadline, true);
+
+    if (timer.tick <= current) {
+      /* Already due, fire on next expiration */
+      timer.tick = current + 1;
+    }
+
+    deadlines[key] = timer.tick;
+    slots[timer.tick % slots.size()].push_back (timer);
+  }
+
+  void cancel (const Key &key)
+  {
+    std::unique_lock <std::mutex> lock (mutex);
+
+    deadlines.erase (key);
+  }
+
+  /* Returns the keys whose deadline is not later than @now */
+  std::vector<Key> expire (Clock::time_point now)
+  {
+    std::unique_lock <std::mutex> lock (mutex);
+    std::vector<Key> expired;
+    uint64_t target = toTick (now, false);
+    uint64_t steps;
+
+    if (target <= current) {
+      return expired;
+    }
+
+    /* No need to visit a slot twice if we are more than a revolution late */
+    steps = std::min <uint64_t> (target - current, slots.size() );
+
+    for (uint64_t i = 1; i <= steps; i++) {
+      std::vector<Timer> &slot = slots[ (current + i) % slots.size()];
+      std::vector<Timer> pending;
+
+      for (auto &timer : slot) {
+        auto it = deadlines.find (timer.key);
+
+        if (it == deadlines.end() || it->second != timer.tick) {
+          /* Cancelled or replaced by a later schedule */
+          continue;
+        }
+
+        if (timer.tick <= target) {
+          expired.push_back (timer.key);
+          deadlines.erase (it);
+        } else {
+          pending.push_back (timer);
+        }
+      }
+
+      slot.swap (pending);
+    }
+
+    current = target;
+
+    return expired;
+  }
+
+  Clock::duration getTick () const
+  {
+    return tick;
+  }
+
+  size_t size ()
+  {
+    std::unique_lock <std::mutex> lock (mutex);
+
+    return deadlines.size();
+  }
+
+private:
+  class Timer
+  {
+  public:
+    Key key;
+    uint64_t tick;
+  };
+
+  uint64_t toTick (Clock::time_point time, bool roundUp) const
+  {
+    Clock::duration elapsed = time - origin;
+
+    if (elapsed.count() <= 0) {
+      return 0;
+    }
+
+    if (roundUp) {
+      return (elapsed + tick - Clock::duration (1) ) / tick;
+    }
+
+    return elapsed / tick;
+  }
+
+  std::mutex mutex;
+  Clock::duration tick;
+  Clock::time_point origin;
+  uint64_t current;
+  std::unordered_map<Key, uint64_t> deadlines;
+  std::vector<std::vector<Timer>> slots;
+};
+
+} /* kurento */
+
+#endif /* __TIMER_WHEEL_HPP__ */
@@ -13,68 +13,101 @@
  *
  */
 
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_generators.hpp>
-#include <boost/uuid/uuid_io.hpp>
-#include <chrono>
-#include <sstream>
+#include "UUIDGenerator.hpp"
+
+#include <cstdint>
+#include <random>
 #include <sys/types.h>
 #include <unistd.h>
 
 namespace kurento
 {
 
+/*
+ * Each thread owns its generator, seeded from the system entropy source, so
+ * generating identifiers never contends and never shares unsynchronized
+ * state between threads.
+ */
 class RandomGenerator
 {
-  boost::uuids::basic_random_generator<boost::mt19937> gen;
-  boost::mt19937 ran;
+  std::mt19937_64 ran;
   pid_t pid;
 
 public:
-  RandomGenerator () : gen (&ran)
+  RandomGenerator ()
   {
     init ();
   }
 
   void init ()
   {
-    std::chrono::high_resolution_clock::time_point now =
-      std::chrono::high_resolution_clock::now();
-
-    std::chrono::nanoseconds time =
-      std::chrono::duration_cast<std::chrono::nanoseconds>
-      (now.time_since_epoch () );
+    std::random_device device;
+    std::seed_seq seed {device(), device(), device(), device(),
+                        device(), device(), device(), device() };
 
-    ran.seed (time.count() );
+    ran.seed (seed);
 
     pid = getpid();
   }
 
   void reinit ()
   {
+    /* A forked child must not repeat the identifiers of its parent */
     if (pid != getpid() ) {
       init();
     }
   }
 
-  std::string getUUID ()
+  void getUUID (std::string &dest)
   {
+    static const char hex[] = "0123456789abcdef";
+    uint8_t bytes[16];
+    uint64_t high, low;
+    char *out;
+
     reinit();
 
-    std::stringstream ss;
-    boost::uuids::uuid uuid = gen ();
+    high = ran ();
+    low = ran ();
+
+    for (int i = 0; i < 8; i++) {
+      bytes[i] = high >> (56 - 8 * i);
+      bytes[i + 8] = low >> (56 - 8 * i);
+    }
+
+    /* Version 4 (random) and RFC 4122 variant */
+    bytes[6] = (bytes[6] & 0x0f) | 0x40;
+    bytes[8] = (bytes[8] & 0x3f) | 0x80;
 
-    ss << uuid;
-    return ss.str();
+    dest.resize (UUID_STR_LENGTH);
+    out = &dest[0];
+
+    for (int i = 0; i < 16; i++) {
+      if (i == 4 || i == 6 || i == 8 || i == 10) {
+        *out++ = '-';
+      }
+
+      *out++ = hex[bytes[i] >> 4];
+      *out++ = hex[bytes[i] & 0x0f];
+    }
   }
 };
 
-static RandomGenerator gen;
+static thread_local RandomGenerator gen;
+
+void
+generateUUID (std::string &dest)
+{
+  gen.getUUID (dest);
+}
 
 std::string
 generateUUID ()
 {
-  return gen.getUUID ();
+  std::string uuid;
+
+  gen.getUUID (uuid);
+  return uuid;
 }
 
 }
@@ -17,11 +17,19 @@
 #ifndef __UUID_GENERATOR_HPP__
 #define __UUID_GENERATOR_HPP__
 
+#include <string>
+
 namespace kurento
 {
 
+/* Length of the canonical textual form, without trailing '\0' */
+static const size_t UUID_STR_LENGTH = 36;
+
 std::string generateUUID ();
 
+/* Writes the new UUID in @dest, reusing its storage */
+void generateUUID (std::string &dest);
+
 }
 
 #endif /* __UUID_GENERATOR_HPP__ */
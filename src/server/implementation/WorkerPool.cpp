@@ -16,25 +16,26 @@
 #include <gst/gst.h>
 
 #include "WorkerPool.hpp"
-#include <atomic>
 
 #define GST_CAT_DEFAULT kurento_worker_pool
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoWorkerPool"
 
-const int WORKER_THREADS_TIMEOUT = 3; /* seconds */
-
 namespace kurento
 {
 
+/* Pool and worker served by the current thread, if any */
+static thread_local WorkerPool *currentPool = NULL;
+static thread_local void *currentWorker = NULL;
+
 static void
-workerThreadLoop ( boost::shared_ptr< boost::asio::io_service > io_service )
+watcherThreadLoop ( boost::shared_ptr< boost::asio::io_service > io_service )
 {
   bool running = true;
 
   while (running) {
     try {
-      GST_DEBUG ("Working thread starting");
+      GST_DEBUG ("Watcher thread starting");
       io_service->run();
       running = false;
     } catch (std::exception &e) {
@@ -44,37 +45,51 @@ workerThreadLoop ( boost::shared_ptr< boost::asio::io_service > io_service )
     }
   }
 
-  GST_DEBUG ("Working thread finished");
+  GST_DEBUG ("Watcher thread finished");
 }
 
-WorkerPool::WorkerPool (int threads)
+WorkerPool::WorkerPool (int threads, std::chrono::milliseconds monitorPeriod)
+  : monitorPeriod (monitorPeriod)
 {
+  for (int i = 0; i < N_PRIORITIES; i++) {
+    lanePending[i] = 0;
+  }
+
+  workers = std::make_shared<const WorkerList> ();
+
   /* Prepare watcher */
   watcher_service = boost::shared_ptr< boost::asio::io_service >
                     ( new boost::asio::io_service () );
   watcher_work = std::shared_ptr< boost::asio::io_service::work >
                  ( new boost::asio::io_service::work (*watcher_service) );
-  watcher = std::thread (std::bind (&workerThreadLoop, watcher_service) );
+  monitor = std::shared_ptr< boost::asio::deadline_timer > (
+              new boost::asio::deadline_timer (*watcher_service) );
 
   /* Prepare pool of threads */
-  io_service = boost::shared_ptr< boost::asio::io_service >
-               ( new boost::asio::io_service () );
-  work = std::shared_ptr< boost::asio::io_service::work >
-         ( new boost::asio::io_service::work (*io_service) );
-
   for (int i = 0; i < threads; i++) {
-    workers.push_back (std::thread (std::bind (&workerThreadLoop, io_service) ) );
+    spawnWorker ();
   }
+
+  scheduleMonitor();
+  watcher = std::thread (std::bind (&watcherThreadLoop, watcher_service) );
 }
 
 WorkerPool::~WorkerPool()
 {
   std::unique_lock <std::mutex> lock (mutex);
-  terminated = true ;
+  std::shared_ptr<const WorkerList> current;
+  Task task;
+  Priority priority;
+
+  terminated = true;
+  current = std::atomic_load (&workers);
   lock.unlock();
 
   watcher_service->stop();
-  io_service->stop();
+
+  std::unique_lock <std::mutex> idleLock (idleMutex);
+  idleCond.notify_all();
+  idleLock.unlock();
 
   try {
     if (std::this_thread::get_id() != watcher.get_id() ) {
@@ -92,78 +107,244 @@ WorkerPool::~WorkerPool()
     GST_ERROR ("Error detaching: %s", e.what() );
   }
 
-  for (uint i = 0; i < workers.size (); i++) {
+  for (auto worker : *current) {
     try {
-      if (std::this_thread::get_id() != workers[i].get_id() ) {
-        workers[i].join();
+      if (std::this_thread::get_id() != worker->thread.get_id() ) {
+        worker->thread.join();
+      } else {
+        /* Pool is being destroyed from one of its tasks */
+        worker->detached = true;
       }
     } catch (std::system_error &e) {
       GST_ERROR ("Error joining: %s", e.what() );
     }
 
     try {
-      if (workers[i].joinable() ) {
-        workers[i].detach();
+      if (worker->thread.joinable() ) {
+        worker->thread.detach();
       }
     } catch (std::system_error &e) {
       GST_ERROR ("Error detaching: %s", e.what() );
     }
   }
 
-  workers.empty();
-
   // Executing queued tasks
-  io_service->reset();
+  while (popTask (NULL, task, priority) ) {
+    runTask (task, priority);
+  }
+}
 
-  while (io_service->poll() ) {
+void
+WorkerPool::post (std::function<void () > handler, Priority priority)
+{
+  std::shared_ptr<const WorkerList> current = std::atomic_load (&workers);
+  std::shared_ptr<Worker> target;
+  Task task;
+
+  task.handler = std::move (handler);
+  task.posted = std::chrono::steady_clock::now();
+
+  if (currentPool == this && currentWorker != NULL) {
+    /* Keep locality, other workers will steal it if this one is busy */
+    for (auto worker : *current) {
+      if (worker.get() == currentWorker) {
+        target = worker;
+        break;
+      }
+    }
   }
+
+  if (!target) {
+    target = current->at (nextWorker++ % current->size() );
+  }
+
+  queueDepth[priority].record (lanePending[priority]);
+  posted++;
+
+  /*
+   * Counted under the lock of the queue, once the task is there: idle workers
+   * only look for tasks while something is pending, and a task can only be
+   * taken (and discounted) after it is counted.
+   */
+  std::unique_lock <std::mutex> lock (target->mutex);
+  target->lanes[priority].push_back (std::move (task) );
+  lanePending[priority]++;
+  pending++;
+  lock.unlock();
+
+  std::unique_lock <std::mutex> idleLock (idleMutex);
+  idleLock.unlock();
+  idleCond.notify_one();
 }
 
-static void
-async_worker_test (std::shared_ptr<std::atomic<bool>> alive)
+bool
+WorkerPool::popTask (Worker *self, Task &task, Priority &priority)
 {
-  *alive = true;
+  std::shared_ptr<const WorkerList> current = std::atomic_load (&workers);
+
+  if (pending == 0) {
+    return false;
+  }
+
+  for (int lane = 0; lane < N_PRIORITIES; lane++) {
+    if (lanePending[lane] == 0) {
+      continue;
+    }
+
+    if (self != NULL) {
+      std::unique_lock <std::mutex> lock (self->mutex);
+
+      if (!self->lanes[lane].empty() ) {
+        task = std::move (self->lanes[lane].front() );
+        self->lanes[lane].pop_front();
+        priority = (Priority) lane;
+        lanePending[lane]--;
+        pending--;
+        return true;
+      }
+    }
+
+    for (auto worker : *current) {
+      if (worker.get() == self) {
+        continue;
+      }
+
+      std::unique_lock <std::mutex> lock (worker->mutex);
+
+      if (!worker->lanes[lane].empty() ) {
+        /* Steal the newest task, the owner keeps serving the oldest ones */
+        task = std::move (worker->lanes[lane].back() );
+        worker->lanes[lane].pop_back();
+        priority = (Priority) lane;
+        lanePending[lane]--;
+        pending--;
+        return true;
+      }
+    }
+  }
+
+  return false;
 }
 
 void
-WorkerPool::checkWorkers ()
+WorkerPool::runTask (Task &task, Priority priority)
 {
-  std::shared_ptr<std::atomic<bool>> alive;
+  std::chrono::microseconds waited =
+    std::chrono::duration_cast<std::chrono::microseconds>
+    (std::chrono::steady_clock::now() - task.posted);
 
-  alive = std::shared_ptr<std::atomic<bool>> ( new std::atomic<bool> (false) );
+  latency[priority].record (waited.count() );
 
-  io_service->post (std::bind (&async_worker_test, alive) );
+  try {
+    task.handler ();
+  } catch (std::exception &e) {
+    GST_ERROR ("Unexpected error while running a task: %s", e.what() );
+  } catch (...) {
+    GST_ERROR ("Unexpected error while running a task");
+  }
+}
 
-  boost::shared_ptr< boost::asio::deadline_timer > timer (
-    new boost::asio::deadline_timer ( *watcher_service ) );
+void
+WorkerPool::workerLoop (std::shared_ptr<Worker> worker)
+{
+  Task task;
+  Priority priority;
 
-  timer->expires_from_now ( boost::posix_time::seconds (
-                              WORKER_THREADS_TIMEOUT) );
-  timer->async_wait ( [timer, alive,
-  this] (const boost::system::error_code & error) {
-    if (error) {
-      GST_ERROR ("ERROR: %s", error.message().c_str() );
-      return;
-    }
+  GST_DEBUG ("Working thread starting");
 
-    if (*alive) {
-      return;
+  currentPool = this;
+  currentWorker = worker.get();
+
+  while (true) {
+    if (popTask (worker.get(), task, priority) ) {
+      runTask (task, priority);
+
+      if (worker->detached) {
+        /* The pool does not exist anymore */
+        return;
+      }
+
+      task.handler = nullptr;
+      completed++;
+      continue;
     }
 
-    GST_WARNING ("Worker threads locked. Spawning a new one.");
+    std::unique_lock <std::mutex> idleLock (idleMutex);
 
-    std::unique_lock <std::mutex> lock (mutex);
+    if (terminated) {
+      break;
+    }
 
-    if (!terminated) {
-      workers.push_back (std::thread (std::bind (&workerThreadLoop, io_service) ) );
+    if (pending == 0) {
+      idleCond.wait (idleLock);
     }
-  });
+  }
+
+  currentPool = NULL;
+  currentWorker = NULL;
+
+  GST_DEBUG ("Working thread finished");
+}
+
+void
+WorkerPool::spawnWorker ()
+{
+  std::shared_ptr<Worker> worker (new Worker () );
+  std::shared_ptr<WorkerList> list (new WorkerList (*std::atomic_load (
+                                      &workers) ) );
+
+  list->push_back (worker);
+  std::atomic_store (&workers, std::shared_ptr<const WorkerList> (list) );
+
+  worker->thread = std::thread (std::bind (&WorkerPool::workerLoop, this,
+                                worker) );
 }
 
 void
-WorkerPool::setWatcher ()
+WorkerPool::checkWorkers ()
 {
-  watcher_service->post (std::bind (&WorkerPool::checkWorkers, this) );
+  uint64_t currentPosted = posted;
+  uint64_t currentCompleted = completed;
+  bool stalled;
+
+  /* Workers are stalled if nothing finished during the last period while
+   * tasks queued before it are still pending */
+  stalled = currentCompleted == lastCompleted && lastPosted > currentCompleted;
+
+  lastPosted = currentPosted;
+  lastCompleted = currentCompleted;
+
+  if (!stalled) {
+    return;
+  }
+
+  stallsDetected++;
+  GST_WARNING ("Worker threads locked. Spawning a new one.");
+
+  std::unique_lock <std::mutex> lock (mutex);
+
+  if (!terminated) {
+    spawnWorker ();
+    threadsSpawned++;
+  }
+}
+
+void
+WorkerPool::scheduleMonitor ()
+{
+  monitor->expires_from_now (boost::posix_time::milliseconds (
+                               monitorPeriod.count() ) );
+  monitor->async_wait ([this] (const boost::system::error_code & error) {
+    if (error == boost::asio::error::operation_aborted) {
+      return;
+    } else if (error) {
+      GST_ERROR ("ERROR: %s", error.message().c_str() );
+      return;
+    }
+
+    checkWorkers ();
+    scheduleMonitor ();
+  });
 }
 
 WorkerPool::StaticConstructor WorkerPool::staticConstructor;
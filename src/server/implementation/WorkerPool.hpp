@@ -18,40 +18,129 @@
 
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
 #include <boost/asio.hpp>
 
+#include "Histogram.hpp"
+
 namespace kurento
 {
 
+/*
+ * Pool of threads, each one owning a queue per priority lane. Tasks posted
+ * from a worker go to its own queue, the rest are distributed round robin.
+ * Idle workers steal from the others, always serving higher priority lanes
+ * first.
+ */
 class WorkerPool
 {
 public:
-  WorkerPool (int threads);
+  enum Priority {
+    /* Short control operations, a client is waiting for them */
+    INTERACTIVE = 0,
+    /* Release of resources, potentially slow */
+    TEARDOWN,
+    /* Housekeeping that nobody waits for, such as session expiration */
+    BACKGROUND,
+    N_PRIORITIES
+  };
+
+  /*
+   * @monitorPeriod is how often the workers are checked for progress, a new
+   * one is spawned if they made none during a whole period
+   */
+  WorkerPool (int threads, std::chrono::milliseconds monitorPeriod =
+                std::chrono::seconds (3) );
   ~WorkerPool();
 
-  template <typename CompletionHandler>
-  BOOST_ASIO_INITFN_RESULT_TYPE (CompletionHandler, void () )
-  post (BOOST_ASIO_MOVE_ARG (CompletionHandler) handler)
+  void post (std::function<void () > handler, Priority priority = INTERACTIVE);
+
+  /* Number of times the monitor found the workers making no progress */
+  uint64_t getStallsDetected () const
+  {
+    return stallsDetected;
+  }
+
+  /* Number of threads spawned by the monitor to replace stuck workers */
+  uint64_t getThreadsSpawned () const
+  {
+    return threadsSpawned;
+  }
+
+  /* Tasks waiting in the lane when a new one is posted */
+  const Histogram &getQueueDepthHistogram (Priority priority) const
+  {
+    return queueDepth[priority];
+  }
+
+  /* Microseconds since a task is posted until it starts running */
+  const Histogram &getLatencyHistogram (Priority priority) const
   {
-    setWatcher();
-    return io_service->post (handler);
+    return latency[priority];
   }
 
 private:
-  void setWatcher();
+  class Task
+  {
+  public:
+    std::function<void () > handler;
+    std::chrono::steady_clock::time_point posted;
+  };
+
+  class Worker
+  {
+  public:
+    std::mutex mutex;
+    std::deque<Task> lanes[N_PRIORITIES];
+    std::thread thread;
+    std::atomic<bool> detached {false};
+  };
+
+  typedef std::vector<std::shared_ptr<Worker>> WorkerList;
+
+  void spawnWorker ();
+  void workerLoop (std::shared_ptr<Worker> worker);
+  bool popTask (Worker *worker, Task &task, Priority &priority);
+  void runTask (Task &task, Priority priority);
+
+  void scheduleMonitor();
   void checkWorkers();
 
-  boost::shared_ptr< boost::asio::io_service > io_service;
-  std::shared_ptr< boost::asio::io_service::work > work;
-  std::vector<std::thread> workers;
+  /* Replaced as a whole when a worker is added, read with atomic_load */
+  std::shared_ptr<const WorkerList> workers;
+  std::atomic<size_t> nextWorker {0};
+
+  std::mutex idleMutex;
+  std::condition_variable idleCond;
+  std::atomic<size_t> pending {0};
+  std::atomic<size_t> lanePending[N_PRIORITIES];
+
+  Histogram queueDepth[N_PRIORITIES];
+  Histogram latency[N_PRIORITIES];
 
   boost::shared_ptr< boost::asio::io_service > watcher_service;
   std::shared_ptr< boost::asio::io_service::work > watcher_work;
   std::thread watcher;
+  std::shared_ptr< boost::asio::deadline_timer > monitor;
+  std::chrono::milliseconds monitorPeriod;
+
+  std::atomic<uint64_t> posted {0};
+  std::atomic<uint64_t> completed {0};
+  std::atomic<uint64_t> stallsDetected {0};
+  std::atomic<uint64_t> threadsSpawned {0};
+
+  /* Only accessed from the watcher thread */
+  uint64_t lastPosted = 0;
+  uint64_t lastCompleted = 0;
 
   std::mutex mutex;
 
-  bool terminated = false;
+  std::atomic<bool> terminated {false};
 
   class StaticConstructor
   {
@@ -9,6 +9,9 @@
 #include <SignalHandler.hpp>
 
 #include "Statistics.hpp"
+#include <StatsSampler.hpp>
+#include <MediaPipelineImpl.hpp>
+#include <EventDispatcher.hpp>
 
 #define GST_CAT_DEFAULT kurento_base_rtp_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -17,6 +20,8 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define KMS_MEDIA_DISCONNECTED 0
 #define KMS_MEDIA_CONNECTED 1
 
+#define STATS_SAMPLING_PERIOD_DEFAULT 1000 /* ms */
+
 namespace kurento
 {
 void BaseRtpEndpointImpl::postConstructor ()
@@ -30,6 +35,30 @@ void BaseRtpEndpointImpl::postConstructor ()
                                 std::placeholders::_2) ),
                           std::dynamic_pointer_cast<BaseRtpEndpointImpl>
                           (shared_from_this() ) );
+
+  std::weak_ptr<BaseRtpEndpointImpl> weak =
+    std::dynamic_pointer_cast<BaseRtpEndpointImpl> (shared_from_this() );
+
+  /*
+   * Sampling starts once stats are requested, endpoints nobody asks for are
+   * never sampled
+   */
+  statsSamplingPeriod = getConfigValue <int, BaseRtpEndpoint>
+                        ("statsSamplingPeriod", STATS_SAMPLING_PERIOD_DEFAULT);
+
+  std::dynamic_pointer_cast<MediaPipelineImpl> (getMediaPipeline() )->
+  addStatsSource (getHandle(), getId(), [weak] () {
+    std::shared_ptr<BaseRtpEndpointImpl> self = weak.lock();
+
+    if (!self) {
+      return stats::RTCStatsReport ();
+    }
+
+    /* Reported from the next sample on, never sampled from here */
+    self->startStatsSampling ();
+
+    return self->statsTracker.getReport ();
+  });
 }
 
 BaseRtpEndpointImpl::BaseRtpEndpointImpl (const boost::property_tree::ptree
@@ -41,12 +70,19 @@ BaseRtpEndpointImpl::BaseRtpEndpointImpl (const boost::property_tree::ptree
 
   current_state = std::make_shared <MediaState>
                   (MediaState::DISCONNECTED);
+  reported_state = current_state;
 
   stateChangedHandlerId = 0;
+  statsSamplingPeriod = 0;
+  statsSampled = false;
 }
 
 BaseRtpEndpointImpl::~BaseRtpEndpointImpl ()
 {
+  std::dynamic_pointer_cast<MediaPipelineImpl> (getMediaPipeline() )->
+  removeStatsSource (getHandle() );
+  StatsSampler::get().remove (getHandle() );
+
   if (stateChangedHandlerId > 0) {
     unregister_signal_handler (element, stateChangedHandlerId);
   }
@@ -77,12 +113,35 @@ BaseRtpEndpointImpl::updateState (guint new_state)
   }
 
   if (old_state->getValue() != current_state->getValue() ) {
-    /* Emit state change signal */
-    MediaStateChanged event (shared_from_this(),
-                             MediaStateChanged::getName (), old_state, current_state);
+    /*
+     * Called from streaming threads, intermediate states can be skipped. The
+     * event is built when delivered, so a coalesced one still starts from
+     * the state subscribers saw last.
+     */
+    postEvent (MediaStateChanged::getName (), [this] () {
+      emitMediaStateChanged ();
+    }, EventDispatcher::COALESCE);
+  }
+}
 
-    this->signalMediaStateChanged (event);
+void
+BaseRtpEndpointImpl::emitMediaStateChanged ()
+{
+  std::unique_lock<std::recursive_mutex> lock (mutex);
+  std::shared_ptr<MediaState> old_state = reported_state;
+  std::shared_ptr<MediaState> new_state = current_state;
+
+  reported_state = new_state;
+  lock.unlock ();
+
+  if (old_state->getValue() == new_state->getValue() ) {
+    return;
   }
+
+  MediaStateChanged event (shared_from_this(), MediaStateChanged::getName (),
+                           old_state, new_state);
+
+  signalMediaStateChanged (event);
 }
 
 int BaseRtpEndpointImpl::getMinVideoRecvBandwidth ()
@@ -130,19 +189,54 @@ void BaseRtpEndpointImpl::setMaxVideoSendBandwidth (int maxVideoSendBandwidth)
   g_object_set (element, "max-video-send-bandwidth", maxVideoSendBandwidth, NULL);
 }
 
-std::map <std::string, std::shared_ptr<RTCStats>>
-    BaseRtpEndpointImpl::getStats ()
+void
+BaseRtpEndpointImpl::sampleStats ()
 {
-  std::map <std::string, std::shared_ptr<RTCStats>> rtcStatsReport;
   GstStructure *stats;
 
   g_signal_emit_by_name (getGstreamerElement(), "stats", &stats);
 
-  rtcStatsReport = stats::createRTCStatsReport (time (NULL), stats);
+  statsTracker.update (g_get_real_time () / (double) G_USEC_PER_SEC, stats);
 
   gst_structure_free (stats);
+}
+
+/* Returns false if sampling is disabled */
+bool
+BaseRtpEndpointImpl::startStatsSampling ()
+{
+  std::weak_ptr<BaseRtpEndpointImpl> weak;
+
+  if (statsSamplingPeriod <= 0) {
+    return false;
+  }
+
+  if (statsSampled.exchange (true) ) {
+    return true;
+  }
+
+  weak = std::dynamic_pointer_cast<BaseRtpEndpointImpl> (shared_from_this() );
+  StatsSampler::get().add (getHandle(),
+                           std::chrono::milliseconds (statsSamplingPeriod), [weak] () {
+    std::shared_ptr<BaseRtpEndpointImpl> self = weak.lock();
+
+    if (self) {
+      self->sampleStats();
+    }
+  });
+
+  return true;
+}
+
+std::map <std::string, std::shared_ptr<RTCStats>>
+    BaseRtpEndpointImpl::getStats ()
+{
+  /* Only before the first sample or if the sampler is disabled */
+  if (!startStatsSampling () || !statsTracker.hasReport () ) {
+    sampleStats ();
+  }
 
-  return rtcStatsReport;
+  return statsTracker.getReport ();
 }
 
 std::shared_ptr<MediaState>
@@ -7,6 +7,8 @@
 #include "BaseRtpEndpoint.hpp"
 #include <EventHandler.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <Statistics.hpp>
+#include <atomic>
 
 namespace kurento
 {
@@ -64,10 +66,21 @@ private:
 
   std::string formatGstStructure (const GstStructure *stats);
   std::shared_ptr<MediaState> current_state;
+  /* Last state sent to subscribers, updated when the event is delivered */
+  std::shared_ptr<MediaState> reported_state;
   gulong stateChangedHandlerId;
   std::recursive_mutex mutex;
 
   void updateState (guint new_state);
+  void emitMediaStateChanged ();
+
+  /* Filled by the stats sampler, getStats returns its last report */
+  stats::RTCStatsTracker statsTracker;
+  int statsSamplingPeriod;
+  std::atomic<bool> statsSampled;
+
+  void sampleStats ();
+  bool startStatsSampling ();
 
   class StaticConstructor
   {
@@ -15,6 +15,10 @@
 #include "kmselement.h"
 #include <DotGraph.hpp>
 #include <GstreamerDotDetails.hpp>
+#include <ElementPool.hpp>
+#include <EventDispatcher.hpp>
+
+#include <chrono>
 
 #define GST_CAT_DEFAULT kurento_media_element_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -147,20 +151,17 @@ public:
                                        sourcePadName);
   }
 
-  std::shared_ptr<ElementConnectionData> toInterface ()
+  MediaElementImpl::ConnectionEntry toEntry ()
   {
-    std::shared_ptr<ElementConnectionData> iface (new ElementConnectionData (
-          source.lock(), sink.lock(), type, sourceDescription, sinkDescription) );
-
-    if (!iface->getSink () ) {
-      throw KurentoException (MEDIA_OBJECT_NOT_FOUND, "Reference to sink is null");
-    }
+    MediaElementImpl::ConnectionEntry entry;
 
-    if (!iface->getSource () ) {
-      throw KurentoException (MEDIA_OBJECT_NOT_FOUND, "Reference to source is null");
-    }
+    entry.source = source;
+    entry.sink = sink;
+    entry.type = type->getValue ();
+    entry.sourceDescription = sourceDescription;
+    entry.sinkDescription = sinkDescription;
 
-    return iface;
+    return entry;
   }
 
 private:
@@ -192,21 +193,11 @@ convertMediaType (std::shared_ptr<MediaType> mediaType)
 }
 
 void
-_media_element_impl_bus_message (GstBus *bus, GstMessage *message,
-                                 gpointer data)
+MediaElementImpl::busMessage (GstMessage *message)
 {
   if (message->type == GST_MESSAGE_ERROR) {
     GError *err = NULL;
     gchar *debug = NULL;
-    MediaElementImpl *elem = reinterpret_cast <MediaElementImpl *> (data);
-
-    if (elem == NULL) {
-      return;
-    }
-
-    if (message->src != GST_OBJECT (elem->element) ) {
-      return;
-    }
 
     GST_ERROR ("MediaElement error: %" GST_PTR_FORMAT, message);
     gst_message_parse_error (message, &err, &debug);
@@ -217,10 +208,12 @@ _media_element_impl_bus_message (GstBus *bus, GstMessage *message,
     }
 
     try {
-      Error error (elem->shared_from_this(), errorMessage , 0,
+      Error error (shared_from_this(), errorMessage , 0,
                    "UNEXPECTED_ELEMENT_ERROR");
 
-      elem->signalError (error);
+      postEvent (Error::getName (), [this, error] () {
+        signalError (error);
+      }, EventDispatcher::RELIABLE);
     } catch (std::bad_weak_ptr &e) {
     }
 
@@ -233,101 +226,44 @@ void
 _media_element_pad_added (GstElement *elem, GstPad *pad, gpointer data)
 {
   MediaElementImpl *self = (MediaElementImpl *) data;
-  bool retry = false;
+  std::shared_ptr<ElementConnectionDataInternal> connection;
+  std::shared_ptr<MediaElementImpl> source;
+  std::string padName = GST_OBJECT_NAME (pad);
+  std::unique_lock<std::recursive_mutex> lock (
+    self->pipeline->getConnectionsMutex () );
 
   GST_LOG_OBJECT (pad, "Pad added");
 
-  do {
-    if (retry) {
-      GST_DEBUG_OBJECT (pad, "Retriying connection");
-      retry = false;
-    }
-
-    if (GST_PAD_IS_SRC (pad) ) {
-      std::unique_lock<std::recursive_timed_mutex> lock (self->sinksMutex,
-          std::defer_lock);
-      std::shared_ptr<MediaType> type;
+  if (GST_PAD_IS_SRC (pad) ) {
+    std::unique_lock<std::recursive_mutex> sinksLock (self->sinksMutex);
+    auto it = self->sinksByPadName.find (padName);
 
-      retry = !lock.try_lock_for (std::chrono::milliseconds {self->dist (self->rnd) });
-
-      if (retry) {
-        continue;
-      }
-
-      //FIXME: This method of pad recognition should change as well as pad names
-
-      if (g_str_has_prefix (GST_OBJECT_NAME (pad), "audio") ) {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::AUDIO) );
-      } else if (g_str_has_prefix (GST_OBJECT_NAME (pad), "video") ) {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::VIDEO) );
-      } else {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::DATA) );
-      }
-
-      try {
-        auto connections = self->sinks.at (type).at ("");
-
-        for (auto it : connections) {
-          if (g_strcmp0 (GST_OBJECT_NAME (pad), it->getSourcePadName() ) == 0) {
-            std::unique_lock<std::recursive_timed_mutex> sinkLock (
-              it->getSink()->sourcesMutex,
-              std::defer_lock);
-
-            retry = !sinkLock.try_lock_for (std::chrono::milliseconds {self->dist (self->rnd) });
-
-            if (retry) {
-              continue;
-            }
-
-            self->performConnection (it);
-          }
-        }
-      } catch (std::out_of_range) {
-
-      }
-    } else {
-      std::unique_lock<std::recursive_timed_mutex> lock (self->sourcesMutex,
-          std::defer_lock);
-      std::shared_ptr<MediaType> type;
-
-      retry = !lock.try_lock_for (std::chrono::milliseconds {self->dist (self->rnd) });
-
-      if (retry) {
-        continue;
-      }
+    if (it != self->sinksByPadName.end () ) {
+      self->performConnection (it->second);
+    }
 
-      if (g_str_has_prefix (GST_OBJECT_NAME (pad), "sink_audio") ) {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::AUDIO) );
-      } else if (g_str_has_prefix (GST_OBJECT_NAME (pad), "sink_video") ) {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::VIDEO) );
-      } else {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::DATA) );
-      }
+    return;
+  }
 
-      try {
-        auto sourceData = self->sources.at (type).at ("");
-        auto source = sourceData->getSource();
+  {
+    std::unique_lock<std::recursive_mutex> sourcesLock (self->sourcesMutex);
+    auto it = self->sourcesByPadName.find (padName);
 
-        if (source) {
-          if (g_strcmp0 (GST_OBJECT_NAME (pad),
-                         sourceData->getSinkPadName().c_str() ) == 0) {
-            std::unique_lock<std::recursive_timed_mutex> sourceLock (source->sinksMutex,
-                std::defer_lock);
+    if (it == self->sourcesByPadName.end () ) {
+      return;
+    }
 
-            retry = !sourceLock.try_lock_for (std::chrono::milliseconds {self->dist (self->rnd) });
+    connection = it->second;
+  }
 
-            if (retry) {
-              continue;
-            }
+  /* Connections cannot change meanwhile, the pipeline lock is still held */
+  source = connection->getSource();
 
-            source->performConnection (sourceData);
-          }
-        }
-      } catch (std::out_of_range) {
+  if (source) {
+    std::unique_lock<std::recursive_mutex> sourceLock (source->sinksMutex);
 
-      }
-    }
-  } while (retry);
+    source->performConnection (connection);
+  }
 }
 
 MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
@@ -335,10 +271,19 @@ MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
                                     const std::string &factoryName) : MediaObjectImpl (config, parent)
 {
   std::shared_ptr<MediaPipelineImpl> pipe;
+  int poolSize;
 
   pipe = std::dynamic_pointer_cast<MediaPipelineImpl> (getMediaPipeline() );
+  pipeline = pipe;
 
-  element = gst_element_factory_make (factoryName.c_str(), NULL);
+  sourcesSnapshot = std::shared_ptr<const ConnectionsSnapshot>
+                    (new ConnectionsSnapshot() );
+  sinksSnapshot = std::shared_ptr<const ConnectionsSnapshot>
+                  (new ConnectionsSnapshot() );
+
+  poolSize = getConfigValue<int, MediaElement> ("elementPool." + factoryName,
+             0);
+  element = ElementPool::get ().take (factoryName, poolSize);
 
   if (element == NULL) {
     throw KurentoException (MEDIA_OBJECT_NOT_AVAILABLE,
@@ -346,14 +291,14 @@ MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
   }
 
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipe->getPipeline () ) );
-  handlerId = g_signal_connect (bus, "message",
-                                G_CALLBACK (_media_element_impl_bus_message), this);
+  pipe->addBusHandler (GST_OBJECT (element), [this] (GstMessage * message) {
+    busMessage (message);
+  });
 
 
   padAddedHandlerId = g_signal_connect (element, "pad_added",
                                         G_CALLBACK (_media_element_pad_added), this);
 
-  g_object_ref (element);
   gst_bin_add (GST_BIN ( pipe->getPipeline() ), element);
   gst_element_sync_state_with_parent (element);
 
@@ -369,22 +314,22 @@ MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
 
 MediaElementImpl::~MediaElementImpl ()
 {
-  std::shared_ptr<MediaPipelineImpl> pipe;
-
   GST_LOG ("Deleting media element %s", getName().c_str () );
 
   disconnectAll();
 
-  pipe = std::dynamic_pointer_cast<MediaPipelineImpl> (getMediaPipeline() );
+  if (!pipeline->isTearingDown () ) {
+    gst_element_send_event (element, gst_event_new_eos () );
+  }
 
-  gst_element_send_event (element, gst_event_new_eos () );
   gst_element_set_locked_state (element, TRUE);
   gst_element_set_state (element, GST_STATE_NULL);
-  gst_bin_remove (GST_BIN ( pipe->getPipeline() ), element);
+  gst_bin_remove (GST_BIN ( pipeline->getPipeline() ), element);
   g_signal_handler_disconnect (element, padAddedHandlerId);
+  /* Before the address of the element can be reused by a new one */
+  pipeline->removeBusHandler (GST_OBJECT (element) );
   g_object_unref (element);
 
-  g_signal_handler_disconnect (bus, handlerId);
   g_object_unref (bus);
 }
 
@@ -398,186 +343,146 @@ MediaElementImpl::release ()
 
 void MediaElementImpl::disconnectAll ()
 {
-  while (!getSinkConnections().empty() ) {
-    std::unique_lock<std::recursive_timed_mutex> sinkLock (sinksMutex,
-        std::defer_lock);
-
-    if (!sinkLock.try_lock_for (std::chrono::milliseconds {dist (rnd) }) ) {
-      GST_DEBUG_OBJECT (getGstreamerElement(), "Retry disconnect all");
-      continue;
-    }
+  std::unique_lock<std::recursive_mutex> lock (
+    pipeline->getConnectionsMutex () );
 
-    for (std::shared_ptr<ElementConnectionData> connData : getSinkConnections() ) {
-      auto sinkImpl = std::dynamic_pointer_cast <MediaElementImpl>
-                      (connData->getSink () );
-      std::unique_lock<std::recursive_timed_mutex> sinkLock (sinkImpl->sourcesMutex,
-          std::defer_lock);
+  for (std::shared_ptr<ElementConnectionData> connData : getSinkConnections() ) {
+    disconnect (connData->getSink (), connData->getType (),
+                connData->getSourceDescription (),
+                connData->getSinkDescription () );
+  }
 
-      if (sinkLock.try_lock_for (std::chrono::milliseconds {dist (rnd) }) ) {
-        disconnect (connData->getSink (), connData->getType (),
-                    connData->getSourceDescription (),
-                    connData->getSinkDescription () );
-      }
-      else {
-        GST_DEBUG_OBJECT (sinkImpl->getGstreamerElement(),
-                          "Retry disconnect all %" GST_PTR_FORMAT, getGstreamerElement() );
-      }
-    }
+  for (std::shared_ptr<ElementConnectionData> connData :
+       getSourceConnections() ) {
+    connData->getSource ()->disconnect (connData->getSink (),
+                                        connData->getType (),
+                                        connData->getSourceDescription (),
+                                        connData->getSinkDescription () );
   }
+}
 
-  while (!getSourceConnections().empty() ) {
-    std::unique_lock<std::recursive_timed_mutex> sourceLock (sourcesMutex,
-        std::defer_lock);
+/* Must be called with sourcesMutex held */
+void
+MediaElementImpl::updateSourcesSnapshot ()
+{
+  std::shared_ptr<ConnectionsSnapshot> snapshot (new ConnectionsSnapshot() );
 
-    if (!sourceLock.try_lock_for (std::chrono::milliseconds {dist (rnd) }) ) {
-      GST_DEBUG_OBJECT (getGstreamerElement(), "Retry disconnect all");
-      continue;
-    }
+  snapshot->version = std::atomic_load (&sourcesSnapshot)->version + 1;
 
-    for (std::shared_ptr<ElementConnectionData> connData :
-         getSourceConnections() ) {
-      auto sourceImpl = std::dynamic_pointer_cast <MediaElementImpl>
-                        (connData->getSource () );
-      std::unique_lock<std::recursive_timed_mutex> sourceLock (sourceImpl->sinksMutex,
-          std::defer_lock);
-
-      if (sourceLock.try_lock_for (std::chrono::milliseconds {dist (rnd) }) ) {
-        connData->getSource ()->disconnect (connData->getSink (),
-                                            connData->getType (),
-                                            connData->getSourceDescription (),
-                                            connData->getSinkDescription () );
-      }
-      else {
-        GST_DEBUG_OBJECT (sourceImpl->getGstreamerElement (),
-                          "Retry disconnect all %" GST_PTR_FORMAT, getGstreamerElement() );
-      }
+  for (auto it : sources) {
+    for (auto it2 : it.second) {
+      snapshot->connections.push_back (it2.second->toEntry() );
     }
   }
+
+  std::atomic_store (&sourcesSnapshot,
+                     std::shared_ptr<const ConnectionsSnapshot> (snapshot) );
 }
 
-std::vector<std::shared_ptr<ElementConnectionData>>
-    MediaElementImpl::getSourceConnections ()
+/* Must be called with sinksMutex held */
+void
+MediaElementImpl::updateSinksSnapshot ()
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sourcesMutex);
-  std::vector<std::shared_ptr<ElementConnectionData>> ret;
+  std::shared_ptr<ConnectionsSnapshot> snapshot (new ConnectionsSnapshot() );
 
-  for (auto it : sources) {
+  snapshot->version = std::atomic_load (&sinksSnapshot)->version + 1;
+
+  for (auto it : sinks) {
     for (auto it2 : it.second) {
-      try {
-        ret.push_back (it2.second->toInterface() );
-      } catch (KurentoException) {
+      for (auto it3 : it2.second) {
+        snapshot->connections.push_back (it3->toEntry() );
       }
     }
   }
 
-  return ret;
+  std::atomic_store (&sinksSnapshot,
+                     std::shared_ptr<const ConnectionsSnapshot> (snapshot) );
 }
 
+/* Connections whose elements are still alive, as new objects for the caller */
 std::vector<std::shared_ptr<ElementConnectionData>>
-    MediaElementImpl::getSourceConnections (
-      std::shared_ptr<MediaType> mediaType)
+    MediaElementImpl::getConnections (
+      const std::shared_ptr<const ConnectionsSnapshot> &snapshot,
+      std::function<bool (const ConnectionEntry &) > filter)
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sourcesMutex);
   std::vector<std::shared_ptr<ElementConnectionData>> ret;
 
-  try {
-    for (auto it : sources.at (mediaType) ) {
-      try {
-        ret.push_back (it.second->toInterface() );
-      } catch (KurentoException) {
+  for (const ConnectionEntry &entry : snapshot->connections) {
+    std::shared_ptr<MediaElement> source = entry.source.lock ();
+    std::shared_ptr<MediaElement> sink = entry.sink.lock ();
 
-      }
+    if (!source || !sink || (filter && !filter (entry) ) ) {
+      continue;
     }
-  } catch (std::out_of_range) {
 
+    ret.push_back (std::shared_ptr<ElementConnectionData> (
+                     new ElementConnectionData (source, sink,
+                         std::shared_ptr<MediaType> (new MediaType (entry.type) ),
+                         entry.sourceDescription, entry.sinkDescription) ) );
   }
 
   return ret;
 }
 
 std::vector<std::shared_ptr<ElementConnectionData>>
-    MediaElementImpl::getSourceConnections (
-      std::shared_ptr<MediaType> mediaType, const std::string &description)
+    MediaElementImpl::getSourceConnections ()
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sourcesMutex);
-  std::vector<std::shared_ptr<ElementConnectionData>> ret;
+  return getConnections (std::atomic_load (&sourcesSnapshot), nullptr);
+}
 
-  try {
-    ret.push_back (sources.at (mediaType).at (description)->toInterface() );
-  } catch (KurentoException) {
+std::vector<std::shared_ptr<ElementConnectionData>>
+    MediaElementImpl::getSourceConnections (
+      std::shared_ptr<MediaType> mediaType)
+{
+  MediaType::type type = mediaType->getValue ();
 
-  } catch (std::out_of_range) {
+  return getConnections (std::atomic_load (&sourcesSnapshot),
+  [type] (const ConnectionEntry & entry) {
+    return entry.type == type;
+  });
+}
 
-  }
+std::vector<std::shared_ptr<ElementConnectionData>>
+    MediaElementImpl::getSourceConnections (
+      std::shared_ptr<MediaType> mediaType, const std::string &description)
+{
+  MediaType::type type = mediaType->getValue ();
 
-  return ret;
+  /* Sources are indexed by the description on the sink side */
+  return getConnections (std::atomic_load (&sourcesSnapshot),
+  [type, &description] (const ConnectionEntry & entry) {
+    return entry.type == type && entry.sinkDescription == description;
+  });
 }
 
 std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSinkConnections ()
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
-  std::vector<std::shared_ptr<ElementConnectionData>> ret;
-
-  for (auto it : sinks) {
-    for (auto it2 : it.second) {
-      for (auto it3 : it2.second) {
-        try {
-          ret.push_back (it3->toInterface() );
-        } catch (KurentoException) {
-
-        }
-      }
-    }
-  }
-
-  return ret;
+  return getConnections (std::atomic_load (&sinksSnapshot), nullptr);
 }
 
 std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSinkConnections (
       std::shared_ptr<MediaType> mediaType)
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
-  std::vector<std::shared_ptr<ElementConnectionData>> ret;
+  MediaType::type type = mediaType->getValue ();
 
-  try {
-    for (auto it : sinks.at (mediaType) ) {
-      for (auto it3 : it.second) {
-        try {
-          ret.push_back (it3->toInterface() );
-        } catch (KurentoException) {
-
-        }
-      }
-    }
-  } catch (std::out_of_range) {
-
-  }
-
-  return ret;
+  return getConnections (std::atomic_load (&sinksSnapshot),
+  [type] (const ConnectionEntry & entry) {
+    return entry.type == type;
+  });
 }
 
 std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSinkConnections (
       std::shared_ptr<MediaType> mediaType, const std::string &description)
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
-  std::vector<std::shared_ptr<ElementConnectionData>> ret;
-
-  try {
-    for (auto it : sinks.at (mediaType).at (description) ) {
-      try {
-        ret.push_back (it->toInterface() );
-      } catch (KurentoException) {
+  MediaType::type type = mediaType->getValue ();
 
-      }
-    }
-  } catch (std::out_of_range) {
-
-  }
-
-  return ret;
+  return getConnections (std::atomic_load (&sinksSnapshot),
+  [type, &description] (const ConnectionEntry & entry) {
+    return entry.type == type && entry.sourceDescription == description;
+  });
 }
 
 void MediaElementImpl::connect (std::shared_ptr<MediaElement> sink)
@@ -607,36 +512,122 @@ void MediaElementImpl::connect (std::shared_ptr<MediaElement> sink,
                                 const std::string &sourceMediaDescription,
                                 const std::string &sinkMediaDescription)
 {
-  KmsElementPadType type;
-  gchar *padName;
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
   std::shared_ptr<MediaElementImpl> sinkImpl =
     std::dynamic_pointer_cast<MediaElementImpl> (sink);
 
-  if (sinkImpl->getMediaPipeline ()->getId () != getMediaPipeline ()->getId() ) {
+  if (sinkImpl->pipeline->getHandle () != pipeline->getHandle () ) {
     throw KurentoException (CONNECT_ERROR,
                             "Media elements does not share pipeline");
   }
 
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
-  std::unique_lock<std::recursive_timed_mutex> sinkLock (sinkImpl->sourcesMutex);
+  std::unique_lock<std::recursive_mutex> pipelineLock (
+    pipeline->getConnectionsMutex () );
+  std::shared_ptr<ElementConnectionData> replaced;
+
+  replaced = connectLocked (sinkImpl, mediaType, sourceMediaDescription,
+                            sinkMediaDescription);
+
+  pipelineLock.unlock ();
+
+  pipeline->getConnectLatency ().record (
+    std::chrono::duration_cast<std::chrono::microseconds>
+    (std::chrono::steady_clock::now() - start).count() );
+
+  if (replaced) {
+    postElementDisconnected (replaced);
+  }
+
+  postElementConnected (std::shared_ptr<ElementConnectionData> (
+                          new ElementConnectionData (shared_from_this (), sink, mediaType,
+                              sourceMediaDescription, sinkMediaDescription) ) );
+}
+
+std::function<void () >
+MediaElementImpl::elementConnectedEmitter (
+  std::shared_ptr<ElementConnectionData> connection)
+{
+  std::shared_ptr<MediaElementImpl> source =
+    std::dynamic_pointer_cast<MediaElementImpl> (connection->getSource () );
+  ElementConnected elementConnected (source, ElementConnected::getName (),
+                                     connection->getSink (), connection->getType (),
+                                     connection->getSourceDescription (),
+                                     connection->getSinkDescription () );
+
+  return [source, elementConnected] () {
+    source->signalElementConnected (elementConnected);
+  };
+}
+
+std::function<void () >
+MediaElementImpl::elementDisconnectedEmitter (
+  std::shared_ptr<ElementConnectionData> connection)
+{
+  std::shared_ptr<MediaElementImpl> source =
+    std::dynamic_pointer_cast<MediaElementImpl> (connection->getSource () );
+  ElementDisconnected elementDisconnected (source,
+      ElementDisconnected::getName (),
+      connection->getSink (), connection->getType (),
+      connection->getSourceDescription (),
+      connection->getSinkDescription () );
+
+  return [source, elementDisconnected] () {
+    source->signalElementDisconnected (elementDisconnected);
+  };
+}
+
+void
+MediaElementImpl::postElementConnected (std::shared_ptr<ElementConnectionData>
+                                        connection)
+{
+  std::shared_ptr<MediaElementImpl> source =
+    std::dynamic_pointer_cast<MediaElementImpl> (connection->getSource () );
+
+  source->postEvent (ElementConnected::getName (),
+                     elementConnectedEmitter (connection) );
+}
+
+void
+MediaElementImpl::postElementDisconnected (
+  std::shared_ptr<ElementConnectionData> connection)
+{
+  std::shared_ptr<MediaElementImpl> source =
+    std::dynamic_pointer_cast<MediaElementImpl> (connection->getSource () );
+
+  source->postEvent (ElementDisconnected::getName (),
+                     elementDisconnectedEmitter (connection) );
+}
+
+std::shared_ptr<ElementConnectionData>
+MediaElementImpl::connectLocked (std::shared_ptr<MediaElementImpl> sinkImpl,
+                                 std::shared_ptr<MediaType> mediaType,
+                                 const std::string &sourceMediaDescription,
+                                 const std::string &sinkMediaDescription)
+{
+  KmsElementPadType type;
+  gchar *padName;
+  std::unique_lock<std::recursive_mutex> lock (sinksMutex);
+  std::unique_lock<std::recursive_mutex> sinkLock (sinkImpl->sourcesMutex);
   std::vector <std::shared_ptr <ElementConnectionData>> connections;
+  std::shared_ptr <ElementConnectionData> replaced;
   std::shared_ptr <ElementConnectionDataInternal> connectionData (
     new ElementConnectionDataInternal (std::dynamic_pointer_cast<MediaElement>
-                                       (shared_from_this () ), sink, mediaType,
+                                       (shared_from_this () ), sinkImpl, mediaType,
                                        sourceMediaDescription,
                                        sinkMediaDescription) );
 
   GST_DEBUG ("Connecting %s -> %s params %s %s %s", getName().c_str(),
-             sink->getName ().c_str (), mediaType->getString ().c_str (),
+             sinkImpl->getName ().c_str (), mediaType->getString ().c_str (),
              sourceMediaDescription.c_str(), sinkMediaDescription.c_str() );
 
-  connections = sink->getSourceConnections (mediaType, sinkMediaDescription);
+  connections = sinkImpl->getSourceConnections (mediaType, sinkMediaDescription);
 
   if (!connections.empty () ) {
-    std::shared_ptr <ElementConnectionData> connection = connections.at (0);
-    connection->getSource()->disconnect (connection->getSink (), mediaType,
-                                         sourceMediaDescription,
-                                         connection->getSinkDescription () );
+    replaced = connections.at (0);
+    std::dynamic_pointer_cast<MediaElementImpl> (replaced->getSource () )->
+    disconnectLocked (sinkImpl, mediaType, replaced->getSourceDescription (),
+                      replaced->getSinkDescription () );
   }
 
   type = convertMediaType (mediaType);
@@ -644,6 +635,12 @@ void MediaElementImpl::connect (std::shared_ptr<MediaElement> sink,
                          sourceMediaDescription.c_str (), &padName, NULL);
 
   if (padName == NULL) {
+    if (replaced) {
+      std::dynamic_pointer_cast<MediaElementImpl> (replaced->getSource () )->
+      connectLocked (sinkImpl, mediaType, replaced->getSourceDescription (),
+                     replaced->getSinkDescription () );
+    }
+
     throw KurentoException (CONNECT_ERROR, "Element: '" + getName() +
                             "'does note provide a connection for " +
                             mediaType->getString () + "-" +
@@ -653,18 +650,16 @@ void MediaElementImpl::connect (std::shared_ptr<MediaElement> sink,
   connectionData->setSourcePadName (padName);
 
   sinks[mediaType][sourceMediaDescription].insert (connectionData);
+  sinksByPadName[padName] = connectionData;
   sinkImpl->sources[mediaType][sinkMediaDescription] = connectionData;
+  sinkImpl->sourcesByPadName[connectionData->getSinkPadName ()] = connectionData;
 
-  performConnection (connectionData);
+  updateSinksSnapshot ();
+  sinkImpl->updateSourcesSnapshot ();
 
-  sinkLock.unlock();
-  lock.unlock ();
+  performConnection (connectionData);
 
-  ElementConnected elementConnected (shared_from_this(),
-                                     ElementConnected::getName (),
-                                     sink, mediaType, sourceMediaDescription,
-                                     sinkMediaDescription);
-  signalElementConnected (elementConnected);
+  return replaced;
 }
 
 void
@@ -741,37 +736,81 @@ void MediaElementImpl::disconnect (std::shared_ptr<MediaElement> sink,
     return;
   }
 
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
   std::shared_ptr<MediaElementImpl> sinkImpl =
     std::dynamic_pointer_cast<MediaElementImpl> (sink);
-  std::unique_lock<std::recursive_timed_mutex> sinkLock (sinkImpl->sourcesMutex);
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
+  std::unique_lock<std::recursive_mutex> pipelineLock (
+    pipeline->getConnectionsMutex () );
+  bool disconnected;
+
+  disconnected = disconnectLocked (sinkImpl, mediaType, sourceMediaDescription,
+                                   sinkMediaDescription);
+
+  pipelineLock.unlock ();
+
+  pipeline->getDisconnectLatency ().record (
+    std::chrono::duration_cast<std::chrono::microseconds>
+    (std::chrono::steady_clock::now() - start).count() );
+
+  if (disconnected) {
+    postElementDisconnected (std::shared_ptr<ElementConnectionData> (
+                               new ElementConnectionData (shared_from_this (), sink, mediaType,
+                                   sourceMediaDescription, sinkMediaDescription) ) );
+  }
+}
+
+bool
+MediaElementImpl::disconnectLocked (std::shared_ptr<MediaElementImpl> sinkImpl,
+                                    std::shared_ptr<MediaType> mediaType,
+                                    const std::string &sourceMediaDescription,
+                                    const std::string &sinkMediaDescription)
+{
+  std::unique_lock<std::recursive_mutex> lock (sinksMutex);
+  std::unique_lock<std::recursive_mutex> sinkLock (sinkImpl->sourcesMutex);
 
   GST_DEBUG ("Disconnecting %s - %s params %s %s %s", getName().c_str(),
-             sink->getName ().c_str (), mediaType->getString ().c_str (),
+             sinkImpl->getName ().c_str (), mediaType->getString ().c_str (),
              sourceMediaDescription.c_str(), sinkMediaDescription.c_str() );
 
   try {
     std::shared_ptr<ElementConnectionDataInternal> connectionData;
     gboolean ret;
 
-    connectionData = sinkImpl->sources.at (mediaType).at (sourceMediaDescription);
-    sinkImpl->sources.at (mediaType).erase (sourceMediaDescription);
-    sinks.at (mediaType).at (sinkMediaDescription).erase (connectionData);
+    /* Sources are indexed by the description on the sink side */
+    connectionData = sinkImpl->sources.at (mediaType).at (sinkMediaDescription);
+    auto &descriptionSinks = sinks.at (mediaType).at (sourceMediaDescription);
+
+    /* The sink pad may be fed by another source or description */
+    if (descriptionSinks.find (connectionData) == descriptionSinks.end () ) {
+      return false;
+    }
+
+    sinkImpl->sources.at (mediaType).erase (sinkMediaDescription);
+    descriptionSinks.erase (connectionData);
+
+    auto sinkPad = sinkImpl->sourcesByPadName.find (
+                     connectionData->getSinkPadName () );
+
+    if (sinkPad != sinkImpl->sourcesByPadName.end ()
+        && sinkPad->second == connectionData) {
+      sinkImpl->sourcesByPadName.erase (sinkPad);
+    }
+
+    if (connectionData->getSourcePadName () != NULL) {
+      sinksByPadName.erase (connectionData->getSourcePadName () );
+    }
+
+    updateSinksSnapshot ();
+    sinkImpl->updateSourcesSnapshot ();
 
     g_signal_emit_by_name (getGstreamerElement (), "release-requested-srcpad",
                            connectionData->getSourcePadName (), &ret, NULL);
   } catch (std::out_of_range) {
-
+    return false;
   }
 
-  sinkLock.unlock();
-  lock.unlock ();
-
-  ElementDisconnected elementDisconnected (shared_from_this(),
-      ElementDisconnected::getName (),
-      sink, mediaType, sourceMediaDescription,
-      sinkMediaDescription);
-  signalElementDisconnected (elementDisconnected);
+  return true;
 }
 
 void MediaElementImpl::setAudioFormat (std::shared_ptr<AudioCaps> caps)
@@ -845,32 +884,39 @@ void MediaElementImpl::setVideoFormat (std::shared_ptr<VideoCaps> caps)
   g_object_set (element, "video-caps", c, NULL);
 }
 
-std::string MediaElementImpl::getGstreamerDot (
-  std::shared_ptr<GstreamerDotDetails> details)
+static GstDebugGraphDetails
+convertDetails (std::shared_ptr<GstreamerDotDetails> details)
 {
   switch (details->getValue() ) {
   case GstreamerDotDetails::SHOW_MEDIA_TYPE:
-    return generateDotGraph (GST_BIN (element), GST_DEBUG_GRAPH_SHOW_MEDIA_TYPE);
+    return GST_DEBUG_GRAPH_SHOW_MEDIA_TYPE;
 
   case GstreamerDotDetails::SHOW_CAPS_DETAILS:
-    return generateDotGraph (GST_BIN (element), GST_DEBUG_GRAPH_SHOW_CAPS_DETAILS);
+    return GST_DEBUG_GRAPH_SHOW_CAPS_DETAILS;
 
   case GstreamerDotDetails::SHOW_NON_DEFAULT_PARAMS:
-    return generateDotGraph (GST_BIN (element),
-                             GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS);
+    return GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS;
 
   case GstreamerDotDetails::SHOW_STATES:
-    return generateDotGraph (GST_BIN (element), GST_DEBUG_GRAPH_SHOW_STATES);
+    return GST_DEBUG_GRAPH_SHOW_STATES;
 
   case GstreamerDotDetails::SHOW_ALL:
   default:
-    return generateDotGraph (GST_BIN (element), GST_DEBUG_GRAPH_SHOW_ALL);
+    return GST_DEBUG_GRAPH_SHOW_ALL;
   }
 }
 
+std::string MediaElementImpl::getGstreamerDot (
+  std::shared_ptr<GstreamerDotDetails> details)
+{
+  return *graphCache.get (GST_BIN (element), GRAPH_FORMAT_DOT,
+                          convertDetails (details) );
+}
+
 std::string MediaElementImpl::getGstreamerDot()
 {
-  return generateDotGraph (GST_BIN (element), GST_DEBUG_GRAPH_SHOW_ALL);
+  return *graphCache.get (GST_BIN (element), GRAPH_FORMAT_DOT,
+                          GST_DEBUG_GRAPH_SHOW_ALL);
 }
 
 void MediaElementImpl::setOutputBitrate (int bitrate)
@@ -5,10 +5,12 @@
 #include "MediaElement.hpp"
 #include "MediaType.hpp"
 #include <EventHandler.hpp>
+#include <DotGraph.hpp>
 #include <gst/gst.h>
+#include <functional>
 #include <mutex>
 #include <set>
-#include <random>
+#include <unordered_map>
 
 namespace kurento
 {
@@ -30,6 +32,7 @@ void Serialize (std::shared_ptr<MediaElementImpl> &object,
                 JsonSerializer &serializer);
 
 class ElementConnectionDataInternal;
+class MediaPipelineImpl;
 
 class MediaElementImpl : public MediaObjectImpl, public virtual MediaElement
 {
@@ -108,11 +111,13 @@ public:
 protected:
   GstElement *element;
   GstBus *bus;
-  gulong handlerId;
 
 private:
-  std::recursive_timed_mutex sourcesMutex;
-  std::recursive_timed_mutex sinksMutex;
+  /* Connection changes always take the pipeline connections mutex first */
+  std::shared_ptr<MediaPipelineImpl> pipeline;
+
+  std::recursive_mutex sourcesMutex;
+  std::recursive_mutex sinksMutex;
 
   std::map<std::shared_ptr <MediaType>, std::map<std::string,
       std::shared_ptr<ElementConnectionDataInternal>>, MediaTypeCmp> sources;
@@ -120,14 +125,80 @@ private:
       std::set<std::shared_ptr<ElementConnectionDataInternal>>>, MediaTypeCmp>
       sinks;
 
-  std::mt19937_64 rnd {std::random_device{}() };
-  std::uniform_int_distribution<> dist {1, 100};
+  /*
+   * Immutable view of the connections, replaced as a whole every time they
+   * change, so getSourceConnections and getSinkConnections are served from
+   * it without locking. Elements are only weakly referenced, callers get
+   * their own ElementConnectionData built from the entries.
+   */
+  class ConnectionEntry
+  {
+  public:
+    std::weak_ptr<MediaElement> source;
+    std::weak_ptr<MediaElement> sink;
+    MediaType::type type;
+    std::string sourceDescription;
+    std::string sinkDescription;
+  };
+
+  class ConnectionsSnapshot
+  {
+  public:
+    uint64_t version = 0;
+    std::vector<ConnectionEntry> connections;
+  };
+
+  /* Accessed with std::atomic_load and std::atomic_store */
+  std::shared_ptr<const ConnectionsSnapshot> sourcesSnapshot;
+  std::shared_ptr<const ConnectionsSnapshot> sinksSnapshot;
+
+  /* Connections indexed by the name of the pad they are waiting for */
+  std::unordered_map<std::string, std::shared_ptr<ElementConnectionDataInternal>>
+      sinksByPadName;
+  std::unordered_map<std::string, std::shared_ptr<ElementConnectionDataInternal>>
+      sourcesByPadName;
 
   gulong padAddedHandlerId;
 
+  GraphCache graphCache;
+
   void disconnectAll();
+  void busMessage (GstMessage *message);
+  void updateSourcesSnapshot ();
+  void updateSinksSnapshot ();
+  static std::vector<std::shared_ptr<ElementConnectionData>> getConnections (
+        const std::shared_ptr<const ConnectionsSnapshot> &snapshot,
+        std::function<bool (const ConnectionEntry &) > filter);
   void performConnection (std::shared_ptr <ElementConnectionDataInternal> data);
 
+  /*
+   * Caller must hold the connections mutex of the pipeline. No events are
+   * raised. connectLocked returns the connection it replaced on the same
+   * sink pad, if any, and leaves everything as it was if it throws.
+   * disconnectLocked returns false if there was no such connection.
+   */
+  std::shared_ptr<ElementConnectionData> connectLocked (
+    std::shared_ptr<MediaElementImpl> sinkImpl,
+    std::shared_ptr<MediaType> mediaType,
+    const std::string &sourceMediaDescription,
+    const std::string &sinkMediaDescription);
+  bool disconnectLocked (std::shared_ptr<MediaElementImpl> sinkImpl,
+                         std::shared_ptr<MediaType> mediaType,
+                         const std::string &sourceMediaDescription,
+                         const std::string &sinkMediaDescription);
+
+  /* Raised from the source element of @connection */
+  static void postElementConnected (std::shared_ptr<ElementConnectionData>
+                                    connection);
+  static void postElementDisconnected (std::shared_ptr<ElementConnectionData>
+                                       connection);
+
+  /* Emit the event of @connection from its source element when called */
+  static std::function<void () > elementConnectedEmitter (
+    std::shared_ptr<ElementConnectionData> connection);
+  static std::function<void () > elementDisconnectedEmitter (
+    std::shared_ptr<ElementConnectionData> connection);
+
   class StaticConstructor
   {
   public:
@@ -136,8 +207,8 @@ private:
 
   static StaticConstructor staticConstructor;
 
-  friend void _media_element_impl_bus_message (GstBus *bus, GstMessage *message,
-      gpointer data);
+  friend class MediaPipelineImpl;
+  friend class ElementConnectionDataInternal;
   friend void _media_element_pad_added (GstElement *elem, GstPad *pad,
                                         gpointer data);
 };
@@ -6,6 +6,7 @@
 #include <gst/gst.h>
 #include <UUIDGenerator.hpp>
 #include <MediaSet.hpp>
+#include <EventDispatcher.hpp>
 
 #define GST_CAT_DEFAULT kurento_media_object_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -22,13 +23,30 @@ MediaObjectImpl::MediaObjectImpl (const boost::property_tree::ptree &config) :
 MediaObjectImpl::MediaObjectImpl (const boost::property_tree::ptree &config,
                                   std::shared_ptr< MediaObject > parent) : config (config)
 {
+  std::shared_ptr<MediaObjectImpl> parentImpl =
+    std::dynamic_pointer_cast<MediaObjectImpl> (parent);
+
+  /* Children built from the configuration of their parent share its values */
+  if (parentImpl && &parentImpl->config == &config) {
+    configSnapshot = parentImpl->configSnapshot;
+  } else {
+    configSnapshot = ConfigSnapshot::get (config);
+  }
+
   this->parent = parent;
 
   creationTime = time (NULL);
   initialId = createId();
+  handle = ObjectHandleTable::get().reserve();
   this->sendTagsInEvents = false;
 }
 
+MediaObjectImpl::~MediaObjectImpl ()
+{
+  EventDispatcher::get ().forget (handle);
+  ObjectHandleTable::get().retire (handle);
+}
+
 std::shared_ptr<MediaPipeline>
 MediaObjectImpl::getMediaPipeline ()
 {
@@ -39,6 +57,33 @@ MediaObjectImpl::getMediaPipeline ()
   }
 }
 
+void
+MediaObjectImpl::postEvent (const std::string &type,
+                            std::function<void () > emit, int flags)
+{
+  std::shared_ptr<MediaObject> self;
+  std::shared_ptr<MediaObjectImpl> pipeline;
+  ObjectHandle queue = handle;
+
+  try {
+    self = shared_from_this ();
+  } catch (std::bad_weak_ptr &e) {
+    GST_DEBUG ("Object being destroyed, event not raised");
+    return;
+  }
+
+  /* Events of the objects in a pipeline are delivered in order */
+  pipeline = std::dynamic_pointer_cast<MediaObjectImpl> (getMediaPipeline () );
+
+  if (pipeline) {
+    queue = pipeline->getHandle ();
+  }
+
+  EventDispatcher::get ().post (queue, handle, type, [self, emit] () {
+    emit ();
+  }, flags);
+}
+
 std::string
 MediaObjectImpl::createId()
 {
@@ -70,11 +115,10 @@ MediaObjectImpl::getName()
 std::string
 MediaObjectImpl::getId()
 {
-  std::unique_lock<std::recursive_mutex> lck (mutex);
-
-  if (id.empty () ) {
+  /* Type is not known until the object is fully constructed */
+  std::call_once (idFlag, [this] () {
     id = this->initialId + "_" + this->getModule() + "." + this->getType ();
-  }
+  });
 
   return id;
 }
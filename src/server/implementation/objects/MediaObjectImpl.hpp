@@ -10,7 +10,10 @@
 #include <KurentoException.hpp>
 #include <mutex>
 #include <map>
+#include <functional>
 #include "Tag.hpp"
+#include <ObjectHandle.hpp>
+#include <ConfigSnapshot.hpp>
 #include <gst/gst.h>
 
 namespace kurento
@@ -32,7 +35,7 @@ public:
   MediaObjectImpl (const boost::property_tree::ptree &config,
                    std::shared_ptr <MediaObject> parent);
 
-  virtual ~MediaObjectImpl () {}
+  virtual ~MediaObjectImpl ();
 
   void addTag (const std::string &key, const std::string &value);
   void removeTag (const std::string &key);
@@ -50,6 +53,12 @@ public:
 
   virtual std::string getId ();
 
+  /* Assigned at construction, used as key by internal tables */
+  ObjectHandle getHandle () const
+  {
+    return handle;
+  }
+
   virtual std::string getName ();
   virtual void setName (const std::string &name);
 
@@ -80,24 +89,13 @@ protected:
   template <class T, class C>
   T getConfigValue (const std::string &key)
   {
-    auto child = config.get_child ("modules." + dynamic_cast <C *>
-                                   (this)->getModule() + "."
-                                   + dynamic_cast <C *> (this)->getType() + "." + key);
-    std::stringstream ss;
-    Json::Value val;
-    Json::Reader reader;
-    kurento::JsonSerializer serializer (false);
-    boost::property_tree::ptree array;
-
-    array.push_back (std::make_pair ("val", child) );
-    boost::property_tree::write_json (ss, array);
-
-    reader.parse (ss.str(), val);
-
+    std::string path = configPath<C> (key);
     T ret {};
 
-    serializer.JsonValue = val;
-    serializer.Serialize ("val", ret);
+    if (!configSnapshot->get (path, ret) ) {
+      throw boost::property_tree::ptree_bad_path ("No such node",
+          boost::property_tree::ptree::path_type (path) );
+    }
 
     return ret;
   }
@@ -105,9 +103,13 @@ protected:
   template <class T, class C>
   T getConfigValue (const std::string &key, T defaultValue)
   {
+    T ret {};
+
     try {
-      return getConfigValue<T, C> (key);
-    } catch (boost::property_tree::ptree_bad_path &e) {
+      if (configSnapshot->get (configPath<C> (key), ret) ) {
+        return ret;
+      }
+
       /* This case is expected, the config does not have the requested key */
     } catch (KurentoException &e) {
       GST_WARNING ("Posible error deserializing %s from config", key.c_str() );
@@ -124,12 +126,33 @@ protected:
    */
   virtual void postConstructor ();
 
+  /*
+   * Raises an event of @type from the event dispatcher instead of the calling
+   * thread. The object is kept alive until @emit runs. @flags are the ones of
+   * EventDispatcher::post ().
+   */
+  void postEvent (const std::string &type, std::function<void () > emit,
+                  int flags = 0);
+
   const boost::property_tree::ptree &config;
 
+  /* Values are read from here, never from config */
+  std::shared_ptr<const ConfigSnapshot> configSnapshot;
+
 private:
 
+  template <class C>
+  std::string configPath (const std::string &key)
+  {
+    C *self = dynamic_cast <C *> (this);
+
+    return "modules." + self->getModule() + "." + self->getType() + "." + key;
+  }
+
   std::string initialId;
   std::string id;
+  std::once_flag idFlag;
+  ObjectHandle handle;
   std::string name;
   std::recursive_mutex mutex;
   std::shared_ptr<MediaObject> parent;
@@ -6,17 +6,58 @@
 #include <gst/gst.h>
 #include <DotGraph.hpp>
 #include <GstreamerDotDetails.hpp>
+#include <GstreamerGraphFormat.hpp>
 #include <SignalHandler.hpp>
+#include <MediaElementImpl.hpp>
+#include <ElementConnectionData.hpp>
+#include <MediaType.hpp>
+#include <ElementConnected.hpp>
+#include <ElementDisconnected.hpp>
+#include <EventDispatcher.hpp>
+#include <StatsSampler.hpp>
+#include <ElementPool.hpp>
+#include <RTCStatsDelta.hpp>
+
+#include <chrono>
+#include <set>
+#include <tuple>
 
 #define GST_CAT_DEFAULT kurento_media_pipeline_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoMediaPipelineImpl"
 
+#define STATS_EVENT_PERIOD_DEFAULT 1000 /* ms */
+
 namespace kurento
 {
+void
+MediaPipelineImpl::addBusHandler (GstObject *src, BusHandler handler)
+{
+  std::unique_lock<std::recursive_mutex> lock (busHandlersMutex);
+
+  busHandlers[src] = handler;
+}
+
+void
+MediaPipelineImpl::removeBusHandler (GstObject *src)
+{
+  std::unique_lock<std::recursive_mutex> lock (busHandlersMutex);
+
+  busHandlers.erase (src);
+}
+
 void
 MediaPipelineImpl::busMessage (GstMessage *message)
 {
+  std::unique_lock<std::recursive_mutex> lock (busHandlersMutex);
+  auto it = busHandlers.find (message->src);
+
+  if (it != busHandlers.end () ) {
+    it->second (message);
+  }
+
+  lock.unlock ();
+
   switch (message->type) {
   case GST_MESSAGE_ERROR: {
     GError *err = NULL;
@@ -36,7 +77,9 @@ MediaPipelineImpl::busMessage (GstMessage *message)
       Error error (shared_from_this(), errorMessage , 0,
                    "UNEXPECTED_PIPELINE_ERROR");
 
-      signalError (error);
+      postEvent (Error::getName (), [this, error] () {
+        signalError (error);
+      }, EventDispatcher::RELIABLE);
     } catch (std::bad_weak_ptr &e) {
     }
 
@@ -65,35 +108,34 @@ void MediaPipelineImpl::postConstructor ()
                       std::dynamic_pointer_cast<MediaPipelineImpl>
                       (shared_from_this() ) );
   g_object_unref (bus);
+
+  statsEventPeriod = getConfigValue <int, MediaPipeline> ("statsEventPeriod",
+                     STATS_EVENT_PERIOD_DEFAULT);
 }
 
 MediaPipelineImpl::MediaPipelineImpl (const boost::property_tree::ptree &config)
-  : MediaObjectImpl (config)
+  : MediaObjectImpl (config), signalStatsUpdated (*this)
 {
-  GstClock *clock;
+  int poolSize = getConfigValue <int, MediaPipeline> ("poolSize", 0);
 
-  pipeline = gst_pipeline_new (NULL);
+  /* Already running with the system clock */
+  pipeline = ElementPool::get ().takePipeline (poolSize);
 
   if (pipeline == NULL) {
     throw KurentoException (MEDIA_OBJECT_NOT_AVAILABLE,
                             "Cannot create gstreamer pipeline");
   }
 
-  g_object_set (G_OBJECT (pipeline), "async-handling", TRUE, NULL);
-
-  clock = gst_system_clock_obtain ();
-  gst_pipeline_use_clock (GST_PIPELINE (pipeline), clock);
-  g_object_unref (clock);
-
-  gst_element_set_state (pipeline, GST_STATE_PLAYING);
-
   busMessageHandler = 0;
+  tearingDown = false;
 }
 
 MediaPipelineImpl::~MediaPipelineImpl ()
 {
   GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
 
+  StatsSampler::get().remove (getHandle() );
+
   if (busMessageHandler > 0) {
     unregister_signal_handler (bus, busMessageHandler);
   }
@@ -104,32 +146,404 @@ MediaPipelineImpl::~MediaPipelineImpl ()
   g_object_unref (pipeline);
 }
 
-std::string MediaPipelineImpl::getGstreamerDot (
-  std::shared_ptr<GstreamerDotDetails> details)
+void
+MediaPipelineImpl::release ()
+{
+  /*
+   * All elements are being released with the pipeline. Stopping the bin at
+   * once changes the state of its children in dependency order (sinks first)
+   * so each element does not need to stop itself when destroyed.
+   */
+  tearingDown = true;
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  MediaObjectImpl::release();
+}
+
+/*
+ * Validates the whole batch before touching the graph and groups the
+ * connections by source element, so that each source takes its lock and
+ * requests its pads in one go. A batch may not have two connections to the
+ * same sink pad, as the later one would replace the former.
+ */
+std::map<MediaElementImpl *, std::vector<std::shared_ptr<ElementConnectionData>>>
+    MediaPipelineImpl::groupBySource (const
+                                      std::vector<std::shared_ptr<ElementConnectionData>> &connections)
+{
+  std::map<MediaElementImpl *, std::vector<std::shared_ptr<ElementConnectionData>>>
+      bySource;
+  std::set<std::tuple<MediaElementImpl *, int, std::string>> sinkPads;
+
+  for (auto connection : connections) {
+    std::shared_ptr<MediaElementImpl> source;
+    std::shared_ptr<MediaElementImpl> sink;
+
+    if (!connection) {
+      throw KurentoException (CONNECT_ERROR, "Invalid connection in batch");
+    }
+
+    source = std::dynamic_pointer_cast<MediaElementImpl>
+             (connection->getSource () );
+    sink = std::dynamic_pointer_cast<MediaElementImpl> (connection->getSink () );
+
+    if (!source || !sink || !connection->getType () ) {
+      throw KurentoException (CONNECT_ERROR,
+                              "Source, sink and media type are required");
+    }
+
+    if (source->pipeline.get () != this || sink->pipeline.get () != this) {
+      throw KurentoException (CONNECT_ERROR,
+                              "Media elements does not belong to pipeline '" + getId () + "'");
+    }
+
+    if (!sinkPads.insert (std::make_tuple (sink.get (),
+                                           (int) connection->getType ()->getValue (),
+                                           connection->getSinkDescription () ) ).second) {
+      throw KurentoException (CONNECT_ERROR, "Duplicated " +
+                              connection->getType ()->getString () + " connection to '" +
+                              sink->getId () + "' in batch");
+    }
+
+    bySource[source.get ()].push_back (connection);
+  }
+
+  return bySource;
+}
+
+void
+MediaPipelineImpl::connectElements (const
+                                    std::vector<std::shared_ptr<ElementConnectionData>> &connections)
+{
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  auto bySource = groupBySource (connections);
+  /* Connections made, with the one each of them replaced, if any */
+  std::vector<std::pair<std::shared_ptr<ElementConnectionData>, std::shared_ptr<ElementConnectionData>>>
+      done;
+  std::vector<std::function<void () >> events;
+  std::unique_lock<std::recursive_mutex> lock (connectionsMutex);
+
+  GST_DEBUG ("Connecting %" G_GSIZE_FORMAT " elements in batch",
+             connections.size () );
+
+  try {
+    for (auto it : bySource) {
+      std::unique_lock<std::recursive_mutex> sourceLock (it.first->sinksMutex);
+
+      for (auto connection : it.second) {
+        std::shared_ptr<ElementConnectionData> replaced;
+
+        replaced = it.first->connectLocked (
+                     std::dynamic_pointer_cast<MediaElementImpl> (connection->getSink () ),
+                     connection->getType (), connection->getSourceDescription (),
+                     connection->getSinkDescription () );
+        done.push_back (std::make_pair (connection, replaced) );
+      }
+    }
+  } catch (KurentoException &e) {
+    /* Leave the graph as it was before the batch, newest changes first */
+    for (auto it = done.rbegin (); it != done.rend (); it++) {
+      std::shared_ptr<ElementConnectionData> connection = it->first;
+      std::shared_ptr<ElementConnectionData> replaced = it->second;
+      std::shared_ptr<MediaElementImpl> sink =
+        std::dynamic_pointer_cast<MediaElementImpl> (connection->getSink () );
+
+      std::dynamic_pointer_cast<MediaElementImpl> (connection->getSource () )->
+      disconnectLocked (sink, connection->getType (),
+                        connection->getSourceDescription (),
+                        connection->getSinkDescription () );
+
+      if (replaced) {
+        std::dynamic_pointer_cast<MediaElementImpl> (replaced->getSource () )->
+        connectLocked (sink, replaced->getType (),
+                       replaced->getSourceDescription (),
+                       replaced->getSinkDescription () );
+      }
+    }
+
+    throw;
+  }
+
+  lock.unlock ();
+
+  connectLatency.record (std::chrono::duration_cast<std::chrono::microseconds>
+                         (std::chrono::steady_clock::now() - start).count() );
+
+  /* Events are fired once the whole batch is linked */
+  for (auto it : done) {
+    if (it.second) {
+      events.push_back (MediaElementImpl::elementDisconnectedEmitter (
+                          it.second) );
+    }
+
+    events.push_back (MediaElementImpl::elementConnectedEmitter (it.first) );
+  }
+
+  postBatchEvents (ElementConnected::getName (), events);
+}
+
+void
+MediaPipelineImpl::disconnectElements (const
+                                       std::vector<std::shared_ptr<ElementConnectionData>> &connections)
+{
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  auto bySource = groupBySource (connections);
+  std::vector<std::shared_ptr<ElementConnectionData>> done;
+  std::vector<std::function<void () >> events;
+  std::unique_lock<std::recursive_mutex> lock (connectionsMutex);
+
+  GST_DEBUG ("Disconnecting %" G_GSIZE_FORMAT " elements in batch",
+             connections.size () );
+
+  for (auto it : bySource) {
+    std::unique_lock<std::recursive_mutex> sourceLock (it.first->sinksMutex);
+
+    for (auto connection : it.second) {
+      if (it.first->disconnectLocked (std::dynamic_pointer_cast<MediaElementImpl>
+                                      (connection->getSink () ), connection->getType (),
+                                      connection->getSourceDescription (),
+                                      connection->getSinkDescription () ) ) {
+        done.push_back (connection);
+      }
+    }
+  }
+
+  lock.unlock ();
+
+  disconnectLatency.record (std::chrono::duration_cast<std::chrono::microseconds>
+                            (std::chrono::steady_clock::now() - start).count() );
+
+  /* Only for the connections that existed */
+  for (auto connection : done) {
+    events.push_back (MediaElementImpl::elementDisconnectedEmitter (
+                        connection) );
+  }
+
+  postBatchEvents (ElementDisconnected::getName (), events);
+}
+
+/*
+ * Clients still get one event per connection from its source element, but
+ * the whole batch takes a single entry of the event queue, so a batch larger
+ * than the queue neither drops its own events nor the pending ones of other
+ * objects. It is reliable: dropping it would lose every event of the batch.
+ */
+void
+MediaPipelineImpl::postBatchEvents (const std::string &type,
+                                    const std::vector<std::function<void () >> &events)
+{
+  if (events.empty () ) {
+    return;
+  }
+
+  postEvent (type, [events] () {
+    for (auto &emit : events) {
+      emit ();
+    }
+  }, EventDispatcher::RELIABLE);
+}
+
+static GstDebugGraphDetails
+convertDetails (std::shared_ptr<GstreamerDotDetails> details)
 {
   switch (details->getValue() ) {
   case GstreamerDotDetails::SHOW_MEDIA_TYPE:
-    return generateDotGraph (GST_BIN (pipeline), GST_DEBUG_GRAPH_SHOW_MEDIA_TYPE);
+    return GST_DEBUG_GRAPH_SHOW_MEDIA_TYPE;
 
   case GstreamerDotDetails::SHOW_CAPS_DETAILS:
-    return generateDotGraph (GST_BIN (pipeline), GST_DEBUG_GRAPH_SHOW_CAPS_DETAILS);
+    return GST_DEBUG_GRAPH_SHOW_CAPS_DETAILS;
 
   case GstreamerDotDetails::SHOW_NON_DEFAULT_PARAMS:
-    return generateDotGraph (GST_BIN (pipeline),
-                             GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS);
+    return GST_DEBUG_GRAPH_SHOW_NON_DEFAULT_PARAMS;
 
   case GstreamerDotDetails::SHOW_STATES:
-    return generateDotGraph (GST_BIN (pipeline), GST_DEBUG_GRAPH_SHOW_STATES);
+    return GST_DEBUG_GRAPH_SHOW_STATES;
 
   case GstreamerDotDetails::SHOW_ALL:
   default:
-    return generateDotGraph (GST_BIN (pipeline), GST_DEBUG_GRAPH_SHOW_ALL);
+    return GST_DEBUG_GRAPH_SHOW_ALL;
+  }
+}
+
+void
+MediaPipelineImpl::addStatsSource (ObjectHandle handle, const std::string &id,
+                                   StatsSource source)
+{
+  std::unique_lock<std::mutex> lock (statsSourcesMutex);
+
+  statsSources[handle] = std::make_pair (id, source);
+}
+
+void
+MediaPipelineImpl::removeStatsSource (ObjectHandle handle)
+{
+  std::pair<std::string, StatsSource> source;
+  std::unique_lock<std::mutex> lock (statsSourcesMutex);
+  auto it = statsSources.find (handle);
+
+  if (it != statsSources.end () ) {
+    /* Destroyed out of the lock */
+    source.swap (it->second);
+    statsSources.erase (it);
+  }
+}
+
+sigc::connection
+MediaPipelineImpl::StatsUpdatedSignal::connect (const slot_type &slot)
+{
+  std::shared_ptr<void> subscription = pipeline.subscribeStats ();
+
+  return sigc::signal<void, StatsUpdated>::connect ([slot,
+  subscription] (StatsUpdated event) {
+    slot (event);
+  });
+}
+
+std::shared_ptr<void>
+MediaPipelineImpl::subscribeStats ()
+{
+  std::weak_ptr<MediaPipelineImpl> weak =
+    std::dynamic_pointer_cast<MediaPipelineImpl> (shared_from_this() );
+  std::unique_lock<std::mutex> lock (statsSubscribersMutex);
+
+  if (statsSubscribers++ == 0 && statsEventPeriod > 0) {
+    StatsSampler::get().add (getHandle(),
+                             std::chrono::milliseconds (statsEventPeriod),
+    [weak] () {
+      std::shared_ptr<MediaPipelineImpl> self = weak.lock();
+
+      if (self) {
+        self->emitStatsUpdated();
+      }
+    });
+  }
+
+  /* Released with the slot, a pipeline being destroyed is not notified */
+  return std::shared_ptr<void> (nullptr, [weak] (void *) {
+    std::shared_ptr<MediaPipelineImpl> self = weak.lock();
+
+    if (self) {
+      self->unsubscribeStats ();
+    }
+  });
+}
+
+void
+MediaPipelineImpl::unsubscribeStats ()
+{
+  std::unique_lock<std::mutex> lock (statsSubscribersMutex);
+
+  if (--statsSubscribers == 0) {
+    StatsSampler::get().remove (getHandle() );
+  }
+}
+
+/*
+ * Called from the stats sampler. The update is built in the event queue of
+ * the pipeline, where the signal is emitted, so subscribers are checked and
+ * the encoder is used from one place only.
+ */
+void
+MediaPipelineImpl::emitStatsUpdated ()
+{
+  postEvent (StatsUpdated::getName (), [this] () {
+    sendStatsUpdated ();
+  }, EventDispatcher::COALESCE);
+}
+
+void
+MediaPipelineImpl::sendStatsUpdated ()
+{
+  std::vector<std::pair<std::string, StatsSource>> sources;
+  std::map<std::string, stats::RTCStatsReport> reports;
+  std::vector<std::shared_ptr<RTCStatsDelta>> updates;
+
+  if (signalStatsUpdated.empty () ) {
+    /* Whoever subscribes next gets every field */
+    statsEncoder.reset ();
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock (statsSourcesMutex);
+
+  for (auto &it : statsSources) {
+    sources.push_back (it.second);
+  }
+
+  lock.unlock ();
+
+  for (auto &source : sources) {
+    reports[source.first] = source.second ();
+  }
+
+  updates = statsEncoder.encode (reports);
+
+  if (updates.empty () ) {
+    return;
   }
+
+  StatsUpdated event (shared_from_this (), updates);
+
+  signalStatsUpdated (event);
+}
+
+std::string MediaPipelineImpl::getGstreamerDot (
+  std::shared_ptr<GstreamerDotDetails> details)
+{
+  return *graphCache.get (GST_BIN (pipeline), GRAPH_FORMAT_DOT,
+                          convertDetails (details) );
 }
 
 std::string MediaPipelineImpl::getGstreamerDot()
 {
-  return generateDotGraph (GST_BIN (pipeline), GST_DEBUG_GRAPH_SHOW_ALL);
+  return *graphCache.get (GST_BIN (pipeline), GRAPH_FORMAT_DOT,
+                          GST_DEBUG_GRAPH_SHOW_ALL);
+}
+
+std::string MediaPipelineImpl::getGstreamerGraph (
+  std::shared_ptr<GstreamerGraphFormat> format)
+{
+  return getGstreamerGraph (format, std::shared_ptr<GstreamerDotDetails> (
+                              new GstreamerDotDetails (GstreamerDotDetails::SHOW_ALL) ) );
+}
+
+std::string MediaPipelineImpl::getGstreamerGraph (
+  std::shared_ptr<GstreamerGraphFormat> format,
+  std::shared_ptr<GstreamerDotDetails> details)
+{
+  return getGstreamerGraph (format, details, "");
+}
+
+std::string MediaPipelineImpl::getGstreamerGraph (
+  std::shared_ptr<GstreamerGraphFormat> format,
+  std::shared_ptr<GstreamerDotDetails> details, const std::string &root)
+{
+  return getGstreamerGraph (format, details, root, 0);
+}
+
+std::string MediaPipelineImpl::getGstreamerGraph (
+  std::shared_ptr<GstreamerGraphFormat> format,
+  std::shared_ptr<GstreamerDotDetails> details, const std::string &root,
+  int depth)
+{
+  std::shared_ptr<const std::string> graph;
+  GraphFilter filter;
+
+  filter.root = root;
+  filter.depth = depth;
+
+  graph = graphCache.get (GST_BIN (pipeline),
+                          format->getValue () == GstreamerGraphFormat::JSON ?
+                          GRAPH_FORMAT_JSON : GRAPH_FORMAT_DOT,
+                          convertDetails (details), filter);
+
+  if (!graph) {
+    throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
+                            "Element " + root + " not found in pipeline");
+  }
+
+  return *graph;
 }
 
 MediaObjectImpl *
@@ -6,11 +6,23 @@
 #include <EventHandler.hpp>
 #include <gst/gst.h>
 #include <boost/property_tree/ptree.hpp>
+#include <Histogram.hpp>
+#include <DotGraph.hpp>
+#include <Statistics.hpp>
+#include "StatsUpdated.hpp"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace kurento
 {
 
 class MediaPipelineImpl;
+class MediaElementImpl;
+class ElementConnectionData;
 
 void Serialize (std::shared_ptr<MediaPipelineImpl> &object,
                 JsonSerializer &serializer);
@@ -33,10 +45,101 @@ public:
   virtual std::string getGstreamerDot (std::shared_ptr<GstreamerDotDetails>
                                        details);
 
+  virtual std::string getGstreamerGraph (std::shared_ptr<GstreamerGraphFormat>
+                                         format);
+  virtual std::string getGstreamerGraph (std::shared_ptr<GstreamerGraphFormat>
+                                         format, std::shared_ptr<GstreamerDotDetails> details);
+  virtual std::string getGstreamerGraph (std::shared_ptr<GstreamerGraphFormat>
+                                         format, std::shared_ptr<GstreamerDotDetails> details,
+                                         const std::string &root);
+  virtual std::string getGstreamerGraph (std::shared_ptr<GstreamerGraphFormat>
+                                         format, std::shared_ptr<GstreamerDotDetails> details,
+                                         const std::string &root, int depth);
+
+  virtual void release ();
+
+  virtual void connectElements (const
+                                std::vector<std::shared_ptr<ElementConnectionData>> &connections);
+  virtual void disconnectElements (const
+                                   std::vector<std::shared_ptr<ElementConnectionData>> &connections);
+
+  /* True once the whole pipeline has been stopped for its destruction */
+  bool isTearingDown ()
+  {
+    return tearingDown;
+  }
+
+  /*
+   * Serializes changes in the connections between elements of this pipeline.
+   * It is always taken before the connection locks of any of its elements,
+   * so those can never be acquired in opposite orders.
+   */
+  std::recursive_mutex &getConnectionsMutex ()
+  {
+    return connectionsMutex;
+  }
+
+  /* Microseconds taken by connect and disconnect operations */
+  Histogram &getConnectLatency ()
+  {
+    return connectLatency;
+  }
+
+  Histogram &getDisconnectLatency ()
+  {
+    return disconnectLatency;
+  }
+
+  /* Graphs served without being generated again */
+  guint64 getGraphCacheHits ()
+  {
+    return graphCache.getHits ();
+  }
+
+  /*
+   * The pipeline owns the only watch on its bus. Messages are routed to the
+   * handler registered for their source object with a single lookup.
+   * Handlers run with the dispatcher lock held, so once removeBusHandler
+   * returns the handler is not running and will not be called again.
+   */
+  typedef std::function<void (GstMessage *) > BusHandler;
+
+  void addBusHandler (GstObject *src, BusHandler handler);
+  void removeBusHandler (GstObject *src);
+
+  /*
+   * Endpoints whose stats are reported in StatsUpdated events. @source must
+   * return the last sampled report of the endpoint, never sample it itself.
+   */
+  typedef std::function<stats::RTCStatsReport () > StatsSource;
+
+  void addStatsSource (ObjectHandle handle, const std::string &id,
+                       StatsSource source);
+  void removeStatsSource (ObjectHandle handle);
+
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
                         std::shared_ptr<EventHandler> handler);
 
+  /*
+   * Stats are only sampled while StatsUpdated has subscribers. Every slot
+   * holds a subscription: connecting the first one registers the pipeline
+   * in the StatsSampler and destroying the last one, when its handler is
+   * disconnected, removes it.
+   */
+  class StatsUpdatedSignal : public sigc::signal<void, StatsUpdated>
+  {
+  public:
+    StatsUpdatedSignal (MediaPipelineImpl &pipeline) : pipeline (pipeline) {}
+
+    sigc::connection connect (const slot_type &slot);
+
+  private:
+    MediaPipelineImpl &pipeline;
+  };
+
+  StatsUpdatedSignal signalStatsUpdated;
+
   virtual void invoke (std::shared_ptr<MediaObjectImpl> obj,
                        const std::string &methodName, const Json::Value &params,
                        Json::Value &response);
@@ -50,8 +153,41 @@ private:
 
   gulong busMessageHandler;
 
+  std::atomic<bool> tearingDown;
+
+  std::recursive_mutex connectionsMutex;
+
+  std::recursive_mutex busHandlersMutex;
+  std::unordered_map<GstObject *, BusHandler> busHandlers;
+  Histogram connectLatency;
+  Histogram disconnectLatency;
+
+  GraphCache graphCache;
+
+  std::mutex statsSourcesMutex;
+  std::unordered_map<ObjectHandle, std::pair<std::string, StatsSource>>
+      statsSources;
+  /* Only used from the event queue of the pipeline */
+  stats::RTCStatsDeltaEncoder statsEncoder;
+
+  std::mutex statsSubscribersMutex;
+  unsigned int statsSubscribers = 0;
+  int statsEventPeriod = 0;
+
+  std::shared_ptr<void> subscribeStats ();
+  void unsubscribeStats ();
+  void emitStatsUpdated ();
+  void sendStatsUpdated ();
+
   void busMessage (GstMessage *message);
 
+  void postBatchEvents (const std::string &type,
+                        const std::vector<std::function<void () >> &events);
+
+  std::map<MediaElementImpl *, std::vector<std::shared_ptr<ElementConnectionData>>>
+      groupBySource (const std::vector<std::shared_ptr<ElementConnectionData>>
+                     &connections);
+
   class StaticConstructor
   {
   public:
@@ -42,6 +42,8 @@ ServerManagerImpl::ServerManagerImpl (const std::shared_ptr<ServerInfo> info,
                                       ModuleManager &moduleManager) : MediaObjectImpl (config),
   info (info), moduleManager (moduleManager)
 {
+  /* Objects are created with the same configuration as the server manager */
+  ConfigSnapshot::publish (config);
   metadata = childToString (config, METADATA);
 }
 
@@ -73,10 +75,11 @@ std::string ServerManagerImpl::getMetadata ()
 
 std::string ServerManagerImpl::getKmd (const std::string &moduleName)
 {
-  for (auto moduleIt : moduleManager.getModules () ) {
-    if (moduleIt.second->getName () == moduleName) {
-      return moduleIt.second->getDescriptor();
-    }
+  /* Only the requested module is loaded if it is a lazy one */
+  std::shared_ptr<ModuleData> module = moduleManager.getModule (moduleName);
+
+  if (module) {
+    return module->getDescriptor();
   }
 
   GST_WARNING ("Requested kmd module doesn't exist");
@@ -38,7 +38,10 @@ public:
                      const boost::property_tree::ptree &config,
                      ModuleManager &moduleManager);
 
-  virtual ~ServerManagerImpl () {};
+  virtual ~ServerManagerImpl ()
+  {
+    ConfigSnapshot::withdraw (config);
+  };
 
   std::string getKmd (const std::string &moduleName);
 
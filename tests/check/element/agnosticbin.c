@@ -977,6 +977,163 @@ GST_START_TEST (h264_encoding_odd_dimension)
   g_main_loop_unref (loop);
 }
 
+GST_END_TEST
+typedef struct _SharedBranch
+{
+  GstElement *queue;
+  GstElement *agnosticbin;
+  GstElement *capsfilter;
+  GstElement *fakesink;
+  GstPad *tee_src;
+  gint buffers;
+} SharedBranch;
+
+#define SHARED_WAIT_STEP (10 * G_TIME_SPAN_MILLISECOND)
+#define SHARED_WAIT_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+
+static void
+count_shared_buffer (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gpointer data)
+{
+  g_atomic_int_inc ((gint *) data);
+}
+
+static void
+wait_for_buffers (SharedBranch * branch, gint buffers)
+{
+  gint64 end = g_get_monotonic_time () + SHARED_WAIT_TIMEOUT;
+
+  while (g_atomic_int_get (&branch->buffers) < buffers) {
+    fail_unless (g_get_monotonic_time () < end, "Timeout waiting for buffers");
+    g_usleep (SHARED_WAIT_STEP);
+  }
+}
+
+static void
+add_shared_branch (GstElement * pipeline, GstElement * tee,
+    SharedBranch * branch)
+{
+  GstCaps *caps = gst_caps_from_string ("audio/x-alaw");
+
+  branch->queue = gst_element_factory_make ("queue", NULL);
+  branch->agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  branch->capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  branch->fakesink = gst_element_factory_make ("fakesink", NULL);
+
+  g_object_set (branch->capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  g_object_set (branch->fakesink, "sync", FALSE, "async", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect (branch->fakesink, "handoff",
+      G_CALLBACK (count_shared_buffer), &branch->buffers);
+
+  gst_bin_add_many (GST_BIN (pipeline), branch->queue, branch->agnosticbin,
+      branch->capsfilter, branch->fakesink, NULL);
+  fail_unless (gst_element_link (branch->capsfilter, branch->fakesink));
+
+  branch->tee_src = gst_element_get_request_pad (tee, "src_%u");
+  fail_unless (gst_element_link_pads (tee, GST_OBJECT_NAME (branch->tee_src),
+          branch->queue, NULL));
+  fail_unless (gst_element_link (branch->queue, branch->agnosticbin));
+}
+
+static void
+link_shared_branch_output (SharedBranch * branch)
+{
+  fail_unless (gst_element_link (branch->agnosticbin, branch->capsfilter));
+}
+
+static void
+remove_shared_branch (GstElement * pipeline, GstElement * tee,
+    SharedBranch * branch)
+{
+  gst_element_release_request_pad (tee, branch->tee_src);
+  g_object_unref (branch->tee_src);
+
+  gst_element_set_state (branch->fakesink, GST_STATE_NULL);
+  gst_element_set_state (branch->capsfilter, GST_STATE_NULL);
+  gst_element_set_state (branch->agnosticbin, GST_STATE_NULL);
+  gst_element_set_state (branch->queue, GST_STATE_NULL);
+
+  gst_bin_remove_many (GST_BIN (pipeline), branch->queue, branch->agnosticbin,
+      branch->capsfilter, branch->fakesink, NULL);
+}
+
+static gboolean
+has_enc_tree_bin (GstElement * agnosticbin)
+{
+  GstIterator *it = gst_bin_iterate_elements (GST_BIN (agnosticbin));
+  GValue item = G_VALUE_INIT;
+  gboolean found = FALSE;
+
+  while (!found && gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    found = g_strcmp0 (G_OBJECT_TYPE_NAME (g_value_get_object (&item)),
+        "KmsEncTreeBin") == 0;
+    g_value_reset (&item);
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  return found;
+}
+
+/*
+ * Two agnosticbins fed from the same tee share the encoder of the first one.
+ * Any of them can be removed while the other one keeps receiving media.
+ */
+static void
+check_shared_teardown (gboolean owner_first)
+{
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *src = gst_element_factory_make ("audiotestsrc", NULL);
+  GstElement *tee = gst_element_factory_make ("tee", NULL);
+  SharedBranch owner = { 0, }, consumer = { 0, };
+  SharedBranch *removed, *survivor;
+  gint buffers;
+
+  g_object_set (src, "is-live", TRUE, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), src, tee, NULL);
+  fail_unless (gst_element_link (src, tee));
+
+  add_shared_branch (pipeline, tee, &owner);
+  add_shared_branch (pipeline, tee, &consumer);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  link_shared_branch_output (&owner);
+  wait_for_buffers (&owner, 10);
+
+  link_shared_branch_output (&consumer);
+  wait_for_buffers (&consumer, 10);
+
+  fail_unless (has_enc_tree_bin (owner.agnosticbin));
+  fail_if (has_enc_tree_bin (consumer.agnosticbin),
+      "The consumer built its own encoder");
+
+  removed = owner_first ? &owner : &consumer;
+  survivor = owner_first ? &consumer : &owner;
+
+  remove_shared_branch (pipeline, tee, removed);
+
+  buffers = g_atomic_int_get (&survivor->buffers);
+  wait_for_buffers (survivor, buffers + 10);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (pipeline);
+}
+
+GST_START_TEST (shared_branch_owner_removed_first)
+{
+  check_shared_teardown (TRUE);
+}
+
+GST_END_TEST
+GST_START_TEST (shared_branch_consumer_removed_first)
+{
+  check_shared_teardown (FALSE);
+}
+
 GST_END_TEST
 /*
  * End of test cases
@@ -1004,6 +1161,8 @@ agnostic2_suite (void)
   tcase_add_test (tc_chain, input_caps_reconfiguration);
   tcase_add_test (tc_chain, encoded_input_n_encoded_output);
   tcase_add_test (tc_chain, h264_encoding_odd_dimension);
+  tcase_add_test (tc_chain, shared_branch_owner_removed_first);
+  tcase_add_test (tc_chain, shared_branch_consumer_removed_first);
 
   return s;
 }
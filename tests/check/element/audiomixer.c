@@ -24,6 +24,11 @@
 /* Manual test: Compile with -DMANUAL_CHECK=true
  * gst-launch-1.0 filesrc location=[path_to_wav_file] ! wavparse ! autoaudiosink
  */
+
+/* Benchmark: Compile with -DBENCHMARK_CHECK=true */
+#ifdef BENCHMARK_CHECK
+#include <sys/resource.h>
+#endif
 #ifdef MANUAL_CHECK
 G_LOCK_DEFINE (mutex);
 static guint id = 0;
@@ -481,6 +486,457 @@ GST_START_TEST (check_audio_disconnection)
   padhash = NULL;
 }
 
+GST_END_TEST
+/* Each mix-minus input is a constant level, different for every input */
+#define MIX_MINUS_INPUTS 3
+#define MIX_MINUS_BUFFERS 10
+#define MIX_MINUS_SAMPLES 80
+#define MIX_MINUS_LEVEL(id) (((id) + 1) * 100)
+static GstBuffer *
+create_level_buffer (gint16 level, guint index)
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gint16 *samples;
+  guint i;
+
+  buffer = gst_buffer_new_allocate (NULL, MIX_MINUS_SAMPLES * sizeof (gint16),
+      NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  samples = (gint16 *) map.data;
+
+  for (i = 0; i < MIX_MINUS_SAMPLES; i++) {
+    samples[i] = level;
+  }
+
+  gst_buffer_unmap (buffer, &map);
+
+  GST_BUFFER_PTS (buffer) = index * 10 * GST_MSECOND;
+  GST_BUFFER_DURATION (buffer) = 10 * GST_MSECOND;
+
+  return buffer;
+}
+
+typedef struct _MixMinusOutput
+{
+  gint16 expected;
+  gint buffers;
+  gboolean valid;
+} MixMinusOutput;
+
+static void
+check_mix_minus_output (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gpointer data)
+{
+  MixMinusOutput *output = data;
+  const gint16 *samples;
+  GstMapInfo map;
+  guint i;
+
+  gst_buffer_map (buf, &map, GST_MAP_READ);
+  samples = (const gint16 *) map.data;
+
+  for (i = 0; i < map.size / sizeof (gint16); i++) {
+    if (samples[i] != output->expected) {
+      GST_ERROR ("Got %d, expected %d", samples[i], output->expected);
+      output->valid = FALSE;
+    }
+  }
+
+  gst_buffer_unmap (buf, &map);
+  output->buffers++;
+}
+
+GST_START_TEST (check_mix_minus_excludes_own_input)
+{
+  GstElement *pipeline, *mixminus;
+  MixMinusOutput outputs[MIX_MINUS_INPUTS];
+  GstElement *srcs[MIX_MINUS_INPUTS];
+  gint16 total = 0;
+  GstMessage *msg;
+  GstCaps *caps;
+  GstBus *bus;
+  guint i, j;
+
+  pipeline = gst_pipeline_new (NULL);
+  mixminus = gst_element_factory_make ("kmsmixminus", NULL);
+  gst_bin_add (GST_BIN (pipeline), mixminus);
+
+  caps = gst_caps_from_string ("audio/x-raw,format=S16LE,rate=8000,"
+      "channels=1,layout=interleaved");
+
+  for (i = 0; i < MIX_MINUS_INPUTS; i++) {
+    total += MIX_MINUS_LEVEL (i);
+  }
+
+  for (i = 0; i < MIX_MINUS_INPUTS; i++) {
+    GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+    gchar *sinkname = g_strdup_printf ("sink_%u", i);
+    gchar *srcname = g_strdup_printf ("src_%u", i);
+
+    srcs[i] = gst_element_factory_make ("appsrc", NULL);
+    g_object_set (G_OBJECT (srcs[i]), "caps", caps, "format",
+        GST_FORMAT_TIME, NULL);
+
+    outputs[i].expected = total - MIX_MINUS_LEVEL (i);
+    outputs[i].buffers = 0;
+    outputs[i].valid = TRUE;
+    g_object_set (G_OBJECT (fakesink), "sync", FALSE, "async", FALSE,
+        "signal-handoffs", TRUE, NULL);
+    g_signal_connect (fakesink, "handoff",
+        G_CALLBACK (check_mix_minus_output), &outputs[i]);
+
+    gst_bin_add_many (GST_BIN (pipeline), srcs[i], fakesink, NULL);
+    fail_unless (gst_element_link_pads (srcs[i], "src", mixminus, sinkname));
+    fail_unless (gst_element_link_pads (mixminus, srcname, fakesink, "sink"));
+
+    g_free (sinkname);
+    g_free (srcname);
+  }
+
+  gst_caps_unref (caps);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  for (i = 0; i < MIX_MINUS_INPUTS; i++) {
+    GstFlowReturn ret;
+
+    for (j = 0; j < MIX_MINUS_BUFFERS; j++) {
+      g_signal_emit_by_name (srcs[i], "push-buffer",
+          create_level_buffer (MIX_MINUS_LEVEL (i), j), &ret);
+    }
+
+    g_signal_emit_by_name (srcs[i], "end-of-stream", &ret);
+  }
+
+  msg = gst_bus_timed_pop_filtered (bus, 5 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+  fail_unless (msg != NULL, "Timeout waiting for EOS");
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS,
+      "Error running pipeline");
+  gst_message_unref (msg);
+
+  for (i = 0; i < MIX_MINUS_INPUTS; i++) {
+    fail_unless (outputs[i].buffers > 0, "No output on src_%u", i);
+    fail_unless (outputs[i].valid, "src_%u does not exclude sink_%u", i, i);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+}
+
+GST_END_TEST
+/* Frames mixed after the inputs stopped are silent */
+static void
+check_live_mix_minus_output (GstElement * fakesink, GstBuffer * buf,
+    GstPad * pad, gpointer data)
+{
+  MixMinusOutput *output = data;
+  const gint16 *samples;
+  gboolean mixed = TRUE;
+  GstMapInfo map;
+  guint i;
+
+  gst_buffer_map (buf, &map, GST_MAP_READ);
+  samples = (const gint16 *) map.data;
+
+  for (i = 0; i < map.size / sizeof (gint16); i++) {
+    if (samples[i] == 0) {
+      mixed = FALSE;
+    } else if (samples[i] != output->expected) {
+      GST_ERROR ("Got %d, expected %d", samples[i], output->expected);
+      output->valid = FALSE;
+    }
+  }
+
+  gst_buffer_unmap (buf, &map);
+
+  if (mixed) {
+    g_atomic_int_inc (&output->buffers);
+  }
+}
+
+GST_START_TEST (check_mix_minus_skips_stalled_input)
+{
+  GstElement *pipeline, *mixminus;
+  MixMinusOutput outputs[MIX_MINUS_INPUTS];
+  GstElement *srcs[MIX_MINUS_INPUTS];
+  guint stalled = MIX_MINUS_INPUTS - 1;
+  gint16 total = 0;
+  GstMessage *msg;
+  GstCaps *caps;
+  GstBus *bus;
+  guint i, j;
+
+  pipeline = gst_pipeline_new (NULL);
+  mixminus = gst_element_factory_make ("kmsmixminus", NULL);
+  gst_bin_add (GST_BIN (pipeline), mixminus);
+
+  caps = gst_caps_from_string ("audio/x-raw,format=S16LE,rate=8000,"
+      "channels=1,layout=interleaved");
+
+  for (i = 0; i < stalled; i++) {
+    total += MIX_MINUS_LEVEL (i);
+  }
+
+  for (i = 0; i < MIX_MINUS_INPUTS; i++) {
+    GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+    gchar *sinkname = g_strdup_printf ("sink_%u", i);
+    gchar *srcname = g_strdup_printf ("src_%u", i);
+
+    srcs[i] = gst_element_factory_make ("appsrc", NULL);
+    g_object_set (G_OBJECT (srcs[i]), "caps", caps, "format",
+        GST_FORMAT_TIME, "is-live", TRUE, NULL);
+
+    outputs[i].expected = total - (i != stalled ? MIX_MINUS_LEVEL (i) : 0);
+    outputs[i].buffers = 0;
+    outputs[i].valid = TRUE;
+    g_object_set (G_OBJECT (fakesink), "sync", TRUE, "async", FALSE,
+        "signal-handoffs", TRUE, NULL);
+    g_signal_connect (fakesink, "handoff",
+        G_CALLBACK (check_live_mix_minus_output), &outputs[i]);
+
+    gst_bin_add_many (GST_BIN (pipeline), srcs[i], fakesink, NULL);
+    fail_unless (gst_element_link_pads (srcs[i], "src", mixminus, sinkname));
+    fail_unless (gst_element_link_pads (mixminus, srcname, fakesink, "sink"));
+
+    g_free (sinkname);
+    g_free (srcname);
+  }
+
+  gst_caps_unref (caps);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* The last input never sends data */
+  for (i = 0; i < stalled; i++) {
+    GstFlowReturn ret;
+
+    for (j = 0; j < MIX_MINUS_BUFFERS; j++) {
+      g_signal_emit_by_name (srcs[i], "push-buffer",
+          create_level_buffer (MIX_MINUS_LEVEL (i), j), &ret);
+    }
+
+    g_signal_emit_by_name (srcs[i], "end-of-stream", &ret);
+  }
+
+  /* Frames are due every 10 ms, give them time to time out */
+  g_usleep (MIX_MINUS_BUFFERS * 50 * G_TIME_SPAN_MILLISECOND);
+
+  for (i = 0; i < MIX_MINUS_INPUTS; i++) {
+    fail_unless (g_atomic_int_get (&outputs[i].buffers) ==
+        MIX_MINUS_BUFFERS, "src_%u stopped with a stalled input", i);
+    fail_unless (outputs[i].valid, "Wrong mix on src_%u", i);
+  }
+
+  {
+    GstFlowReturn ret;
+
+    g_signal_emit_by_name (srcs[stalled], "end-of-stream", &ret);
+  }
+
+  msg = gst_bus_timed_pop_filtered (bus, 5 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+  fail_unless (msg != NULL, "Timeout waiting for EOS");
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS,
+      "Error running pipeline");
+  gst_message_unref (msg);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+}
+
+GST_END_TEST
+static void
+link_fakesink_cb (GstElement * element, GstPad * pad, gpointer data)
+{
+  GstElement *pipeline = GST_ELEMENT (data);
+  GstElement *sink;
+  GstPad *sinkpad;
+
+  if (gst_pad_get_direction (pad) != GST_PAD_SRC)
+    return;
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (G_OBJECT (sink), "sync", FALSE, "async", FALSE, NULL);
+  gst_bin_add (GST_BIN (pipeline), sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  fail_unless (gst_pad_link (pad, sinkpad) == GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+
+  gst_element_sync_state_with_parent (sink);
+}
+
+#ifdef BENCHMARK_CHECK
+/* Buffers of 10 ms pushed by each participant in the benchmark */
+#define BENCHMARK_BUFFERS 500
+#define BENCHMARK_TIMEOUT (120 * GST_SECOND)
+
+static gint64
+get_cpu_time (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  return (gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+      G_USEC_PER_SEC + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* Returns the CPU time in microseconds used to mix all the buffers */
+static gint64
+run_mixer_benchmark (guint participants, gboolean mix_minus)
+{
+  GstElement *pipeline, *audiomixer;
+  gint64 cpu, wall;
+  GstMessage *msg;
+  GstBus *bus;
+  guint i;
+
+  pipeline = gst_pipeline_new (NULL);
+  audiomixer = gst_element_factory_make ("kmsaudiomixer", NULL);
+  g_object_set (G_OBJECT (audiomixer), "mix-minus", mix_minus, NULL);
+  g_signal_connect (audiomixer, "pad-added",
+      G_CALLBACK (link_fakesink_cb), pipeline);
+  gst_bin_add (GST_BIN (pipeline), audiomixer);
+
+  for (i = 0; i < participants; i++) {
+    GstElement *audiotestsrc = gst_element_factory_make ("audiotestsrc", NULL);
+    GstElement *capsfilter = gst_element_factory_make ("capsfilter", NULL);
+    GstCaps *caps;
+
+    caps = gst_caps_from_string ("audio/x-raw,format=S16LE,rate=48000,"
+        "channels=1");
+    g_object_set (G_OBJECT (capsfilter), "caps", caps, NULL);
+    gst_caps_unref (caps);
+
+    g_object_set (G_OBJECT (audiotestsrc), "num-buffers", BENCHMARK_BUFFERS,
+        "samplesperbuffer", 480, "wave", i % 12, NULL);
+
+    gst_bin_add_many (GST_BIN (pipeline), audiotestsrc, capsfilter, NULL);
+    gst_element_link (audiotestsrc, capsfilter);
+    fail_unless (gst_element_link (capsfilter, audiomixer));
+  }
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  wall = g_get_monotonic_time ();
+  cpu = get_cpu_time ();
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (bus, BENCHMARK_TIMEOUT,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+  cpu = get_cpu_time () - cpu;
+  wall = g_get_monotonic_time () - wall;
+
+  fail_unless (msg != NULL, "Benchmark timed out");
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS,
+      "Error running benchmark");
+  gst_message_unref (msg);
+
+  g_print ("%s: %u participants, cpu %" G_GINT64_FORMAT " ms, wall %"
+      G_GINT64_FORMAT " ms\n", mix_minus ? "mix-minus" : "adders",
+      participants, cpu / 1000, wall / 1000);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+
+  return cpu;
+}
+
+GST_START_TEST (benchmark_mix_minus)
+{
+  guint participants[] = { 4, 16, 64 };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (participants); i++) {
+    gint64 adders, mix_minus;
+
+    adders = run_mixer_benchmark (participants[i], FALSE);
+    mix_minus = run_mixer_benchmark (participants[i], TRUE);
+
+    g_print ("%u participants: mix-minus uses %.2f%% of the adders CPU\n",
+        participants[i], adders > 0 ? 100.0 * mix_minus / adders : 0.0);
+  }
+}
+
+GST_END_TEST
+#endif
+static gboolean
+only_input_active (const GstStructure * st, const gchar * padname)
+{
+  const GValue *inputs, *input;
+
+  inputs = gst_structure_get_value (st, "inputs");
+
+  if (inputs == NULL || gst_value_array_get_size (inputs) != 1) {
+    return FALSE;
+  }
+
+  input = gst_value_array_get_value (inputs, 0);
+
+  return g_strcmp0 (g_value_get_string (input), padname) == 0;
+}
+
+GST_START_TEST (check_loudest_input_selection)
+{
+  GstElement *pipeline, *audiomixer;
+  gboolean selected = FALSE;
+  GstMessage *msg;
+  GstBus *bus;
+  guint i;
+
+  pipeline = gst_pipeline_new (NULL);
+  audiomixer = gst_element_factory_make ("kmsaudiomixer", NULL);
+  g_object_set (G_OBJECT (audiomixer), "max-active-inputs", 1, NULL);
+  g_signal_connect (audiomixer, "pad-added",
+      G_CALLBACK (link_fakesink_cb), pipeline);
+  gst_bin_add (GST_BIN (pipeline), audiomixer);
+
+  for (i = 0; i < 3; i++) {
+    GstElement *audiotestsrc = gst_element_factory_make ("audiotestsrc", NULL);
+
+    /* Only the first input (sink_0) is not silent */
+    g_object_set (G_OBJECT (audiotestsrc), "is-live", TRUE, "wave",
+        i == 0 ? 0 : 4, NULL);
+    gst_bin_add (GST_BIN (pipeline), audiotestsrc);
+    fail_unless (gst_element_link (audiotestsrc, audiomixer));
+  }
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  while (!selected && (msg = gst_bus_timed_pop_filtered (bus,
+              5 * GST_SECOND, GST_MESSAGE_ELEMENT | GST_MESSAGE_ERROR))) {
+    const GstStructure *st = gst_message_get_structure (msg);
+
+    fail_if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR,
+        "Error running pipeline");
+
+    if (gst_structure_has_name (st, "active-inputs")) {
+      GST_DEBUG ("Active inputs: %" GST_PTR_FORMAT, st);
+      selected = only_input_active (st, "sink_0");
+    }
+
+    gst_message_unref (msg);
+  }
+
+  fail_unless (selected, "Loudest input was not selected");
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+}
+
 GST_END_TEST
 /******************************/
 /* audiomixer test suit */
@@ -495,6 +951,16 @@ audiomixer_suite (void)
 
   tcase_add_test (tc_chain, check_audio_connection);
   tcase_add_test (tc_chain, check_audio_disconnection);
+  tcase_add_test (tc_chain, check_loudest_input_selection);
+  tcase_add_test (tc_chain, check_mix_minus_excludes_own_input);
+  tcase_add_test (tc_chain, check_mix_minus_skips_stalled_input);
+
+#ifdef BENCHMARK_CHECK
+  tc_chain = tcase_create ("benchmark");
+  tcase_set_timeout (tc_chain, 6 * BENCHMARK_TIMEOUT / GST_SECOND);
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, benchmark_mix_minus);
+#endif
 
   return s;
 }
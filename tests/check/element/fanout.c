@@ -0,0 +1,206 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#define N_OUTPUTS 8
+#define N_BUFFERS 40
+
+#define SLOW_SINK_DELAY (50 * G_TIME_SPAN_MILLISECOND)
+
+static void
+count_buffer (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gpointer data)
+{
+  g_atomic_int_inc ((gint *) data);
+}
+
+static void
+delay_buffer (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gpointer data)
+{
+  g_atomic_int_inc ((gint *) data);
+  g_usleep (SLOW_SINK_DELAY);
+}
+
+static GstElement *
+add_output (GstElement * pipeline, GstElement * fanout, GCallback handoff,
+    gint * count)
+{
+  GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+
+  g_object_set (fakesink, "sync", FALSE, "async", FALSE, "signal-handoffs",
+      TRUE, NULL);
+  g_signal_connect (fakesink, "handoff", handoff, count);
+
+  gst_bin_add (GST_BIN (pipeline), fakesink);
+  fail_unless (gst_element_link (fanout, fakesink));
+
+  return fakesink;
+}
+
+static void
+run_until_eos (GstElement * pipeline)
+{
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstMessage *msg;
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+  fail_unless (msg != NULL, "Timeout waiting for EOS");
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS,
+      "Error received on bus");
+
+  gst_message_unref (msg);
+  g_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+}
+
+GST_START_TEST (check_all_outputs)
+{
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *src = gst_element_factory_make ("audiotestsrc", NULL);
+  GstElement *fanout = gst_element_factory_make ("kmsfanout", NULL);
+  gint counts[N_OUTPUTS] = { 0, };
+  guint i;
+
+  g_object_set (src, "num-buffers", N_BUFFERS, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), src, fanout, NULL);
+  gst_element_link (src, fanout);
+
+  for (i = 0; i < N_OUTPUTS; i++) {
+    add_output (pipeline, fanout, G_CALLBACK (count_buffer), &counts[i]);
+  }
+
+  /* The ring is big enough for every output to get all buffers */
+  g_object_set (fanout, "max-size-buffers", N_BUFFERS, NULL);
+
+  run_until_eos (pipeline);
+
+  for (i = 0; i < N_OUTPUTS; i++) {
+    GST_DEBUG ("Output %u received %d buffers", i, counts[i]);
+    fail_unless (counts[i] == N_BUFFERS);
+  }
+
+  g_object_unref (pipeline);
+}
+
+GST_END_TEST
+GST_START_TEST (check_slow_output)
+{
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *src = gst_element_factory_make ("audiotestsrc", NULL);
+  GstElement *fanout = gst_element_factory_make ("kmsfanout", NULL);
+  gint fast = 0, slow = 0;
+
+  g_object_set (src, "num-buffers", N_BUFFERS, "is-live", TRUE, NULL);
+  g_object_set (fanout, "max-size-buffers", 4, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), src, fanout, NULL);
+  gst_element_link (src, fanout);
+
+  add_output (pipeline, fanout, G_CALLBACK (delay_buffer), &slow);
+  add_output (pipeline, fanout, G_CALLBACK (count_buffer), &fast);
+
+  run_until_eos (pipeline);
+
+  GST_DEBUG ("Slow output received %d buffers, fast one %d", slow, fast);
+
+  /* The slow output drops, it does not slow down the other one */
+  fail_unless (slow < N_BUFFERS);
+
+  if (g_get_num_processors () > 1) {
+    fail_unless (fast == N_BUFFERS);
+  }
+
+  g_object_unref (pipeline);
+}
+
+GST_END_TEST
+GST_START_TEST (check_pad_names)
+{
+  GstElement *fanout = gst_element_factory_make ("kmsfanout", NULL);
+  GstPad *named, *automatic;
+
+  named = gst_element_get_request_pad (fanout, "src_5");
+  fail_unless (named != NULL);
+
+  /* Automatic names never clash with the ones picked by the caller */
+  automatic = gst_element_get_request_pad (fanout, "src_%u");
+  fail_unless (automatic != NULL);
+  fail_unless (g_strcmp0 (GST_OBJECT_NAME (automatic), "src_6") == 0);
+
+  fail_unless (gst_element_get_request_pad (fanout, "src_5") == NULL);
+
+  gst_element_release_request_pad (fanout, named);
+  gst_element_release_request_pad (fanout, automatic);
+  g_object_unref (named);
+  g_object_unref (automatic);
+  g_object_unref (fanout);
+}
+
+GST_END_TEST
+GST_START_TEST (check_no_outputs_keeps_nothing)
+{
+  static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+      GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+  GstElement *fanout = gst_element_factory_make ("kmsfanout", NULL);
+  GstSegment segment;
+  GstBuffer *buffer;
+  GstPad *src;
+
+  src = gst_check_setup_src_pad (fanout, &src_template);
+  gst_pad_set_active (src, TRUE);
+  fail_unless (gst_element_set_state (fanout, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (src, gst_event_new_stream_start ("test")));
+  fail_unless (gst_pad_push_event (src, gst_event_new_segment (&segment)));
+
+  buffer = gst_buffer_new_and_alloc (16);
+  fail_unless (gst_pad_push (src, gst_buffer_ref (buffer)) == GST_FLOW_OK);
+
+  /* Without outputs the ring does not pin the buffer */
+  ASSERT_MINI_OBJECT_REFCOUNT (buffer, "buffer", 1);
+  gst_buffer_unref (buffer);
+
+  gst_element_set_state (fanout, GST_STATE_NULL);
+  gst_pad_set_active (src, FALSE);
+  gst_check_teardown_src_pad (fanout);
+  g_object_unref (fanout);
+}
+
+GST_END_TEST
+/* Suite initialization */
+static Suite *
+fanout_suite (void)
+{
+  Suite *s = suite_create ("fanout");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, check_all_outputs);
+  tcase_add_test (tc_chain, check_slow_output);
+  tcase_add_test (tc_chain, check_pad_names);
+  tcase_add_test (tc_chain, check_no_outputs_keeps_nothing);
+
+  return s;
+}
+
+GST_CHECK_MAIN (fanout);
@@ -0,0 +1,158 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib.h>
+
+#include "kmsloop.h"
+
+#define N_SOURCES 100
+
+static GMutex mutex;
+static GCond cond;
+static guint pending;
+
+typedef struct _LoopData
+{
+  KmsLoop *loop;
+  guint last;
+  gboolean ordered;
+} LoopData;
+
+typedef struct _SourceData
+{
+  LoopData *loop_data;
+  guint index;
+} SourceData;
+
+static gboolean
+check_order (SourceData * data)
+{
+  LoopData *loop_data = data->loop_data;
+
+  if (data->index != loop_data->last + 1) {
+    loop_data->ordered = FALSE;
+  }
+
+  loop_data->last = data->index;
+
+  g_mutex_lock (&mutex);
+  if (--pending == 0) {
+    g_cond_signal (&cond);
+  }
+  g_mutex_unlock (&mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+source_data_free (SourceData * data)
+{
+  g_slice_free (SourceData, data);
+}
+
+GST_START_TEST (pooled_ordering)
+{
+  guint n_loops = 4 * g_get_num_processors ();
+  LoopData *loops = g_new0 (LoopData, n_loops);
+  guint i, j;
+
+  g_mutex_init (&mutex);
+  g_cond_init (&cond);
+  pending = n_loops * N_SOURCES;
+
+  for (i = 0; i < n_loops; i++) {
+    loops[i].loop = kms_loop_new_pooled ();
+    loops[i].ordered = TRUE;
+  }
+
+  /* Interleave the sources of every loop over the shared threads */
+  for (j = 1; j <= N_SOURCES; j++) {
+    for (i = 0; i < n_loops; i++) {
+      SourceData *data = g_slice_new (SourceData);
+
+      data->loop_data = &loops[i];
+      data->index = j;
+      fail_if (kms_loop_idle_add_full (loops[i].loop, G_PRIORITY_DEFAULT,
+              (GSourceFunc) check_order, data,
+              (GDestroyNotify) source_data_free) == 0);
+    }
+  }
+
+  g_mutex_lock (&mutex);
+  while (pending > 0) {
+    g_cond_wait (&cond, &mutex);
+  }
+  g_mutex_unlock (&mutex);
+
+  for (i = 0; i < n_loops; i++) {
+    fail_unless (loops[i].ordered);
+    fail_unless (loops[i].last == N_SOURCES);
+    g_object_unref (loops[i].loop);
+  }
+
+  g_free (loops);
+  g_cond_clear (&cond);
+  g_mutex_clear (&mutex);
+}
+
+GST_END_TEST static gboolean
+unexpected_timeout (gpointer data)
+{
+  fail ("Source of a disposed loop executed");
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+mark_destroyed (gboolean * destroyed)
+{
+  *destroyed = TRUE;
+}
+
+GST_START_TEST (pooled_dispose)
+{
+  KmsLoop *loop = kms_loop_new_pooled ();
+  gboolean destroyed = FALSE;
+
+  fail_if (kms_loop_timeout_add_full (loop, G_PRIORITY_DEFAULT, 60000,
+          unexpected_timeout, &destroyed,
+          (GDestroyNotify) mark_destroyed) == 0);
+
+  g_object_run_dispose (G_OBJECT (loop));
+
+  /* Pending sources are dropped and new ones are refused */
+  fail_unless (destroyed);
+  fail_unless (kms_loop_idle_add (loop, unexpected_timeout, NULL) == 0);
+
+  g_object_unref (loop);
+}
+
+GST_END_TEST
+/* Suite initialization */
+static Suite *
+loop_suite (void)
+{
+  Suite *s = suite_create ("loop");
+  TCase *tc_chain = tcase_create ("pooled");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, pooled_ordering);
+  tcase_add_test (tc_chain, pooled_dispose);
+
+  return s;
+}
+
+GST_CHECK_MAIN (loop);
@@ -34,6 +34,36 @@ GST_START_TEST (check_urls)
 
 }
 
+GST_END_TEST
+GST_START_TEST (check_factories_ignore_session_fields)
+{
+  GstCaps *caps1, *caps2;
+  GList *list1, *list2, *l1, *l2;
+
+  caps1 = gst_caps_from_string ("application/x-rtp, media=(string)audio, "
+      "encoding-name=(string)OPUS, clock-rate=(int)48000, payload=(int)96, "
+      "ssrc=(uint)1, seqnum-base=(uint)10");
+  caps2 = gst_caps_from_string ("application/x-rtp, media=(string)audio, "
+      "encoding-name=(string)OPUS, clock-rate=(int)48000, payload=(int)111, "
+      "ssrc=(uint)2, clock-base=(uint)20");
+
+  list1 = kms_utils_get_element_factories_for_caps
+      (GST_ELEMENT_FACTORY_TYPE_DEPAYLOADER, caps1, NULL);
+  list2 = kms_utils_get_element_factories_for_caps
+      (GST_ELEMENT_FACTORY_TYPE_DEPAYLOADER, caps2, NULL);
+
+  fail_unless (g_list_length (list1) == g_list_length (list2));
+
+  for (l1 = list1, l2 = list2; l1 != NULL; l1 = l1->next, l2 = l2->next) {
+    fail_unless (l1->data == l2->data);
+  }
+
+  gst_plugin_feature_list_free (list1);
+  gst_plugin_feature_list_free (list2);
+  gst_caps_unref (caps1);
+  gst_caps_unref (caps2);
+}
+
 GST_END_TEST
 /* Suite initialization */
 static Suite *
@@ -44,6 +74,7 @@ utils_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, check_urls);
+  tcase_add_test (tc_chain, check_factories_ignore_session_fields);
 
   return s;
 }
@@ -22,6 +22,8 @@
 #include <Fraction.hpp>
 #include <gst/gst.h>
 #include <MediaSet.hpp>
+#include <RpcCodec.hpp>
+#include <chrono>
 
 using namespace kurento;
 
@@ -85,3 +87,117 @@ BOOST_AUTO_TEST_CASE (complex_type)
   kurento::MediaSet::getMediaSet()->release (std::dynamic_pointer_cast
       <MediaObjectImpl> (mediaPipeline) );
 }
+
+static Json::Value
+parseJson (const std::string &text)
+{
+  Json::Value value;
+  Json::Reader reader;
+
+  BOOST_REQUIRE (reader.parse (text, value) );
+
+  return value;
+}
+
+/* Encoded and decoded messages per second */
+static double
+measureCodec (const RpcCodec &codec, const Json::Value &message,
+              size_t &encodedSize)
+{
+  const int ITERATIONS = 5000;
+  std::string encoded;
+  Json::Value decoded;
+
+  auto start = std::chrono::steady_clock::now ();
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    encoded.clear ();
+    codec.encode (message, encoded);
+    codec.decode (encoded.data (), encoded.size (), decoded);
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () -
+                                          start;
+
+  BOOST_CHECK (decoded == message);
+  encodedSize = encoded.size ();
+
+  return ITERATIONS / elapsed.count ();
+}
+
+BOOST_AUTO_TEST_CASE (rpc_codecs)
+{
+  std::string stats;
+  std::string connections;
+
+  for (int i = 0; i < 8; i++) {
+    std::string id = std::to_string (i);
+
+    stats += std::string (i > 0 ? "," : "") + "\"inbound" + id + "\": {"
+             "\"id\": \"inbound" + id + "\", \"type\": \"inboundrtp\", "
+             "\"timestamp\": 1437491234.123, \"ssrc\": \"" + id + "12345678\", "
+             "\"isRemote\": false, \"mediaTrackId\": \"\", "
+             "\"transportId\": \"\", \"codecId\": \"\", "
+             "\"firCount\": 3, \"pliCount\": 12, \"nackCount\": 40, "
+             "\"sliCount\": 0, \"remb\": 0, \"packetsLost\": -2, "
+             "\"fractionLost\": 0.015, \"packetsReceived\": 102345, "
+             "\"bytesReceived\": 123456789, \"jitter\": 0.0034, "
+             "\"bitrate\": 1500000.5, \"packetLossRate\": 0.001, "
+             "\"jitterTrend\": -0.0001}";
+    connections += std::string (i > 0 ? "," : "") + "{"
+                   "\"source\": \"a0b1c2d3_kurento.MediaPipeline/e4f5_kurento.WebRtcEndpoint\", "
+                   "\"sink\": \"a0b1c2d3_kurento.MediaPipeline/f6a7_kurento.WebRtcEndpoint\", "
+                   "\"type\": \"VIDEO\", \"sourceDescription\": \"default\", "
+                   "\"sinkDescription\": \"default\"}";
+  }
+
+  std::vector<std::pair<std::string, Json::Value>> payloads = {
+    {
+      "invoke", parseJson ("{\"jsonrpc\": \"2.0\", \"id\": 17, "
+      "\"method\": \"invoke\", \"params\": {\"object\": "
+      "\"a0b1c2d3_kurento.MediaPipeline/e4f5_kurento.WebRtcEndpoint\", "
+      "\"operation\": \"connect\", \"operationParams\": {\"sink\": "
+      "\"a0b1c2d3_kurento.MediaPipeline/f6a7_kurento.WebRtcEndpoint\"}, "
+      "\"sessionId\": \"9f8e7d6c\"}}")
+    },
+    {
+      "stats", parseJson ("{\"jsonrpc\": \"2.0\", \"id\": 18, "
+      "\"result\": {\"value\": {" + stats + "}, "
+      "\"sessionId\": \"9f8e7d6c\"}}")
+    },
+    {
+      "connections", parseJson ("{\"jsonrpc\": \"2.0\", \"id\": 19, "
+      "\"result\": {\"value\": [" + connections + "], "
+      "\"sessionId\": \"9f8e7d6c\"}}")
+    }
+  };
+
+  BOOST_CHECK (RpcCodec::negotiate ({"msgpack", "cbor", "json"})->getName () ==
+               RpcCodec::CBOR);
+  BOOST_CHECK (RpcCodec::negotiate ({"msgpack"})->getName () == RpcCodec::JSON);
+  BOOST_CHECK (!RpcCodec::get ("msgpack") );
+
+  for (auto &payload : payloads) {
+    size_t jsonSize, cborSize;
+    double json = measureCodec (*RpcCodec::get (RpcCodec::JSON), payload.second,
+                                jsonSize);
+    double cbor = measureCodec (*RpcCodec::get (RpcCodec::CBOR), payload.second,
+                                cborSize);
+
+    BOOST_TEST_MESSAGE (payload.first << " messages/s: json " << json << " ("
+                        << jsonSize << " bytes), cbor " << cbor << " (" << cborSize
+                        << " bytes)");
+    BOOST_CHECK (cborSize < jsonSize);
+
+    /* Truncated messages are rejected, never read out of bounds */
+    std::string encoded;
+    RpcCodec::get (RpcCodec::CBOR)->encode (payload.second, encoded);
+
+    for (size_t len = 0; len < encoded.size (); len += 7) {
+      Json::Value decoded;
+
+      BOOST_CHECK_THROW (RpcCodec::get (RpcCodec::CBOR)->decode (encoded.data (),
+                         len, decoded), KurentoException);
+    }
+  }
+}
@@ -0,0 +1,156 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE EventDispatcher
+#include <boost/test/unit_test.hpp>
+#include <EventDispatcher.hpp>
+
+#include <atomic>
+#include <future>
+#include <vector>
+
+using namespace kurento;
+
+static const ObjectHandle QUEUE = 1;
+static const ObjectHandle SOURCE = 2;
+static const ObjectHandle OTHER_SOURCE = 3;
+
+/* Keeps the only worker busy until the returned promise is set */
+static std::shared_ptr<std::promise<void>>
+blockQueue (EventDispatcher &dispatcher)
+{
+  std::shared_ptr<std::promise<void>> release (new std::promise<void> () );
+  std::shared_future<void> released = release->get_future ().share ();
+  std::promise<void> started;
+
+  dispatcher.post (QUEUE, [released, &started] () {
+    started.set_value ();
+    released.wait ();
+  });
+
+  started.get_future ().wait ();
+
+  return release;
+}
+
+static void
+waitDelivered (EventDispatcher &dispatcher)
+{
+  std::promise<void> done;
+
+  dispatcher.post (QUEUE, QUEUE, "", [&done] () {
+    done.set_value ();
+  }, EventDispatcher::RELIABLE);
+
+  done.get_future ().wait ();
+}
+
+BOOST_AUTO_TEST_CASE (reliable_events_are_not_dropped)
+{
+  EventDispatcher dispatcher (1);
+  std::atomic<int> reliable (0);
+  std::atomic<int> droppable (0);
+  auto release = blockQueue (dispatcher);
+
+  for (size_t i = 0; i < EventDispatcher::QUEUE_CAPACITY; i++) {
+    dispatcher.post (QUEUE, SOURCE, "Error", [&reliable] () {
+      reliable++;
+    }, EventDispatcher::RELIABLE);
+  }
+
+  /* The queue is full of reliable events, droppable ones are discarded */
+  dispatcher.post (QUEUE, SOURCE, "StatsUpdated", [&droppable] () {
+    droppable++;
+  });
+
+  dispatcher.post (QUEUE, SOURCE, "Error", [&reliable] () {
+    reliable++;
+  }, EventDispatcher::RELIABLE);
+
+  release->set_value ();
+  waitDelivered (dispatcher);
+
+  BOOST_CHECK_EQUAL (reliable, (int) EventDispatcher::QUEUE_CAPACITY + 1);
+  BOOST_CHECK_EQUAL (droppable, 0);
+  BOOST_CHECK_EQUAL (dispatcher.getDropped (SOURCE, "StatsUpdated"), 1);
+  BOOST_CHECK_EQUAL (dispatcher.getDropped (SOURCE, "Error"), 0);
+}
+
+BOOST_AUTO_TEST_CASE (drops_are_accounted_by_source_and_type)
+{
+  EventDispatcher dispatcher (1);
+  auto release = blockQueue (dispatcher);
+
+  for (size_t i = 0; i < EventDispatcher::QUEUE_CAPACITY; i++) {
+    dispatcher.post (QUEUE, SOURCE, "ElementConnected", [] () {});
+  }
+
+  /* Both sources share the queue of their pipeline */
+  dispatcher.post (QUEUE, OTHER_SOURCE, "ElementConnected", [] () {});
+  dispatcher.post (QUEUE, OTHER_SOURCE, "ElementConnected", [] () {});
+
+  release->set_value ();
+  waitDelivered (dispatcher);
+
+  BOOST_CHECK_EQUAL (dispatcher.getDropped (SOURCE, "ElementConnected"), 3);
+  BOOST_CHECK_EQUAL (dispatcher.getDropped (OTHER_SOURCE, "ElementConnected"),
+                     0);
+  BOOST_CHECK_EQUAL (dispatcher.getDropped (), 3);
+
+  dispatcher.forget (SOURCE);
+  BOOST_CHECK_EQUAL (dispatcher.getDropped (SOURCE, "ElementConnected"), 0);
+}
+
+BOOST_AUTO_TEST_CASE (coalesced_events_keep_their_place)
+{
+  EventDispatcher dispatcher (1);
+  std::vector<int> delivered;
+  auto release = blockQueue (dispatcher);
+
+  dispatcher.post (QUEUE, SOURCE, "MediaStateChanged", [&delivered] () {
+    delivered.push_back (1);
+  }, EventDispatcher::COALESCE);
+  dispatcher.post (QUEUE, SOURCE, "ElementConnected", [&delivered] () {
+    delivered.push_back (2);
+  });
+  dispatcher.post (QUEUE, SOURCE, "MediaStateChanged", [&delivered] () {
+    delivered.push_back (3);
+  }, EventDispatcher::COALESCE);
+
+  release->set_value ();
+  waitDelivered (dispatcher);
+
+  BOOST_REQUIRE_EQUAL (delivered.size (), 2);
+  BOOST_CHECK_EQUAL (delivered[0], 3);
+  BOOST_CHECK_EQUAL (delivered[1], 2);
+  BOOST_CHECK_EQUAL (dispatcher.getCoalesced (), 1);
+}
+
+BOOST_AUTO_TEST_CASE (shutdown_joins_workers)
+{
+  EventDispatcher dispatcher (2);
+  std::atomic<int> delivered (0);
+
+  waitDelivered (dispatcher);
+  dispatcher.shutdown ();
+
+  /* Discarded once the workers are gone */
+  dispatcher.post (QUEUE, [&delivered] () {
+    delivered++;
+  });
+
+  BOOST_CHECK_EQUAL (delivered, 0);
+}
@@ -19,11 +19,21 @@
 #include <MediaPipelineImpl.hpp>
 #include <MediaElementImpl.hpp>
 #include <ElementConnectionData.hpp>
+#include <ElementConnected.hpp>
+#include <ElementDisconnected.hpp>
 #include <MediaType.hpp>
 #include <KurentoException.hpp>
 #include <GstreamerDotDetails.hpp>
+#include <GstreamerGraphFormat.hpp>
 #include <MediaSet.hpp>
 #include <ModuleManager.hpp>
+#include <ElementPool.hpp>
+#include <EventDispatcher.hpp>
+
+#include <thread>
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
 
 using namespace kurento;
 
@@ -62,6 +72,18 @@ createDummyElement (const std::string &name, const std::string &mediaPipelineId)
   return element;
 }
 
+/* Events are raised asynchronously, wait until @done or time out */
+template <typename F>
+static bool
+waitFor (F done)
+{
+  for (int i = 0; i < 500 && !done (); i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (10) );
+  }
+
+  return done ();
+}
+
 static void
 releaseMediaObject (const std::string &id)
 {
@@ -99,6 +121,9 @@ BOOST_AUTO_TEST_CASE (connection_test)
   connections = src->getSinkConnections ();
   BOOST_CHECK (connections.size() == 2);
 
+  /* Connections are served from a snapshot until they change */
+  BOOST_CHECK (src->getSinkConnections ().at (0) == connections.at (0) );
+
   for (auto it : connections) {
     BOOST_CHECK (it->getSource()->getId() == src->getId() );
   }
@@ -203,6 +228,217 @@ BOOST_AUTO_TEST_CASE (loopback)
   duplex.reset();
 }
 
+BOOST_AUTO_TEST_CASE (crossed_connections)
+{
+  const int ITERATIONS = 200;
+  std::string mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+  std::shared_ptr <MediaPipelineImpl> pipe = std::dynamic_pointer_cast
+      <MediaPipelineImpl> (MediaSet::getMediaSet()->getMediaObject (
+                             mediaPipelineId) );
+  std::shared_ptr <MediaElementImpl> first = createDummyElement ("dummyduplex",
+      mediaPipelineId);
+  std::shared_ptr <MediaElementImpl> second = createDummyElement ("dummyduplex",
+      mediaPipelineId);
+  uint64_t connects = pipe->getConnectLatency().getCount();
+
+  for (auto elem : {
+         first, second
+       }) {
+    g_object_set (elem->getGstreamerElement(), "src-audio", TRUE, "src-video",
+                  TRUE, "sink-audio", TRUE, "sink-video", TRUE, NULL);
+  }
+
+  /* Each thread locks the elements in the opposite order */
+  auto crossConnect = [ITERATIONS] (std::shared_ptr <MediaElementImpl> src,
+  std::shared_ptr <MediaElementImpl> sink) {
+    for (int i = 0; i < ITERATIONS; i++) {
+      src->connect (sink);
+      src->getSinkConnections ();
+      src->disconnect (sink);
+    }
+  };
+
+  std::thread t1 (crossConnect, first, second);
+  std::thread t2 (crossConnect, second, first);
+
+  t1.join();
+  t2.join();
+
+  BOOST_CHECK (first->getSinkConnections().empty() );
+  BOOST_CHECK (second->getSinkConnections().empty() );
+  /* connect (sink) connects audio and video */
+  BOOST_CHECK (pipe->getConnectLatency().getCount() - connects ==
+               4 * ITERATIONS);
+
+  BOOST_TEST_MESSAGE ("Connect p99 " <<
+                      pipe->getConnectLatency().getPercentile (99) <<
+                      " us, disconnect p99 " <<
+                      pipe->getDisconnectLatency().getPercentile (99) << " us");
+
+  releaseMediaObject (first->getId() );
+  releaseMediaObject (second->getId() );
+  releaseMediaObject (mediaPipelineId);
+
+  first.reset();
+  second.reset();
+  pipe.reset();
+}
+
+BOOST_AUTO_TEST_CASE (batch_connections)
+{
+  /* More events than fit in the event queue of the pipeline */
+  const int N_SINKS = EventDispatcher::QUEUE_CAPACITY / 2 + 10;
+  std::string mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+  std::string otherPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+  std::shared_ptr <MediaPipelineImpl> pipe = std::dynamic_pointer_cast
+      <MediaPipelineImpl> (MediaSet::getMediaSet()->getMediaObject (
+                             mediaPipelineId) );
+  std::shared_ptr <MediaElementImpl> src = createDummyElement ("dummysrc",
+      mediaPipelineId);
+  std::shared_ptr <MediaElementImpl> foreign = createDummyElement ("dummysink",
+      otherPipelineId);
+  std::vector<std::shared_ptr <MediaElementImpl>> sinks;
+  std::vector<std::shared_ptr <ElementConnectionData>> connections;
+  std::shared_ptr <MediaType> VIDEO (new MediaType (MediaType::VIDEO) );
+  std::shared_ptr <MediaType> AUDIO (new MediaType (MediaType::AUDIO) );
+  std::atomic<int> connected (0);
+  std::atomic<int> disconnected (0);
+
+  src->signalElementConnected.connect ([&connected] (ElementConnected event) {
+    connected++;
+  });
+  src->signalElementDisconnected.connect ([&disconnected] (
+  ElementDisconnected event) {
+    disconnected++;
+  });
+
+  for (int i = 0; i < N_SINKS; i++) {
+    std::shared_ptr <MediaElementImpl> sink = createDummyElement ("dummysink",
+        mediaPipelineId);
+
+    sinks.push_back (sink);
+    connections.push_back (std::shared_ptr <ElementConnectionData> (
+                             new ElementConnectionData (src, sink, AUDIO, "", "") ) );
+    connections.push_back (std::shared_ptr <ElementConnectionData> (
+                             new ElementConnectionData (src, sink, VIDEO, "", "") ) );
+  }
+
+  /* One invalid connection makes the whole batch fail */
+  std::vector<std::shared_ptr <ElementConnectionData>> invalid = connections;
+  invalid.push_back (std::shared_ptr <ElementConnectionData> (
+                       new ElementConnectionData (src, foreign, AUDIO, "", "") ) );
+
+  BOOST_CHECK_THROW (pipe->connectElements (invalid), KurentoException);
+  BOOST_CHECK (src->getSinkConnections().empty() );
+  BOOST_CHECK (connected == 0);
+
+  pipe->connectElements (connections);
+  BOOST_CHECK (src->getSinkConnections().size() == 2 * N_SINKS);
+  BOOST_CHECK (waitFor ([&connected] () {
+    return connected == 2 * N_SINKS;
+  }) );
+
+  for (auto sink : sinks) {
+    BOOST_CHECK (sink->getSourceConnections().size() == 2);
+  }
+
+  pipe->disconnectElements (connections);
+  BOOST_CHECK (src->getSinkConnections().empty() );
+  BOOST_CHECK (waitFor ([&disconnected] () {
+    return disconnected == 2 * N_SINKS;
+  }) );
+
+  for (auto sink : sinks) {
+    releaseMediaObject (sink->getId() );
+  }
+
+  releaseMediaObject (src->getId() );
+  releaseMediaObject (foreign->getId() );
+  releaseMediaObject (mediaPipelineId);
+  releaseMediaObject (otherPipelineId);
+
+  sinks.clear();
+  src.reset();
+  foreign.reset();
+  pipe.reset();
+}
+
+BOOST_AUTO_TEST_CASE (batch_replaced_connections)
+{
+  std::string mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+  std::shared_ptr <MediaPipelineImpl> pipe = std::dynamic_pointer_cast
+      <MediaPipelineImpl> (MediaSet::getMediaSet()->getMediaObject (
+                             mediaPipelineId) );
+  std::shared_ptr <MediaElementImpl> src1 = createDummyElement ("dummysrc",
+      mediaPipelineId);
+  std::shared_ptr <MediaElementImpl> src2 = createDummyElement ("dummysrc",
+      mediaPipelineId);
+  std::shared_ptr <MediaElementImpl> sink = createDummyElement ("dummysink",
+      mediaPipelineId);
+  std::shared_ptr <MediaType> AUDIO (new MediaType (MediaType::AUDIO) );
+  std::shared_ptr <ElementConnectionData> first (new ElementConnectionData (
+        src1, sink, AUDIO, "", "") );
+  std::shared_ptr <ElementConnectionData> second (new ElementConnectionData (
+        src2, sink, AUDIO, "", "") );
+  std::atomic<int> disconnected (0);
+
+  src1->signalElementDisconnected.connect ([&disconnected] (
+  ElementDisconnected event) {
+    disconnected++;
+  });
+  src2->signalElementDisconnected.connect ([&disconnected] (
+  ElementDisconnected event) {
+    disconnected++;
+  });
+
+  pipe->connectElements ({first});
+
+  /* Both feed the same sink pad, the batch is rejected before any change */
+  BOOST_CHECK_THROW (pipe->connectElements ({first, second}), KurentoException);
+  BOOST_REQUIRE (sink->getSourceConnections().size() == 1);
+  BOOST_CHECK (sink->getSourceConnections().at (0)->getSource() == src1);
+
+  /* Replacing a connection raises its disconnection */
+  pipe->connectElements ({second});
+  BOOST_REQUIRE (sink->getSourceConnections().size() == 1);
+  BOOST_CHECK (sink->getSourceConnections().at (0)->getSource() == src2);
+  BOOST_CHECK (src1->getSinkConnections().empty() );
+  BOOST_CHECK (waitFor ([&disconnected] () {
+    return disconnected == 1;
+  }) );
+
+  /* Only connections that existed are reported as disconnected */
+  pipe->disconnectElements ({first, second});
+  BOOST_CHECK (sink->getSourceConnections().empty() );
+  BOOST_CHECK (waitFor ([&disconnected] () {
+    return disconnected == 2;
+  }) );
+  std::this_thread::sleep_for (std::chrono::milliseconds (100) );
+  BOOST_CHECK (disconnected == 2);
+
+  releaseMediaObject (sink->getId() );
+  releaseMediaObject (src1->getId() );
+  releaseMediaObject (src2->getId() );
+  releaseMediaObject (mediaPipelineId);
+
+  sink.reset();
+  src1.reset();
+  src2.reset();
+  pipe.reset();
+}
+
 BOOST_AUTO_TEST_CASE (no_common_pipeline)
 {
   std::string mediaPipelineId1 =
@@ -271,12 +507,78 @@ BOOST_AUTO_TEST_CASE (dot_test)
 
   BOOST_CHECK (!dot.empty() );
 
+  /* Unchanged pipelines are served from the cache, properties included */
+  guint64 hits = pipe->getGraphCacheHits ();
+
+  BOOST_CHECK (pipe->getGstreamerDot() == dot);
+  BOOST_CHECK (pipe->getGraphCacheHits () == hits + 1);
+
+  /* A notified property change generates the graph again */
+  g_object_set (sink->getGstreamerElement(), "async-handling", TRUE, NULL);
+  pipe->getGstreamerDot();
+  BOOST_CHECK (pipe->getGraphCacheHits () == hits + 1);
+
   std::shared_ptr<kurento::GstreamerDotDetails> details (new
       kurento::GstreamerDotDetails (kurento::GstreamerDotDetails::SHOW_STATES) );
   dot = pipe->getGstreamerDot (details);
 
   BOOST_CHECK (!dot.empty() );
 
+  hits = pipe->getGraphCacheHits ();
+  BOOST_CHECK (pipe->getGstreamerDot (details) == dot);
+  BOOST_CHECK (pipe->getGraphCacheHits () == hits + 1);
+
+  std::shared_ptr<kurento::GstreamerGraphFormat> JSON (new
+      kurento::GstreamerGraphFormat (kurento::GstreamerGraphFormat::JSON) );
+  std::string srcName = GST_OBJECT_NAME (src->getGstreamerElement() );
+  Json::Reader reader;
+  Json::Value graph;
+
+  BOOST_CHECK (reader.parse (pipe->getGstreamerGraph (JSON), graph) );
+  BOOST_CHECK (graph["children"].size() >= 2);
+
+  BOOST_CHECK (reader.parse (pipe->getGstreamerGraph (JSON, details, srcName, 1),
+                             graph) );
+  BOOST_CHECK (graph["name"].asString() == srcName);
+  BOOST_CHECK (graph["pads"].isArray() );
+
+  BOOST_CHECK_THROW (pipe->getGstreamerGraph (JSON, details, "unknown"),
+                     KurentoException);
+
+  /* Every sink receives the same graph */
+  GstBin *bin = GST_BIN (pipe->getPipeline() );
+  StringGraphSink str;
+  std::string chunks;
+  size_t nChunks = 0;
+  ChunkedGraphSink chunked (64, [&] (const std::string & chunk) {
+    chunks += chunk;
+    nChunks++;
+  });
+  char path[] = "/tmp/graph-XXXXXX";
+  int fd = mkstemp (path);
+  gchar *contents = NULL;
+
+  BOOST_REQUIRE (fd >= 0);
+  BOOST_REQUIRE (generateDotGraph (bin, GST_DEBUG_GRAPH_SHOW_MEDIA_TYPE, str) );
+  BOOST_REQUIRE (generateDotGraph (bin, GST_DEBUG_GRAPH_SHOW_MEDIA_TYPE,
+                                   chunked) );
+  BOOST_CHECK (chunks == str.getString() );
+  BOOST_CHECK (nChunks > 1);
+
+  {
+    FdGraphSink file (fd);
+
+    BOOST_REQUIRE (generateDotGraph (bin, GST_DEBUG_GRAPH_SHOW_MEDIA_TYPE,
+                                     file) );
+    BOOST_CHECK (file.isOk () );
+  }
+
+  close (fd);
+  BOOST_REQUIRE (g_file_get_contents (path, &contents, NULL, NULL) );
+  BOOST_CHECK (contents == str.getString() );
+  g_free (contents);
+  unlink (path);
+
   releaseMediaObject (sink->getId() );
   releaseMediaObject (src->getId() );
   releaseMediaObject (mediaPipelineId);
@@ -285,3 +587,56 @@ BOOST_AUTO_TEST_CASE (dot_test)
   src.reset();
   pipe.reset();
 }
+
+BOOST_AUTO_TEST_CASE (element_pool)
+{
+  static boost::property_tree::ptree poolConfig;
+  ElementPool &pool = ElementPool::get ();
+
+  poolConfig.put ("modules.kurento.MediaPipeline.poolSize", 1);
+  poolConfig.put ("modules.kurento.MediaElement.elementPool.dummysink", 2);
+
+  std::string mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      poolConfig, "", Json::Value() )->getId();
+
+  BOOST_CHECK (pool.getMisses (ElementPool::PIPELINE) == 1);
+
+  auto createSink = [&] () {
+    auto mediaObject = MediaSet::getMediaSet()->ref (new  MediaElementImpl (
+                         poolConfig,
+                         MediaSet::getMediaSet()->getMediaObject (mediaPipelineId),
+                         "dummysink") );
+    MediaSet::getMediaSet()->ref ("", mediaObject);
+
+    return mediaObject->getId ();
+  };
+
+  std::string first = createSink ();
+
+  BOOST_CHECK (pool.getMisses ("dummysink") == 1);
+  BOOST_CHECK (pool.getHits ("dummysink") == 0);
+
+  BOOST_REQUIRE (waitFor ([&] () {
+    return pool.getReady ("dummysink") == 2 &&
+           pool.getReady (ElementPool::PIPELINE) == 1;
+  }) );
+
+  std::string second = createSink ();
+  std::string third = createSink ();
+
+  BOOST_CHECK (pool.getMisses ("dummysink") == 1);
+  BOOST_CHECK (pool.getHits ("dummysink") == 2);
+
+  std::string pipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      poolConfig, "", Json::Value() )->getId();
+
+  BOOST_CHECK (pool.getHits (ElementPool::PIPELINE) == 1);
+
+  releaseMediaObject (first);
+  releaseMediaObject (second);
+  releaseMediaObject (third);
+  releaseMediaObject (mediaPipelineId);
+  releaseMediaObject (pipelineId);
+}
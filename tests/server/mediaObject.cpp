@@ -25,6 +25,13 @@
 #include <string>
 #include <MediaSet.hpp>
 #include <ModuleManager.hpp>
+#include <UUIDGenerator.hpp>
+#include <ConfigSnapshot.hpp>
+#include <CodecConfiguration.hpp>
+
+#include <chrono>
+#include <set>
+#include <thread>
 
 using namespace kurento;
 
@@ -210,3 +217,120 @@ BOOST_AUTO_TEST_CASE (creation_time)
   mediaElement.reset ();
   pipe.reset ();
 }
+
+static double
+measureCreations (int nThreads, int iterations,
+                  std::vector<std::set<std::string>> &ids)
+{
+  std::vector<std::thread> threads;
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+
+  ids.assign (nThreads, std::set<std::string> () );
+
+  for (int t = 0; t < nThreads; t++) {
+    threads.push_back (std::thread ([t, iterations, &ids] () {
+      for (int i = 0; i < iterations; i++) {
+        std::shared_ptr <MediaObjectImpl> mediaObject (new MediaObjectImpl (
+              boost::property_tree::ptree() ) );
+
+        ids[t].insert (mediaObject->getId() );
+      }
+    }) );
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+                                          start;
+
+  return nThreads * iterations / elapsed.count();
+}
+
+BOOST_AUTO_TEST_CASE (creation_throughput)
+{
+  const int ITERATIONS = 20000;
+  int nThreads = std::max (4u, std::thread::hardware_concurrency () );
+  std::vector<std::set<std::string>> ids;
+  std::set<std::string> all;
+  std::string uuid;
+
+  generateUUID (uuid);
+  BOOST_CHECK (uuid.size() == UUID_STR_LENGTH);
+  BOOST_CHECK (uuid[8] == '-' && uuid[13] == '-' && uuid[18] == '-'
+               && uuid[23] == '-');
+  BOOST_CHECK (uuid[14] == '4');
+
+  double single = measureCreations (1, ITERATIONS, ids);
+  double multi = measureCreations (nThreads, ITERATIONS, ids);
+
+  BOOST_TEST_MESSAGE ("Objects created/s: 1 thread " << single << ", " <<
+                      nThreads << " threads " << multi);
+
+  /* Identifiers generated by different threads never collide */
+  for (auto &threadIds : ids) {
+    all.insert (threadIds.begin(), threadIds.end() );
+  }
+
+  BOOST_CHECK (all.size() == (size_t) nThreads * ITERATIONS);
+}
+
+BOOST_AUTO_TEST_CASE (config_snapshot)
+{
+  /* Published configurations must outlive the objects using them */
+  static boost::property_tree::ptree conf;
+  boost::property_tree::ptree codecs, codec;
+  int bitrate = 0;
+
+  conf.put ("modules.kurento.MediaElement.outputBitrate", 1000);
+  codec.put ("name", "opus/48000/2");
+  codecs.push_back (std::make_pair ("", codec) );
+  conf.add_child ("modules.kurento.SdpEndpoint.audioCodecs", codecs);
+
+  ConfigSnapshot::publish (conf);
+  auto snapshot = ConfigSnapshot::get (conf);
+
+  BOOST_CHECK (snapshot == ConfigSnapshot::get (conf) );
+  BOOST_CHECK (snapshot->get ("modules.kurento.MediaElement.outputBitrate",
+                              bitrate) );
+  BOOST_CHECK (bitrate == 1000);
+  BOOST_CHECK (!snapshot->get ("modules.kurento.MediaElement.missing",
+                               bitrate) );
+
+  const Json::Value *list = snapshot->find (
+                              "modules.kurento.SdpEndpoint.audioCodecs");
+  BOOST_REQUIRE (list != NULL && list->isArray() );
+  BOOST_CHECK ( (*list) [0]["name"].asString() == "opus/48000/2");
+
+  /* Codec lists are deserialized once, every reader gets the same objects */
+  std::vector<std::shared_ptr<CodecConfiguration>> first, second;
+
+  BOOST_REQUIRE (snapshot->get ("modules.kurento.SdpEndpoint.audioCodecs",
+                                first) );
+  BOOST_REQUIRE (snapshot->get ("modules.kurento.SdpEndpoint.audioCodecs",
+                                second) );
+  BOOST_REQUIRE (first.size() == 1 && second.size() == 1);
+  BOOST_CHECK (first[0]->getName() == "opus/48000/2");
+  BOOST_CHECK (first[0] == second[0]);
+
+  /* Changes are only seen once the configuration is published again */
+  conf.put ("modules.kurento.MediaElement.outputBitrate", 2000);
+  BOOST_CHECK (ConfigSnapshot::get (conf)->get (
+                 "modules.kurento.MediaElement.outputBitrate", bitrate) );
+  BOOST_CHECK (bitrate == 1000);
+
+  ConfigSnapshot::publish (conf);
+  snapshot = ConfigSnapshot::get (conf);
+  BOOST_CHECK (snapshot->get ("modules.kurento.MediaElement.outputBitrate",
+                              bitrate) );
+  BOOST_CHECK (bitrate == 2000);
+
+  /* Not matched by address anymore once withdrawn */
+  ConfigSnapshot::withdraw (conf);
+  BOOST_CHECK (snapshot != ConfigSnapshot::get (conf) );
+  BOOST_CHECK (snapshot->get ("modules.kurento.MediaElement.outputBitrate",
+                              bitrate) );
+  BOOST_CHECK (bitrate == 2000);
+}
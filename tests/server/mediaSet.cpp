@@ -29,6 +29,13 @@
 
 #include <config.h>
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
 using namespace kurento;
 
 std::shared_ptr <ModuleManager> moduleManager;
@@ -240,3 +247,256 @@ BOOST_FIXTURE_TEST_CASE (get_pipelines, F)
 
   pipes.clear();
 }
+
+/*
+ * Reproduces the locking scheme MediaSet used before being sharded: one
+ * recursive mutex guarding ordered maps keyed by object and session ids.
+ */
+class GlobalLockRegistry
+{
+public:
+  void add (const std::string &sessionId,
+            std::shared_ptr<MediaObjectImpl> object)
+  {
+    std::unique_lock <std::recursive_mutex> lock (mutex);
+
+    objects[object->getId()] = object;
+    sessions[object->getId()].insert (sessionId);
+    inUse[sessionId] = true;
+  }
+
+  std::shared_ptr<MediaObjectImpl> getMediaObject (const std::string &id)
+  {
+    std::unique_lock <std::recursive_mutex> lock (mutex);
+    std::shared_ptr<MediaObjectImpl> obj = objects.at (id).lock();
+
+    if (!obj || sessions.at (obj->getId() ).empty() ) {
+      throw KurentoException (MEDIA_OBJECT_NOT_FOUND, "Not found");
+    }
+
+    return obj;
+  }
+
+  void keepAliveSession (const std::string &sessionId)
+  {
+    std::unique_lock <std::recursive_mutex> lock (mutex);
+
+    inUse.at (sessionId) = true;
+  }
+
+private:
+  std::recursive_mutex mutex;
+  std::map<std::string, std::weak_ptr<MediaObjectImpl>> objects;
+  std::map<std::string, std::unordered_set<std::string>> sessions;
+  std::map<std::string, bool> inUse;
+};
+
+template <typename Registry>
+static double
+measureLookups (Registry &registry, const std::vector<std::string> &ids,
+                const std::vector<std::string> &sessions, int nThreads,
+                int iterations, std::atomic<int> &errors)
+{
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int t = 0; t < nThreads; t++) {
+    threads.push_back (std::thread ([&, t] () {
+      for (int i = 0; i < iterations; i++) {
+        size_t n = (t * iterations + i);
+
+        try {
+          registry.getMediaObject (ids[n % ids.size()]);
+          registry.keepAliveSession (sessions[n % sessions.size()]);
+        } catch (KurentoException &e) {
+          errors++;
+        }
+      }
+    }) );
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+                                          start;
+
+  return (nThreads * iterations) / elapsed.count();
+}
+
+BOOST_FIXTURE_TEST_CASE (concurrent_lookups_benchmark, F)
+{
+  const int N_SESSIONS = 16;
+  const int N_ELEMENTS = 256;
+  const int ITERATIONS = 50000;
+  int nThreads = std::max (2u, std::thread::hardware_concurrency() );
+  std::shared_ptr<MediaSet> mediaSet = MediaSet::getMediaSet();
+  GlobalLockRegistry legacy;
+  std::vector<std::string> sessions;
+  std::vector<std::string> ids;
+  std::vector<std::shared_ptr<MediaObjectImpl>> objects;
+  std::atomic<int> errors (0);
+
+  auto mediaPipelineFactory = moduleManager->getFactory ("MediaPipeline");
+  auto passThroughFactory = moduleManager->getFactory ("PassThrough");
+
+  for (int i = 0; i < N_SESSIONS; i++) {
+    sessions.push_back ("session" + std::to_string (i) );
+  }
+
+  auto pipe = mediaPipelineFactory->createObject (boost::property_tree::ptree(),
+              sessions[0], Json::Value() );
+  objects.push_back (pipe);
+
+  Json::Value params;
+  params["mediaPipeline"] = pipe->getId();
+
+  for (int i = 0; i < N_ELEMENTS; i++) {
+    objects.push_back (passThroughFactory->createObject (
+                         boost::property_tree::ptree(),
+                         sessions[i % N_SESSIONS], params) );
+  }
+
+  for (size_t i = 0; i < objects.size(); i++) {
+    ids.push_back (objects[i]->getId() );
+    legacy.add (sessions[i % N_SESSIONS], objects[i]);
+  }
+
+  double legacySingle = measureLookups (legacy, ids, sessions, 1, ITERATIONS,
+                                        errors);
+  double legacyMulti = measureLookups (legacy, ids, sessions, nThreads,
+                                       ITERATIONS, errors);
+  double shardedSingle = measureLookups (*mediaSet, ids, sessions, 1,
+                                         ITERATIONS, errors);
+  double shardedMulti = measureLookups (*mediaSet, ids, sessions, nThreads,
+                                        ITERATIONS, errors);
+
+  BOOST_TEST_MESSAGE ("Lookups/s global lock: 1 thread " << legacySingle <<
+                      ", " << nThreads << " threads " << legacyMulti);
+  BOOST_TEST_MESSAGE ("Lookups/s sharded:     1 thread " << shardedSingle <<
+                      ", " << nThreads << " threads " << shardedMulti);
+  BOOST_TEST_MESSAGE ("Scaling global lock " << legacyMulti / legacySingle <<
+                      "x, sharded " << shardedMulti / shardedSingle << "x");
+
+  BOOST_CHECK (errors == 0);
+
+  objects.clear();
+  mediaSet->release (pipe);
+}
+
+BOOST_FIXTURE_TEST_CASE (session_timeout, F)
+{
+  std::shared_ptr<MediaSet> mediaSet = MediaSet::getMediaSet();
+  std::chrono::seconds interval = MediaSet::getCollectorInterval();
+  std::shared_ptr<kurento::Factory> mediaPipelineFactory;
+  std::vector<std::string> sessions;
+
+  MediaSet::setCollectorInterval (std::chrono::seconds (2) );
+
+  mediaPipelineFactory = moduleManager->getFactory ("MediaPipeline");
+
+  auto alive = mediaPipelineFactory->createObject (boost::property_tree::ptree(),
+               "aliveSession", Json::Value() );
+  auto expired = mediaPipelineFactory->createObject (
+                   boost::property_tree::ptree(), "expiredSession", Json::Value() );
+  std::string aliveId = alive->getId();
+  std::string expiredId = expired->getId();
+
+  alive.reset();
+  expired.reset();
+
+  /* Keep one session alive for longer than the timeout */
+  for (int i = 0; i < 8; i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (500) );
+    mediaSet->keepAliveSession ("aliveSession");
+  }
+
+  sessions = mediaSet->getSessions();
+
+  BOOST_CHECK (std::find (sessions.begin(), sessions.end(),
+                          "aliveSession") != sessions.end() );
+  BOOST_CHECK (std::find (sessions.begin(), sessions.end(),
+                          "expiredSession") == sessions.end() );
+  BOOST_CHECK_THROW (mediaSet->keepAliveSession ("expiredSession"),
+                     KurentoException);
+  BOOST_CHECK_THROW (mediaSet->getMediaObject (expiredId), KurentoException);
+
+  mediaSet->release (aliveId);
+  MediaSet::setCollectorInterval (interval);
+}
+
+BOOST_FIXTURE_TEST_CASE (object_handles, F)
+{
+  std::shared_ptr<MediaSet> mediaSet = MediaSet::getMediaSet();
+  std::shared_ptr<kurento::Factory> mediaPipelineFactory;
+
+  mediaPipelineFactory = moduleManager->getFactory ("MediaPipeline");
+
+  auto pipe = std::dynamic_pointer_cast <MediaObjectImpl>
+              (mediaPipelineFactory->createObject (boost::property_tree::ptree(),
+                  "session1", Json::Value() ) );
+  ObjectHandle handle = pipe->getHandle();
+  std::string id = pipe->getId();
+
+  BOOST_CHECK (handle != INVALID_OBJECT_HANDLE);
+  BOOST_CHECK (mediaSet->getMediaObject (handle) == pipe);
+  BOOST_CHECK (mediaSet->getMediaObject (id) == pipe);
+
+  pipe.reset();
+  mediaSet->release (id);
+
+  /* Handles of destroyed objects are never resolved again */
+  BOOST_CHECK_THROW (mediaSet->getMediaObject (handle), KurentoException);
+  BOOST_CHECK_THROW (mediaSet->getMediaObject (id), KurentoException);
+}
+
+BOOST_FIXTURE_TEST_CASE (teardown_destroys_pipeline_last, F)
+{
+  std::shared_ptr<MediaSet> mediaSet = MediaSet::getMediaSet();
+  TeardownEngine &teardown = mediaSet->getTeardownEngine();
+  uint64_t completed = teardown.getCompleted();
+  uint64_t measured = teardown.getLatencyHistogram().getCount();
+  std::mutex mtx;
+  std::vector<std::string> destroyed;
+  Json::Value params;
+
+  sigc::connection conn = serverManager->signalObjectDestroyed.connect ([&] (
+  ObjectDestroyed event) {
+    std::unique_lock<std::mutex> lck (mtx);
+
+    destroyed.push_back (event.getObjectId() );
+  });
+
+  auto mediaPipelineFactory = moduleManager->getFactory ("MediaPipeline");
+  auto passThroughFactory = moduleManager->getFactory ("PassThrough");
+
+  std::string pipeId = mediaPipelineFactory->createObject (
+                         boost::property_tree::ptree(), "session1", Json::Value() )->getId();
+  params["mediaPipeline"] = pipeId;
+  std::string firstId = passThroughFactory->createObject (
+                          boost::property_tree::ptree(), "session1", params)->getId();
+  std::string secondId = passThroughFactory->createObject (
+                           boost::property_tree::ptree(), "session1", params)->getId();
+
+  mediaSet->release (pipeId);
+
+  for (int i = 0; i < 500 && teardown.getCompleted() == completed; i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (10) );
+  }
+
+  conn.disconnect();
+
+  BOOST_CHECK_EQUAL (teardown.getCompleted(), completed + 1);
+  BOOST_CHECK_EQUAL (teardown.getPending(), 0);
+  BOOST_CHECK_EQUAL (teardown.getLatencyHistogram().getCount(), measured + 1);
+
+  /* Elements keep a reference to their pipeline, it always goes last */
+  std::unique_lock<std::mutex> lck (mtx);
+  BOOST_REQUIRE_EQUAL (destroyed.size(), 3);
+  BOOST_CHECK_EQUAL (destroyed[2], pipeId);
+  BOOST_CHECK (std::find (destroyed.begin(), destroyed.end(),
+                          firstId) != destroyed.end() );
+  BOOST_CHECK (std::find (destroyed.begin(), destroyed.end(),
+                          secondId) != destroyed.end() );
+}
@@ -22,6 +22,7 @@
 #include <Error.hpp>
 #include <gst/gst.h>
 #include <MediaSet.hpp>
+#include <boost/filesystem.hpp>
 
 #include <config.h>
 
@@ -101,3 +102,72 @@ BOOST_AUTO_TEST_CASE (load_modules)
     BOOST_ERROR ("Wrong module version");
   }
 }
+
+BOOST_AUTO_TEST_CASE (lazy_load_modules)
+{
+  std::string manifest = (boost::filesystem::temp_directory_path() /
+                          boost::filesystem::unique_path () ).string();
+
+  gst_init (NULL, NULL);
+
+  {
+    ModuleManager moduleManager;
+
+    moduleManager.setManifest (manifest);
+    moduleManager.loadModulesFromDirectories ("../../src/server");
+
+    BOOST_REQUIRE (moduleManager.getLoadedFactories ().count ("MediaPipeline") );
+  }
+
+  ModuleManager moduleManager;
+
+  moduleManager.setManifest (manifest);
+  moduleManager.loadModulesFromDirectories ("../../src/server");
+
+  /* Lazy modules are only listed once loaded */
+  BOOST_CHECK (!moduleManager.getLoadedFactories ().count ("MediaPipeline") );
+  BOOST_CHECK (!moduleManager.getModules ().count ("libkmscoremodule.so") );
+
+  BOOST_CHECK (moduleManager.getFactory ("MediaPipeline") );
+  BOOST_CHECK (moduleManager.getLoadedFactories ().count ("MediaPipeline") );
+  BOOST_CHECK (moduleManager.getModules ().count ("libkmscoremodule.so") );
+  BOOST_CHECK_THROW (moduleManager.getFactory ("NonExistingFactory"),
+                     KurentoException);
+
+  boost::filesystem::remove (manifest);
+}
+
+BOOST_AUTO_TEST_CASE (lazy_module_data)
+{
+  std::string manifest = (boost::filesystem::temp_directory_path() /
+                          boost::filesystem::unique_path () ).string();
+  std::shared_ptr<ModuleData> data;
+
+  gst_init (NULL, NULL);
+
+  {
+    ModuleManager moduleManager;
+
+    moduleManager.setManifest (manifest);
+    moduleManager.loadModulesFromDirectories ("../../src/server");
+  }
+
+  ModuleManager moduleManager;
+
+  moduleManager.setManifest (manifest);
+  moduleManager.loadModulesFromDirectories ("../../src/server");
+
+  BOOST_CHECK (!moduleManager.getModules ().count ("libkmscoremodule.so") );
+
+  /* Requesting the data of a module loads it */
+  data = moduleManager.getModule ("core");
+  BOOST_REQUIRE (data);
+  BOOST_CHECK (data->getName () == "core");
+  BOOST_CHECK (!data->getDescriptor ().empty () );
+  BOOST_CHECK (moduleManager.getModules ().count ("libkmscoremodule.so") );
+  BOOST_CHECK (moduleManager.getLoadedFactories ().count ("MediaPipeline") );
+
+  BOOST_CHECK (!moduleManager.getModule ("nonExistingModule") );
+
+  boost::filesystem::remove (manifest);
+}
@@ -0,0 +1,280 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE Statistics
+#include <boost/test/unit_test.hpp>
+#include <gst/gst.h>
+#include <Statistics.hpp>
+#include <StatsSampler.hpp>
+#include <RTCInboundRTPStreamStats.hpp>
+#include <RTCStatsDelta.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace kurento;
+
+struct GF {
+  GF();
+};
+
+BOOST_GLOBAL_FIXTURE (GF)
+
+GF::GF()
+{
+  gst_init (NULL, NULL);
+}
+
+#define STREAM_ID "inbound-1234"
+
+/* Stats of an endpoint with a single remote SSRC */
+static GstStructure *
+createStats (guint64 packets, guint64 bytes, gint lost, guint jitter)
+{
+  GstStructure *stream, *session, *stats;
+
+  stream = gst_structure_new ("stream", "ssrc", G_TYPE_UINT, 1234,
+                              "internal", G_TYPE_BOOLEAN, FALSE, "id", G_TYPE_STRING, STREAM_ID,
+                              "packets-received", G_TYPE_UINT64, packets,
+                              "octets-received", G_TYPE_UINT64, bytes,
+                              "rb-packetslost", G_TYPE_INT, lost,
+                              "rb-fractionlost", G_TYPE_UINT, 0,
+                              "rb-jitter", G_TYPE_UINT, jitter, NULL);
+  session = gst_structure_new ("session", "ssrc-1234", GST_TYPE_STRUCTURE,
+                               stream, NULL);
+  stats = gst_structure_new ("stats", "session-0", GST_TYPE_STRUCTURE,
+                             session, NULL);
+
+  gst_structure_free (stream);
+  gst_structure_free (session);
+
+  return stats;
+}
+
+static void
+update (stats::RTCStatsTracker &tracker, double timestamp, guint64 packets,
+        guint64 bytes, gint lost, guint jitter)
+{
+  GstStructure *stats = createStats (packets, bytes, lost, jitter);
+
+  tracker.update (timestamp, stats);
+  gst_structure_free (stats);
+}
+
+static std::shared_ptr<RTCInboundRTPStreamStats>
+getInbound (const stats::RTCStatsReport &report)
+{
+  auto it = report.find (STREAM_ID);
+
+  BOOST_REQUIRE (it != report.end () );
+
+  return std::dynamic_pointer_cast<RTCInboundRTPStreamStats> (it->second);
+}
+
+BOOST_AUTO_TEST_CASE (tracker_rates)
+{
+  stats::RTCStatsTracker tracker;
+  std::shared_ptr<RTCInboundRTPStreamStats> inbound;
+
+  BOOST_CHECK (!tracker.hasReport () );
+  BOOST_CHECK (tracker.getReport ().empty () );
+
+  /* Nothing to compare the first sample with */
+  update (tracker, 10, 100, 10000, 0, 10);
+  inbound = getInbound (tracker.getReport () );
+  BOOST_REQUIRE (inbound);
+  BOOST_CHECK_EQUAL (inbound->getBitrate (), 0);
+  BOOST_CHECK_EQUAL (inbound->getPacketLossRate (), 0);
+  BOOST_CHECK_EQUAL (inbound->getJitterTrend (), 0);
+
+  /* 90 packets received and 10 lost in 2 seconds */
+  update (tracker, 12, 190, 20000, 10, 30);
+  inbound = getInbound (tracker.getReport () );
+  BOOST_REQUIRE (inbound);
+  BOOST_CHECK_CLOSE (inbound->getBitrate (), 40000, 0.01);
+  BOOST_CHECK_CLOSE (inbound->getPacketLossRate (), 0.1, 0.01);
+  /* Jitter grows 10 per second, weighted against a previous trend of 0 */
+  BOOST_CHECK_CLOSE (inbound->getJitterTrend (), 3, 0.01);
+  BOOST_CHECK_EQUAL (inbound->getTimestamp (), 12);
+
+  /* Restarted counters reset the rates */
+  update (tracker, 14, 10, 1000, 0, 10);
+  inbound = getInbound (tracker.getReport () );
+  BOOST_REQUIRE (inbound);
+  BOOST_CHECK_EQUAL (inbound->getBitrate (), 0);
+  BOOST_CHECK_EQUAL (inbound->getPacketLossRate (), 0);
+}
+
+BOOST_AUTO_TEST_CASE (tracker_reports_are_not_reused_while_held)
+{
+  stats::RTCStatsTracker tracker;
+  stats::RTCStatsReport held;
+
+  update (tracker, 10, 100, 10000, 0, 10);
+  update (tracker, 11, 200, 20000, 0, 10);
+  held = tracker.getReport ();
+
+  /* Snapshots are reused in turns, this one is still referenced */
+  for (int i = 2; i < 6; i++) {
+    update (tracker, 10 + i, 100 * (i + 1), 10000 * (i + 1) + i * 1000, 0, 10);
+  }
+
+  BOOST_CHECK_CLOSE (getInbound (held)->getBitrate (), 80000, 0.01);
+  BOOST_CHECK_EQUAL (getInbound (held)->getTimestamp (), 11);
+  BOOST_CHECK_EQUAL (getInbound (tracker.getReport () )->getTimestamp (), 15);
+}
+
+BOOST_AUTO_TEST_CASE (tracker_drops_gone_streams)
+{
+  stats::RTCStatsTracker tracker;
+  GstStructure *empty = gst_structure_new_empty ("stats");
+
+  update (tracker, 10, 100, 10000, 0, 10);
+  BOOST_CHECK_EQUAL (tracker.getReport ().size (), 1);
+
+  tracker.update (11, empty);
+  BOOST_CHECK (tracker.getReport ().empty () );
+  gst_structure_free (empty);
+
+  /* Back again, it is a new stream */
+  update (tracker, 12, 300, 30000, 0, 10);
+  BOOST_CHECK_EQUAL (getInbound (tracker.getReport () )->getBitrate (), 0);
+}
+
+#define ENDPOINT_ID "endpoint"
+
+static std::vector<std::shared_ptr<RTCStatsDelta>>
+encode (stats::RTCStatsDeltaEncoder &encoder,
+        stats::RTCStatsTracker &tracker)
+{
+  std::map<std::string, stats::RTCStatsReport> reports;
+
+  reports[ENDPOINT_ID] = tracker.getReport ();
+
+  return encoder.encode (reports);
+}
+
+BOOST_AUTO_TEST_CASE (encoder_reports_changed_fields)
+{
+  stats::RTCStatsTracker tracker;
+  stats::RTCStatsDeltaEncoder encoder;
+  std::vector<std::shared_ptr<RTCStatsDelta>> deltas;
+  std::map<std::string, double> changes;
+
+  /* Every field is new the first time */
+  update (tracker, 10, 100, 10000, 0, 10);
+  deltas = encode (encoder, tracker);
+  BOOST_REQUIRE_EQUAL (deltas.size (), 1);
+  BOOST_CHECK_EQUAL (deltas[0]->getEndpoint (), ENDPOINT_ID);
+  BOOST_CHECK_EQUAL (deltas[0]->getStatsId (), STREAM_ID);
+  BOOST_CHECK (!deltas[0]->getRemoved () );
+  changes = deltas[0]->getChanges ();
+  BOOST_CHECK_EQUAL (changes["timestamp"], 10);
+  BOOST_CHECK_EQUAL (changes["packetsReceived"], 100);
+  BOOST_CHECK_EQUAL (changes["bytesReceived"], 10000);
+  BOOST_CHECK (changes.find ("jitterTrend") != changes.end () );
+
+  /* Nothing changed */
+  BOOST_CHECK (encode (encoder, tracker).empty () );
+
+  /* Only the timestamp moves while no media flows */
+  update (tracker, 11, 100, 10000, 0, 10);
+  deltas = encode (encoder, tracker);
+  BOOST_REQUIRE_EQUAL (deltas.size (), 1);
+  changes = deltas[0]->getChanges ();
+  BOOST_CHECK_EQUAL (changes.size (), 1);
+  BOOST_CHECK_EQUAL (changes["timestamp"], 11);
+
+  update (tracker, 12, 200, 10000, 0, 10);
+  deltas = encode (encoder, tracker);
+  BOOST_REQUIRE_EQUAL (deltas.size (), 1);
+  changes = deltas[0]->getChanges ();
+  BOOST_CHECK_EQUAL (changes.size (), 2);
+  BOOST_CHECK_EQUAL (changes["timestamp"], 12);
+  BOOST_CHECK_EQUAL (changes["packetsReceived"], 200);
+}
+
+BOOST_AUTO_TEST_CASE (encoder_reports_removed_stats)
+{
+  stats::RTCStatsTracker tracker;
+  stats::RTCStatsDeltaEncoder encoder;
+  std::vector<std::shared_ptr<RTCStatsDelta>> deltas;
+  GstStructure *empty = gst_structure_new_empty ("stats");
+  size_t fields;
+
+  update (tracker, 10, 100, 10000, 0, 10);
+  deltas = encode (encoder, tracker);
+  BOOST_REQUIRE_EQUAL (deltas.size (), 1);
+  fields = deltas[0]->getChanges ().size ();
+
+  /* Everything again after a reset */
+  encoder.reset ();
+  deltas = encode (encoder, tracker);
+  BOOST_REQUIRE_EQUAL (deltas.size (), 1);
+  BOOST_CHECK_EQUAL (deltas[0]->getChanges ().size (), fields);
+
+  tracker.update (11, empty);
+  gst_structure_free (empty);
+  deltas = encode (encoder, tracker);
+  BOOST_REQUIRE_EQUAL (deltas.size (), 1);
+  BOOST_CHECK_EQUAL (deltas[0]->getStatsId (), STREAM_ID);
+  BOOST_CHECK (deltas[0]->getRemoved () );
+  BOOST_CHECK (deltas[0]->getChanges ().empty () );
+
+  /* Reported only once */
+  BOOST_CHECK (encode (encoder, tracker).empty () );
+}
+
+static const ObjectHandle SAMPLED = 1;
+static const ObjectHandle SELF_REMOVED = 2;
+
+BOOST_AUTO_TEST_CASE (sampler_runs_until_removed)
+{
+  std::atomic<int> samples (0);
+  int count;
+
+  StatsSampler::get ().add (SAMPLED, std::chrono::milliseconds (100),
+  [&samples] () {
+    samples++;
+  });
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (650) );
+  StatsSampler::get ().remove (SAMPLED);
+  count = samples;
+
+  BOOST_CHECK (count >= 3);
+  BOOST_CHECK (count <= 7);
+
+  /* Not running anymore once remove returns */
+  std::this_thread::sleep_for (std::chrono::milliseconds (300) );
+  BOOST_CHECK_EQUAL (samples, count);
+}
+
+BOOST_AUTO_TEST_CASE (sampler_remove_from_sample)
+{
+  std::atomic<int> samples (0);
+
+  StatsSampler::get ().add (SELF_REMOVED, std::chrono::milliseconds (100),
+  [&samples] () {
+    samples++;
+    StatsSampler::get ().remove (SELF_REMOVED);
+  });
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (500) );
+
+  BOOST_CHECK_EQUAL (samples, 1);
+}
@@ -0,0 +1,145 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE WorkerPool
+#include <boost/test/unit_test.hpp>
+#include <gst/gst.h>
+#include <WorkerPool.hpp>
+
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace kurento;
+
+struct GF {
+  GF();
+};
+
+BOOST_GLOBAL_FIXTURE (GF)
+
+GF::GF()
+{
+  gst_init (NULL, NULL);
+}
+
+/* Keeps one worker busy until the returned promise is set */
+static std::shared_ptr<std::promise<void>>
+blockWorker (WorkerPool &pool)
+{
+  std::shared_ptr<std::promise<void>> release (new std::promise<void> () );
+  std::shared_future<void> released = release->get_future ().share ();
+  std::promise<void> started;
+
+  pool.post ([released, &started] () {
+    started.set_value ();
+    released.wait ();
+  }, WorkerPool::BACKGROUND);
+
+  started.get_future ().wait ();
+
+  return release;
+}
+
+BOOST_AUTO_TEST_CASE (lanes_are_served_by_priority)
+{
+  WorkerPool pool (1);
+  std::vector<int> order;
+  std::promise<void> done;
+  auto release = blockWorker (pool);
+
+  pool.post ([&order] () {
+    order.push_back (1);
+  }, WorkerPool::BACKGROUND);
+  pool.post ([&order] () {
+    order.push_back (2);
+  }, WorkerPool::BACKGROUND);
+  pool.post ([&order] () {
+    order.push_back (3);
+  }, WorkerPool::TEARDOWN);
+  pool.post ([&order] () {
+    order.push_back (4);
+  });
+  pool.post ([&done] () {
+    done.set_value ();
+  }, WorkerPool::BACKGROUND);
+
+  release->set_value ();
+  BOOST_REQUIRE (done.get_future ().wait_for (std::chrono::seconds (5) ) ==
+                 std::future_status::ready);
+
+  /* Interactive by default, then teardown, each lane in posting order */
+  BOOST_REQUIRE_EQUAL (order.size (), 4);
+  BOOST_CHECK_EQUAL (order[0], 4);
+  BOOST_CHECK_EQUAL (order[1], 3);
+  BOOST_CHECK_EQUAL (order[2], 1);
+  BOOST_CHECK_EQUAL (order[3], 2);
+
+  BOOST_CHECK_EQUAL (pool.getLatencyHistogram (
+                       WorkerPool::INTERACTIVE).getCount (), 1);
+  BOOST_CHECK_EQUAL (pool.getLatencyHistogram (WorkerPool::TEARDOWN).getCount (),
+                     1);
+  BOOST_CHECK_EQUAL (pool.getLatencyHistogram (
+                       WorkerPool::BACKGROUND).getCount (), 4);
+}
+
+BOOST_AUTO_TEST_CASE (idle_workers_steal_tasks)
+{
+  WorkerPool pool (2);
+  std::promise<std::thread::id> posted;
+  std::promise<bool> stolen;
+
+  pool.post ([&pool, &posted, &stolen] () {
+    std::promise<std::thread::id> ran;
+    std::future<std::thread::id> ranFuture = ran.get_future ();
+
+    /* Queued to this worker, which is busy until it runs elsewhere */
+    pool.post ([&ran] () {
+      ran.set_value (std::this_thread::get_id () );
+    }, WorkerPool::TEARDOWN);
+
+    posted.set_value (std::this_thread::get_id () );
+    stolen.set_value (ranFuture.wait_for (std::chrono::seconds (5) ) ==
+                      std::future_status::ready &&
+                      ranFuture.get () != std::this_thread::get_id () );
+  }, WorkerPool::TEARDOWN);
+
+  std::future<bool> stolenFuture = stolen.get_future ();
+
+  BOOST_REQUIRE (stolenFuture.wait_for (std::chrono::seconds (10) ) ==
+                 std::future_status::ready);
+  BOOST_CHECK (stolenFuture.get () );
+  BOOST_CHECK_EQUAL (pool.getStallsDetected (), 0);
+}
+
+BOOST_AUTO_TEST_CASE (stalled_workers_are_replaced)
+{
+  WorkerPool pool (1, std::chrono::milliseconds (100) );
+  std::promise<void> done;
+  auto release = blockWorker (pool);
+
+  /* Only a new worker can run it */
+  pool.post ([&done] () {
+    done.set_value ();
+  }, WorkerPool::TEARDOWN);
+
+  BOOST_CHECK (done.get_future ().wait_for (std::chrono::seconds (5) ) ==
+               std::future_status::ready);
+  BOOST_CHECK (pool.getStallsDetected () >= 1);
+  BOOST_CHECK (pool.getThreadsSpawned () >= 1);
+
+  release->set_value ();
+}